@@ -4,12 +4,92 @@
 #include <ccan/str/hex/hex.h>
 #include <common/type_to_string.h>
 
+/* Pulls a varint which specifies n items of mult size: ensures basic
+ * sanity to avoid trivial OOM (like pull_length() in tx.c) */
+static u64 scan_length(const u8 **cursor, size_t *max, size_t mult)
+{
+	u64 v = pull_varint(cursor, max);
+	if (v * mult > *max) {
+		*cursor = NULL;
+		*max = 0;
+		return 0;
+	}
+	return v;
+}
+
+static void scan_skip(const u8 **cursor, size_t *max, size_t n)
+{
+	if (*cursor)
+		pull(cursor, max, NULL, n);
+}
+
+/* Note where the tx's parts are, without unpacking them, and hash the
+ * non-witness parts to get the txid. */
+static bool scan_tx(const u8 **cursor, size_t *max,
+		    struct bitcoin_block_tx *btx)
+{
+	struct sha256_ctx ctx = SHA256_INIT;
+	const u8 *txin, *txout_end, *locktime;
+	u8 flag = 0;
+	u64 i, j, num;
+
+	btx->raw = *cursor;
+	scan_skip(cursor, max, sizeof(le32));
+
+	/* BIP 144 marker is 0 (impossible to have tx with 0 inputs) */
+	txin = *cursor;
+	btx->num_inputs = scan_length(cursor, max, 32 + 4 + 4 + 1);
+	if (btx->num_inputs == 0) {
+		pull(cursor, max, &flag, 1);
+		if (flag != SEGREGATED_WITNESS_FLAG)
+			return false;
+		txin = *cursor;
+		btx->num_inputs = scan_length(cursor, max, 32 + 4 + 4 + 1);
+	}
+	btx->inputs = *cursor;
+	for (i = 0; i < btx->num_inputs; i++) {
+		scan_skip(cursor, max, 32 + 4);
+		scan_skip(cursor, max, scan_length(cursor, max, 1));
+		scan_skip(cursor, max, sizeof(le32));
+	}
+
+	btx->num_outputs = scan_length(cursor, max, 8 + 1);
+	btx->outputs = *cursor;
+	for (i = 0; i < btx->num_outputs; i++) {
+		scan_skip(cursor, max, sizeof(le64));
+		scan_skip(cursor, max, scan_length(cursor, max, 1));
+	}
+	txout_end = *cursor;
+
+	if (flag & SEGREGATED_WITNESS_FLAG) {
+		for (i = 0; i < btx->num_inputs; i++) {
+			num = scan_length(cursor, max, 1);
+			for (j = 0; j < num; j++)
+				scan_skip(cursor, max,
+					  scan_length(cursor, max, 1));
+		}
+	}
+	locktime = *cursor;
+	scan_skip(cursor, max, sizeof(le32));
+
+	if (!*cursor)
+		return false;
+
+	btx->len = *cursor - btx->raw;
+
+	/* For TXID, we never use extended form. */
+	sha256_update(&ctx, btx->raw, sizeof(le32));
+	sha256_update(&ctx, txin, txout_end - txin);
+	sha256_update(&ctx, locktime, sizeof(le32));
+	sha256_double_done(&ctx, &btx->txid.shad);
+	return true;
+}
+
 /* Encoding is <blockhdr> <varint-num-txs> <tx>... */
 struct bitcoin_block *bitcoin_block_from_hex(const tal_t *ctx,
 					     const char *hex, size_t hexlen)
 {
 	struct bitcoin_block *b;
-	u8 *linear_tx;
 	const u8 *p;
 	size_t len, i, num;
 
@@ -19,26 +99,58 @@ struct bitcoin_block *bitcoin_block_from_hex(const tal_t *ctx,
 	/* Set up the block for success. */
 	b = tal(ctx, struct bitcoin_block);
 
-	/* De-hex the array. */
+	/* De-hex the array: we keep this, and point into it. */
 	len = hex_data_size(hexlen);
-	p = linear_tx = tal_arr(ctx, u8, len);
-	if (!hex_decode(hex, hexlen, linear_tx, len))
+	p = b->raw = tal_arr(b, u8, len);
+	if (!hex_decode(hex, hexlen, b->raw, len))
 		return tal_free(b);
 
 	pull(&p, &len, &b->hdr, sizeof(b->hdr));
-	num = pull_varint(&p, &len);
-	b->tx = tal_arr(b, struct bitcoin_tx *, num);
-	for (i = 0; i < num; i++)
-		b->tx[i] = pull_bitcoin_tx(b->tx, &p, &len);
+	num = scan_length(&p, &len, 1);
+	b->tx = tal_arr(b, struct bitcoin_block_tx, num);
+	for (i = 0; i < num; i++) {
+		if (!scan_tx(&p, &len, &b->tx[i]))
+			return tal_free(b);
+	}
 
 	/* We should end up not overrunning, nor have extra */
 	if (!p || len)
 		return tal_free(b);
 
-	tal_free(linear_tx);
 	return b;
 }
 
+/* These have been checked by scan_tx already. */
+void bitcoin_block_tx_input(const u8 **cursor,
+			    struct bitcoin_txid *txid, u32 *outnum)
+{
+	size_t max = SIZE_MAX;
+
+	pull(cursor, &max, &txid->shad, sizeof(txid->shad));
+	*outnum = pull_le32(cursor, &max);
+	pull(cursor, &max, NULL, pull_varint(cursor, &max));
+	pull_le32(cursor, &max);
+}
+
+void bitcoin_block_tx_output(const u8 **cursor, u64 *amount,
+			     const u8 **script, size_t *script_len)
+{
+	size_t max = SIZE_MAX;
+
+	*amount = pull_le64(cursor, &max);
+	*script_len = pull_varint(cursor, &max);
+	*script = pull(cursor, &max, NULL, *script_len);
+}
+
+struct bitcoin_tx *bitcoin_block_tx_get(const tal_t *ctx,
+					const struct bitcoin_block_tx *btx)
+{
+	const u8 *p = btx->raw;
+	size_t len = btx->len;
+
+	return pull_bitcoin_tx(ctx, &p, &len);
+}
+
 /* We do the same hex-reversing crud as txids. */
 bool bitcoin_blkid_from_hex(const char *hexstr, size_t hexstr_len,
 			    struct bitcoin_blkid *blockid)
@@ -2,6 +2,7 @@
 #define LIGHTNING_BITCOIN_BLOCK_H
 #include "config.h"
 #include "bitcoin/shadouble.h"
+#include "bitcoin/tx.h"
 #include <ccan/endian/endian.h>
 #include <ccan/short_types/short_types.h>
 #include <ccan/structeq/structeq.h>
@@ -23,15 +24,44 @@ struct bitcoin_block_hdr {
 	le32 nonce;
 };
 
+/* A transaction inside a bitcoin_block: rather than unpacking every
+ * transaction, we just note where it is (and its txid). */
+struct bitcoin_block_tx {
+	struct bitcoin_txid txid;
+
+	/* The whole linearized tx, within the block. */
+	const u8 *raw;
+	size_t len;
+
+	/* Use bitcoin_block_tx_input/output to walk these. */
+	const u8 *inputs, *outputs;
+	size_t num_inputs, num_outputs;
+};
+
 struct bitcoin_block {
 	struct bitcoin_block_hdr hdr;
 	/* tal_count shows now many */
-	struct bitcoin_tx **tx;
+	struct bitcoin_block_tx *tx;
+	/* The linearized block, which tx[] points into. */
+	u8 *raw;
 };
 
 struct bitcoin_block *bitcoin_block_from_hex(const tal_t *ctx,
 					     const char *hex, size_t hexlen);
 
+/* Pull the next input's outpoint: start *cursor at btx->inputs. */
+void bitcoin_block_tx_input(const u8 **cursor,
+			    struct bitcoin_txid *txid, u32 *outnum);
+
+/* Pull the next output: start *cursor at btx->outputs.  *script points
+ * into the block. */
+void bitcoin_block_tx_output(const u8 **cursor, u64 *amount,
+			     const u8 **script, size_t *script_len);
+
+/* Unpack the whole transaction. */
+struct bitcoin_tx *bitcoin_block_tx_get(const tal_t *ctx,
+					const struct bitcoin_block_tx *btx);
+
 /* Parse hex string to get blockid (reversed, a-la bitcoind). */
 bool bitcoin_blkid_from_hex(const char *hexstr, size_t hexstr_len,
 			    struct bitcoin_blkid *blockid);
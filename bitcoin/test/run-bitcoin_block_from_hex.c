@@ -0,0 +1,99 @@
+#include <assert.h>
+#include <bitcoin/block.c>
+#include <bitcoin/pullpush.c>
+#include <bitcoin/shadouble.c>
+#include <bitcoin/tx.c>
+#include <bitcoin/varint.c>
+#include <ccan/str/hex/hex.h>
+#include <ccan/tal/str/str.h>
+#include <common/utils.h>
+
+/* Same as run-tx-encode.c */
+const char extended_tx[] = "02000000000101b5bef485c41d0d1f58d1e8a561924ece5c476d86cff063ea10c8df06136eb31d00000000171600144aa38e396e1394fb45cbf83f48d1464fbc9f498fffffffff0140330f000000000017a9140580ba016669d3efaf09a0b2ec3954469ea2bf038702483045022100f2abf9e9cf238c66533af93f23937eae8ac01fb6f105a00ab71dbefb9637dc9502205c1ac745829b3f6889607961f5d817dfa0c8f52bdda12e837c4f7b162f6db8a701210204096eb817f7efb414ef4d3d8be39dd04374256d3b054a322d4a6ee22736d03b00000000";
+
+static void check_block_tx(const struct bitcoin_block_tx *btx,
+			   const struct bitcoin_tx *tx)
+{
+	struct bitcoin_txid txid;
+	struct bitcoin_tx *unpacked;
+	const u8 *cursor;
+
+	bitcoin_txid(tx, &txid);
+	assert(bitcoin_txid_eq(&btx->txid, &txid));
+
+	assert(btx->num_inputs == tal_count(tx->input));
+	cursor = btx->inputs;
+	for (size_t i = 0; i < btx->num_inputs; i++) {
+		u32 outnum;
+
+		bitcoin_block_tx_input(&cursor, &txid, &outnum);
+		assert(bitcoin_txid_eq(&txid, &tx->input[i].txid));
+		assert(outnum == tx->input[i].index);
+	}
+
+	assert(btx->num_outputs == tal_count(tx->output));
+	cursor = btx->outputs;
+	for (size_t i = 0; i < btx->num_outputs; i++) {
+		const u8 *script;
+		size_t script_len;
+		u64 amount;
+
+		bitcoin_block_tx_output(&cursor, &amount, &script, &script_len);
+		assert(amount == tx->output[i].amount);
+		assert(memeq(script, script_len, tx->output[i].script,
+			     tal_count(tx->output[i].script)));
+	}
+
+	unpacked = bitcoin_block_tx_get(tmpctx, btx);
+	assert(unpacked);
+	assert(memeq(linearize_tx(tmpctx, unpacked), btx->len,
+		     btx->raw, btx->len));
+}
+
+int main(void)
+{
+	setup_locale();
+	setup_tmpctx();
+
+	struct bitcoin_tx *segwit, *legacy;
+	struct bitcoin_block_hdr hdr;
+	struct bitcoin_block *b;
+	u8 *raw;
+	char *hex;
+
+	segwit = bitcoin_tx_from_hex(tmpctx, extended_tx, strlen(extended_tx));
+	legacy = bitcoin_tx_from_hex(tmpctx, extended_tx, strlen(extended_tx));
+	legacy->input[0].witness = NULL;
+	legacy->output[0].amount++;
+
+	/* <blockhdr> <varint-num-txs> <tx>... */
+	memset(&hdr, 1, sizeof(hdr));
+	raw = tal_arr(tmpctx, u8, 0);
+	push(&hdr, sizeof(hdr), &raw);
+	push_varint(2, push, &raw);
+	push(linearize_tx(tmpctx, segwit), tal_count(linearize_tx(tmpctx, segwit)),
+	     &raw);
+	push(linearize_tx(tmpctx, legacy), tal_count(linearize_tx(tmpctx, legacy)),
+	     &raw);
+	hex = tal_hex(tmpctx, raw);
+
+	b = bitcoin_block_from_hex(tmpctx, hex, strlen(hex));
+	assert(b);
+	assert(memeq(&b->hdr, sizeof(b->hdr), &hdr, sizeof(hdr)));
+	assert(tal_count(b->tx) == 2);
+	check_block_tx(&b->tx[0], segwit);
+	check_block_tx(&b->tx[1], legacy);
+
+	/* Trailing newline is fine. */
+	assert(bitcoin_block_from_hex(tmpctx, tal_fmt(tmpctx, "%s\n", hex),
+				      strlen(hex) + 1));
+
+	/* Truncated, or with extra on the end, is not. */
+	for (size_t len = 0; len < strlen(hex); len += 2)
+		assert(!bitcoin_block_from_hex(tmpctx, hex, len));
+	assert(!bitcoin_block_from_hex(tmpctx, tal_fmt(tmpctx, "%s00", hex),
+				       strlen(hex) + 2));
+
+	tal_free(tmpctx);
+	return 0;
+}
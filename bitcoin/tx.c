@@ -11,8 +11,6 @@
 #include <common/type_to_string.h>
 #include <stdio.h>
 
-#define SEGREGATED_WITNESS_FLAG 0x1
-
 static void push_tx_input(const struct bitcoin_tx_input *input,
 			 void (*push)(const void *, size_t, void *), void *pushp)
 {
@@ -8,6 +8,8 @@
 #include <ccan/structeq/structeq.h>
 #include <ccan/tal/tal.h>
 
+#define SEGREGATED_WITNESS_FLAG 0x1
+
 struct bitcoin_txid {
 	struct sha256_double shad;
 };
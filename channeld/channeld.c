@@ -25,6 +25,7 @@
 #include <channeld/commit_tx.h>
 #include <channeld/full_channel.h>
 #include <channeld/gen_channel_wire.h>
+#include <channeld/htlc_sigs.h>
 #include <common/crypto_sync.h>
 #include <common/dev_disconnect.h>
 #include <common/htlc_tx.h>
@@ -37,6 +38,7 @@
 #include <common/sphinx.h>
 #include <common/status.h>
 #include <common/subdaemon.h>
+#include <common/threadpool.h>
 #include <common/timeout.h>
 #include <common/type_to_string.h>
 #include <common/version.h>
@@ -68,6 +70,12 @@ struct commit_sigs {
 	secp256k1_ecdsa_signature *htlc_sigs;
 };
 
+/* Below this many HTLCs, handing signatures to other threads isn't worth it. */
+#define PARALLEL_VERIFY_MIN_HTLCS 8
+/* There's a channeld for every channel, so don't let each one have a
+ * thread for every CPU. */
+#define PARALLEL_VERIFY_MAX_THREADS 2
+
 struct peer {
 	struct crypto_state cs;
 	struct channel_config conf[NUM_SIDES];
@@ -158,6 +166,10 @@ struct peer {
 
 	/* Make sure peer is live. */
 	struct timeabs last_recv;
+
+	/* Threads to check HTLC signatures: only created once we see a
+	 * commitment with enough HTLCs to be worth it. */
+	struct threadpool *verify_pool;
 };
 
 static u8 *create_channel_announcement(const tal_t *ctx, struct peer *peer);
@@ -344,7 +356,7 @@ static void send_announcement_signatures(struct peer *peer)
 	    NULL, &peer->channel_id, &peer->short_channel_ids[LOCAL],
 	    &peer->announcement_node_sigs[LOCAL],
 	    &peer->announcement_bitcoin_sigs[LOCAL]);
-	sync_crypto_write(&peer->cs, PEER_FD, take(msg));
+	sync_crypto_queue(&peer->cs, PEER_FD, take(msg));
 }
 
 /* Tentatively create a channel_announcement, possibly with invalid
@@ -536,6 +548,52 @@ static bool get_shared_secret(const struct htlc *htlc,
 	return !memeqzero(shared_secret, sizeof(*shared_secret));
 }
 
+/* Unwrap the onion of their (now irrevocably committed) HTLC, so the
+ * master only has to decide where it goes. */
+static struct peeled_htlc *peel_htlc(const tal_t *ctx, const struct htlc *htlc)
+{
+	struct peeled_htlc *peeled = tal(ctx, struct peeled_htlc);
+	struct onionpacket *op;
+	struct route_step *rs;
+
+	peeled->id = htlc->id;
+	peeled->next_onion = NULL;
+
+	op = parse_onionpacket(tmpctx, htlc->routing, TOTAL_PACKET_SIZE);
+	if (!op) {
+		/* FIXME: could be bad version, bad key. */
+		peeled->failcode = WIRE_INVALID_ONION_VERSION;
+		return peeled;
+	}
+
+	/* HSM won't ecdh it */
+	if (memeqzero(htlc->shared_secret, sizeof(*htlc->shared_secret))) {
+		peeled->failcode = WIRE_INVALID_ONION_KEY;
+		return peeled;
+	}
+
+	rs = process_onionpacket(tmpctx, op, htlc->shared_secret->data,
+				 htlc->rhash.u.u8, sizeof(htlc->rhash));
+	if (!rs) {
+		peeled->failcode = WIRE_INVALID_ONION_HMAC;
+		return peeled;
+	}
+
+	/* Unknown realm isn't a bad onion, it's a normal failure. */
+	if (rs->hop_data.realm != 0) {
+		peeled->failcode = WIRE_INVALID_REALM;
+		return peeled;
+	}
+
+	peeled->failcode = 0;
+	peeled->next_channel = rs->hop_data.channel_id;
+	peeled->amt_forward = rs->hop_data.amt_forward;
+	peeled->outgoing_cltv = rs->hop_data.outgoing_cltv;
+	if (rs->nextcase == ONION_FORWARD)
+		peeled->next_onion = serialize_onionpacket(peeled, rs->next);
+	return peeled;
+}
+
 static void handle_peer_add_htlc(struct peer *peer, const u8 *msg)
 {
 	struct channel_id channel_id;
@@ -688,7 +746,7 @@ static void maybe_send_shutdown(struct peer *peer)
 	send_channel_update(peer, ROUTING_FLAGS_DISABLED);
 
 	msg = towire_shutdown(NULL, &peer->channel_id, peer->final_scriptpubkey);
-	sync_crypto_write(&peer->cs, PEER_FD, take(msg));
+	sync_crypto_queue(&peer->cs, PEER_FD, take(msg));
 	peer->send_shutdown = false;
 	peer->shutdown_sent[LOCAL] = true;
 	billboard_update(peer);
@@ -872,6 +930,7 @@ static struct commit_sigs *calc_commitsigs(const tal_t *ctx,
 	struct bitcoin_tx **txs;
 	const u8 **wscripts;
 	const struct htlc **htlc_map;
+	const struct unsigned_htlc_tx **htlc_txs;
 	struct commit_sigs *commit_sigs = tal(ctx, struct commit_sigs);
 	struct pubkey local_htlckey;
 	const u8 *msg;
@@ -881,14 +940,38 @@ static struct commit_sigs *calc_commitsigs(const tal_t *ctx,
 			  commit_index,
 			  REMOTE);
 
-	msg = towire_hsm_sign_remote_commitment_tx(NULL, txs[0],
-						   &peer->channel->funding_pubkey[REMOTE],
-						   *txs[0]->input[0].amount);
+	/* BOLT #2:
+	 *
+	 * A sending node:
+	 *...
+	 *  - MUST include one `htlc_signature` for every HTLC transaction
+	 *    corresponding to BIP69 lexicographic ordering of the commitment
+	 *    transaction.
+	 */
+	htlc_txs = tal_arr(tmpctx, const struct unsigned_htlc_tx *,
+			   tal_count(txs) - 1);
+	for (i = 0; i < tal_count(htlc_txs); i++) {
+		struct unsigned_htlc_tx *utx;
+
+		htlc_txs[i] = utx = tal(htlc_txs, struct unsigned_htlc_tx);
+		utx->tx = txs[i + 1];
+		utx->wscript = wscripts[i + 1];
+	}
+
+	/* One round trip for all of them. */
+	msg = towire_hsm_sign_remote_commitment_txs(NULL, txs[0],
+					&peer->channel->funding_pubkey[REMOTE],
+					*txs[0]->input[0].amount,
+					&peer->remote_per_commit,
+					htlc_txs);
 
 	msg = hsm_req(tmpctx, take(msg));
-	if (!fromwire_hsm_sign_tx_reply(msg, &commit_sigs->commit_sig))
+	if (!fromwire_hsm_sign_remote_commitment_txs_reply(commit_sigs, msg,
+						&commit_sigs->commit_sig,
+						&commit_sigs->htlc_sigs)
+	    || tal_count(commit_sigs->htlc_sigs) != tal_count(htlc_txs))
 		status_failed(STATUS_FAIL_HSM_IO,
-			      "Reading sign_remote_commitment_tx reply: %s",
+			      "Reading sign_remote_commitment_txs reply: %s",
 			      tal_hex(tmpctx, msg));
 
 	status_trace("Creating commit_sig signature %"PRIu64" %s for tx %s wscript %s key %s",
@@ -907,29 +990,7 @@ static struct commit_sigs *calc_commitsigs(const tal_t *ctx,
 		status_failed(STATUS_FAIL_INTERNAL_ERROR,
 			      "Deriving local_htlckey");
 
-	/* BOLT #2:
-	 *
-	 * A sending node:
-	 *...
-	 *  - MUST include one `htlc_signature` for every HTLC transaction
-	 *    corresponding to BIP69 lexicographic ordering of the commitment
-	 *    transaction.
-	 */
-	commit_sigs->htlc_sigs = tal_arr(commit_sigs, secp256k1_ecdsa_signature,
-					 tal_count(txs) - 1);
-
 	for (i = 0; i < tal_count(commit_sigs->htlc_sigs); i++) {
-		msg = towire_hsm_sign_remote_htlc_tx(NULL, txs[i + 1],
-						     wscripts[i + 1],
-						     *txs[i+1]->input[0].amount,
-						     &peer->remote_per_commit);
-
-		msg = hsm_req(tmpctx, take(msg));
-		if (!fromwire_hsm_sign_tx_reply(msg, &commit_sigs->htlc_sigs[i]))
-			status_failed(STATUS_FAIL_HSM_IO,
-				      "Bad sign_remote_htlc_tx reply: %s",
-				      tal_hex(tmpctx, msg));
-
 		status_trace("Creating HTLC signature %s for tx %s wscript %s key %s",
 			     type_to_string(tmpctx, secp256k1_ecdsa_signature,
 					    &commit_sigs->htlc_sigs[i]),
@@ -1038,7 +1099,7 @@ static void send_commit(struct peer *peer)
 				      feerate, max);
 
 		msg = towire_update_fee(NULL, &peer->channel_id, feerate);
-		sync_crypto_write(&peer->cs, PEER_FD, take(msg));
+		sync_crypto_queue(&peer->cs, PEER_FD, take(msg));
 	}
 
 	/* BOLT #2:
@@ -1245,6 +1306,7 @@ static void handle_peer_commit_sig(struct peer *peer, const u8 *msg)
 	struct bitcoin_tx **txs;
 	const struct htlc **htlc_map, **changed_htlcs;
 	const u8 **wscripts;
+	struct threadpool *pool;
 	size_t i;
 
 	changed_htlcs = tal_arr(msg, const struct htlc *, 0);
@@ -1330,18 +1392,27 @@ static void handle_peer_commit_sig(struct peer *peer, const u8 *msg)
 	 *     transaction:
 	 *     - MUST fail the channel.
 	 */
-	for (i = 0; i < tal_count(htlc_sigs); i++) {
-		if (!check_tx_sig(txs[1+i], 0, NULL, wscripts[1+i],
-				  &remote_htlckey, &htlc_sigs[i]))
-			peer_failed(&peer->cs,
-				    &peer->channel_id,
-				    "Bad commit_sig signature %s for htlc %s wscript %s key %s",
-				    type_to_string(msg, secp256k1_ecdsa_signature, &htlc_sigs[i]),
-				    type_to_string(msg, struct bitcoin_tx, txs[1+i]),
-				    tal_hex(msg, wscripts[1+i]),
-				    type_to_string(msg, struct pubkey,
-						   &remote_htlckey));
-	}
+	if (tal_count(htlc_sigs) >= PARALLEL_VERIFY_MIN_HTLCS) {
+		if (!peer->verify_pool) {
+			size_t nthreads = threadpool_default_threads();
+			if (nthreads > PARALLEL_VERIFY_MAX_THREADS)
+				nthreads = PARALLEL_VERIFY_MAX_THREADS;
+			peer->verify_pool = threadpool_new(peer, nthreads);
+		}
+		pool = peer->verify_pool;
+	} else
+		pool = NULL;
+
+	if (!check_htlc_sigs(pool, txs + 1, wscripts + 1, &remote_htlckey,
+			     htlc_sigs, &i))
+		peer_failed(&peer->cs,
+			    &peer->channel_id,
+			    "Bad commit_sig signature %s for htlc %s wscript %s key %s",
+			    type_to_string(msg, secp256k1_ecdsa_signature, &htlc_sigs[i]),
+			    type_to_string(msg, struct bitcoin_tx, txs[1+i]),
+			    tal_hex(msg, wscripts[1+i]),
+			    type_to_string(msg, struct pubkey,
+					   &remote_htlckey));
 
 	status_trace("Received commit_sig with %zu htlc sigs",
 		     tal_count(htlc_sigs));
@@ -1364,6 +1435,8 @@ static u8 *got_revoke_msg(const tal_t *ctx, u64 revoke_num,
 {
 	u8 *msg;
 	struct changed_htlc *changed = tal_arr(tmpctx, struct changed_htlc, 0);
+	const struct peeled_htlc **peeled
+		= tal_arr(tmpctx, const struct peeled_htlc *, 0);
 
 	for (size_t i = 0; i < tal_count(changed_htlcs); i++) {
 		struct changed_htlc *c = tal_arr_expand(&changed);
@@ -1375,10 +1448,15 @@ static u8 *got_revoke_msg(const tal_t *ctx, u64 revoke_num,
 
 		c->id = changed_htlcs[i]->id;
 		c->newstate = changed_htlcs[i]->state;
+
+		/* Master will route these now. */
+		if (htlc->state == RCVD_ADD_ACK_REVOCATION)
+			*tal_arr_expand(&peeled) = peel_htlc(peeled, htlc);
 	}
 
 	msg = towire_channel_got_revoke(ctx, revoke_num, per_commitment_secret,
-					next_per_commit_point, feerate, changed);
+					next_per_commit_point, feerate, changed,
+					peeled);
 	return msg;
 }
 
@@ -1731,7 +1809,7 @@ static void resend_revoke(struct peer *peer)
 	struct pubkey point;
 	/* Current commit is peer->next_index[LOCAL]-1, revoke prior */
 	u8 *msg = make_revocation_msg(peer, peer->next_index[LOCAL]-2, &point);
-	sync_crypto_write(&peer->cs, PEER_FD, take(msg));
+	sync_crypto_queue(&peer->cs, PEER_FD, take(msg));
 }
 
 static void send_fail_or_fulfill(struct peer *peer, const struct htlc *h)
@@ -1770,7 +1848,7 @@ static void send_fail_or_fulfill(struct peer *peer, const struct htlc *h)
 			    &peer->channel_id,
 			    "HTLC %"PRIu64" state %s not failed/fulfilled",
 			    h->id, htlc_state_name(h->state));
-	sync_crypto_write(&peer->cs, PEER_FD, take(msg));
+	sync_crypto_queue(&peer->cs, PEER_FD, take(msg));
 }
 
 static void resend_commitment(struct peer *peer, const struct changed_htlc *last)
@@ -1815,7 +1893,7 @@ static void resend_commitment(struct peer *peer, const struct changed_htlc *last
 							 abs_locktime_to_blocks(
 								 &h->expiry),
 							 h->routing);
-			sync_crypto_write(&peer->cs, PEER_FD, take(msg));
+			sync_crypto_queue(&peer->cs, PEER_FD, take(msg));
 		} else if (h->state == SENT_REMOVE_COMMIT) {
 			send_fail_or_fulfill(peer, h);
 		}
@@ -1825,7 +1903,7 @@ static void resend_commitment(struct peer *peer, const struct changed_htlc *last
 	if (peer->channel->funder == LOCAL) {
 		msg = towire_update_fee(NULL, &peer->channel_id,
 					channel_feerate(peer->channel, REMOTE));
-		sync_crypto_write(&peer->cs, PEER_FD, take(msg));
+		sync_crypto_queue(&peer->cs, PEER_FD, take(msg));
 	}
 
 	/* Re-send the commitment_signed itself. */
@@ -1833,7 +1911,7 @@ static void resend_commitment(struct peer *peer, const struct changed_htlc *last
 	msg = towire_commitment_signed(NULL, &peer->channel_id,
 				       &commit_sigs->commit_sig,
 				       commit_sigs->htlc_sigs);
-	sync_crypto_write(&peer->cs, PEER_FD, take(msg));
+	sync_crypto_queue(&peer->cs, PEER_FD, take(msg));
 	tal_free(commit_sigs);
 
 	/* If we have already received the revocation for the previous, the
@@ -2041,7 +2119,7 @@ static void peer_reconnect(struct peer *peer,
 		 peer->revocations_received,
 		 last_remote_per_commit_secret,
 		 &my_current_per_commitment_point);
-	sync_crypto_write(&peer->cs, PEER_FD, take(msg));
+	sync_crypto_queue(&peer->cs, PEER_FD, take(msg));
 
 	peer_billboard(false, "Sent reestablish, waiting for theirs");
 
@@ -2102,7 +2180,7 @@ static void peer_reconnect(struct peer *peer,
 		msg = towire_funding_locked(NULL,
 					    &peer->channel_id,
 					    &peer->next_local_per_commit);
-		sync_crypto_write(&peer->cs, PEER_FD, take(msg));
+		sync_crypto_queue(&peer->cs, PEER_FD, take(msg));
 	}
 
 	/* Note: next_index is the index of the current commit we're working
@@ -2264,7 +2342,7 @@ static void handle_funding_locked(struct peer *peer, const u8 *msg)
 		msg = towire_funding_locked(NULL,
 					    &peer->channel_id,
 					    &peer->next_local_per_commit);
-		sync_crypto_write(&peer->cs, PEER_FD, take(msg));
+		sync_crypto_queue(&peer->cs, PEER_FD, take(msg));
 		peer->funding_locked[LOCAL] = true;
 	}
 
@@ -2311,7 +2389,7 @@ static void handle_offer_htlc(struct peer *peer, const u8 *inmsg)
 					     peer->htlc_id, amount_msat,
 					     &payment_hash, cltv_expiry,
 					     onion_routing_packet);
-		sync_crypto_write(&peer->cs, PEER_FD, take(msg));
+		sync_crypto_queue(&peer->cs, PEER_FD, take(msg));
 		start_commit_timer(peer);
 		/* Tell the master. */
 		msg = towire_channel_offer_htlc_reply(NULL, peer->htlc_id,
@@ -2669,7 +2747,7 @@ static void init_channel(struct peer *peer)
 
 	/* If we have a funding_signed message, send that immediately */
 	if (funding_signed)
-		sync_crypto_write(&peer->cs, PEER_FD, take(funding_signed));
+		sync_crypto_queue(&peer->cs, PEER_FD, take(funding_signed));
 
 	/* Reenable channel */
 	channel_announcement_negotiate(peer);
@@ -2709,6 +2787,7 @@ int main(int argc, char *argv[])
 	peer->next_commit_sigs = NULL;
 	peer->shutdown_sent[LOCAL] = false;
 	peer->last_update_timestamp = 0;
+	peer->verify_pool = NULL;
 	/* We actually received it in the previous daemon, but near enough */
 	peer->last_recv = time_now();
 
@@ -2776,6 +2855,10 @@ int main(int argc, char *argv[])
 		} else
 			tptr = NULL;
 
+		/* We've handled everything pending: now send what that
+		 * generated, all together. */
+		sync_crypto_flush(PEER_FD);
+
 		if (select(nfds, &rfds, NULL, NULL, tptr) < 0) {
 			/* Signals OK, eg. SIGUSR1 */
 			if (errno == EINTR)
@@ -2808,6 +2891,7 @@ int main(int argc, char *argv[])
 
 	/* We only exit when shutdown is complete. */
 	assert(shutdown_complete(peer));
+	sync_crypto_flush(PEER_FD);
 	send_shutdown_complete(peer);
 	daemon_shutdown();
 	return 0;
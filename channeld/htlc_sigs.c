@@ -0,0 +1,52 @@
+#include <bitcoin/signature.h>
+#include <channeld/htlc_sigs.h>
+#include <common/threadpool.h>
+#include <common/utils.h>
+
+struct htlc_sig_check {
+	const struct pubkey *key;
+	const secp256k1_ecdsa_signature *sigs;
+	struct sha256_double *hashes;
+	bool *ok;
+};
+
+/* Runs in a worker thread: no tal here! */
+static void check_one(struct htlc_sig_check *check, size_t i)
+{
+	check->ok[i] = check_signed_hash(&check->hashes[i], &check->sigs[i],
+					 check->key);
+}
+
+bool check_htlc_sigs(struct threadpool *pool,
+		     struct bitcoin_tx **txs,
+		     const u8 **wscripts,
+		     const struct pubkey *key,
+		     const secp256k1_ecdsa_signature *sigs,
+		     size_t *bad)
+{
+	struct htlc_sig_check check;
+	size_t n = tal_count(sigs);
+
+	check.key = key;
+	check.sigs = sigs;
+	check.hashes = tal_arr(tmpctx, struct sha256_double, n);
+	check.ok = tal_arr(tmpctx, bool, n);
+
+	for (size_t i = 0; i < n; i++)
+		sha256_tx_for_sig(&check.hashes[i], txs[i], 0, wscripts[i]);
+
+	if (pool)
+		threadpool_run(pool, n, check_one, &check);
+	else {
+		for (size_t i = 0; i < n; i++)
+			check_one(&check, i);
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		if (!check.ok[i]) {
+			*bad = i;
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,29 @@
+#ifndef LIGHTNING_CHANNELD_HTLC_SIGS_H
+#define LIGHTNING_CHANNELD_HTLC_SIGS_H
+#include "config.h"
+#include <bitcoin/pubkey.h>
+#include <bitcoin/tx.h>
+#include <secp256k1.h>
+
+struct threadpool;
+
+/**
+ * check_htlc_sigs: check the peer's signatures on our HTLC transactions.
+ * @pool: threadpool to verify in (NULL to just do it here).
+ * @txs: the HTLC transactions (as channel_txs() returns, after the first).
+ * @wscripts: the witness script for each of @txs.
+ * @key: the key they should all be signed with.
+ * @sigs: tal_arr of one signature for each of @txs.
+ * @bad: set to the index of the first bad signature, if any.
+ *
+ * The sighashes are all computed first, then the (much slower)
+ * verifications are spread over @pool.
+ */
+bool check_htlc_sigs(struct threadpool *pool,
+		     struct bitcoin_tx **txs,
+		     const u8 **wscripts,
+		     const struct pubkey *key,
+		     const secp256k1_ecdsa_signature *sigs,
+		     size_t *bad);
+
+#endif /* LIGHTNING_CHANNELD_HTLC_SIGS_H */
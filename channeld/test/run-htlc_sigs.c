@@ -0,0 +1,172 @@
+#include "../../channeld/htlc_sigs.c"
+#include "../../common/threadpool.c"
+#include <bitcoin/privkey.h>
+#include <bitcoin/signature.h>
+#include <ccan/time/time.h>
+#include <common/pseudorand.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for status_failed */
+void status_failed(enum status_failreason code UNNEEDED,
+		   const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "status_failed called!\n"); abort(); }
+/* Generated stub for status_fmt */
+void status_fmt(enum log_level level UNNEEDED, const char *fmt UNNEEDED, ...)
+
+{ fprintf(stderr, "status_fmt called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+/* Shaped like an HTLC tx: one input, one output, a ~130 byte wscript. */
+static struct bitcoin_tx *random_htlc_tx(const tal_t *ctx, const u8 **wscript)
+{
+	struct bitcoin_tx *tx = bitcoin_tx(ctx, 1, 1);
+	u8 *script;
+
+	for (size_t i = 0; i < sizeof(tx->input[0].txid); i++)
+		tx->input[0].txid.shad.sha.u.u8[i] = pseudorand(256);
+	tx->input[0].index = pseudorand(483);
+	tx->input[0].amount = tal(tx->input, u64);
+	*tx->input[0].amount = pseudorand(100000000);
+	tx->output[0].amount = *tx->input[0].amount - 1000;
+	tx->output[0].script = tal_arrz(tx, u8, 34);
+
+	script = tal_arr(ctx, u8, 133);
+	for (size_t i = 0; i < tal_count(script); i++)
+		script[i] = pseudorand(256);
+	*wscript = script;
+	return tx;
+}
+
+struct commitment {
+	struct bitcoin_tx **txs;
+	const u8 **wscripts;
+	secp256k1_ecdsa_signature *sigs;
+};
+
+static struct commitment *new_commitment(const tal_t *ctx, size_t num_htlcs,
+					 const struct privkey *privkey,
+					 const struct pubkey *pubkey)
+{
+	struct commitment *c = tal(ctx, struct commitment);
+
+	c->txs = tal_arr(c, struct bitcoin_tx *, num_htlcs);
+	c->wscripts = tal_arr(c, const u8 *, num_htlcs);
+	c->sigs = tal_arr(c, secp256k1_ecdsa_signature, num_htlcs);
+	for (size_t i = 0; i < num_htlcs; i++) {
+		c->txs[i] = random_htlc_tx(c, &c->wscripts[i]);
+		sign_tx_input(c->txs[i], 0, NULL, c->wscripts[i],
+			      privkey, pubkey, &c->sigs[i]);
+	}
+	return c;
+}
+
+/* What handle_peer_commit_sig used to do. */
+static bool check_each(const struct commitment *c, const struct pubkey *key,
+		       size_t *bad)
+{
+	for (size_t i = 0; i < tal_count(c->sigs); i++) {
+		if (!check_tx_sig(c->txs[i], 0, NULL, c->wscripts[i],
+				  key, &c->sigs[i])) {
+			*bad = i;
+			return false;
+		}
+	}
+	return true;
+}
+
+static void test_bad_sig(struct threadpool *pool,
+			 const struct privkey *privkey,
+			 const struct pubkey *pubkey)
+{
+	struct commitment *c = new_commitment(tmpctx, 20, privkey, pubkey);
+	size_t bad;
+
+	assert(check_htlc_sigs(pool, c->txs, c->wscripts, pubkey, c->sigs,
+			       &bad));
+
+	/* Swap two: both are now wrong, and we must report the first. */
+	c->sigs[17] = c->sigs[5];
+	sign_tx_input(c->txs[17], 0, NULL, c->wscripts[17],
+		      privkey, pubkey, &c->sigs[5]);
+	assert(!check_htlc_sigs(pool, c->txs, c->wscripts, pubkey, c->sigs,
+				&bad));
+	assert(bad == 5);
+	assert(!check_each(c, pubkey, &bad));
+	assert(bad == 5);
+
+	/* No HTLCs at all is fine. */
+	c = new_commitment(tmpctx, 0, privkey, pubkey);
+	assert(check_htlc_sigs(pool, c->txs, c->wscripts, pubkey, c->sigs,
+			       &bad));
+}
+
+static void bench(struct threadpool *pool, size_t num_htlcs, size_t runs,
+		  const struct privkey *privkey, const struct pubkey *pubkey)
+{
+	struct commitment *c = new_commitment(tmpctx, num_htlcs,
+					      privkey, pubkey);
+	struct timemono start;
+	struct timerel each, batched;
+	size_t bad;
+
+	start = time_mono();
+	for (size_t i = 0; i < runs; i++)
+		assert(check_each(c, pubkey, &bad));
+	each = timemono_since(start);
+
+	start = time_mono();
+	for (size_t i = 0; i < runs; i++)
+		assert(check_htlc_sigs(pool, c->txs, c->wscripts, pubkey,
+				       c->sigs, &bad));
+	batched = timemono_since(start);
+
+	printf("%zu htlcs: %"PRIu64" usec per commitment one at a time,"
+	       " %"PRIu64" usec with %zu threads\n",
+	       num_htlcs,
+	       time_to_usec(time_divide(each, runs)),
+	       time_to_usec(time_divide(batched, runs)),
+	       tal_count(pool->threads));
+}
+
+int main(int argc, char *argv[])
+{
+	setup_locale();
+	setup_tmpctx();
+	secp256k1_ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY
+						 | SECP256K1_CONTEXT_SIGN);
+
+	struct privkey privkey;
+	struct pubkey pubkey;
+	struct threadpool *pool;
+	/* Keep make check quick: pass a number of runs for the real bench. */
+	size_t runs = 1, nthreads = threadpool_default_threads();
+
+	if (argc > 1)
+		runs = atoi(argv[1]);
+	if (argc > 2)
+		nthreads = atoi(argv[2]);
+
+	memset(&privkey, 7, sizeof(privkey));
+	if (!pubkey_from_privkey(&privkey, &pubkey))
+		abort();
+
+	test_bad_sig(NULL, &privkey, &pubkey);
+	for (size_t i = 0; i < 4; i++) {
+		pool = threadpool_new(tmpctx, i);
+		test_bad_sig(pool, &privkey, &pubkey);
+		tal_free(pool);
+	}
+
+	pool = threadpool_new(tmpctx, nthreads);
+	bench(pool, 10, runs, &privkey, &pubkey);
+	if (argc > 1) {
+		bench(pool, 100, runs, &privkey, &pubkey);
+		bench(pool, 483, runs, &privkey, &pubkey);
+	}
+
+	secp256k1_context_destroy(secp256k1_ctx);
+	tal_free(tmpctx);
+	return 0;
+}
@@ -579,6 +579,7 @@ int main(int argc, char *argv[])
 
 	/* We're done! */
 	/* Properly close the channel first. */
+	sync_crypto_flush(PEER_FD);
 	if (!socket_close(PEER_FD))
 		status_unusual("Closing and draining peerfd gave error: %s",
 			       strerror(errno));
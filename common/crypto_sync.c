@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <ccan/read_write_all/read_write_all.h>
 #include <common/crypto_sync.h>
 #include <common/cryptomsg.h>
@@ -13,37 +14,80 @@
 #include <wire/wire.h>
 #include <wire/wire_sync.h>
 
-void sync_crypto_write(struct crypto_state *cs, int fd, const void *msg TAKES)
+/* Each subdaemon only talks to one peer, so this can simply be static:
+ * messages we've encrypted but not yet written.  The peer must receive them
+ * in the order we encrypted them, so every write goes through here. */
+static u8 *outq;
+static size_t outq_len;
+static int outq_fd = -1;
+
+/* Don't hoard too much: the kernel's socket buffer is about this size. */
+#define OUTQ_FLUSH_LEN 65536
+
+void sync_crypto_flush(int fd)
+{
+	size_t len = outq_len;
+
+	if (!len)
+		return;
+
+	assert(fd == outq_fd);
+	outq_len = 0;
+	if (!write_all(fd, outq, len))
+		peer_failed_connection_lost();
+}
+
+static void crypto_write(struct crypto_state *cs, int fd,
+			 const void *msg TAKES, bool flush)
 {
 #if DEVELOPER
-	bool post_sabotage = false;
+	bool post_sabotage = false, drop = false;
 	int type = fromwire_peektype(msg);
+	size_t prev_len = outq_len;
 #endif
-	u8 *enc;
+	size_t len = cryptomsg_encrypted_len(msg);
 
 	status_peer_io(LOG_IO_OUT, msg);
-	enc = cryptomsg_encrypt_msg(NULL, cs, msg);
 
 #if DEVELOPER
 	switch (dev_disconnect(type)) {
 	case DEV_DISCONNECT_BEFORE:
+		sync_crypto_flush(fd);
 		dev_sabotage_fd(fd);
 		peer_failed_connection_lost();
 	case DEV_DISCONNECT_DROPPKT:
-		enc = tal_free(enc); /* FALL THRU */
+		drop = true; /* FALL THRU */
 	case DEV_DISCONNECT_AFTER:
 		post_sabotage = true;
+		flush = true;
 		break;
 	case DEV_DISCONNECT_BLACKHOLE:
+		sync_crypto_flush(fd);
 		dev_blackhole_fd(fd);
 		break;
 	case DEV_DISCONNECT_NORMAL:
 		break;
 	}
 #endif
-	if (!write_all(fd, enc, tal_count(enc)))
-		peer_failed_connection_lost();
-	tal_free(enc);
+	assert(outq_len == 0 || fd == outq_fd);
+	outq_fd = fd;
+	if (!outq)
+		outq = tal_arr(NULL, u8, OUTQ_FLUSH_LEN);
+	if (outq_len + len > tal_count(outq))
+		tal_resize(&outq, outq_len + len);
+
+	/* Even if we drop it, it still uses up a nonce. */
+	cryptomsg_encrypt_msg_into(cs, msg, outq + outq_len);
+	outq_len += len;
+#if DEVELOPER
+	if (drop)
+		outq_len = prev_len;
+#endif
+	if (taken(msg))
+		tal_free(msg);
+
+	if (flush || outq_len >= OUTQ_FLUSH_LEN)
+		sync_crypto_flush(fd);
 
 #if DEVELOPER
 	if (post_sabotage)
@@ -51,6 +95,16 @@ void sync_crypto_write(struct crypto_state *cs, int fd, const void *msg TAKES)
 #endif
 }
 
+void sync_crypto_write(struct crypto_state *cs, int fd, const void *msg TAKES)
+{
+	crypto_write(cs, fd, msg, true);
+}
+
+void sync_crypto_queue(struct crypto_state *cs, int fd, const void *msg TAKES)
+{
+	crypto_write(cs, fd, msg, false);
+}
+
 /* We're happy for the kernel to batch update and gossip messages, but a
  * commitment message, for example, should be instantly sent.  There's no
  * great way of doing this, unfortunately.
@@ -90,6 +144,7 @@ void sync_crypto_write_no_delay(struct crypto_state *cs, int fd,
 			complained = true;
 		}
 	}
+	/* This sends anything queued before it, too. */
 	sync_crypto_write(cs, fd, msg);
 
 	val = 0;
@@ -101,6 +156,9 @@ u8 *sync_crypto_read(const tal_t *ctx, struct crypto_state *cs, int fd)
 	u8 hdr[18], *enc, *dec;
 	u16 len;
 
+	/* They may be waiting for what we've queued before they send. */
+	sync_crypto_flush(fd);
+
 	if (!read_all(fd, hdr, sizeof(hdr))) {
 		status_trace("Failed reading header: %s", strerror(errno));
 		peer_failed_connection_lost();
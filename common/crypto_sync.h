@@ -6,10 +6,19 @@
 
 struct crypto_state;
 
-/* Exits with peer_failed_connection_lost() if write fails. */
+/* Exits with peer_failed_connection_lost() if write fails.  Anything
+ * queued by sync_crypto_queue() is written first. */
 void sync_crypto_write(struct crypto_state *cs, int fd, const void *msg TAKES);
 
-/* Same, but disabled nagle for this message. */
+/* Encrypt now, but only write once sync_crypto_flush() is called (or
+ * sync_crypto_write() or sync_crypto_read(), or plenty has built up), so a
+ * burst of messages costs one syscall. */
+void sync_crypto_queue(struct crypto_state *cs, int fd, const void *msg TAKES);
+
+/* Write out anything queued.  Call before handing off the crypto_state! */
+void sync_crypto_flush(int fd);
+
+/* Same as sync_crypto_write, but disabled nagle for this message. */
 void sync_crypto_write_no_delay(struct crypto_state *cs, int fd,
 				const void *msg TAKES);
 
@@ -156,17 +156,13 @@ bool cryptomsg_decrypt_header(struct crypto_state *cs, u8 hdr[18], u16 *lenp)
 	return true;
 }
 
-u8 *cryptomsg_encrypt_msg(const tal_t *ctx,
-			  struct crypto_state *cs,
-			  const u8 *msg TAKES)
+void cryptomsg_encrypt_msg_into(struct crypto_state *cs,
+				const u8 *msg, u8 *out)
 {
 	unsigned char npub[crypto_aead_chacha20poly1305_ietf_NPUBBYTES];
 	unsigned long long clen, mlen = tal_count(msg);
 	be16 l;
 	int ret;
-	u8 *out;
-
-	out = tal_arr(ctx, u8, sizeof(l) + 16 + mlen + 16);
 
 	/* BOLT #8:
 	 *
@@ -237,7 +233,15 @@ u8 *cryptomsg_encrypt_msg(const tal_t *ctx,
 #endif
 
 	maybe_rotate_key(&cs->sn, &cs->sk, &cs->s_ck);
+}
+
+u8 *cryptomsg_encrypt_msg(const tal_t *ctx,
+			  struct crypto_state *cs,
+			  const u8 *msg TAKES)
+{
+	u8 *out = tal_arr(ctx, u8, cryptomsg_encrypted_len(msg));
 
+	cryptomsg_encrypt_msg_into(cs, msg, out);
 	if (taken(msg))
 		tal_free(msg);
 	return out;
@@ -22,10 +22,17 @@
  */
 #define CRYPTOMSG_BODY_OVERHEAD 16
 
+/* How long will @msg be once encrypted? */
+#define cryptomsg_encrypted_len(msg)					\
+	(CRYPTOMSG_HDR_SIZE + tal_count(msg) + CRYPTOMSG_BODY_OVERHEAD)
+
 /* Low-level functions for sync comms: doesn't discard unknowns! */
 u8 *cryptomsg_encrypt_msg(const tal_t *ctx,
 			  struct crypto_state *cs,
 			  const u8 *msg);
+/* Same, but into @out, which must have cryptomsg_encrypted_len(msg) bytes. */
+void cryptomsg_encrypt_msg_into(struct crypto_state *cs,
+				const u8 *msg, u8 *out);
 bool cryptomsg_decrypt_header(struct crypto_state *cs, u8 hdr[18], u16 *lenp);
 u8 *cryptomsg_decrypt_body(const tal_t *ctx,
 			   struct crypto_state *cs, const u8 *in);
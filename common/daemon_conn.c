@@ -135,6 +135,11 @@ void daemon_conn_send(struct daemon_conn *dc, const u8 *msg)
 	msg_enqueue(dc->out, msg);
 }
 
+size_t daemon_conn_queue_length(const struct daemon_conn *dc)
+{
+	return msg_queue_length(dc->out);
+}
+
 void daemon_conn_send_fd(struct daemon_conn *dc, int fd)
 {
 	msg_enqueue_fd(dc->out, fd);
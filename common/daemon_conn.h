@@ -41,6 +41,11 @@ void daemon_conn_send(struct daemon_conn *dc, const u8 *msg);
  */
 void daemon_conn_wake(struct daemon_conn *dc);
 
+/**
+ * daemon_conn_queue_length - How many messages are waiting to be sent?
+ */
+size_t daemon_conn_queue_length(const struct daemon_conn *dc);
+
 /**
  * daemon_conn_send_fd - Enqueue a file descriptor to be sent (closed after)
  */
@@ -55,6 +55,30 @@ void towire_changed_htlc(u8 **pptr, const struct changed_htlc *changed)
 	towire_u64(pptr, changed->id);
 }
 
+void towire_peeled_htlc(u8 **pptr, const struct peeled_htlc *peeled)
+{
+	towire_u64(pptr, peeled->id);
+	towire_u16(pptr, peeled->failcode);
+	if (peeled->failcode)
+		return;
+
+	towire_short_channel_id(pptr, &peeled->next_channel);
+	towire_u64(pptr, peeled->amt_forward);
+	towire_u32(pptr, peeled->outgoing_cltv);
+	towire_bool(pptr, peeled->next_onion != NULL);
+	if (peeled->next_onion) {
+		assert(tal_count(peeled->next_onion) == TOTAL_PACKET_SIZE);
+		towire_u8_array(pptr, peeled->next_onion, TOTAL_PACKET_SIZE);
+	}
+}
+
+void towire_unsigned_htlc_tx(u8 **pptr, const struct unsigned_htlc_tx *utx)
+{
+	towire_bitcoin_tx(pptr, utx->tx);
+	towire_u16(pptr, tal_count(utx->wscript));
+	towire_u8_array(pptr, utx->wscript, tal_count(utx->wscript));
+}
+
 void towire_side(u8 **pptr, const enum side side)
 {
 	towire_u8(pptr, side);
@@ -134,6 +158,42 @@ void fromwire_changed_htlc(const u8 **cursor, size_t *max,
 	changed->id = fromwire_u64(cursor, max);
 }
 
+struct peeled_htlc *fromwire_peeled_htlc(const tal_t *ctx, const u8 **cursor,
+					 size_t *max)
+{
+	struct peeled_htlc *peeled = tal(ctx, struct peeled_htlc);
+
+	peeled->id = fromwire_u64(cursor, max);
+	peeled->failcode = fromwire_u16(cursor, max);
+	peeled->next_onion = NULL;
+	if (peeled->failcode)
+		return peeled;
+
+	fromwire_short_channel_id(cursor, max, &peeled->next_channel);
+	peeled->amt_forward = fromwire_u64(cursor, max);
+	peeled->outgoing_cltv = fromwire_u32(cursor, max);
+	if (fromwire_bool(cursor, max)) {
+		peeled->next_onion = tal_arr(peeled, u8, TOTAL_PACKET_SIZE);
+		fromwire_u8_array(cursor, max, peeled->next_onion,
+				  TOTAL_PACKET_SIZE);
+	}
+	return peeled;
+}
+
+struct unsigned_htlc_tx *fromwire_unsigned_htlc_tx(const tal_t *ctx,
+						   const u8 **cursor,
+						   size_t *max)
+{
+	struct unsigned_htlc_tx *utx = tal(ctx, struct unsigned_htlc_tx);
+	u8 *wscript;
+
+	utx->tx = fromwire_bitcoin_tx(utx, cursor, max);
+	wscript = tal_arr(utx, u8, fromwire_u16(cursor, max));
+	fromwire_u8_array(cursor, max, wscript, tal_count(wscript));
+	utx->wscript = wscript;
+	return utx;
+}
+
 enum side fromwire_side(const u8 **cursor, size_t *max)
 {
 	enum side side = fromwire_u8(cursor, max);
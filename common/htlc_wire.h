@@ -2,6 +2,7 @@
 #define LIGHTNING_COMMON_HTLC_WIRE_H
 #include "config.h"
 #include <bitcoin/preimage.h>
+#include <bitcoin/short_channel_id.h>
 #include <ccan/short_types/short_types.h>
 #include <common/htlc.h>
 #include <common/sphinx.h>
@@ -38,10 +39,30 @@ struct changed_htlc {
 	u64 id;
 };
 
+/* channeld unwraps their onions, so the master only has to route them. */
+struct peeled_htlc {
+	u64 id;
+	/* If this is non-zero, we couldn't, and the rest is unset. */
+	enum onion_type failcode;
+	struct short_channel_id next_channel;
+	u64 amt_forward;
+	u32 outgoing_cltv;
+	/* NULL if it's for us, otherwise onion to send to next hop. */
+	u8 *next_onion;
+};
+
+/* One of their HTLC transactions, for hsmd to sign. */
+struct unsigned_htlc_tx {
+	struct bitcoin_tx *tx;
+	const u8 *wscript;
+};
+
 void towire_added_htlc(u8 **pptr, const struct added_htlc *added);
 void towire_fulfilled_htlc(u8 **pptr, const struct fulfilled_htlc *fulfilled);
 void towire_failed_htlc(u8 **pptr, const struct failed_htlc *failed);
 void towire_changed_htlc(u8 **pptr, const struct changed_htlc *changed);
+void towire_peeled_htlc(u8 **pptr, const struct peeled_htlc *peeled);
+void towire_unsigned_htlc_tx(u8 **pptr, const struct unsigned_htlc_tx *utx);
 void towire_htlc_state(u8 **pptr, const enum htlc_state hstate);
 void towire_side(u8 **pptr, const enum side side);
 void towire_shachain(u8 **pptr, const struct shachain *shachain);
@@ -52,8 +73,13 @@ void fromwire_fulfilled_htlc(const u8 **cursor, size_t *max,
 			     struct fulfilled_htlc *fulfilled);
 struct failed_htlc *fromwire_failed_htlc(const tal_t *ctx, const u8 **cursor,
 					 size_t *max);
+struct unsigned_htlc_tx *fromwire_unsigned_htlc_tx(const tal_t *ctx,
+						   const u8 **cursor,
+						   size_t *max);
 void fromwire_changed_htlc(const u8 **cursor, size_t *max,
 			   struct changed_htlc *changed);
+struct peeled_htlc *fromwire_peeled_htlc(const tal_t *ctx, const u8 **cursor,
+					 size_t *max);
 enum htlc_state fromwire_htlc_state(const u8 **cursor, size_t *max);
 enum side fromwire_side(const u8 **cursor, size_t *max);
 void fromwire_shachain(const u8 **cursor, size_t *max,
@@ -0,0 +1,574 @@
+/* Alternative to ccan/io/poll.c, chosen with ./configure --enable-epoll:
+ * the same backend, but using epoll(7) so that each loop costs O(ready fds)
+ * rather than O(all fds). */
+/* backend.h needs io.h first, as in ccan/io/poll.c. */
+#include <ccan/io/io.h>
+#include <ccan/io/backend.h>
+#include <assert.h>
+#include <ccan/crypto/siphash24/siphash24.h>
+#include <ccan/htable/htable_type.h>
+#include <ccan/time/time.h>
+#include <ccan/timer/timer.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* How many events we take from the kernel at once. */
+#define MAX_READY 128
+
+/* A conn in io_wait(), so io_wake() doesn't have to look at every fd. */
+struct io_waiter {
+	const void *wait;
+	struct io_conn *conn;
+	enum io_direction dir;
+};
+
+static const void *waiter_keyof(const struct io_waiter *w)
+{
+	return w->wait;
+}
+
+static size_t hash_wait(const void *wait)
+{
+	static struct siphash_seed seed;
+	return siphash24(&seed, &wait, sizeof(wait));
+}
+
+static bool waiter_eq(const struct io_waiter *w, const void *wait)
+{
+	return w->wait == wait;
+}
+
+HTABLE_DEFINE_TYPE(struct io_waiter, waiter_keyof, hash_wait, waiter_eq,
+		   waiter_map);
+
+struct epoll_info {
+	struct fd *fd;
+	/* What epoll is watching for (0 == not registered at all, since
+	 * epoll always reports EPOLLHUP and EPOLLERR). */
+	uint32_t events;
+	/* epoll refuses regular files: poll() says they're always ready. */
+	bool unpollable;
+	/* Non-NULL while that direction is in io_wait(). */
+	struct io_waiter *waiter[2];
+};
+
+static int epfd = -1;
+/* A forked child shares our epoll instance: it needs its own. */
+static bool forked = false, atfork_registered = false;
+static size_t num_fds = 0, max_fds = 0, num_waiting = 0, num_unpollable = 0;
+static struct epoll_info *infos = NULL;
+static struct waiter_map waiters
+= { HTABLE_INITIALIZER(waiters.raw, waiter_map_hash, NULL) };
+/* The events we're currently handling (data.ptr is NULLed if freed). */
+static struct epoll_event *ready = NULL;
+static size_t num_ready = 0;
+static LIST_HEAD(always);
+static struct timemono (*nowfn)(void) = time_mono;
+static int (*pollfn)(struct pollfd *fds, nfds_t nfds, int timeout) = poll;
+
+struct timemono (*io_time_override(struct timemono (*now)(void)))(void)
+{
+	struct timemono (*old)(void) = nowfn;
+	nowfn = now;
+	return old;
+}
+
+int (*io_poll_override(int (*poll)(struct pollfd *fds, nfds_t nfds, int timeout)))(struct pollfd *, nfds_t, int)
+{
+	int (*old)(struct pollfd *fds, nfds_t nfds, int timeout) = pollfn;
+	pollfn = poll;
+	return old;
+}
+
+static void check_fork(void);
+
+static void set_events(struct epoll_info *info, uint32_t events)
+{
+	struct epoll_event ev;
+	int op;
+
+	if (info->events == events)
+		return;
+
+	check_fork();
+
+	if (!info->unpollable) {
+		if (!info->events)
+			op = EPOLL_CTL_ADD;
+		else if (!events)
+			op = EPOLL_CTL_DEL;
+		else
+			op = EPOLL_CTL_MOD;
+
+		ev.events = events;
+		ev.data.ptr = info->fd;
+		/* If we can't watch it, treat it as always ready like poll()
+		 * would: the read or write will then tell the truth (eg. a
+		 * closed fd gives EBADF, just as POLLNVAL would). */
+		if (epoll_ctl(epfd, op, info->fd->fd, &ev) != 0
+		    && op != EPOLL_CTL_DEL) {
+			if (info->events)
+				epoll_ctl(epfd, EPOLL_CTL_DEL, info->fd->fd, &ev);
+			info->unpollable = true;
+			num_unpollable++;
+		}
+	}
+
+	if (info->events)
+		num_waiting--;
+	info->events = events;
+	if (info->events)
+		num_waiting++;
+}
+
+static void child_after_fork(void)
+{
+	forked = true;
+}
+
+/* Otherwise the child changing what it watches changes ours, too. */
+static void check_fork(void)
+{
+	size_t i;
+
+	if (!forked)
+		return;
+	forked = false;
+
+	if (epfd < 0)
+		return;
+	close(epfd);
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+
+	for (i = 0; i < num_fds; i++) {
+		uint32_t events = infos[i].events;
+
+		/* If we couldn't make a new one, nothing is watchable. */
+		if (epfd < 0 && !infos[i].unpollable) {
+			infos[i].unpollable = true;
+			num_unpollable++;
+		}
+		if (!events)
+			continue;
+		infos[i].events = 0;
+		num_waiting--;
+		set_events(&infos[i], events);
+	}
+}
+
+static void stop_waiting(struct epoll_info *info, enum io_direction dir)
+{
+	if (!info->waiter[dir])
+		return;
+	waiter_map_del(&waiters, info->waiter[dir]);
+	info->waiter[dir] = tal_free(info->waiter[dir]);
+}
+
+static void update_waiting(struct io_conn *conn, enum io_direction dir)
+{
+	struct epoll_info *info = &infos[conn->fd.backend_info];
+	const void *wait = conn->plan[dir].arg.u1.const_vp;
+	struct io_waiter *w;
+
+	if (conn->plan[dir].status != IO_WAITING) {
+		stop_waiting(info, dir);
+		return;
+	}
+
+	if (info->waiter[dir]) {
+		if (info->waiter[dir]->wait == wait)
+			return;
+		stop_waiting(info, dir);
+	}
+
+	w = tal(conn, struct io_waiter);
+	w->wait = wait;
+	w->conn = conn;
+	w->dir = dir;
+	waiter_map_add(&waiters, w);
+	info->waiter[dir] = w;
+}
+
+static bool add_fd(struct fd *fd, uint32_t events)
+{
+	if (!max_fds) {
+		assert(num_fds == 0);
+		if (!atfork_registered) {
+			if (pthread_atfork(NULL, NULL, child_after_fork) != 0)
+				return false;
+			atfork_registered = true;
+		}
+		forked = false;
+		epfd = epoll_create1(EPOLL_CLOEXEC);
+		if (epfd < 0)
+			return false;
+		infos = tal_arr(NULL, struct epoll_info, 8);
+		if (!infos) {
+			close(epfd);
+			epfd = -1;
+			return false;
+		}
+		max_fds = 8;
+	}
+
+	if (num_fds + 1 > max_fds) {
+		size_t num = max_fds * 2;
+
+		if (!tal_resize(&infos, num))
+			return false;
+		max_fds = num;
+	}
+
+	infos[num_fds].fd = fd;
+	infos[num_fds].events = 0;
+	infos[num_fds].unpollable = false;
+	infos[num_fds].waiter[IO_IN] = infos[num_fds].waiter[IO_OUT] = NULL;
+	set_events(&infos[num_fds], events);
+	fd->backend_info = num_fds;
+	num_fds++;
+
+	return true;
+}
+
+static void del_fd(struct fd *fd)
+{
+	size_t i, n = fd->backend_info;
+
+	assert(n != -1);
+	assert(n < num_fds);
+	/* Must unregister before close: a forked child may share it. */
+	set_events(&infos[n], 0);
+	if (infos[n].unpollable)
+		num_unpollable--;
+	stop_waiting(&infos[n], IO_IN);
+	stop_waiting(&infos[n], IO_OUT);
+
+	/* In case we're iterating now. */
+	for (i = 0; i < num_ready; i++) {
+		if (ready[i].data.ptr == fd)
+			ready[i].data.ptr = NULL;
+	}
+
+	if (n != num_fds - 1) {
+		/* Move last one over us. */
+		infos[n] = infos[num_fds-1];
+		assert(infos[n].fd->backend_info == num_fds-1);
+		infos[n].fd->backend_info = n;
+	} else if (num_fds == 1) {
+		/* Free everything when no more fds. */
+		infos = tal_free(infos);
+		waiter_map_clear(&waiters);
+		/* io_loop frees this once it's finished with it. */
+		if (!num_ready)
+			ready = tal_free(ready);
+		close(epfd);
+		epfd = -1;
+		max_fds = 0;
+	}
+	num_fds--;
+	fd->backend_info = -1;
+}
+
+static void destroy_listener(struct io_listener *l)
+{
+	del_fd(&l->fd);
+	close(l->fd.fd);
+}
+
+bool add_listener(struct io_listener *l)
+{
+	if (!add_fd(&l->fd, EPOLLIN))
+		return false;
+	tal_add_destructor(l, destroy_listener);
+	return true;
+}
+
+void remove_from_always(struct io_conn *conn)
+{
+	list_del_init(&conn->always);
+}
+
+void backend_new_always(struct io_conn *conn)
+{
+	/* In case it's already in always list. */
+	list_del(&conn->always);
+	list_add_tail(&always, &conn->always);
+}
+
+void backend_new_plan(struct io_conn *conn)
+{
+	uint32_t events = 0;
+
+	if (conn->plan[IO_IN].status == IO_POLLING_NOTSTARTED
+	    || conn->plan[IO_IN].status == IO_POLLING_STARTED)
+		events |= EPOLLIN;
+	if (conn->plan[IO_OUT].status == IO_POLLING_NOTSTARTED
+	    || conn->plan[IO_OUT].status == IO_POLLING_STARTED)
+		events |= EPOLLOUT;
+
+	set_events(&infos[conn->fd.backend_info], events);
+	update_waiting(conn, IO_IN);
+	update_waiting(conn, IO_OUT);
+}
+
+void backend_wake(const void *wait)
+{
+	struct io_waiter *w;
+
+	while ((w = waiter_map_get(&waiters, wait)) != NULL) {
+		struct io_conn *conn = w->conn;
+		enum io_direction dir = w->dir;
+
+		/* io_do_wakeup() doesn't tell us the plan changed. */
+		stop_waiting(&infos[conn->fd.backend_info], dir);
+		io_do_wakeup(conn, dir);
+	}
+}
+
+static void destroy_conn(struct io_conn *conn, bool close_fd)
+{
+	int saved_errno = errno;
+
+	del_fd(&conn->fd);
+	if (close_fd)
+		close(conn->fd.fd);
+	/* In case it's on always list, remove it. */
+	list_del_init(&conn->always);
+
+	/* errno saved/restored by tal_free itself. */
+	if (conn->finish) {
+		errno = saved_errno;
+		conn->finish(conn, conn->finish_arg);
+	}
+}
+
+static void destroy_conn_close_fd(struct io_conn *conn)
+{
+	destroy_conn(conn, true);
+}
+
+bool add_conn(struct io_conn *c)
+{
+	if (!add_fd(&c->fd, 0))
+		return false;
+	tal_add_destructor(c, destroy_conn_close_fd);
+	return true;
+}
+
+void cleanup_conn_without_close(struct io_conn *conn)
+{
+	tal_del_destructor(conn, destroy_conn_close_fd);
+	destroy_conn(conn, false);
+}
+
+static void accept_conn(struct io_listener *l)
+{
+	int fd = accept(l->fd.fd, NULL, NULL);
+
+	/* FIXME: What to do here? */
+	if (fd < 0)
+		return;
+
+	io_new_conn(l->ctx, fd, l->init, l->arg);
+}
+
+static bool handle_always(void)
+{
+	bool ret = false;
+	struct io_conn *conn;
+
+	while ((conn = list_pop(&always, struct io_conn, always)) != NULL) {
+		assert(conn->plan[IO_IN].status == IO_ALWAYS
+		       || conn->plan[IO_OUT].status == IO_ALWAYS);
+
+		/* Re-initialize, for next time. */
+		list_node_init(&conn->always);
+		io_do_always(conn);
+		ret = true;
+	}
+	return ret;
+}
+
+static void make_room(size_t num)
+{
+	if (!ready)
+		ready = tal_arr(NULL, struct epoll_event, num);
+	else if (tal_count(ready) < num)
+		tal_resize(&ready, num);
+}
+
+/* Fds epoll can't tell us about are handled as if poll() said they were
+ * ready: the read or write itself will say if they weren't.  We put
+ * them in ready[], rather than walking infos[], since callbacks can
+ * free fds and so move other entries in infos[]. */
+static void add_unwatched(bool all)
+{
+	size_t i;
+
+	make_room(num_ready + num_fds);
+	for (i = 0; i < num_fds; i++) {
+		if (!infos[i].events)
+			continue;
+		if (!all && !infos[i].unpollable)
+			continue;
+		ready[num_ready].events = EPOLLIN|EPOLLOUT;
+		ready[num_ready].data.ptr = infos[i].fd;
+		num_ready++;
+	}
+}
+
+/* Handle them in the same order poll.c would. */
+static int cmp_ready(const void *a, const void *b)
+{
+	const struct fd *fa = ((const struct epoll_event *)a)->data.ptr;
+	const struct fd *fb = ((const struct epoll_event *)b)->data.ptr;
+
+	if (fa->backend_info < fb->backend_info)
+		return -1;
+	return fa->backend_info > fb->backend_info;
+}
+
+static void handle_events(struct fd *fd, uint32_t events)
+{
+	int pollflags = 0;
+	uint32_t wanted = infos[fd->backend_info].events;
+
+	/* An earlier callback may have changed what this wants. */
+	if (!wanted)
+		return;
+	events &= wanted | EPOLLHUP | EPOLLERR;
+
+	if (events & EPOLLIN)
+		pollflags |= POLLIN;
+	if (events & EPOLLOUT)
+		pollflags |= POLLOUT;
+
+	if (fd->listener) {
+		struct io_listener *l = (void *)fd;
+		if (pollflags & POLLIN)
+			accept_conn(l);
+		else if (events & (EPOLLHUP|EPOLLERR)) {
+			errno = EBADF;
+			io_close_listener(l);
+		}
+	} else if (pollflags) {
+		io_ready((struct io_conn *)fd, pollflags);
+	} else if (events & (EPOLLHUP|EPOLLERR)) {
+		errno = EBADF;
+		io_close((struct io_conn *)fd);
+	}
+}
+
+/* This is the main loop. */
+void *io_loop(struct timers *timers, struct timer **expired)
+{
+	void *ret;
+
+	/* if timers is NULL, expired must be.  If not, not. */
+	assert(!timers == !expired);
+
+	/* Make sure this is NULL if we exit for some other reason. */
+	if (expired)
+		*expired = NULL;
+
+	while (!io_loop_return) {
+		int r, ms_timeout = -1;
+		bool guess = false;
+		size_t i;
+
+		if (handle_always()) {
+			/* Could have started/finished more. */
+			continue;
+		}
+
+		/* Everything closed? */
+		if (num_fds == 0)
+			break;
+
+		check_fork();
+
+		/* You can't tell them all to go to sleep! */
+		assert(num_waiting);
+
+		if (timers) {
+			struct timemono now, first;
+
+			now = nowfn();
+
+			/* Call functions for expired timers. */
+			*expired = timers_expire(timers, now);
+			if (*expired)
+				break;
+
+			/* Now figure out how long to wait for the next one. */
+			if (timer_earliest(timers, &first)) {
+				uint64_t next;
+				next = time_to_msec(timemono_between(first, now));
+				if (next < INT_MAX)
+					ms_timeout = next;
+				else
+					ms_timeout = INT_MAX;
+			}
+		}
+
+		/* Those we can't watch are always ready, so don't sleep. */
+		if (num_unpollable)
+			ms_timeout = 0;
+
+		make_room(MAX_READY);
+
+		/* If they've overridden poll, they still get to do the
+		 * sleeping: on the epoll fd, which is readable when any of
+		 * ours are ready.  If it says something is ready but epoll
+		 * doesn't agree (eg. it's faking it), we don't know which, so
+		 * we try them all, as poll() would have. */
+		if (pollfn != poll) {
+			struct pollfd pfd;
+
+			pfd.fd = epfd;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			r = pollfn(&pfd, 1, ms_timeout);
+			if (r > 0) {
+				r = epoll_wait(epfd, ready, MAX_READY, 0);
+				guess = (r == 0);
+			}
+		} else
+			r = epoll_wait(epfd, ready, MAX_READY, ms_timeout);
+
+		if (r < 0) {
+			/* Signals shouldn't break us, unless they set
+			 * io_loop_return. */
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		num_ready = r;
+		if (guess || num_unpollable)
+			add_unwatched(guess);
+		qsort(ready, num_ready, sizeof(ready[0]), cmp_ready);
+		for (i = 0; i < num_ready && !io_loop_return; i++) {
+			/* NULL if it was freed by an earlier callback. */
+			if (ready[i].data.ptr)
+				handle_events(ready[i].data.ptr,
+					      ready[i].events);
+		}
+		num_ready = 0;
+		if (!num_fds)
+			ready = tal_free(ready);
+	}
+
+	ret = io_loop_return;
+	io_loop_return = NULL;
+
+	return ret;
+}
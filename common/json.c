@@ -216,3 +216,96 @@ again:
 
 	return toks;
 }
+
+struct json_parser *json_parser_new(const tal_t *ctx)
+{
+	struct json_parser *p = tal(ctx, struct json_parser);
+
+	jsmn_init(&p->jsmn);
+	p->toks = tal_arr(p, jsmntok_t, 10);
+	p->next = 0;
+	return p;
+}
+
+/* Is the element starting at toks[p->next] complete? */
+static bool next_complete(const struct json_parser *p)
+{
+	return p->next < p->jsmn.toknext && p->toks[p->next].end != -1;
+}
+
+const jsmntok_t *json_parser_next(struct json_parser *p,
+				  const char *input, size_t len, bool *valid)
+{
+	const jsmntok_t *tok;
+	size_t end;
+	int ret;
+
+	*valid = true;
+
+	/* jsmn picks up where it left off, at p->jsmn.pos */
+	while (!next_complete(p) && p->jsmn.pos < len) {
+		ret = jsmn_parse(&p->jsmn, input, len,
+				 p->toks, tal_count(p->toks) - 1);
+		if (ret == JSMN_ERROR_INVAL) {
+			*valid = false;
+			return NULL;
+		}
+		if (ret != JSMN_ERROR_NOMEM)
+			break;
+		tal_resize(&p->toks, tal_count(p->toks) * 2);
+	}
+
+	if (!next_complete(p))
+		return NULL;
+
+	tok = p->toks + p->next;
+	end = json_next(tok) - p->toks;
+
+	/* Make sure the one after is always referenceable (we always keep
+	 * one spare, above). */
+	if (end == p->jsmn.toknext) {
+		p->toks[end].type = -1;
+		p->toks[end].start = p->toks[end].end = p->toks[end].size = 0;
+	}
+	p->next = end;
+	return tok;
+}
+
+size_t json_parser_discard(struct json_parser *p)
+{
+	size_t used;
+
+	/* Nothing returned yet? */
+	if (p->next == 0)
+		return 0;
+
+	/* Anything before pos is done with (a partial string or primitive
+	 * restarts from its beginning). */
+	if (p->next == p->jsmn.toknext) {
+		used = p->jsmn.pos;
+		jsmn_init(&p->jsmn);
+		p->next = 0;
+		return used;
+	}
+
+	/* Otherwise everything before the next element is done with: slide
+	 * its (possibly partial) tokens down, so a client which always has
+	 * another request on the way doesn't grow our buffers forever. */
+	used = p->toks[p->next].start;
+	for (size_t i = p->next; i < p->jsmn.toknext; i++) {
+		jsmntok_t *tok = &p->toks[i - p->next];
+
+		*tok = p->toks[i];
+		tok->start -= used;
+		if (tok->end != -1)
+			tok->end -= used;
+		if (tok->parent != -1)
+			tok->parent -= p->next;
+	}
+	p->jsmn.pos -= used;
+	p->jsmn.toknext -= p->next;
+	if (p->jsmn.toksuper != -1)
+		p->jsmn.toksuper -= p->next;
+	p->next = 0;
+	return used;
+}
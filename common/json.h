@@ -57,4 +57,39 @@ const jsmntok_t *json_get_arr(const jsmntok_t tok[], size_t index);
 /* If input is complete and valid, return tokens. */
 jsmntok_t *json_parse_input(const char *input, int len, bool *valid);
 
+/* For parsing a stream of JSON elements as it arrives, without rescanning
+ * what we've already seen. */
+struct json_parser {
+	jsmn_parser jsmn;
+	/* Tokens for everything parsed so far. */
+	jsmntok_t *toks;
+	/* Where the next element not yet returned starts. */
+	size_t next;
+};
+
+struct json_parser *json_parser_new(const tal_t *ctx);
+
+/**
+ * json_parser_next - parse some more, and return the next complete element.
+ * @p: the parser.
+ * @input: the buffer, of which only the end can have changed since last time.
+ * @len: the length of @input.
+ * @valid: set to false if input is invalid.
+ *
+ * Returns the tokens for the next element (valid until the next call), or
+ * NULL if there's no complete one yet, or input is invalid.
+ */
+const jsmntok_t *json_parser_next(struct json_parser *p,
+				  const char *input, size_t len, bool *valid);
+
+/**
+ * json_parser_discard - how much of the input is no longer needed?
+ * @p: the parser.
+ *
+ * Forgets every element already returned by json_parser_next(): returns
+ * the number of bytes which must now be removed from the front of input
+ * (often 0).  Any partial element which follows is kept.
+ */
+size_t json_parser_discard(struct json_parser *p);
+
 #endif /* LIGHTNING_COMMON_JSON_H */
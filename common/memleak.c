@@ -87,8 +87,12 @@ static void children_into_htable(const void *exclude1, const void *exclude2,
 			    || strends(name, "struct linkable"))
 				continue;
 
-			/* ccan/io allocates pollfd array. */
-			if (strends(name, "struct pollfd[]") && !tal_parent(i))
+			/* ccan/io allocates pollfd array (or, with
+			 * common/io_epoll.c, these). */
+			if ((strends(name, "struct pollfd[]")
+			     || strends(name, "struct epoll_info[]")
+			     || strends(name, "struct epoll_event[]"))
+			    && !tal_parent(i))
 				continue;
 
 			/* Don't add tmpctx. */
@@ -50,6 +50,11 @@ const u8 *msg_dequeue(struct msg_queue *q)
 	return msg;
 }
 
+size_t msg_queue_length(const struct msg_queue *q)
+{
+	return tal_count(q->q);
+}
+
 int msg_extract_fd(const u8 *msg)
 {
 	const u8 *p = msg + sizeof(u16);
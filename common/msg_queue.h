@@ -24,6 +24,9 @@ void msg_wake(const struct msg_queue *q);
 /* Returns NULL if nothing to do. */
 const u8 *msg_dequeue(struct msg_queue *q);
 
+/* How many messages (and fds) are waiting to be sent? */
+size_t msg_queue_length(const struct msg_queue *q);
+
 /* Returns -1 if not an fd: close after sending. */
 int msg_extract_fd(const u8 *msg);
 
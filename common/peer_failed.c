@@ -46,6 +46,8 @@ void peer_failed_received_errmsg(int peer_fd, int gossip_fd,
 
 	if (!channel_id)
 		channel_id = &all_channels;
+	/* Master takes over the connection, so it must be up-to-date. */
+	sync_crypto_flush(peer_fd);
 	msg = towire_status_peer_error(NULL, channel_id, desc, cs, NULL);
 	peer_billboard(true, "Received error from peer: %s", desc);
 	status_send_fatal(take(msg), peer_fd, gossip_fd);
@@ -19,6 +19,9 @@ u8 *peer_or_gossip_sync_read(const tal_t *ctx,
 	fd_set readfds;
 	u8 *msg;
 
+	/* Don't sit on anything we've queued while we wait. */
+	sync_crypto_flush(peer_fd);
+
 	FD_ZERO(&readfds);
 	FD_SET(peer_fd, &readfds);
 	FD_SET(gossip_fd, &readfds);
@@ -80,25 +83,47 @@ bool is_wrong_channel(const u8 *msg, const struct channel_id *expected,
 	return !channel_id_eq(expected, actual);
 }
 
-void handle_gossip_msg(int peer_fd, struct crypto_state *cs, const u8 *msg TAKES)
+static void send_gossip(int peer_fd, struct crypto_state *cs,
+			const u8 *gossip)
 {
-	u8 *gossip;
-
-	if (!fromwire_gossip_send_gossip(tmpctx, msg, &gossip)) {
-		status_broken("Got bad message from gossipd: %s",
-			      tal_hex(msg, msg));
-		peer_failed_connection_lost();
-	}
-
 	/* Gossipd can send us gossip messages, OR errors */
 	if (is_msg_for_gossipd(gossip)) {
-		sync_crypto_write(cs, peer_fd, gossip);
+		sync_crypto_queue(cs, peer_fd, gossip);
 	} else if (fromwire_peektype(gossip) == WIRE_ERROR) {
 		status_debug("Gossipd told us to send error");
 		sync_crypto_write(cs, peer_fd, gossip);
 		peer_failed_connection_lost();
 	} else {
 		status_broken("Gossipd gave us bad send_gossip message %s",
+			      tal_hex(tmpctx, gossip));
+		peer_failed_connection_lost();
+	}
+}
+
+void handle_gossip_msg(int peer_fd, struct crypto_state *cs, const u8 *msg TAKES)
+{
+	u8 *gossip;
+
+	if (fromwire_gossip_send_gossip(tmpctx, msg, &gossip)) {
+		send_gossip(peer_fd, cs, gossip);
+	} else if (fromwire_gossip_send_gossip_batch(tmpctx, msg, &gossip)) {
+		const u8 *cursor = gossip;
+		size_t max = tal_count(gossip);
+
+		while (max) {
+			u16 len = fromwire_u16(&cursor, &max);
+			u8 *one = tal_arr(tmpctx, u8, len);
+
+			fromwire_u8_array(&cursor, &max, one, len);
+			if (!cursor) {
+				status_broken("Gossipd gave us bad batch %s",
+					      tal_hex(tmpctx, gossip));
+				peer_failed_connection_lost();
+			}
+			send_gossip(peer_fd, cs, one);
+		}
+	} else {
+		status_broken("Got bad message from gossipd: %s",
 			      tal_hex(msg, msg));
 		peer_failed_connection_lost();
 	}
@@ -0,0 +1,84 @@
+/* Cost of each io_loop wakeup when only one of many fds is ready: make
+ * common/test/io_epoll/bench-wakeup-poll and bench-wakeup-epoll, and
+ * compare. */
+#include <assert.h>
+#include <ccan/err/err.h>
+#include <ccan/io/io.h>
+#include <ccan/tal/tal.h>
+#include <ccan/time/time.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int *fds;
+static size_t num_fds, wakeups, max_wakeups;
+
+/* Make a random conn readable by writing to the other end of its pair. */
+static void poke_random(void)
+{
+	size_t i = random() % num_fds;
+
+	if (write(fds[i ^ 1], "", 1) != 1)
+		err(1, "write");
+}
+
+static struct io_plan *read_one(struct io_conn *conn, char *c);
+
+static struct io_plan *woken(struct io_conn *conn, char *c)
+{
+	if (++wakeups == max_wakeups)
+		io_break(&wakeups);
+	else
+		poke_random();
+	return read_one(conn, c);
+}
+
+static struct io_plan *read_one(struct io_conn *conn, char *c)
+{
+	return io_read(conn, c, 1, woken, c);
+}
+
+int main(int argc, char *argv[])
+{
+	struct rlimit rl;
+	struct timemono start;
+	struct timerel elapsed;
+	char *bufs;
+	const tal_t *ctx = tal(NULL, char);
+
+	num_fds = argc > 1 ? atoi(argv[1]) : 10000;
+	max_wakeups = argc > 2 ? atoi(argv[2]) : 10000;
+	/* They come in pairs. */
+	num_fds &= ~(size_t)1;
+	if (num_fds == 0 || max_wakeups == 0 || argc > 3)
+		errx(1, "Usage: %s [num_fds [wakeups]]", argv[0]);
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	fds = tal_arr(ctx, int, num_fds);
+	bufs = tal_arr(ctx, char, num_fds);
+	for (size_t i = 0; i < num_fds; i += 2) {
+		if (socketpair(AF_LOCAL, SOCK_STREAM, 0, fds + i) != 0)
+			err(1, "socketpair %zu", i);
+		io_new_conn(ctx, fds[i], read_one, bufs + i);
+		io_new_conn(ctx, fds[i+1], read_one, bufs + i + 1);
+	}
+
+	start = time_mono();
+	poke_random();
+	io_loop(NULL, NULL);
+	elapsed = timemono_since(start);
+	assert(wakeups == max_wakeups);
+
+	printf("%zu fds: %zu wakeups in %"PRIu64" usec (%.2f usec each)\n",
+	       num_fds, wakeups, time_to_usec(elapsed),
+	       (double)time_to_usec(elapsed) / wakeups);
+	tal_free(ctx);
+	return 0;
+}
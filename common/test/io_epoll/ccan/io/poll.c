@@ -0,0 +1,2 @@
+/* The ccan/io tests include this directly: give them io_epoll.c instead. */
+#include "../../../../io_epoll.c"
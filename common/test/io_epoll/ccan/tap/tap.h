@@ -0,0 +1,23 @@
+#ifndef LIGHTNING_COMMON_TEST_IO_EPOLL_CCAN_TAP_TAP_H
+#define LIGHTNING_COMMON_TEST_IO_EPOLL_CCAN_TAP_TAP_H
+/* We don't ship ccan/tap: this is just enough of it for the ccan/io tests. */
+#include <stdio.h>
+
+static unsigned int tap_planned, tap_run, tap_failed;
+
+#define plan_tests(n) (tap_planned = (n), printf("1..%u\n", tap_planned))
+
+#define ok(e, ...)							\
+	((e) ? (printf("ok %u\n", ++tap_run), 1)			\
+	 : (tap_failed++,						\
+	    fprintf(stderr, "not ok %u - %s:%u: %s\n",			\
+		    ++tap_run, __FILE__, __LINE__, #e), 0))
+#define ok1(e) ok((e), #e)
+#define pass(...) ok(1, __VA_ARGS__)
+
+#define exit_status()							\
+	(tap_run != tap_planned						\
+	 ? (fprintf(stderr, "planned %u tests but ran %u\n",		\
+		    tap_planned, tap_run), 1)				\
+	 : tap_failed != 0)
+#endif /* LIGHTNING_COMMON_TEST_IO_EPOLL_CCAN_TAP_TAP_H */
@@ -0,0 +1,133 @@
+#include "../../io_epoll.c"
+#include <ccan/io/io.h>
+/* Include the C files directly. */
+#include <ccan/io/io.c>
+#include <ccan/tap/tap.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static struct io_conn *victim;
+static int wake_a, wake_b;
+
+static struct io_plan *read_all(struct io_conn *conn, char *buf)
+{
+	return io_read(conn, buf, 5, io_close_cb, NULL);
+}
+
+/* Handled in order, so the first frees the second. */
+static struct io_plan *kill_victim(struct io_conn *conn, char *buf)
+{
+	ok1(conn != victim);
+	tal_free(victim);
+	return io_close(conn);
+}
+
+static struct io_plan *read_then_kill(struct io_conn *conn, char *buf)
+{
+	return io_read(conn, buf, 1, kill_victim, buf);
+}
+
+static struct io_plan *woken(struct io_conn *conn, int *count)
+{
+	(*count)++;
+	return io_close(conn);
+}
+
+static struct io_plan *wait_on(struct io_conn *conn, int *count)
+{
+	return io_wait(conn, count, woken, count);
+}
+
+/* Unpollable ones are handled in a batch, too. */
+static struct io_plan *read_all_then_kill(struct io_conn *conn, char *buf)
+{
+	return io_read(conn, buf, 5, kill_victim, buf);
+}
+
+static int tmpfile_with(const char *contents)
+{
+	char filename[] = "run-epoll-XXXXXX";
+	int fd = mkstemp(filename);
+
+	if (fd < 0)
+		abort();
+	unlink(filename);
+	if (write(fd, contents, strlen(contents)) != strlen(contents)
+	    || lseek(fd, 0, SEEK_SET) != 0)
+		abort();
+	return fd;
+}
+
+int main(void)
+{
+	int fds[2], fds2[2], fd, status;
+	char buf[6], buf2[6];
+	char buf3[6];
+	struct io_conn *a;
+
+	plan_tests(23);
+
+	/* epoll refuses regular files: they're always ready, like poll. */
+	fd = tmpfile_with("hello");
+	memset(buf, 0, sizeof(buf));
+	io_new_conn(NULL, fd, read_all, buf);
+	ok1(io_loop(NULL, NULL) == NULL);
+	ok1(strcmp(buf, "hello") == 0);
+	ok1(num_unpollable == 0);
+
+	/* A child which changes what it's watching mustn't change ours. */
+	ok1(pipe(fds) == 0);
+	memset(buf, 0, sizeof(buf));
+	a = io_new_conn(NULL, fds[0], read_all, buf);
+	fflush(stdout);
+	if (!fork()) {
+		tal_free(a);
+		if (write(fds[1], "hello", 5) != 5)
+			exit(1);
+		exit(0);
+	}
+	ok1(io_loop(NULL, NULL) == NULL);
+	ok1(strcmp(buf, "hello") == 0);
+	ok1(wait(&status) && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	close(fds[1]);
+
+	/* Freeing a conn with events already pending in this batch. */
+	ok1(pipe(fds) == 0 && pipe(fds2) == 0);
+	io_new_conn(NULL, fds[0], read_then_kill, buf);
+	victim = io_new_conn(NULL, fds2[0], read_then_kill, buf2);
+	/* Both readable, so both in the first batch. */
+	if (write(fds[1], "a", 1) != 1 || write(fds2[1], "b", 1) != 1)
+		abort();
+	ok1(io_loop(NULL, NULL) == NULL);
+	close(fds[1]);
+	close(fds2[1]);
+
+	/* The first unpollable one frees the second, and the third moves
+	 * into its slot: it must still be handled, and only once. */
+	memset(buf, 0, sizeof(buf));
+	memset(buf3, 0, sizeof(buf3));
+	io_new_conn(NULL, tmpfile_with("hello"), read_all_then_kill, buf);
+	victim = io_new_conn(NULL, tmpfile_with("world"), read_all, buf2);
+	io_new_conn(NULL, tmpfile_with("again"), read_all, buf3);
+	ok1(num_unpollable == 3);
+	ok1(io_loop(NULL, NULL) == NULL);
+	ok1(strcmp(buf, "hello") == 0);
+	ok1(strcmp(buf3, "again") == 0);
+
+	/* io_wake only wakes those waiting on that pointer. */
+	for (int i = 0; i < 4; i++) {
+		ok(pipe(fds) == 0, "pipe %i", i);
+		io_new_conn(NULL, fds[0], wait_on, i < 3 ? &wake_a : &wake_b);
+		close(fds[1]);
+	}
+	ok1(waiters.raw.elems == 4);
+	io_wake(&wake_a);
+	ok1(waiters.raw.elems == 1);
+	io_wake(&wake_b);
+	ok1(io_loop(NULL, NULL) == NULL);
+	ok1(wake_a == 3 && wake_b == 1);
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
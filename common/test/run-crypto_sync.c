@@ -0,0 +1,124 @@
+#include "../crypto_sync.c"
+#include "../cryptomsg.c"
+#include <assert.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for dev_blackhole_fd */
+void dev_blackhole_fd(int fd UNNEEDED)
+{ fprintf(stderr, "dev_blackhole_fd called!\n"); abort(); }
+/* Generated stub for dev_sabotage_fd */
+void dev_sabotage_fd(int fd UNNEEDED)
+{ fprintf(stderr, "dev_sabotage_fd called!\n"); abort(); }
+/* Generated stub for peer_failed_connection_lost */
+void peer_failed_connection_lost(void)
+{ fprintf(stderr, "peer_failed_connection_lost called!\n"); abort(); }
+/* Generated stub for status_fmt */
+void status_fmt(enum log_level level UNNEEDED, const char *fmt UNNEEDED, ...)
+
+{ fprintf(stderr, "status_fmt called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+int fromwire_peektype(const u8 *cursor)
+{
+	return (cursor[0] << 8) | cursor[1];
+}
+
+enum dev_disconnect dev_disconnect(int pkt_type UNUSED)
+{
+	return DEV_DISCONNECT_NORMAL;
+}
+
+void status_peer_io(enum log_level iodir UNUSED, const u8 *p UNUSED)
+{
+}
+
+/* How many bytes has the other end written to us? */
+static size_t readable(int fd)
+{
+	int n;
+
+	if (ioctl(fd, FIONREAD, &n) != 0)
+		abort();
+	return n;
+}
+
+static u8 *numbered_msg(const tal_t *ctx, u16 num, size_t len)
+{
+	u8 *msg = tal_arrz(ctx, u8, len);
+
+	/* A valid message type (odd), then something to check. */
+	msg[0] = 0xFF;
+	msg[1] = 0xFF;
+	msg[2] = num >> 8;
+	msg[3] = num;
+	return msg;
+}
+
+int main(void)
+{
+	setup_locale();
+	setup_tmpctx();
+
+	struct crypto_state cs_out, cs_in;
+	int fds[2];
+	size_t num;
+	u8 *msg;
+
+	memset(&cs_out, 0, sizeof(cs_out));
+	memset(&cs_out.sk, 1, sizeof(cs_out.sk));
+	memset(&cs_out.rk, 2, sizeof(cs_out.rk));
+	memset(&cs_out.s_ck, 3, sizeof(cs_out.s_ck));
+	cs_out.r_ck = cs_out.s_ck;
+	cs_in = cs_out;
+	cs_in.sk = cs_out.rk;
+	cs_in.rk = cs_out.sk;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		abort();
+
+	/* Queued messages stay here until flushed... */
+	for (size_t i = 0; i < 10; i++)
+		sync_crypto_queue(&cs_out, fds[0],
+				  take(numbered_msg(NULL, i, 100)));
+	assert(readable(fds[1]) == 0);
+	sync_crypto_flush(fds[0]);
+	assert(outq_len == 0);
+	assert(readable(fds[1]) == 10 * (100 + 34));
+
+	/* ... or until an immediate write, which goes out after them. */
+	sync_crypto_queue(&cs_out, fds[0], take(numbered_msg(NULL, 10, 100)));
+	assert(readable(fds[1]) == 10 * (100 + 34));
+	sync_crypto_write(&cs_out, fds[0], take(numbered_msg(NULL, 11, 100)));
+	assert(outq_len == 0);
+	assert(readable(fds[1]) == 12 * (100 + 34));
+
+	/* ... or until there's too much to sit on. */
+	num = 12;
+	do {
+		/* Don't fill the socket buffer before we read. */
+		assert(num < 100);
+		sync_crypto_queue(&cs_out, fds[0],
+				  take(numbered_msg(NULL, num++, 5000)));
+	} while (outq_len != 0);
+	assert(readable(fds[1]) == 12 * (100 + 34) + (num - 12) * (5000 + 34));
+
+	for (size_t i = 0; i < 12; i++) {
+		msg = sync_crypto_read(tmpctx, &cs_in, fds[1]);
+		assert(tal_count(msg) == 100);
+		assert(memeq(msg, 100, numbered_msg(tmpctx, i, 100), 100));
+	}
+	for (size_t i = 12; i < num; i++) {
+		msg = sync_crypto_read(tmpctx, &cs_in, fds[1]);
+		assert(memeq(msg, tal_count(msg),
+			     numbered_msg(tmpctx, i, 5000), 5000));
+	}
+
+	close(fds[0]);
+	close(fds[1]);
+	tal_free(outq);
+	tal_free(tmpctx);
+	return 0;
+}
@@ -0,0 +1,189 @@
+#include "../threadpool.c"
+#include <bitcoin/privkey.h>
+#include <bitcoin/shadouble.h>
+#include <bitcoin/signature.h>
+#include <ccan/mem/mem.h>
+#include <ccan/time/time.h>
+#include <common/utils.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for status_failed */
+void status_failed(enum status_failreason code UNNEEDED,
+		   const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "status_failed called!\n"); abort(); }
+/* Generated stub for status_fmt */
+void status_fmt(enum log_level level UNNEEDED, const char *fmt UNNEEDED, ...)
+
+{ fprintf(stderr, "status_fmt called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+/* Like hsmd's sign_job: some hashes, keys, and somewhere to put sigs. */
+struct sigs {
+	struct sha256_double *hashes;
+	struct privkey *privkeys;
+	secp256k1_ecdsa_signature *sigs;
+};
+
+static struct sigs *new_sigs(const tal_t *ctx, size_t n, u64 seed)
+{
+	struct sigs *s = tal(ctx, struct sigs);
+
+	s->hashes = tal_arr(s, struct sha256_double, n);
+	s->privkeys = tal_arr(s, struct privkey, n);
+	s->sigs = tal_arrz(s, secp256k1_ecdsa_signature, n);
+	for (size_t i = 0; i < n; i++) {
+		u64 v = seed * 1000003 + i;
+		sha256_double(&s->hashes[i], &v, sizeof(v));
+		memset(&s->privkeys[i], 1 + (seed % 100), sizeof(s->privkeys[i]));
+	}
+	return s;
+}
+
+static void sign_one(struct sigs *s, size_t i)
+{
+	sign_hash(&s->privkeys[i], &s->hashes[i], &s->sigs[i]);
+}
+
+static void check_sigs(const struct sigs *s)
+{
+	for (size_t i = 0; i < tal_count(s->sigs); i++) {
+		secp256k1_ecdsa_signature sig;
+
+		sign_hash(&s->privkeys[i], &s->hashes[i], &sig);
+		assert(memeq(&sig, sizeof(sig), &s->sigs[i], sizeof(s->sigs[i])));
+	}
+}
+
+static size_t num_done;
+
+static void count_done(struct sigs *s)
+{
+	check_sigs(s);
+	if (++num_done == 10)
+		io_break(&num_done);
+}
+
+static void test_run(struct threadpool *pool)
+{
+	struct sigs *s;
+
+	threadpool_run(pool, 0, sign_one, (struct sigs *)NULL);
+
+	s = new_sigs(tmpctx, 100, 1);
+	threadpool_run(pool, tal_count(s->sigs), sign_one, s);
+	check_sigs(s);
+}
+
+static void test_start(struct threadpool *pool)
+{
+	num_done = 0;
+	for (size_t i = 0; i < 10; i++) {
+		struct sigs *s = new_sigs(tmpctx, i * 10, i);
+		threadpool_start(pool, tal_count(s->sigs), sign_one, count_done, s);
+		/* Never called synchronously. */
+		assert(num_done == 0);
+	}
+	io_loop(NULL, NULL);
+	assert(num_done == 10);
+}
+
+/* Each simulated channeld asks for a commitment (and its HTLCs) to be
+ * signed, and only asks for the next once it has the reply. */
+struct client {
+	struct threadpool *pool;
+	struct sigs *sigs;
+	size_t remaining;
+	size_t *clients_left;
+};
+
+static void client_next(struct client *c);
+
+static void client_reply(struct client *c)
+{
+	if (--c->remaining == 0) {
+		if (--*c->clients_left == 0)
+			io_break(c);
+		return;
+	}
+	client_next(c);
+}
+
+static void client_sign_one(struct client *c, size_t i)
+{
+	sign_one(c->sigs, i);
+}
+
+static void client_next(struct client *c)
+{
+	threadpool_start(c->pool, tal_count(c->sigs->sigs), client_sign_one,
+			 client_reply, c);
+}
+
+static void bench_clients(size_t nthreads, size_t num_clients,
+			  size_t num_commits, size_t num_htlcs)
+{
+	struct threadpool *pool = threadpool_new(tmpctx, nthreads);
+	struct client *clients = tal_arr(tmpctx, struct client, num_clients);
+	size_t clients_left = num_clients;
+	struct timemono start;
+	u64 usec;
+
+	for (size_t i = 0; i < num_clients; i++) {
+		clients[i].pool = pool;
+		clients[i].sigs = new_sigs(clients, 1 + num_htlcs, i);
+		clients[i].remaining = num_commits;
+		clients[i].clients_left = &clients_left;
+	}
+
+	start = time_mono();
+	for (size_t i = 0; i < num_clients; i++)
+		client_next(&clients[i]);
+	io_loop(NULL, NULL);
+	usec = time_to_usec(timemono_between(time_mono(), start));
+
+	for (size_t i = 0; i < num_clients; i++)
+		check_sigs(clients[i].sigs);
+
+	printf("%zu threads, %zu clients, %zu commitments of %zu htlcs:"
+	       " %"PRIu64" usec (%"PRIu64" sigs/sec)\n",
+	       nthreads, num_clients, num_commits, num_htlcs, usec,
+	       (u64)num_clients * num_commits * (1 + num_htlcs) * 1000000
+	       / (usec ? usec : 1));
+	tal_free(pool);
+}
+
+int main(int argc, char *argv[])
+{
+	setup_locale();
+	setup_tmpctx();
+	secp256k1_ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY
+						 | SECP256K1_CONTEXT_SIGN);
+
+	size_t num_clients = 20, num_commits = 10, num_htlcs = 30;
+	size_t nthreads = threadpool_default_threads();
+
+	if (argc > 1)
+		num_clients = atoi(argv[1]);
+	if (argc > 2)
+		num_commits = atoi(argv[2]);
+	if (argc > 3)
+		num_htlcs = atoi(argv[3]);
+	if (argc > 4)
+		nthreads = atoi(argv[4]);
+
+	for (size_t i = 0; i < 4; i++) {
+		struct threadpool *pool = threadpool_new(tmpctx, i);
+		test_run(pool);
+		test_start(pool);
+		tal_free(pool);
+	}
+
+	bench_clients(0, num_clients, num_commits, num_htlcs);
+	bench_clients(nthreads, num_clients, num_commits, num_htlcs);
+
+	secp256k1_context_destroy(secp256k1_ctx);
+	tal_free(tmpctx);
+	return 0;
+}
@@ -0,0 +1,232 @@
+#include <assert.h>
+#include <ccan/io/io.h>
+#include <ccan/list/list.h>
+#include <common/status.h>
+#include <common/threadpool.h>
+#include <common/utils.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+struct batch {
+	/* In threadpool->pending until all started, then (if done is set)
+	 * in threadpool->complete once all finished. */
+	struct list_node list;
+	void (*fn)(void *arg, size_t i);
+	void (*done)(void *arg);
+	void *arg;
+	size_t n;
+	/* How many have been started, and how many have finished. */
+	size_t started, finished;
+};
+
+struct threadpool {
+	/* Protects everything below (except threads and conn). */
+	pthread_mutex_t lock;
+	/* Signalled when there's new work, or we're shutting down. */
+	pthread_cond_t work;
+	/* Signalled when a threadpool_run batch finishes. */
+	pthread_cond_t finished;
+
+	struct list_head pending;
+	struct list_head complete;
+	bool shutdown;
+
+	pthread_t *threads;
+
+	/* For threadpool_start: a byte is written to fds[1] whenever a
+	 * batch is complete, to wake the io_loop. */
+	int fds[2];
+	struct io_conn *conn;
+	char buf[64];
+	size_t buflen;
+};
+
+/* Called with lock held: start the next job of b, and account for it. */
+static void run_one(struct threadpool *pool, struct batch *b)
+{
+	size_t i = b->started++;
+
+	if (b->started == b->n)
+		list_del_from(&pool->pending, &b->list);
+
+	pthread_mutex_unlock(&pool->lock);
+	b->fn(b->arg, i);
+	pthread_mutex_lock(&pool->lock);
+
+	if (++b->finished != b->n)
+		return;
+
+	if (b->done) {
+		list_add_tail(&pool->complete, &b->list);
+		/* Non-blocking: if the pipe is full, it's awake anyway. */
+		if (write(pool->fds[1], "", 1) != 1)
+			assert(errno == EAGAIN || errno == EWOULDBLOCK);
+	} else
+		pthread_cond_broadcast(&pool->finished);
+}
+
+static void *worker(struct threadpool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while (!pool->shutdown) {
+		struct batch *b = list_top(&pool->pending, struct batch, list);
+		if (b)
+			run_one(pool, b);
+		else
+			pthread_cond_wait(&pool->work, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+static void destroy_threadpool(struct threadpool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = true;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (size_t i = 0; i < tal_count(pool->threads); i++)
+		pthread_join(pool->threads[i], NULL);
+
+	/* pool->conn closes fds[0] itself. */
+	if (pool->conn)
+		close(pool->fds[1]);
+	pthread_cond_destroy(&pool->finished);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+}
+
+struct threadpool *threadpool_new(const tal_t *ctx, size_t nthreads)
+{
+	struct threadpool *pool = tal(ctx, struct threadpool);
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->finished, NULL);
+	list_head_init(&pool->pending);
+	list_head_init(&pool->complete);
+	pool->shutdown = false;
+	pool->conn = NULL;
+	pool->threads = tal_arr(pool, pthread_t, 0);
+	tal_add_destructor(pool, destroy_threadpool);
+
+	for (size_t i = 0; i < nthreads; i++) {
+		pthread_t thread;
+		int err = pthread_create(&thread, NULL,
+					 (void *(*)(void *))worker, pool);
+		if (err) {
+			/* We can still work, just slower. */
+			status_unusual("Could only create %zu of %zu threads:"
+				       " %s", i, nthreads, strerror(err));
+			break;
+		}
+		*tal_arr_expand(&pool->threads) = thread;
+	}
+	return pool;
+}
+
+size_t threadpool_default_threads(void)
+{
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (ncpus < 2)
+		return 0;
+	return ncpus - 1;
+}
+
+void threadpool_run_(struct threadpool *pool, size_t n,
+		     void (*fn)(void *arg, size_t i), void *arg)
+{
+	struct batch b;
+
+	if (n == 0)
+		return;
+
+	b.fn = fn;
+	b.done = NULL;
+	b.arg = arg;
+	b.n = n;
+	b.started = b.finished = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	list_add_tail(&pool->pending, &b.list);
+	pthread_cond_broadcast(&pool->work);
+
+	/* Help until they're all started, then wait for stragglers. */
+	while (b.started != b.n)
+		run_one(pool, &b);
+	while (b.finished != b.n)
+		pthread_cond_wait(&pool->finished, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static struct io_plan *read_complete(struct io_conn *conn,
+				     struct threadpool *pool);
+
+static struct io_plan *batches_complete(struct io_conn *conn,
+					struct threadpool *pool)
+{
+	struct batch *b;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		b = list_pop(&pool->complete, struct batch, list);
+		pthread_mutex_unlock(&pool->lock);
+		if (!b)
+			break;
+		b->done(b->arg);
+		tal_free(b);
+	}
+	return read_complete(conn, pool);
+}
+
+static struct io_plan *read_complete(struct io_conn *conn,
+				     struct threadpool *pool)
+{
+	return io_read_partial(conn, pool->buf, sizeof(pool->buf),
+			       &pool->buflen, batches_complete, pool);
+}
+
+void threadpool_start_(struct threadpool *pool, size_t n,
+		       void (*fn)(void *arg, size_t i),
+		       void (*done)(void *arg),
+		       void *arg)
+{
+	struct batch *b = tal(pool, struct batch);
+
+	/* First time, we set up our pipe to the io_loop. */
+	if (!pool->conn) {
+		if (pipe(pool->fds) != 0)
+			status_failed(STATUS_FAIL_INTERNAL_ERROR,
+				      "threadpool pipe: %s", strerror(errno));
+		fcntl(pool->fds[1], F_SETFL,
+		      fcntl(pool->fds[1], F_GETFL) | O_NONBLOCK);
+		pool->conn = io_new_conn(pool, pool->fds[0],
+					 read_complete, pool);
+	}
+
+	b->fn = fn;
+	b->done = done;
+	b->arg = arg;
+	b->n = n;
+	b->started = b->finished = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	if (n == 0) {
+		list_add_tail(&pool->complete, &b->list);
+		if (write(pool->fds[1], "", 1) != 1)
+			assert(errno == EAGAIN || errno == EWOULDBLOCK);
+	} else {
+		list_add_tail(&pool->pending, &b->list);
+		pthread_cond_broadcast(&pool->work);
+		/* Nobody else is going to do it! */
+		if (tal_count(pool->threads) == 0) {
+			while (b->started != b->n)
+				run_one(pool, b);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
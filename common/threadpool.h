@@ -0,0 +1,52 @@
+#ifndef LIGHTNING_COMMON_THREADPOOL_H
+#define LIGHTNING_COMMON_THREADPOOL_H
+#include "config.h"
+#include <ccan/tal/tal.h>
+#include <ccan/typesafe_cb/typesafe_cb.h>
+#include <stddef.h>
+
+/* A few worker threads for CPU-heavy work, like signing and verifying.
+ *
+ * Nothing else here is thread-safe (tal in particular!), so jobs must be
+ * pure computation: everything they need is set up beforehand, and job i
+ * only writes to its own output slot. */
+struct threadpool;
+
+/* nthreads may be 0, in which case jobs simply run in this thread. */
+struct threadpool *threadpool_new(const tal_t *ctx, size_t nthreads);
+
+/* One fewer than the number of CPUs: the caller is busy too. */
+size_t threadpool_default_threads(void);
+
+/**
+ * threadpool_run - call fn(arg, i) for every i < n, and wait for them all.
+ *
+ * The calling thread helps out, rather than just sitting there.
+ */
+#define threadpool_run(pool, n, fn, arg)				\
+	threadpool_run_((pool), (n),					\
+			typesafe_cb_postargs(void, void *, (fn), (arg),	\
+					     size_t),			\
+			(arg))
+void threadpool_run_(struct threadpool *pool, size_t n,
+		     void (*fn)(void *arg, size_t i), void *arg);
+
+/**
+ * threadpool_start - call fn(arg, i) for every i < n, in the background.
+ *
+ * Once they're all finished, done(arg) is called from the io_loop (never
+ * from inside this call, even if there are no threads).  Batches are
+ * started in order, but can finish in any order.
+ */
+#define threadpool_start(pool, n, fn, done, arg)			\
+	threadpool_start_((pool), (n),					\
+			  typesafe_cb_postargs(void, void *, (fn), (arg), \
+					       size_t),			\
+			  typesafe_cb(void, void *, (done), (arg)),	\
+			  (arg))
+void threadpool_start_(struct threadpool *pool, size_t n,
+		       void (*fn)(void *arg, size_t i),
+		       void (*done)(void *arg),
+		       void *arg);
+
+#endif /* LIGHTNING_COMMON_THREADPOOL_H */
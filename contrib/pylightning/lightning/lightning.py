@@ -108,13 +108,16 @@ class LightningRpc(UnixDomainSocketRpc):
         res = self.call("listpeers", payload)
         return res.get("peers") and res["peers"][0] or None
 
-    def listnodes(self, node_id=None):
+    def listnodes(self, node_id=None, since=None, changed_since=None):
         """
         Show all nodes in our local network view, filter on node {id}
-        if provided
+        if provided, and on those announced {since} a timestamp or
+        {changed_since} a previous call's broadcast_index
         """
         payload = {
-            "id": node_id
+            "id": node_id,
+            "since": since,
+            "changed_since": changed_since
         }
         return self.call("listnodes", payload)
 
@@ -137,12 +140,22 @@ class LightningRpc(UnixDomainSocketRpc):
         }
         return self.call("getroute", payload)
 
-    def listchannels(self, short_channel_id=None):
+    def listchannels(self, short_channel_id=None, source=None, since=None,
+                     active_only=None, changed_since=None, after=None,
+                     limit=None):
         """
-        Show all known channels, accept optional {short_channel_id}
+        Show all known channels, accept optional {short_channel_id}, and
+        filters on {source}, {since}, {active_only} and {changed_since}.
+        Show at most {limit} channels {after} a short_channel_id
         """
         payload = {
-            "short_channel_id": short_channel_id
+            "short_channel_id": short_channel_id,
+            "source": source,
+            "since": since,
+            "active_only": active_only,
+            "changed_since": changed_since,
+            "after": after,
+            "limit": limit
         }
         return self.call("listchannels", payload)
 
@@ -0,0 +1,161 @@
+/* Write a synthetic gossip_store, eg. for benchmarking initial sync. */
+#include <bitcoin/chainparams.h>
+#include <bitcoin/privkey.h>
+#include <bitcoin/short_channel_id.h>
+#include <ccan/crc/crc.h>
+#include <ccan/err/err.h>
+#include <ccan/opt/opt.h>
+#include <ccan/read_write_all/read_write_all.h>
+#include <ccan/time/time.h>
+#include <common/pseudorand.h>
+#include <common/utils.h>
+#include <fcntl.h>
+#include <gossipd/gen_gossip_store.h>
+#include <gossipd/gossip_store.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <wire/gen_peer_wire.h>
+
+static void write_record(int fd, const u8 *msg)
+{
+	beint32_t hdr[2];
+
+	hdr[0] = cpu_to_be32(tal_count(msg));
+	hdr[1] = cpu_to_be32(crc32c(0, msg, tal_count(msg)));
+	if (!write_all(fd, hdr, sizeof(hdr))
+	    || !write_all(fd, msg, tal_count(msg)))
+		err(1, "Writing gossip_store");
+}
+
+int main(int argc, char *argv[])
+{
+	const tal_t *ctx = tal(NULL, char);
+	const struct chainparams *chainparams;
+	char *network = "regtest";
+	unsigned int num_channels = 1000;
+	size_t num_nodes, num_msgs = 0;
+	struct pubkey *ids;
+	bool *has_channel;
+	secp256k1_ecdsa_signature sig;
+	u8 version = GOSSIP_STORE_VERSION;
+	u8 rgb_color[3], alias[32];
+	u8 *empty;
+	u32 now = time_now().ts.tv_sec;
+	int fd;
+
+	setup_locale();
+	secp256k1_ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY |
+						 SECP256K1_CONTEXT_SIGN);
+	setup_tmpctx();
+
+	opt_register_arg("--channels", opt_set_uintval, opt_show_uintval,
+			 &num_channels, "Number of channels to create");
+	opt_register_arg("--network", opt_set_charp, opt_show_charp, &network,
+			 "Chain the gossip is for");
+	opt_register_noarg("--help|-h", opt_usage_and_exit,
+			   "<gossip_store>\n"
+			   "Create a gossip_store of random channels and nodes.\n"
+			   "Signatures are not valid, but aren't checked on load.",
+			   "Print this message.");
+
+	opt_parse(&argc, argv, opt_log_stderr_exit);
+	if (argc != 2)
+		opt_usage_exit_fail("Need a gossip_store filename");
+
+	chainparams = chainparams_for_network(network);
+	if (!chainparams)
+		opt_usage_exit_fail("Unknown network %s", network);
+
+	/* Roughly the shape of mainnet. */
+	num_nodes = num_channels / 4 + 2;
+	ids = tal_arr(ctx, struct pubkey, num_nodes);
+	for (size_t i = 0; i < num_nodes; i++) {
+		struct privkey priv;
+
+		memset(&priv, 0, sizeof(priv));
+		memcpy(&priv, &i, sizeof(i));
+		priv.secret.data[31] = 1;
+		if (!pubkey_from_privkey(&priv, &ids[i]))
+			abort();
+	}
+	has_channel = tal_arrz(ctx, bool, num_nodes);
+
+	memset(&sig, 0, sizeof(sig));
+	memset(rgb_color, 0, sizeof(rgb_color));
+	memset(alias, 0, sizeof(alias));
+	empty = tal_arr(ctx, u8, 0);
+
+	fd = open(argv[1], O_WRONLY|O_CREAT|O_TRUNC, 0600);
+	if (fd < 0 || !write_all(fd, &version, sizeof(version)))
+		err(1, "Creating %s", argv[1]);
+
+	for (size_t i = 0; i < num_channels; i++) {
+		struct short_channel_id scid;
+		const struct pubkey *n1, *n2;
+		size_t a = pseudorand(num_nodes), b;
+		u8 *msg;
+
+		do {
+			b = pseudorand(num_nodes);
+		} while (b == a);
+		has_channel[a] = has_channel[b] = true;
+		if (pubkey_cmp(&ids[a], &ids[b]) < 0) {
+			n1 = &ids[a];
+			n2 = &ids[b];
+		} else {
+			n1 = &ids[b];
+			n2 = &ids[a];
+		}
+
+		mk_short_channel_id(&scid, i / 1000 + 1, i % 1000, 0);
+		msg = towire_channel_announcement(tmpctx, &sig, &sig,
+						  &sig, &sig, empty,
+						  &chainparams->genesis_blockhash,
+						  &scid, n1, n2, n1, n2);
+		write_record(fd, towire_gossip_store_channel_announcement(
+				     tmpctx, msg, 1000000));
+
+		for (int dir = 0; dir < 2; dir++) {
+			msg = towire_channel_update(tmpctx, &sig,
+						    &chainparams->genesis_blockhash,
+						    &scid, now, 0, dir,
+						    pseudorand(144),
+						    pseudorand(1000),
+						    pseudorand(1000),
+						    pseudorand(1000));
+			write_record(fd,
+				     towire_gossip_store_channel_update(tmpctx,
+									msg));
+		}
+		num_msgs += 3;
+		clean_tmpctx();
+	}
+
+	/* Only nodes with channels get announced. */
+	for (size_t i = 0; i < num_nodes; i++) {
+		u8 *msg;
+
+		if (!has_channel[i])
+			continue;
+		msg = towire_node_announcement(tmpctx, &sig, empty, now,
+					       &ids[i], rgb_color, alias,
+					       empty);
+		write_record(fd,
+			     towire_gossip_store_node_announcement(tmpctx,
+								   msg));
+		num_msgs++;
+	}
+	if (close(fd) != 0)
+		err(1, "Closing %s", argv[1]);
+
+	/* So they know how many to expect. */
+	printf("%zu\n", num_msgs);
+
+	tal_free(ctx);
+	tal_free(tmpctx);
+	secp256k1_context_destroy(secp256k1_ctx);
+	opt_free_table();
+	return 0;
+}
@@ -3,10 +3,12 @@
 #include <ccan/io/io.h>
 #include <ccan/opt/opt.h>
 #include <ccan/read_write_all/read_write_all.h>
+#include <ccan/time/time.h>
 #include <common/crypto_sync.h>
 #include <common/dev_disconnect.h>
 #include <common/peer_failed.h>
 #include <common/status.h>
+#include <inttypes.h>
 #include <netdb.h>
 #include <secp256k1_ecdh.h>
 #include <wire/peer_wire.h>
@@ -40,6 +42,21 @@ struct io_conn {
 static struct secret notsosecret;
 static bool initial_sync = false;
 static unsigned long max_messages = -1UL;
+static bool stats = false;
+
+/* For --stats: how fast did it come? */
+static struct timemono start;
+static u64 num_msgs, num_bytes;
+
+static void print_stats(void)
+{
+	u64 msec = time_to_msec(timemono_since(start));
+
+	fprintf(stderr, "%"PRIu64" messages, %"PRIu64" bytes"
+		" in %"PRIu64" msec (%"PRIu64" msgs/sec)\n",
+		num_msgs, num_bytes, msec,
+		msec ? num_msgs * 1000 / msec : 0);
+}
 
 /* Empty stubs to make us compile */
 void status_peer_io(enum log_level iodir, const u8 *p)
@@ -69,6 +86,8 @@ enum dev_disconnect dev_disconnect(int pkt_type)
 
 void peer_failed_connection_lost(void)
 {
+	if (stats)
+		print_stats();
 	exit(0);
 }
 
@@ -138,17 +157,26 @@ static struct io_plan *handshake_success(struct io_conn *conn,
 	}
 
 	/* Now write out whatever we get. */
+	start = time_mono();
 	while ((msg = sync_crypto_read(NULL, &cs, conn->fd)) != NULL) {
 		be16 len = cpu_to_be16(tal_bytelen(msg));
 
-		if (!write_all(STDOUT_FILENO, &len, sizeof(len))
-		    || !write_all(STDOUT_FILENO, msg, tal_bytelen(msg)))
+		num_msgs++;
+		num_bytes += tal_bytelen(msg);
+		if (!stats
+		    && (!write_all(STDOUT_FILENO, &len, sizeof(len))
+			|| !write_all(STDOUT_FILENO, msg, tal_bytelen(msg))))
 			err(1, "Writing out msg");
 		tal_free(msg);
 
-		if (--max_messages == 0)
+		if (--max_messages == 0) {
+			if (stats)
+				print_stats();
 			exit(0);
+		}
 	}
+	if (stats)
+		print_stats();
 	err(1, "Reading msg");
 }
 
@@ -171,6 +199,8 @@ int main(int argc, char *argv[])
 	opt_register_arg("--max-messages", opt_set_ulongval, opt_show_ulongval,
 			 &max_messages,
 			 "Terminate after reading this many messages (> 0)");
+	opt_register_noarg("--stats", opt_set_bool, &stats,
+			   "Don't output messages, just say how fast they came");
 	opt_register_noarg("--help|-h", opt_usage_and_exit,
 			   "id@addr[:port] [hex-msg-tosend...]\n"
 			   "Connect to a lightning peer and relay gossip messages from it",
@@ -8,83 +8,128 @@
 #include <common/status.h>
 #include <common/type_to_string.h>
 #include <gossipd/broadcast.h>
+#include <gossipd/gossip_store.h>
 #include <wire/gen_peer_wire.h>
 
-struct queued_message {
-	/* Broadcast index. */
-	u64 index;
-
-	/* Timestamp, for filtering. */
-	u32 timestamp;
-
-	/* Serialized payload */
-	const u8 *payload;
-};
-
-struct broadcast_state *new_broadcast_state(tal_t *ctx)
+struct broadcast_state *new_broadcast_state(tal_t *ctx,
+					    struct gossip_store *gs)
 {
 	struct broadcast_state *bstate = tal(ctx, struct broadcast_state);
 	uintmap_init(&bstate->broadcasts);
+	uintmap_init(&bstate->segments);
 	/* Skip 0 because we initialize peers with 0 */
 	bstate->next_index = 1;
 	bstate->count = 0;
+	bstate->gs = gs;
 	return bstate;
 }
 
-void broadcast_del(struct broadcast_state *bstate, u64 index, const u8 *payload)
+static void segment_add(struct broadcast_state *bstate, u64 index,
+			u32 timestamp)
+{
+	struct broadcast_segment *seg;
+
+	seg = uintmap_get(&bstate->segments, index / BROADCAST_SEGMENT_SIZE);
+	if (!seg) {
+		seg = tal(bstate, struct broadcast_segment);
+		seg->timestamp_min = seg->timestamp_max = timestamp;
+		seg->count = 0;
+		uintmap_add(&bstate->segments, index / BROADCAST_SEGMENT_SIZE,
+			    seg);
+	} else if (timestamp < seg->timestamp_min)
+		seg->timestamp_min = timestamp;
+	else if (timestamp > seg->timestamp_max)
+		seg->timestamp_max = timestamp;
+	seg->count++;
+}
+
+static void segment_del(struct broadcast_state *bstate, u64 index)
+{
+	struct broadcast_segment *seg;
+
+	seg = uintmap_get(&bstate->segments, index / BROADCAST_SEGMENT_SIZE);
+	assert(seg);
+	if (--seg->count == 0) {
+		uintmap_del(&bstate->segments, index / BROADCAST_SEGMENT_SIZE);
+		tal_free(seg);
+	}
+}
+
+void broadcast_del(struct broadcast_state *bstate, u64 index)
 {
 	const struct queued_message *q = uintmap_del(&bstate->broadcasts, index);
 	if (q != NULL) {
-		assert(q->payload == payload);
+		segment_del(bstate, index);
 		tal_free(q);
+		bstate->count--;
 		broadcast_state_check(bstate, "broadcast_del");
 	}
 }
 
-static void destroy_queued_message(struct queued_message *msg,
-				   struct broadcast_state *bstate)
-{
-	broadcast_del(bstate, msg->index, msg->payload);
-	bstate->count--;
-}
-
-static struct queued_message *new_queued_message(const tal_t *ctx,
-						 struct broadcast_state *bstate,
-						 const u8 *payload,
+static struct queued_message *new_queued_message(struct broadcast_state *bstate,
+						 u64 store_offset,
 						 u32 timestamp,
 						 u64 index)
 {
-	struct queued_message *msg = tal(ctx, struct queued_message);
-	assert(payload);
-	msg->payload = payload;
+	struct queued_message *msg = tal(bstate, struct queued_message);
+	assert(store_offset);
+	msg->store_offset = store_offset;
 	msg->index = index;
 	msg->timestamp = timestamp;
 	uintmap_add(&bstate->broadcasts, index, msg);
-	tal_add_destructor2(msg, destroy_queued_message, bstate);
+	segment_add(bstate, index, timestamp);
 	bstate->count++;
 	return msg;
 }
 
 u64 insert_broadcast(struct broadcast_state *bstate,
-		      const u8 *payload, u32 timestamp)
+		     u64 store_offset, u32 timestamp)
 {
-	/* Free payload, free index. */
-	new_queued_message(payload, bstate, payload, timestamp,
-			   bstate->next_index);
+	new_queued_message(bstate, store_offset, timestamp, bstate->next_index);
 	broadcast_state_check(bstate, "insert_broadcast");
 	return bstate->next_index++;
 }
 
-const u8 *next_broadcast(struct broadcast_state *bstate,
-			 u32 timestamp_min, u32 timestamp_max,
-			 u64 *last_index)
+u64 broadcast_store_offset(struct broadcast_state *bstate, u64 index)
+{
+	const struct queued_message *q = uintmap_get(&bstate->broadcasts, index);
+
+	assert(q);
+	return q->store_offset;
+}
+
+struct queued_message *next_broadcast(struct broadcast_state *bstate,
+				      u32 timestamp_min, u32 timestamp_max,
+				      u64 *last_index)
 {
 	struct queued_message *m;
+	/* Segment we know overlaps the range, so isn't worth looking up. */
+	u64 overlapping = UINT64_MAX;
 
 	while ((m = uintmap_after(&bstate->broadcasts, last_index)) != NULL) {
+		const struct broadcast_segment *seg;
+		u64 segnum;
+
 		if (m->timestamp >= timestamp_min
 		    && m->timestamp <= timestamp_max)
-			return m->payload;
+			return m;
+
+		segnum = m->index / BROADCAST_SEGMENT_SIZE;
+		if (segnum == overlapping)
+			continue;
+
+		/* Can anything else in this segment match?  If not, go
+		 * straight to the end of it: but no further than the last
+		 * message, since the caller keeps this index, and newer
+		 * messages can still go into the rest of the segment. */
+		seg = uintmap_get(&bstate->segments, segnum);
+		if (seg->timestamp_min > timestamp_max
+		    || seg->timestamp_max < timestamp_min) {
+			*last_index = (segnum + 1) * BROADCAST_SEGMENT_SIZE - 1;
+			if (*last_index >= bstate->next_index)
+				*last_index = bstate->next_index - 1;
+		} else
+			overlapping = segnum;
 	}
 	return NULL;
 }
@@ -126,6 +171,7 @@ struct broadcast_state *broadcast_state_check(struct broadcast_state *b,
 					      const char *abortstr)
 {
 	secp256k1_ecdsa_signature sig;
+	const struct queued_message *q;
 	const u8 *msg;
 	u8 *features, *addresses, color[3], alias[32];
 	struct bitcoin_blkid chain_hash;
@@ -141,7 +187,8 @@ struct broadcast_state *broadcast_state_check(struct broadcast_state *b,
 	pubkey_set_init(&pubkeys);
 	uintmap_init(&channels);
 
-	while ((msg = next_broadcast(b, 0, UINT32_MAX, &index)) != NULL) {
+	while ((q = next_broadcast(b, 0, UINT32_MAX, &index)) != NULL) {
+		msg = gossip_store_get(tmpctx, b->gs, q->store_offset);
 		if (fromwire_channel_announcement(tmpctx, msg, &sig, &sig, &sig,
 						  &sig, &features, &chain_hash,
 						  &scid, &node_id_1, &node_id_2,
@@ -9,27 +9,63 @@
 
 /* Common functionality to implement staggered broadcasts with replacement. */
 
+struct gossip_store;
+
+struct queued_message {
+	/* Broadcast index. */
+	u64 index;
+
+	/* Timestamp, for filtering. */
+	u32 timestamp;
+
+	/* Where the serialized payload is in the gossip_store */
+	u64 store_offset;
+};
+
+/* Broadcasts are grouped by index into segments which know the range of
+ * their timestamps, so peers which only want recent gossip can skip whole
+ * segments instead of looking at every message. */
+#define BROADCAST_SEGMENT_SIZE 1024
+
+struct broadcast_segment {
+	/* Range of timestamps of every message ever added to this segment:
+	 * we don't shrink this on deletion, so it may be wider than needed. */
+	u32 timestamp_min, timestamp_max;
+
+	/* How many messages are still in it: freed when this hits 0. */
+	size_t count;
+};
+
 struct broadcast_state {
 	u64 next_index;
 	UINTMAP(struct queued_message *) broadcasts;
+	/* Indexed by broadcast index / BROADCAST_SEGMENT_SIZE */
+	UINTMAP(struct broadcast_segment *) segments;
 	size_t count;
+	/* Where the payloads live. */
+	struct gossip_store *gs;
 };
 
-struct broadcast_state *new_broadcast_state(tal_t *ctx);
+struct broadcast_state *new_broadcast_state(tal_t *ctx,
+					    struct gossip_store *gs);
 
-/* Append a queued message for broadcast.  Freeing the msg will remove it. */
-u64 insert_broadcast(struct broadcast_state *bstate, const u8 *msg,
+/* Append a queued message for broadcast: the message itself must already
+ * be in the gossip_store at store_offset. */
+u64 insert_broadcast(struct broadcast_state *bstate, u64 store_offset,
 		     u32 timestamp);
 
-/* Manually delete a broadcast: not usually needed, since destructor does it */
-void broadcast_del(struct broadcast_state *bstate, u64 index, const u8 *payload);
+/* Delete a broadcast (the gossip_store entry is garbage from now on) */
+void broadcast_del(struct broadcast_state *bstate, u64 index);
+
+/* Where in the gossip_store is the broadcast with this index? */
+u64 broadcast_store_offset(struct broadcast_state *bstate, u64 index);
 
 /* Return the broadcast with index >= *last_index, timestamp >= min and <= max
  * and update *last_index.
  * There's no broadcast with index 0. */
-const u8 *next_broadcast(struct broadcast_state *bstate,
-			 u32 timestamp_min, u32 timestamp_max,
-			 u64 *last_index);
+struct queued_message *next_broadcast(struct broadcast_state *bstate,
+				      u32 timestamp_min, u32 timestamp_max,
+				      u64 *last_index);
 
 /* Returns b if all OK, otherwise aborts if abortstr non-NULL, otherwise returns
  * NULL. */
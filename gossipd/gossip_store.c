@@ -3,6 +3,7 @@
 #include <ccan/crc/crc.h>
 #include <ccan/endian/endian.h>
 #include <ccan/read_write_all/read_write_all.h>
+#include <ccan/time/time.h>
 #include <common/status.h>
 #include <common/utils.h>
 #include <errno.h>
@@ -10,6 +11,8 @@
 #include <gossipd/gen_gossip_store.h>
 #include <gossipd/gen_gossip_wire.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <wire/gen_peer_wire.h>
 #include <wire/wire.h>
@@ -17,42 +20,120 @@
 #define GOSSIP_STORE_FILENAME "gossip_store"
 #define GOSSIP_STORE_TEMP_FILENAME "gossip_store.tmp"
 
+/* We map at least this much, so small stores don't remap on every append. */
+#define GOSSIP_STORE_MIN_MAP (1024 * 1024)
+
+/* How many messages we copy at a time when compacting in the background. */
+#define GOSSIP_STORE_COMPACT_BATCH 1000
+
 struct gossip_store {
 	int fd;
 	u8 version;
 
+	/* Length of the store file, ie. offset of the next entry. */
+	u64 len;
+
+	/* Read-only mapping of the store (NULL if not mapped yet).  This can
+	 * extend past the end of the file: we never look beyond len. */
+	u8 *map;
+	size_t map_len;
+
 	/* Counters for entries in the gossip_store entries. This is used to
 	 * decide whether we should rewrite the on-disk store or not */
 	size_t count;
 
-	/* The broadcast struct we source messages from when rewriting the
-	 * gossip_store */
-	struct broadcast_state *broadcast;
-
 	/* Handle to the routing_state to retrieve additional information,
-	 * should it be needed */
+	 * should it be needed, and the broadcasts we source messages from
+	 * when rewriting the gossip_store */
 	struct routing_state *rstate;
 
 	/* Disable compaction if we encounter an error during a prior
 	 * compaction */
 	bool disable_compaction;
+
+	/* While compacting (compact_fd >= 0): the new store we're writing,
+	 * its length, the last broadcast index we copied into it and where
+	 * each copy went.  Once we've copied everything which was there when
+	 * we started (up to compact_end), we finish in one go, so we don't
+	 * chase new messages forever. */
+	int compact_fd;
+	u64 compact_len;
+	u64 compact_index, compact_end;
+	struct compacted_msg *compacted;
+
+	/* When compaction started, how many steps it took and how long those
+	 * took in total: the rest of the time we were doing other things. */
+	struct timemono compact_started;
+	size_t compact_steps;
+	struct timerel compact_time;
+};
+
+struct compacted_msg {
+	u64 index;
+	u64 offset;
 };
 
+static void gossip_store_unmap(struct gossip_store *gs)
+{
+	if (gs->map)
+		munmap(gs->map, gs->map_len);
+	gs->map = NULL;
+	gs->map_len = 0;
+}
+
 static void gossip_store_destroy(struct gossip_store *gs)
 {
+	gossip_store_unmap(gs);
 	close(gs->fd);
+	if (gs->compact_fd >= 0) {
+		close(gs->compact_fd);
+		unlink(GOSSIP_STORE_TEMP_FILENAME);
+	}
+}
+
+/* Return a pointer to len bytes at offset within the store. */
+static const u8 *gossip_store_map(struct gossip_store *gs,
+				  u64 offset, size_t len)
+{
+	if (offset + len > gs->len)
+		status_failed(STATUS_FAIL_INTERNAL_ERROR,
+			      "gossip_store: access %"PRIu64"+%zu beyond end %"
+			      PRIu64, offset, len, gs->len);
+
+	if (offset + len > gs->map_len) {
+		size_t map_len = gs->len * 2;
+
+		/* Leave room to grow, since we append as we go. */
+		if (map_len < GOSSIP_STORE_MIN_MAP)
+			map_len = GOSSIP_STORE_MIN_MAP;
+
+		gossip_store_unmap(gs);
+		gs->map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, gs->fd, 0);
+		if (gs->map == MAP_FAILED) {
+			gs->map = NULL;
+			status_failed(STATUS_FAIL_INTERNAL_ERROR,
+				      "gossip_store: mmap of %zu bytes: %s",
+				      map_len, strerror(errno));
+		}
+		gs->map_len = map_len;
+	}
+	return gs->map + offset;
 }
 
 struct gossip_store *gossip_store_new(const tal_t *ctx,
-				      struct routing_state *rstate,
-				      struct broadcast_state *broadcast)
+				      struct routing_state *rstate)
 {
 	struct gossip_store *gs = tal(ctx, struct gossip_store);
+	struct stat st;
+
 	gs->count = 0;
 	gs->fd = open(GOSSIP_STORE_FILENAME, O_RDWR|O_APPEND|O_CREAT, 0600);
-	gs->broadcast = broadcast;
 	gs->rstate = rstate;
 	gs->disable_compaction = false;
+	gs->compact_fd = -1;
+	gs->compacted = NULL;
+	gs->map = NULL;
+	gs->map_len = 0;
 
 	tal_add_destructor(gs, gossip_store_destroy);
 
@@ -61,8 +142,14 @@ struct gossip_store *gossip_store_new(const tal_t *ctx,
 	if (read(gs->fd, &gs->version, sizeof(gs->version))
 	    == sizeof(gs->version)) {
 		/* Version match?  All good */
-		if (gs->version == GOSSIP_STORE_VERSION)
+		if (gs->version == GOSSIP_STORE_VERSION) {
+			if (fstat(gs->fd, &st) != 0)
+				status_failed(STATUS_FAIL_INTERNAL_ERROR,
+					      "Reading store size: %s",
+					      strerror(errno));
+			gs->len = st.st_size;
 			return gs;
+		}
 
 		status_unusual("Gossip store version %u not %u: removing",
 			       gs->version, GOSSIP_STORE_VERSION);
@@ -76,6 +163,7 @@ struct gossip_store *gossip_store_new(const tal_t *ctx,
 	    != sizeof(gs->version))
 		status_failed(STATUS_FAIL_INTERNAL_ERROR,
 			      "Writing version to store: %s", strerror(errno));
+	gs->len = sizeof(gs->version);
 	return gs;
 }
 
@@ -115,9 +203,11 @@ static u8 *gossip_store_wrap_channel_announcement(const tal_t *ctx,
  *
  * @param fd File descriptor to write the wrapped message into
  * @param gossip_msg The message to write
+ * @param len The length of the file, updated on success
  * @return true if the message was wrapped and written
  */
-static bool gossip_store_append(int fd, struct routing_state *rstate, const u8 *gossip_msg)
+static bool gossip_store_append(int fd, struct routing_state *rstate,
+				const u8 *gossip_msg, u64 *len)
 {
 	int t =  fromwire_peektype(gossip_msg);
 	u32 msglen;
@@ -144,162 +234,407 @@ static bool gossip_store_append(int fd, struct routing_state *rstate, const u8 *
 	belen = cpu_to_be32(msglen);
 	checksum = cpu_to_be32(crc32c(0, msg, msglen));
 
-	return (write(fd, &belen, sizeof(belen)) == sizeof(belen) &&
-		write(fd, &checksum, sizeof(checksum)) == sizeof(checksum) &&
-		write(fd, msg, msglen) == msglen);
+	if (write(fd, &belen, sizeof(belen)) != sizeof(belen) ||
+	    write(fd, &checksum, sizeof(checksum)) != sizeof(checksum) ||
+	    write(fd, msg, msglen) != msglen)
+		return false;
+
+	*len += sizeof(belen) + sizeof(checksum) + msglen;
+	return true;
 }
 
-/**
- * Rewrite the on-disk gossip store, compacting it along the way
- *
- * Creates a new file, writes all the updates from the `broadcast_state`, and
- * then atomically swaps the files.
- */
+/* Messages we held back from broadcast may remember where they were in the
+ * store (if we loaded them from it): that's no longer true. */
+static void forget_held_offsets(struct routing_state *rstate)
+{
+	struct chan *chan;
+	struct node *node;
+	struct node_map_iter it;
+	u64 idx;
+
+	for (chan = uintmap_first(&rstate->chanmap, &idx);
+	     chan;
+	     chan = uintmap_after(&rstate->chanmap, &idx))
+		chan->channel_announce_offset = 0;
+
+	for (node = node_map_first(rstate->nodes, &it);
+	     node;
+	     node = node_map_next(rstate->nodes, &it))
+		node->node_announcement_offset = 0;
+}
 
-static void gossip_store_compact(struct gossip_store *gs)
+static void compact_abort(struct gossip_store *gs)
 {
-	size_t count = 0;
-	u64 index = 0;
-	int fd;
-	const u8 *msg;
+	close(gs->compact_fd);
+	gs->compact_fd = -1;
+	unlink(GOSSIP_STORE_TEMP_FILENAME);
+	gs->compacted = tal_free(gs->compacted);
+	status_trace("Encountered an error while compacting, disabling "
+		     "future compactions.");
+	gs->disable_compaction = true;
+}
 
-	assert(gs->broadcast);
+static bool compact_start(struct gossip_store *gs)
+{
 	status_trace(
 	    "Compacting gossip_store with %zu entries, %zu of which are stale",
-	    gs->count, gs->count - gs->broadcast->count);
+	    gs->count, gs->count - gs->rstate->broadcasts->count);
 
-	fd = open(GOSSIP_STORE_TEMP_FILENAME, O_RDWR|O_APPEND|O_CREAT, 0600);
-
-	if (fd < 0) {
+	gs->compact_fd = open(GOSSIP_STORE_TEMP_FILENAME,
+			      O_RDWR|O_APPEND|O_CREAT|O_TRUNC, 0600);
+	if (gs->compact_fd < 0) {
 		status_broken(
 		    "Could not open file for gossip_store compaction");
-		goto disable;
+		gs->disable_compaction = true;
+		return false;
 	}
 
-	if (write(fd, &gs->version, sizeof(gs->version))
-	    != sizeof(gs->version)) {
+	gs->compact_len = sizeof(gs->version);
+	gs->compact_index = 0;
+	gs->compact_end = gs->rstate->broadcasts->next_index;
+	gs->compacted = tal_arr(gs, struct compacted_msg, 0);
+	gs->compact_started = time_mono();
+	gs->compact_time = time_from_sec(0);
+	gs->compact_steps = 0;
+	if (!write_all(gs->compact_fd, &gs->version, sizeof(gs->version))) {
 		status_broken("Writing version to store: %s", strerror(errno));
-		goto unlink_disable;
+		compact_abort(gs);
+		return false;
 	}
+	return true;
+}
 
-	while ((msg = next_broadcast(gs->broadcast, 0, UINT32_MAX, &index)) != NULL) {
-		if (!gossip_store_append(fd, gs->rstate, msg)) {
-			status_broken("Failed writing to gossip store: %s",
-				      strerror(errno));
-			goto unlink_disable;
+/* Copy up to max broadcasts into the new store: they're already wrapped and
+ * checksummed, so we just copy the records.  Sets *done when we've copied
+ * everything. */
+static bool compact_copy(struct gossip_store *gs, size_t max, bool *done)
+{
+	struct queued_message *q;
+	u8 *buf = tal_arr(tmpctx, u8, 0);
+	size_t n = 0, n_compacted = tal_count(gs->compacted);
+	bool ok = true;
+
+	*done = false;
+	while (n < max) {
+		const u8 *p;
+		size_t hdrmax = sizeof(beint32_t), reclen;
+
+		q = next_broadcast(gs->rstate->broadcasts, 0, UINT32_MAX,
+				   &gs->compact_index);
+		if (!q) {
+			*done = true;
+			break;
+		}
 
+		p = gossip_store_map(gs, q->store_offset, hdrmax);
+		reclen = sizeof(beint32_t) * 2 + fromwire_u32(&p, &hdrmax);
+		p = gossip_store_map(gs, q->store_offset, reclen);
+
+		tal_resize(&gs->compacted, n_compacted + 1);
+		gs->compacted[n_compacted].index = q->index;
+		gs->compacted[n_compacted].offset
+			= gs->compact_len + tal_count(buf);
+		n_compacted++;
+		tal_expand(&buf, p, reclen);
+		n++;
+
+		/* Don't buffer the whole store if we're doing it in one go */
+		if (tal_count(buf) >= GOSSIP_STORE_MIN_MAP) {
+			ok = write_all(gs->compact_fd, buf, tal_count(buf));
+			gs->compact_len += tal_count(buf);
+			tal_resize(&buf, 0);
+			if (!ok)
+				break;
 		}
-		count++;
 	}
 
+	if (ok) {
+		ok = write_all(gs->compact_fd, buf, tal_count(buf));
+		gs->compact_len += tal_count(buf);
+	}
+	if (!ok)
+		status_broken("Failed writing to gossip store: %s",
+			      strerror(errno));
+	tal_free(buf);
+	return ok;
+}
+
+/* Everything is copied: swap in the new store. */
+static bool compact_finish(struct gossip_store *gs)
+{
+	struct broadcast_state *bstate = gs->rstate->broadcasts;
+	struct queued_message *q;
+	size_t i = 0, count = tal_count(gs->compacted);
+	u64 index = 0, old_len = gs->len;
+
 	if (rename(GOSSIP_STORE_TEMP_FILENAME, GOSSIP_STORE_FILENAME) == -1) {
 		status_broken(
 		    "Error swapping compacted gossip_store into place: %s",
 		    strerror(errno));
-		goto unlink_disable;
+		return false;
 	}
 
+	/* Now point everyone at the new store.  Both are in index order, and
+	 * we copied every broadcast, but some may have been deleted since. */
+	while ((q = next_broadcast(bstate, 0, UINT32_MAX, &index)) != NULL) {
+		while (i < count && gs->compacted[i].index < q->index)
+			i++;
+		assert(i < count && gs->compacted[i].index == q->index);
+		q->store_offset = gs->compacted[i].offset;
+	}
+	forget_held_offsets(gs->rstate);
+
 	status_trace(
 	    "Compaction completed: dropped %zu messages, new count %zu",
 	    gs->count - count, count);
+	status_trace("Compaction reclaimed %"PRIu64" bytes in %zu steps,"
+		     " taking %"PRIu64" msec over %"PRIu64" msec",
+		     old_len - gs->compact_len, gs->compact_steps,
+		     time_to_msec(gs->compact_time),
+		     time_to_msec(timemono_since(gs->compact_started)));
+
 	gs->count = count;
+	gossip_store_unmap(gs);
 	close(gs->fd);
-	gs->fd = fd;
-	return;
+	gs->fd = gs->compact_fd;
+	gs->len = gs->compact_len;
+	gs->compact_fd = -1;
+	gs->compacted = tal_free(gs->compacted);
+	return true;
+}
 
-unlink_disable:
-	unlink(GOSSIP_STORE_TEMP_FILENAME);
-disable:
-	status_trace("Encountered an error while compacting, disabling "
-		     "future compactions.");
-	gs->disable_compaction = true;
+/* Copy up to max more broadcasts, and swap in the new store if that's all
+ * of them.  Returns true if there's more to do. */
+static bool compact_step(struct gossip_store *gs, size_t max)
+{
+	struct timemono start = time_mono();
+	bool done;
+
+	gs->compact_steps++;
+	if (gs->compact_index + 1 >= gs->compact_end)
+		max = SIZE_MAX;
+	if (!compact_copy(gs, max, &done)) {
+		compact_abort(gs);
+		return false;
+	}
+	gs->compact_time = timerel_add(gs->compact_time,
+				       timemono_since(start));
+	if (!done)
+		return true;
+
+	if (!compact_finish(gs))
+		compact_abort(gs);
+	return false;
 }
 
-void gossip_store_add(struct gossip_store *gs, const u8 *gossip_msg)
+bool gossip_store_compact_step(struct gossip_store *gs)
+{
+	if (gs->compact_fd < 0) {
+		if (gs->disable_compaction
+		    || gs->count < 1000
+		    || gs->count <= gs->rstate->broadcasts->count * 1.25)
+			return false;
+		if (!compact_start(gs))
+			return false;
+	}
+
+	return compact_step(gs, GOSSIP_STORE_COMPACT_BATCH);
+}
+
+/**
+ * Rewrite the on-disk gossip store, compacting it along the way
+ *
+ * Creates a new file, writes all the updates from the `broadcast_state`, and
+ * then atomically swaps the files, all in one go.
+ */
+static void gossip_store_compact(struct gossip_store *gs)
 {
-	/* Only give error message once. */
-	if (gs->fd == -1)
+	if (gs->compact_fd < 0 && !compact_start(gs))
 		return;
 
-	if (!gossip_store_append(gs->fd, gs->rstate, gossip_msg)) {
-		status_broken("Failed writing to gossip store: %s",
+	while (compact_step(gs, SIZE_MAX));
+}
+
+u64 gossip_store_add(struct gossip_store *gs, const u8 *gossip_msg)
+{
+	u64 offset;
+
+	/* We don't keep broadcast messages anywhere else, so this is fatal */
+	offset = gs->len;
+	if (!gossip_store_append(gs->fd, gs->rstate, gossip_msg, &gs->len))
+		status_failed(STATUS_FAIL_INTERNAL_ERROR,
+			      "Failed writing to gossip store: %s",
 			      strerror(errno));
-		gs->fd = -1;
-	}
 
 	gs->count++;
-	if (gs->count >= 1000 && gs->count > gs->broadcast->count * 1.25 &&
-	    !gs->disable_compaction)
-		gossip_store_compact(gs);
+	return offset;
 }
 
 void gossip_store_add_channel_delete(struct gossip_store *gs,
 				     const struct short_channel_id *scid)
 {
 	u8 *msg = towire_gossip_store_channel_delete(NULL, scid);
-	gossip_store_append(gs->fd, gs->rstate, msg);
+	if (!gossip_store_append(gs->fd, gs->rstate, msg, &gs->len))
+		status_broken("Failed writing channel_delete to gossip store: %s",
+			      strerror(errno));
 	tal_free(msg);
 }
 
+/* Every wrapper except channel_delete continues with the length-prefixed
+ * message it carries: return a pointer to that message within the buffer
+ * (*p is NULL if it's truncated). */
+static const u8 *gossip_store_unwrap(const u8 **p, size_t *max, u16 *msglen)
+{
+	const u8 *msg;
+
+	*msglen = fromwire_u16(p, max);
+	msg = *p;
+	fromwire_pad(p, max, *msglen);
+	return msg;
+}
+
+const u8 *gossip_store_get(const tal_t *ctx,
+			   struct gossip_store *gs, u64 offset)
+{
+	const u8 *p, *msg;
+	size_t max = sizeof(beint32_t) * 2;
+	u32 reclen;
+	u16 len;
+	int type;
+
+	p = gossip_store_map(gs, offset, max);
+	reclen = fromwire_u32(&p, &max);
+
+	max = reclen;
+	p = gossip_store_map(gs, offset + sizeof(beint32_t) * 2, max);
+	type = fromwire_u16(&p, &max);
+	if (type != WIRE_GOSSIP_STORE_CHANNEL_ANNOUNCEMENT
+	    && type != WIRE_GOSSIP_STORE_CHANNEL_UPDATE
+	    && type != WIRE_GOSSIP_STORE_NODE_ANNOUNCEMENT)
+		status_failed(STATUS_FAIL_INTERNAL_ERROR,
+			      "gossip_store: bad type %u at %"PRIu64,
+			      type, offset);
+	msg = gossip_store_unwrap(&p, &max, &len);
+	if (!p)
+		status_failed(STATUS_FAIL_INTERNAL_ERROR,
+			      "gossip_store: truncated message at %"PRIu64,
+			      offset);
+	return tal_dup_arr(ctx, u8, msg, len, 0);
+}
+
+/* Check lengths and checksums, returning the end of the last good entry.
+ * We count node_announcements on the way, so we can size the node map. */
+static u64 gossip_store_validate(struct gossip_store *gs, size_t *num_nodes)
+{
+	u64 off = sizeof(gs->version);
+	const u8 *map;
+
+	*num_nodes = 0;
+	if (gs->len == off)
+		return off;
+
+	map = gossip_store_map(gs, 0, gs->len);
+	while (off < gs->len) {
+		const u8 *p = map + off;
+		size_t max = gs->len - off;
+		u32 msglen = fromwire_u32(&p, &max);
+		u32 checksum = fromwire_u32(&p, &max);
+
+		if (!p || max < msglen) {
+			status_unusual("gossip_store: truncated file?");
+			break;
+		}
+		if (checksum != crc32c(0, p, msglen)) {
+			status_unusual("gossip_store: Checksum verification"
+				       " failed at %"PRIu64, off);
+			break;
+		}
+		max = msglen;
+		if (fromwire_u16(&p, &max) == WIRE_GOSSIP_STORE_NODE_ANNOUNCEMENT)
+			(*num_nodes)++;
+		off += sizeof(beint32_t) * 2 + msglen;
+	}
+	return off;
+}
+
 void gossip_store_load(struct routing_state *rstate, struct gossip_store *gs)
 {
-	beint32_t belen, becsum;
-	u32 msglen, checksum;
-	u8 *msg, *gossip_msg;
-	u64 satoshis;
+	u32 msglen;
+	const u8 *p, *inner;
+	u16 inner_len;
+	u8 *msg;
+	u64 satoshis = 0;
+	size_t max, num_nodes;
 	struct short_channel_id scid;
 	/* We set/check version byte on creation */
-	off_t known_good = 1;
+	u64 known_good = 1, end;
 	const char *bad;
 	size_t stats[] = {0, 0, 0, 0};
-	int fd = gs->fd;
-	gs->fd = -1;
-
-	if (lseek(fd, known_good, SEEK_SET) < 0) {
-		status_unusual("gossip_store: lseek failure");
-		goto truncate_nomsg;
-	}
-	while (read(fd, &belen, sizeof(belen)) == sizeof(belen) &&
-	       read(fd, &becsum, sizeof(becsum)) == sizeof(becsum)) {
-		msglen = be32_to_cpu(belen);
-		checksum = be32_to_cpu(becsum);
-		msg = tal_arr(gs, u8, msglen);
-
-		if (read(fd, msg, msglen) != msglen) {
-			status_unusual("gossip_store: truncated file?");
-			goto truncate_nomsg;
+	int type;
+
+	/* Checking everything before we touch the routing tables keeps the
+	 * replay loop tight, and tells us how big the node map will get. */
+	end = gossip_store_validate(gs, &num_nodes);
+	routing_reserve_nodes(rstate, num_nodes);
+
+	/* The routing_add_* functions parse with tal_count(), so we hand them
+	 * a copy: reuse one buffer, since they copy what they keep. */
+	msg = tal_arr(tmpctx, u8, 0);
+
+	/* Loading shouldn't append anything, but don't replay it if it does */
+	while (known_good < end) {
+		/* Appending can remap the store, so look it up each time. */
+		max = sizeof(beint32_t);
+		p = gossip_store_map(gs, known_good, max);
+		msglen = fromwire_u32(&p, &max);
+
+		max = msglen;
+		p = gossip_store_map(gs, known_good + sizeof(beint32_t) * 2,
+				     max);
+		type = fromwire_u16(&p, &max);
+		if (type == WIRE_GOSSIP_STORE_CHANNEL_DELETE)
+			fromwire_short_channel_id(&p, &max, &scid);
+		else {
+			inner = gossip_store_unwrap(&p, &max, &inner_len);
+			if (p) {
+				tal_resize(&msg, inner_len);
+				memcpy(msg, inner, inner_len);
+			}
+			if (type == WIRE_GOSSIP_STORE_CHANNEL_ANNOUNCEMENT)
+				satoshis = fromwire_u64(&p, &max);
 		}
-
-		if (checksum != crc32c(0, msg, msglen)) {
-			bad = "Checksum verification failed";
+		if (!p) {
+			bad = "Truncated message";
 			goto truncate;
 		}
 
-		if (fromwire_gossip_store_channel_announcement(msg, msg,
-							       &gossip_msg,
-							       &satoshis)) {
-			if (!routing_add_channel_announcement(rstate,
-							      gossip_msg,
-							      satoshis)) {
+		switch (type) {
+		case WIRE_GOSSIP_STORE_CHANNEL_ANNOUNCEMENT:
+			if (!routing_add_channel_announcement(rstate, msg,
+							      satoshis,
+							      known_good)) {
 				bad = "Bad channel_announcement";
 				goto truncate;
 			}
 			stats[0]++;
-		} else if (fromwire_gossip_store_channel_update(msg, msg,
-								&gossip_msg)) {
-			if (!routing_add_channel_update(rstate, gossip_msg)) {
+			break;
+		case WIRE_GOSSIP_STORE_CHANNEL_UPDATE:
+			if (!routing_add_channel_update(rstate, msg,
+							known_good)) {
 				bad = "Bad channel_update";
 				goto truncate;
 			}
 			stats[1]++;
-		} else if (fromwire_gossip_store_node_announcement(msg, msg,
-								   &gossip_msg)) {
-			if (!routing_add_node_announcement(rstate, gossip_msg)) {
+			break;
+		case WIRE_GOSSIP_STORE_NODE_ANNOUNCEMENT:
+			if (!routing_add_node_announcement(rstate, msg,
+							   known_good)) {
 				bad = "Bad node_announcement";
 				goto truncate;
 			}
 			stats[2]++;
-		} else if (fromwire_gossip_store_channel_delete(msg, &scid)) {
+			break;
+		case WIRE_GOSSIP_STORE_CHANNEL_DELETE: {
 			struct chan *c = get_channel(rstate, &scid);
 			if (!c) {
 				bad = "Bad channel_delete";
@@ -307,33 +642,44 @@ void gossip_store_load(struct routing_state *rstate, struct gossip_store *gs)
 			}
 			tal_free(c);
 			stats[3]++;
-		} else if (fromwire_gossip_store_local_add_channel(
-			       msg, msg, &gossip_msg)) {
-			handle_local_add_channel(rstate, gossip_msg);
-		} else {
+			break;
+		}
+		case WIRE_GOSSIP_STORE_LOCAL_ADD_CHANNEL:
+			handle_local_add_channel(rstate, msg);
+			break;
+		default:
 			bad = "Unknown message";
 			goto truncate;
 		}
-		known_good += sizeof(belen) + msglen;
+		known_good += sizeof(beint32_t) * 2 + msglen;
 		gs->count++;
-		tal_free(msg);
 	}
+
+	/* Validation stopped early: the rest is corrupt. */
+	if (end < gs->len)
+		goto truncate_nomsg;
 	goto out;
 
 truncate:
 	status_unusual("gossip_store: %s (%s) truncating to %"PRIu64,
-		       bad, tal_hex(msg, msg), (u64)1);
+		       bad,
+		       tal_hexstr(tmpctx,
+				  gossip_store_map(gs, known_good
+						   + sizeof(beint32_t) * 2,
+						   msglen),
+				  msglen),
+		       (u64)1);
 truncate_nomsg:
 	/* FIXME: We would like to truncate to known_good, except we would
 	 * miss channel_delete msgs.  If we put block numbers into the store
 	 * as we process them, we can know how far we need to roll back if we
-	 * truncate the store */
-	if (ftruncate(fd, 1) != 0)
-		status_failed(STATUS_FAIL_INTERNAL_ERROR,
-			      "Truncating store: %s", strerror(errno));
+	 * truncate the store.
+	 *
+	 * What we've loaded refers into the store, so we can't simply
+	 * truncate it: rewrite it with only what we've accepted. */
+	gossip_store_compact(gs);
 out:
 	status_trace("gossip_store: Read %zu/%zu/%zu/%zu cannounce/cupdate/nannounce/cdelete from store in %"PRIu64" bytes",
 		     stats[0], stats[1], stats[2], stats[3],
-		     (u64)known_good);
-	gs->fd = fd;
+		     known_good);
 }
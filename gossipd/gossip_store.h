@@ -17,8 +17,7 @@ struct gossip_store;
 struct routing_state;
 
 struct gossip_store *gossip_store_new(const tal_t *ctx,
-				      struct routing_state *rstate,
-				      struct broadcast_state *broadcast);
+				      struct routing_state *rstate);
 
 /**
  * Load the initial gossip store, if any.
@@ -30,8 +29,30 @@ void gossip_store_load(struct routing_state *rstate, struct gossip_store *gs);
 
 /**
  * Add a gossip message to the gossip_store
+ *
+ * Returns the offset of the message within the store, which stays valid
+ * until the store is compacted: only broadcasts are updated then.
+ */
+u64 gossip_store_add(struct gossip_store *gs, const u8 *gossip_msg);
+
+/**
+ * Compact the gossip_store a little at a time, once it's mostly stale.
+ *
+ * Each call copies a bounded number of messages into the new store, and the
+ * last swaps it in.  Returns true if we're part way through, so this should
+ * be called again soon.
+ */
+bool gossip_store_compact_step(struct gossip_store *gs);
+
+/**
+ * Get a copy of the gossip message at this offset in the gossip_store.
+ *
+ * @param ctx The context to allocate the message from
+ * @param gs  The `gossip_store` to read from
+ * @param offset The offset returned by gossip_store_add (or loaded from)
  */
-void gossip_store_add(struct gossip_store *gs, const u8 *gossip_msg);
+const u8 *gossip_store_get(const tal_t *ctx,
+			   struct gossip_store *gs, u64 offset);
 
 /**
  * Remember that we deleted a channel as a result of its outpoint being spent
@@ -25,6 +25,7 @@
 #include <common/pseudorand.h>
 #include <common/status.h>
 #include <common/subdaemon.h>
+#include <common/threadpool.h>
 #include <common/timeout.h>
 #include <common/type_to_string.h>
 #include <common/utils.h>
@@ -57,6 +58,10 @@
 #define HSM_FD 3
 #define CONNECTD_FD 4
 
+/* Broadcast gossip goes to peers in batches of up to this many bytes (the
+ * most a gossip_send_gossip_batch can hold). */
+#define MAX_GOSSIP_BATCH 65535
+
 #if DEVELOPER
 static u32 max_scids_encode_bytes = -1U;
 static bool suppress_gossip = false;
@@ -90,6 +95,16 @@ struct daemon {
 
 	/* What we can actually announce. */
 	struct wireaddr *announcable;
+
+	/* Gossip from peers waiting to have its signatures checked. */
+	struct list_head gossip_in;
+	size_t num_gossip_in;
+
+	/* The batch whose signatures are being checked now (if any). */
+	struct gossip_batch *gossip_checking;
+
+	/* Threads to check them in. */
+	struct threadpool *sigpool;
 };
 
 struct peer {
@@ -120,6 +135,9 @@ struct peer {
 	/* If this is NULL, we're syncing gossip now. */
 	struct oneshot *gossip_timer;
 
+	/* How many gossip messages we've sent, in how many batches. */
+	u64 gossip_sent, gossip_batches;
+
 	/* How many query responses are we expecting? */
 	size_t num_scid_queries_outstanding;
 
@@ -139,7 +157,7 @@ static void peer_disable_channels(struct daemon *daemon, struct node *node)
 	for (size_t i = 0; i < tal_count(node->chans); i++) {
 		struct chan *c = node->chans[i];
 		if (pubkey_eq(&other_node(node, c)->id, &daemon->id))
-			c->local_disabled = true;
+			set_chan_local_disabled(daemon->rstate, c, true);
 	}
 }
 
@@ -518,8 +536,6 @@ static void handle_gossip_timestamp_filter(struct peer *peer, const u8 *msg)
 	if (peer->gossip_timestamp_min > peer->gossip_timestamp_max)
 		wake_gossip_out(peer);
 
-	/* FIXME: We don't index by timestamp, so this forces a brute
-	 * search! */
 	peer->gossip_timestamp_min = first_timestamp;
 	peer->gossip_timestamp_max = first_timestamp + timestamp_range - 1;
 	if (peer->gossip_timestamp_max < peer->gossip_timestamp_min)
@@ -846,11 +862,17 @@ static bool create_next_scid_reply(struct peer *peer)
 		if (!chan || !is_chan_announced(chan))
 			continue;
 
-		queue_peer_msg(peer, chan->channel_announce);
-		if (chan->half[0].channel_update)
-			queue_peer_msg(peer, chan->half[0].channel_update);
-		if (chan->half[1].channel_update)
-			queue_peer_msg(peer, chan->half[1].channel_update);
+		queue_peer_msg(peer,
+			       take(get_broadcast_msg(NULL, rstate,
+						      chan->channel_announcement_index)));
+		for (size_t j = 0; j < ARRAY_SIZE(chan->half); j++) {
+			const u8 *update;
+
+			update = get_channel_update_msg(NULL, rstate,
+							&chan->half[j]);
+			if (update)
+				queue_peer_msg(peer, take(update));
+		}
 
 		/* Record node ids for later transmission of node_announcement */
 		*tal_arr_expand(&peer->scid_query_nodes) = chan->nodes[0]->id;
@@ -878,7 +900,9 @@ static bool create_next_scid_reply(struct peer *peer)
 		if (!n || !n->node_announcement_index)
 			continue;
 
-		queue_peer_msg(peer, n->node_announcement);
+		queue_peer_msg(peer,
+			       take(get_broadcast_msg(NULL, rstate,
+						      n->node_announcement_index)));
 		sent = true;
 	}
 	peer->scid_query_nodes_idx = i;
@@ -909,10 +933,24 @@ static bool create_next_scid_reply(struct peer *peer)
 	return sent;
 }
 
+/* Appends msg to batch, unless it would overflow. */
+static bool gossip_batch_add(u8 **batch, const u8 *msg)
+{
+	if (tal_count(*batch) + sizeof(be16) + tal_count(msg)
+	    > MAX_GOSSIP_BATCH)
+		return false;
+	towire_u16(batch, tal_count(msg));
+	towire(batch, msg, tal_count(msg));
+	return true;
+}
+
 /* If we're supposed to be sending gossip, do so now. */
 static bool maybe_queue_gossip(struct peer *peer)
 {
-	const u8 *next;
+	const struct queued_message *next;
+	const u8 *first = NULL;
+	u8 *batch = NULL;
+	size_t num = 0;
 
 	if (peer->gossip_timer)
 		return false;
@@ -922,13 +960,52 @@ static bool maybe_queue_gossip(struct peer *peer)
 		return false;
 #endif
 
-	next = next_broadcast(peer->daemon->rstate->broadcasts,
-			      peer->gossip_timestamp_min,
-			      peer->gossip_timestamp_max,
-			      &peer->broadcast_index);
+	/* Rather than one message per wakeup (for us, and for the peer's
+	 * daemon), send as many as fit in a batch. */
+	for (;;) {
+		u64 prev_index = peer->broadcast_index;
+		const u8 *msg;
+
+		next = next_broadcast(peer->daemon->rstate->broadcasts,
+				      peer->gossip_timestamp_min,
+				      peer->gossip_timestamp_max,
+				      &peer->broadcast_index);
+		if (!next)
+			break;
+
+		msg = gossip_store_get(tmpctx, peer->daemon->rstate->store,
+				       next->store_offset);
+		if (!first) {
+			first = msg;
+			num = 1;
+			continue;
+		}
+		if (!batch) {
+			batch = tal_arr(tmpctx, u8, 0);
+			/* Too big to batch?  Send it alone. */
+			if (!gossip_batch_add(&batch, first)) {
+				peer->broadcast_index = prev_index;
+				break;
+			}
+		}
+		if (!gossip_batch_add(&batch, msg)) {
+			/* That one can go in the next batch. */
+			peer->broadcast_index = prev_index;
+			break;
+		}
+		num++;
+	}
 
-	if (next) {
-		queue_peer_msg(peer, next);
+	if (num) {
+		/* No point wrapping a single message. */
+		if (num == 1)
+			queue_peer_msg(peer, first);
+		else
+			daemon_conn_send(peer->dc,
+					 take(towire_gossip_send_gossip_batch(NULL,
+									      batch)));
+		peer->gossip_sent += num;
+		peer->gossip_batches++;
 		return true;
 	}
 
@@ -1020,7 +1097,7 @@ static void maybe_update_local_channel(struct daemon *daemon,
 	const struct half_chan *hc = &chan->half[direction];
 
 	/* Don't generate a channel_update for an uninitialized channel. */
-	if (!hc->channel_update)
+	if (!is_halfchan_defined(hc))
 		return;
 
 	/* Nothing to update? */
@@ -1087,7 +1164,8 @@ static void handle_get_update(struct peer *peer, const u8 *msg)
 	/* Since we're going to send it out, make sure it's up-to-date. */
 	maybe_update_local_channel(peer->daemon, chan, direction);
 
-	update = chan->half[direction].channel_update;
+	update = get_channel_update_msg(tmpctx, rstate,
+					&chan->half[direction]);
 out:
 	status_trace("peer %s schanid %s: %s update",
 		     type_to_string(tmpctx, struct pubkey, &peer->id),
@@ -1180,7 +1258,138 @@ static void handle_local_channel_update(struct peer *peer, const u8 *msg)
 
 	/* Normal case: just toggle local_disabled, and generate broadcast in
 	 * maybe_update_local_channel when/if someone asks about it. */
-	chan->local_disabled = disable;
+	set_chan_local_disabled(peer->daemon->rstate, chan, disable);
+}
+
+/*~ Checking signatures is most of the work of taking in gossip, and it's
+ * pure CPU, so we do it in batches on a threadpool.  Gossip from peers is
+ * queued up while the previous batch is being checked; once a batch is
+ * done, handle_gossip_msg() goes through it in order exactly as before, but
+ * finds the signatures already checked.  If too much piles up, we stop
+ * reading from peers until the next batch starts. */
+#define MAX_GOSSIP_IN 10000
+
+/* A batch's signatures go into the routing.c cache before they're checked:
+ * with more than it holds, the first would be pushed out again before
+ * handle_gossip_msg() got to them, and be checked a second time there.  The
+ * other half is for those still waiting on a txout lookup. */
+#define MAX_GOSSIP_BATCH_SIGS (SIG_CACHE_MAX / 2)
+
+struct gossip_in {
+	/* Off daemon->gossip_in, or a gossip_batch's msgs */
+	struct list_node list;
+
+	/* Our parent. */
+	struct peer *peer;
+
+	/* Is it in a batch already? */
+	bool checking;
+
+	const u8 *msg;
+};
+
+struct gossip_batch {
+	struct daemon *daemon;
+	struct list_head msgs;
+
+	/* What the threads check, and the results. */
+	struct gossip_sig *sigs;
+	bool *ok;
+};
+
+static void destroy_gossip_in(struct gossip_in *gin)
+{
+	list_del(&gin->list);
+	if (!gin->checking)
+		gin->peer->daemon->num_gossip_in--;
+}
+
+/* Runs in a worker thread: no tal here! */
+static void check_one_gossip_sig(struct gossip_batch *batch, size_t i)
+{
+	batch->ok[i] = check_signed_hash(&batch->sigs[i].hash,
+					 &batch->sigs[i].sig,
+					 &batch->sigs[i].key);
+}
+
+static void check_gossip_in(struct daemon *daemon);
+
+static void gossip_batch_checked(struct gossip_batch *batch)
+{
+	struct daemon *daemon = batch->daemon;
+	struct gossip_in *gin;
+
+	for (size_t i = 0; i < tal_count(batch->sigs); i++)
+		gossip_sig_checked(daemon->rstate,
+				   &batch->sigs[i], batch->ok[i]);
+
+	/* Peers which have gone away have taken their gossip with them. */
+	while ((gin = list_top(&batch->msgs, struct gossip_in, list)) != NULL) {
+		u8 *err = handle_gossip_msg(daemon, gin->msg, "subdaemon");
+		if (err)
+			queue_peer_msg(gin->peer, take(err));
+		tal_free(gin);
+	}
+
+	tal_free(batch);
+	daemon->gossip_checking = NULL;
+	check_gossip_in(daemon);
+}
+
+/* Start checking everything queued, unless we're busy already. */
+static void check_gossip_in(struct daemon *daemon)
+{
+	struct gossip_batch *batch;
+	struct gossip_in *gin;
+
+	if (daemon->gossip_checking || list_empty(&daemon->gossip_in))
+		return;
+
+	batch = tal(daemon, struct gossip_batch);
+	batch->daemon = daemon;
+	list_head_init(&batch->msgs);
+
+	/* A channel_announcement has the most signatures: 4. */
+	batch->sigs = tal_arr(batch, struct gossip_sig, 0);
+	while (tal_count(batch->sigs) + 4 <= MAX_GOSSIP_BATCH_SIGS
+	       && (gin = list_pop(&daemon->gossip_in,
+				  struct gossip_in, list)) != NULL) {
+		list_add_tail(&batch->msgs, &gin->list);
+		gin->checking = true;
+		daemon->num_gossip_in--;
+		gossip_sigs_to_check(daemon->rstate, gin->msg, &batch->sigs);
+	}
+	batch->ok = tal_arr(batch, bool, tal_count(batch->sigs));
+
+	daemon->gossip_checking = batch;
+	threadpool_start(daemon->sigpool, tal_count(batch->sigs),
+			 check_one_gossip_sig, gossip_batch_checked, batch);
+
+	/* There's room in the queue again. */
+	io_wake(&daemon->gossip_in);
+}
+
+/* Returns false if they should wait before sending us more. */
+static bool queue_gossip_in(struct peer *peer, const u8 *msg)
+{
+	struct daemon *daemon = peer->daemon;
+	struct gossip_in *gin = tal(peer, struct gossip_in);
+
+	gin->peer = peer;
+	gin->checking = false;
+	gin->msg = tal_dup_arr(gin, u8, msg, tal_count(msg), 0);
+	list_add_tail(&daemon->gossip_in, &gin->list);
+	daemon->num_gossip_in++;
+	tal_add_destructor(gin, destroy_gossip_in);
+
+	check_gossip_in(daemon);
+	return daemon->num_gossip_in < MAX_GOSSIP_IN;
+}
+
+static struct io_plan *owner_read_next(struct io_conn *conn,
+				       struct peer *peer)
+{
+	return daemon_conn_read_next(conn, peer->dc);
 }
 
 /**
@@ -1191,14 +1400,12 @@ static struct io_plan *owner_msg_in(struct io_conn *conn,
 				    const u8 *msg,
 				    struct peer *peer)
 {
-	u8 *err;
-
 	int type = fromwire_peektype(msg);
 	if (type == WIRE_CHANNEL_ANNOUNCEMENT || type == WIRE_CHANNEL_UPDATE ||
 	    type == WIRE_NODE_ANNOUNCEMENT) {
-		err = handle_gossip_msg(peer->daemon, msg, "subdaemon");
-		if (err)
-			queue_peer_msg(peer, take(err));
+		if (!queue_gossip_in(peer, msg))
+			return io_wait(conn, &peer->daemon->gossip_in,
+				       owner_read_next, peer);
 	} else if (type == WIRE_QUERY_SHORT_CHANNEL_IDS) {
 		handle_query_short_channel_ids(peer, msg);
 	} else if (type == WIRE_REPLY_SHORT_CHANNEL_IDS_END) {
@@ -1265,6 +1472,7 @@ static struct io_plan *connectd_new_peer(struct io_conn *conn,
 	peer->query_channel_blocks = NULL;
 	peer->num_pings_outstanding = 0;
 	peer->gossip_timer = NULL;
+	peer->gossip_sent = peer->gossip_batches = 0;
 
 	list_add_tail(&peer->daemon->peers, &peer->list);
 	tal_add_destructor(peer, destroy_peer);
@@ -1375,9 +1583,6 @@ static void append_half_channel(struct gossip_getchannels_entry **entries,
 	const struct half_chan *c = &chan->half[idx];
 	struct gossip_getchannels_entry *e;
 
-	if (!is_halfchan_defined(c))
-		return;
-
 	e = tal_arr_expand(entries);
 
 	raw_pubkey(e->source, &chan->nodes[idx]->id);
@@ -1394,11 +1599,77 @@ static void append_half_channel(struct gossip_getchannels_entry **entries,
 	e->delay = c->delay;
 }
 
-static void append_channel(struct gossip_getchannels_entry **entries,
-			   const struct chan *chan)
+/* What listchannels wants to see: 0/NULL/false means don't care. */
+struct getchannels_filter {
+	const struct pubkey *source;
+	u32 since;
+	u64 changed_since;
+	bool active_only;
+};
+
+static bool halfchan_wanted(const struct getchannels_filter *filter,
+			    const struct chan *chan, int idx)
+{
+	const struct half_chan *c = &chan->half[idx];
+
+	if (!is_halfchan_defined(c))
+		return false;
+	if (filter->source && !pubkey_eq(&chan->nodes[idx]->id, filter->source))
+		return false;
+	if (c->last_timestamp < filter->since)
+		return false;
+	/* A new channel_announcement means both halves are new to them. */
+	if (filter->changed_since
+	    && c->channel_update_index <= filter->changed_since
+	    && chan->channel_announcement_index <= filter->changed_since)
+		return false;
+	if (filter->active_only
+	    && (!is_halfchan_enabled(c) || chan->local_disabled))
+		return false;
+	return true;
+}
+
+/* Returns true if it appended anything. */
+static bool append_channel(struct gossip_getchannels_entry **entries,
+			   const struct chan *chan,
+			   const struct getchannels_filter *filter)
 {
-	append_half_channel(entries, chan, 0);
-	append_half_channel(entries, chan, 1);
+	bool appended = false;
+
+	for (int i = 0; i < 2; i++) {
+		if (halfchan_wanted(filter, chan, i)) {
+			append_half_channel(entries, chan, i);
+			appended = true;
+		}
+	}
+	return appended;
+}
+
+/* Next channel after prev (or first if prev is NULL), in scid order.  If
+ * node is set, only its channels: there aren't many, so we don't bother
+ * keeping them sorted. */
+static struct chan *next_chan(struct routing_state *rstate,
+			      const struct node *node,
+			      const struct short_channel_id *prev)
+{
+	struct chan *next = NULL;
+	u64 idx;
+
+	if (node) {
+		for (size_t i = 0; i < tal_count(node->chans); i++) {
+			struct chan *c = node->chans[i];
+			if (prev && c->scid.u64 <= prev->u64)
+				continue;
+			if (!next || c->scid.u64 < next->scid.u64)
+				next = c;
+		}
+		return next;
+	}
+
+	if (!prev)
+		return uintmap_first(&rstate->chanmap, &idx);
+	idx = prev->u64;
+	return uintmap_after(&rstate->chanmap, &idx);
 }
 
 static struct io_plan *getchannels_req(struct io_conn *conn,
@@ -1408,27 +1679,52 @@ static struct io_plan *getchannels_req(struct io_conn *conn,
 	u8 *out;
 	struct gossip_getchannels_entry *entries;
 	struct chan *chan;
-	struct short_channel_id *scid;
-
-	if (!fromwire_gossip_getchannels_request(msg, msg, &scid))
+	struct short_channel_id *scid, *prev, *last = NULL;
+	struct pubkey *source;
+	struct getchannels_filter filter;
+	u32 max;
+
+	if (!fromwire_gossip_getchannels_request(msg, msg, &scid, &prev, &max,
+						 &source, &filter.since,
+						 &filter.changed_since,
+						 &filter.active_only))
 		master_badmsg(WIRE_GOSSIP_GETCHANNELS_REQUEST, msg);
+	filter.source = source;
 
 	entries = tal_arr(tmpctx, struct gossip_getchannels_entry, 0);
 	if (scid) {
 		chan = get_channel(daemon->rstate, scid);
 		if (chan)
-			append_channel(&entries, chan);
+			append_channel(&entries, chan, &filter);
 	} else {
-		u64 idx;
+		const struct node *node = NULL;
 
-		for (chan = uintmap_first(&daemon->rstate->chanmap, &idx);
-		     chan;
-		     chan = uintmap_after(&daemon->rstate->chanmap, &idx)) {
-			append_channel(&entries, chan);
+		if (source) {
+			node = get_node(daemon->rstate, source);
+			/* No such node?  No channels. */
+			if (!node)
+				goto done;
 		}
+
+		/* lightningd asks for these a piece at a time, so neither
+		 * of us holds a huge list at once.  Filtered-out channels
+		 * are cheap to skip, so they don't count. */
+		chan = next_chan(daemon->rstate, node, prev);
+		for (u32 n = 0; chan && n < max;
+		     chan = next_chan(daemon->rstate, node, &chan->scid)) {
+			if (append_channel(&entries, chan, &filter))
+				n++;
+			last = &chan->scid;
+		}
+
+		/* No more? */
+		if (!chan)
+			last = NULL;
 	}
 
-	out = towire_gossip_getchannels_reply(NULL, entries);
+done:
+	out = towire_gossip_getchannels_reply(NULL, entries, last,
+				daemon->rstate->broadcasts->next_index - 1);
 	daemon_conn_send(daemon->master, take(out));
 	return daemon_conn_read_next(conn, daemon->master);
 }
@@ -1454,6 +1750,16 @@ static void append_node(const struct gossip_getnodes_entry ***entries,
 	memcpy(e->color, n->rgb_color, ARRAY_SIZE(e->color));
 }
 
+static bool node_wanted(const struct node *n, u32 since, u64 changed_since)
+{
+	/* Unannounced nodes have last_timestamp -1 */
+	if (since && n->last_timestamp < since)
+		return false;
+	if (changed_since && n->node_announcement_index <= changed_since)
+		return false;
+	return true;
+}
+
 static struct io_plan *getnodes(struct io_conn *conn, struct daemon *daemon,
 				const u8 *msg)
 {
@@ -1461,24 +1767,30 @@ static struct io_plan *getnodes(struct io_conn *conn, struct daemon *daemon,
 	struct node *n;
 	const struct gossip_getnodes_entry **nodes;
 	struct pubkey *id;
+	u32 since;
+	u64 changed_since;
 
-	if (!fromwire_gossip_getnodes_request(tmpctx, msg, &id))
+	if (!fromwire_gossip_getnodes_request(tmpctx, msg, &id,
+					      &since, &changed_since))
 		master_badmsg(WIRE_GOSSIP_GETNODES_REQUEST, msg);
 
 	nodes = tal_arr(tmpctx, const struct gossip_getnodes_entry *, 0);
 	if (id) {
 		n = get_node(daemon->rstate, id);
-		if (n)
+		if (n && node_wanted(n, since, changed_since))
 			append_node(&nodes, n);
 	} else {
 		struct node_map_iter i;
 		n = node_map_first(daemon->rstate->nodes, &i);
 		while (n != NULL) {
-			append_node(&nodes, n);
+			if (node_wanted(n, since, changed_since))
+				append_node(&nodes, n);
 			n = node_map_next(daemon->rstate->nodes, &i);
 		}
 	}
-	out = towire_gossip_getnodes_reply(NULL, nodes);
+	out = towire_gossip_getnodes_reply(NULL,
+				daemon->rstate->broadcasts->next_index - 1,
+				nodes);
 	daemon_conn_send(daemon->master, take(out));
 	return daemon_conn_read_next(conn, daemon->master);
 }
@@ -1739,6 +2051,43 @@ static struct io_plan *dev_gossip_suppress(struct io_conn *conn,
 	suppress_gossip = true;
 	return daemon_conn_read_next(conn, daemon->master);
 }
+
+static struct io_plan *dev_gossip_queues(struct io_conn *conn,
+					 struct daemon *daemon,
+					 const u8 *msg)
+{
+	struct peer *peer;
+	struct pubkey *ids = tal_arr(tmpctx, struct pubkey, 0);
+	u64 *behind = tal_arr(tmpctx, u64, 0), *queued = tal_arr(tmpctx, u64, 0);
+	u64 *sent = tal_arr(tmpctx, u64, 0), *batches = tal_arr(tmpctx, u64, 0);
+	u64 last_index = daemon->rstate->broadcasts->next_index - 1;
+
+	if (!fromwire_gossip_dev_gossip_queues(msg))
+		master_badmsg(WIRE_GOSSIP_DEV_GOSSIP_QUEUES, msg);
+
+	list_for_each(&daemon->peers, peer, list) {
+		*tal_arr_expand(&ids) = peer->id;
+		/* In broadcast indices, not messages: an upper bound, since
+		 * some of those may have been replaced, or be outside their
+		 * timestamp filter. */
+		if (peer->broadcast_index < last_index)
+			*tal_arr_expand(&behind) = last_index
+				- peer->broadcast_index;
+		else
+			*tal_arr_expand(&behind) = 0;
+		*tal_arr_expand(&queued) = daemon_conn_queue_length(peer->dc);
+		*tal_arr_expand(&sent) = peer->gossip_sent;
+		*tal_arr_expand(&batches) = peer->gossip_batches;
+	}
+
+	daemon_conn_send(daemon->master,
+			 take(towire_gossip_dev_gossip_queues_reply(NULL, ids,
+								    behind,
+								    queued,
+								    sent,
+								    batches)));
+	return daemon_conn_read_next(conn, daemon->master);
+}
 #endif /* DEVELOPER */
 
 static void gossip_send_keepalive_update(struct daemon *daemon,
@@ -1762,6 +2111,21 @@ static void gossip_send_keepalive_update(struct daemon *daemon,
 			     __func__);
 }
 
+/* Compaction copies a batch of messages each time: in between, we wait just
+ * long enough for io_loop to service peers (and getroute requests). */
+static void gossip_store_compact_timer(struct daemon *daemon)
+{
+	struct timerel next;
+
+	if (gossip_store_compact_step(daemon->rstate->store))
+		next = time_from_msec(1);
+	else
+		next = time_from_sec(60);
+
+	new_reltimer(&daemon->timers, daemon, next,
+		     gossip_store_compact_timer, daemon);
+}
+
 static void gossip_refresh_network(struct daemon *daemon)
 {
 	u64 now = time_now().ts.tv_sec;
@@ -1815,7 +2179,8 @@ static void gossip_disable_local_channels(struct daemon *daemon)
 		return;
 
 	for (size_t i = 0; i < tal_count(local_node->chans); i++)
-		local_node->chans[i]->local_disabled = true;
+		set_chan_local_disabled(daemon->rstate,
+					local_node->chans[i], true);
 }
 
 /* Parse an incoming gossip init message and assign config variables
@@ -1854,6 +2219,8 @@ static struct io_plan *gossip_init(struct io_conn *conn,
 		     time_from_sec(daemon->rstate->prune_timeout/4),
 		     gossip_refresh_network, daemon);
 
+	gossip_store_compact_timer(daemon);
+
 	return daemon_conn_read_next(conn, daemon->master);
 }
 
@@ -1989,7 +2356,7 @@ static struct io_plan *handle_local_channel_close(struct io_conn *conn,
 
 	chan = get_channel(rstate, &scid);
 	if (chan)
-		chan->local_disabled = true;
+		set_chan_local_disabled(rstate, chan, true);
 	return daemon_conn_read_next(conn, daemon->master);
 }
 
@@ -2050,12 +2417,15 @@ static struct io_plan *recv_req(struct io_conn *conn,
 		return dev_set_max_scids_encode_size(conn, daemon, msg);
 	case WIRE_GOSSIP_DEV_SUPPRESS:
 		return dev_gossip_suppress(conn, daemon, msg);
+	case WIRE_GOSSIP_DEV_GOSSIP_QUEUES:
+		return dev_gossip_queues(conn, daemon, msg);
 #else
 	case WIRE_GOSSIP_QUERY_SCIDS:
 	case WIRE_GOSSIP_SEND_TIMESTAMP_FILTER:
 	case WIRE_GOSSIP_QUERY_CHANNEL_RANGE:
 	case WIRE_GOSSIP_DEV_SET_MAX_SCIDS_ENCODE_SIZE:
 	case WIRE_GOSSIP_DEV_SUPPRESS:
+	case WIRE_GOSSIP_DEV_GOSSIP_QUEUES:
 		break;
 #endif /* !DEVELOPER */
 
@@ -2071,6 +2441,8 @@ static struct io_plan *recv_req(struct io_conn *conn,
 	case WIRE_GOSSIP_GET_UPDATE:
 	case WIRE_GOSSIP_GET_UPDATE_REPLY:
 	case WIRE_GOSSIP_SEND_GOSSIP:
+	case WIRE_GOSSIP_SEND_GOSSIP_BATCH:
+	case WIRE_GOSSIP_DEV_GOSSIP_QUEUES_REPLY:
 	case WIRE_GOSSIP_LOCAL_ADD_CHANNEL:
 	case WIRE_GOSSIP_LOCAL_CHANNEL_UPDATE:
 	case WIRE_GOSSIP_GET_TXOUT:
@@ -2148,6 +2520,10 @@ int main(int argc, char *argv[])
 
 	daemon = tal(NULL, struct daemon);
 	list_head_init(&daemon->peers);
+	list_head_init(&daemon->gossip_in);
+	daemon->num_gossip_in = 0;
+	daemon->gossip_checking = NULL;
+	daemon->sigpool = threadpool_new(daemon, threadpool_default_threads());
 	timers_init(&daemon->timers, time_mono());
 
 	/* stdin == control */
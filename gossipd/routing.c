@@ -3,6 +3,7 @@
 #include <bitcoin/block.h>
 #include <bitcoin/script.h>
 #include <ccan/array_size/array_size.h>
+#include <ccan/build_assert/build_assert.h>
 #include <ccan/endian/endian.h>
 #include <ccan/mem/mem.h>
 #include <ccan/tal/str/str.h>
@@ -75,6 +76,84 @@ HTABLE_DEFINE_TYPE(struct pending_node_announce, pending_node_announce_keyof,
 		   node_map_hash_key, pending_node_announce_eq,
 		   pending_node_map);
 
+struct sig_cache_entry {
+	/* Off sig_cache->entries, oldest first */
+	struct list_node list;
+
+	struct gossip_sig gsig;
+
+	/* False while it's being checked. */
+	bool ok;
+};
+
+static const struct gossip_sig *
+sig_cache_entry_keyof(const struct sig_cache_entry *e)
+{
+	return &e->gsig;
+}
+
+static size_t gossip_sig_hash(const struct gossip_sig *gsig)
+{
+	return siphash24(siphash_seed(), &gsig->hash, sizeof(gsig->hash));
+}
+
+static bool sig_cache_entry_eq(const struct sig_cache_entry *e,
+			       const struct gossip_sig *gsig)
+{
+	return memeq(&e->gsig.hash, sizeof(e->gsig.hash),
+		     &gsig->hash, sizeof(gsig->hash))
+		&& memeq(&e->gsig.sig, sizeof(e->gsig.sig),
+			 &gsig->sig, sizeof(gsig->sig))
+		&& pubkey_eq(&e->gsig.key, &gsig->key);
+}
+
+HTABLE_DEFINE_TYPE(struct sig_cache_entry, sig_cache_entry_keyof,
+		   gossip_sig_hash, sig_cache_entry_eq, sig_htable);
+
+struct sig_cache {
+	struct sig_htable htable;
+	struct list_head entries;
+	size_t count;
+};
+
+static void destroy_sig_cache(struct sig_cache *sc)
+{
+	sig_htable_clear(&sc->htable);
+}
+
+static struct sig_cache *new_sig_cache(const tal_t *ctx)
+{
+	struct sig_cache *sc = tal(ctx, struct sig_cache);
+
+	sig_htable_init(&sc->htable);
+	list_head_init(&sc->entries);
+	sc->count = 0;
+	tal_add_destructor(sc, destroy_sig_cache);
+	return sc;
+}
+
+static void sig_cache_del(struct sig_cache *sc, struct sig_cache_entry *e)
+{
+	sig_htable_del(&sc->htable, e);
+	list_del_from(&sc->entries, &e->list);
+	sc->count--;
+	tal_free(e);
+}
+
+static void sig_cache_add(struct sig_cache *sc, const struct gossip_sig *gsig,
+			  bool ok)
+{
+	struct sig_cache_entry *e = tal(sc, struct sig_cache_entry);
+
+	e->gsig = *gsig;
+	e->ok = ok;
+	sig_htable_add(&sc->htable, e);
+	list_add_tail(&sc->entries, &e->list);
+	if (++sc->count > SIG_CACHE_MAX)
+		sig_cache_del(sc, list_top(&sc->entries,
+					   struct sig_cache_entry, list));
+}
+
 static struct node_map *empty_node_map(const tal_t *ctx)
 {
 	struct node_map *map = tal(ctx, struct node_map);
@@ -83,6 +162,18 @@ static struct node_map *empty_node_map(const tal_t *ctx)
 	return map;
 }
 
+void routing_reserve_nodes(struct routing_state *rstate, size_t num_nodes)
+{
+	struct node_map_iter it;
+
+	/* Resizing would rehash everything, so only do this up front. */
+	if (num_nodes == 0 || node_map_first(rstate->nodes, &it))
+		return;
+
+	node_map_clear(rstate->nodes);
+	node_map_init_sized(rstate->nodes, num_nodes);
+}
+
 struct routing_state *new_routing_state(const tal_t *ctx,
 					const struct bitcoin_blkid *chain_hash,
 					const struct pubkey *local_id,
@@ -90,12 +181,14 @@ struct routing_state *new_routing_state(const tal_t *ctx,
 {
 	struct routing_state *rstate = tal(ctx, struct routing_state);
 	rstate->nodes = empty_node_map(rstate);
-	rstate->broadcasts = new_broadcast_state(rstate);
 	rstate->chain_hash = *chain_hash;
 	rstate->local_id = *local_id;
 	rstate->prune_timeout = prune_timeout;
-	rstate->store = gossip_store_new(rstate, rstate, rstate->broadcasts);
+	rstate->store = gossip_store_new(rstate, rstate);
+	rstate->broadcasts = new_broadcast_state(rstate, rstate->store);
 	rstate->local_channel_announced = false;
+	rstate->graph = NULL;
+	rstate->sig_cache = new_sig_cache(rstate);
 	list_head_init(&rstate->pending_cannouncement);
 	uintmap_init(&rstate->chanmap);
 
@@ -121,13 +214,153 @@ bool node_map_node_eq(const struct node *n, const struct pubkey *key)
 	return pubkey_eq(&n->id, key);
 }
 
+/* Too big to reach, but don't overflow if added. */
+#define INFINITE 0x3FFFFFFFFFFFFFFFULL
+
+/* half_chan->graph_edge if it's not in the graph. */
+#define NO_GRAPH_EDGE UINT32_MAX
+
+/* Everything find_route needs to know about a (defined) half_chan. */
+struct graph_edge {
+	/* Index of the node this half_chan comes from. */
+	u32 src;
+	u32 base_fee;
+	u32 proportional_fee;
+	u32 delay;
+	u64 htlc_minimum_msat;
+	u64 htlc_maximum_msat;
+	time_t unroutable_until;
+	struct short_channel_id scid;
+	struct chan *chan;
+	/* Also has ROUTING_FLAGS_DISABLED if chan->local_disabled */
+	u8 channel_flags;
+};
+
+/* Compressed sparse row form of the network, for find_route.  The edges
+ * into nodes[i] are edges[first_edge[i]] up to edges[first_edge[i+1]]. */
+struct routing_graph {
+	/* Indexed by node->graph_idx */
+	struct node **nodes;
+	u32 *first_edge;
+	/* Indexed by half_chan->graph_edge */
+	struct graph_edge *edges;
+};
+
+static void destroy_routing_graph(struct routing_graph *graph,
+				  struct routing_state *rstate)
+{
+	rstate->graph = NULL;
+}
+
+/* Nodes or channels added or removed: rebuild graph when next needed. */
+static void invalidate_graph(struct routing_state *rstate)
+{
+	tal_free(rstate->graph);
+}
+
+static void fill_graph_edge(struct graph_edge *e, u32 src,
+			    struct chan *chan, int idx)
+{
+	const struct half_chan *c = &chan->half[idx];
+
+	e->src = src;
+	e->base_fee = c->base_fee;
+	e->proportional_fee = c->proportional_fee;
+	e->delay = c->delay;
+	e->htlc_minimum_msat = c->htlc_minimum_msat;
+	e->htlc_maximum_msat = c->htlc_maximum_msat;
+	e->unroutable_until = c->unroutable_until;
+	e->scid = chan->scid;
+	e->chan = chan;
+	e->channel_flags = c->channel_flags;
+	if (chan->local_disabled)
+		e->channel_flags |= ROUTING_FLAGS_DISABLED;
+}
+
+/* Routing values of this half_chan changed: update graph in place. */
+static void update_graph_edge(struct routing_state *rstate,
+			      struct chan *chan, int idx)
+{
+	struct graph_edge *e;
+
+	if (!rstate->graph)
+		return;
+
+	/* Wasn't defined before?  Needs to be inserted. */
+	if (chan->half[idx].graph_edge == NO_GRAPH_EDGE) {
+		invalidate_graph(rstate);
+		return;
+	}
+
+	e = &rstate->graph->edges[chan->half[idx].graph_edge];
+	fill_graph_edge(e, e->src, chan, idx);
+}
+
+static struct routing_graph *get_graph(struct routing_state *rstate)
+{
+	struct routing_graph *graph;
+	struct node_map_iter it;
+	struct node *n;
+	size_t num_nodes = 0, num_edges = 0, i;
+
+	if (rstate->graph)
+		return rstate->graph;
+
+	/* Number nodes first, since edges refer to them. */
+	for (n = node_map_first(rstate->nodes, &it);
+	     n;
+	     n = node_map_next(rstate->nodes, &it)) {
+		n->graph_idx = num_nodes++;
+		for (i = 0; i < tal_count(n->chans); i++) {
+			struct chan *chan = n->chans[i];
+			if (is_halfchan_defined(&chan->half[half_chan_to(n, chan)]))
+				num_edges++;
+		}
+	}
+
+	graph = tal(rstate, struct routing_graph);
+	graph->nodes = tal_arr(graph, struct node *, num_nodes);
+	graph->first_edge = tal_arr(graph, u32, num_nodes + 1);
+	graph->edges = tal_arr(graph, struct graph_edge, num_edges);
+
+	num_edges = 0;
+	for (n = node_map_first(rstate->nodes, &it);
+	     n;
+	     n = node_map_next(rstate->nodes, &it)) {
+		graph->nodes[n->graph_idx] = n;
+		graph->first_edge[n->graph_idx] = num_edges;
+		for (i = 0; i < tal_count(n->chans); i++) {
+			struct chan *chan = n->chans[i];
+			int idx = half_chan_to(n, chan);
+			struct half_chan *c = &chan->half[idx];
+
+			if (!is_halfchan_defined(c)) {
+				c->graph_edge = NO_GRAPH_EDGE;
+				continue;
+			}
+			c->graph_edge = num_edges;
+			fill_graph_edge(&graph->edges[num_edges++],
+					chan->nodes[idx]->graph_idx, chan, idx);
+		}
+	}
+	graph->first_edge[num_nodes] = num_edges;
+
+	rstate->graph = graph;
+	tal_add_destructor2(graph, destroy_routing_graph, rstate);
+	return graph;
+}
+
 static void destroy_node(struct node *node, struct routing_state *rstate)
 {
 	node_map_del(rstate->nodes, node);
+	invalidate_graph(rstate);
 
 	/* These remove themselves from the array. */
 	while (tal_count(node->chans))
 		tal_free(node->chans[0]);
+
+	if (node->node_announcement_index)
+		broadcast_del(rstate->broadcasts, node->node_announcement_index);
 }
 
 struct node *get_node(struct routing_state *rstate, const struct pubkey *id)
@@ -147,11 +380,13 @@ static struct node *new_node(struct routing_state *rstate,
 	n->chans = tal_arr(n, struct chan *, 0);
 	n->globalfeatures = NULL;
 	n->node_announcement = NULL;
+	n->node_announcement_offset = 0;
 	n->node_announcement_index = 0;
 	n->last_timestamp = -1;
 	n->addresses = tal_arr(n, struct wireaddr, 0);
 	node_map_add(rstate->nodes, n);
 	tal_add_destructor2(n, destroy_node, rstate);
+	invalidate_graph(rstate);
 
 	return n;
 }
@@ -208,12 +443,33 @@ static bool node_announce_predates_channels(const struct node *node)
 	return true;
 }
 
-static u64 persistent_broadcast(struct routing_state *rstate, const u8 *msg, u32 timestamp)
+/* Broadcast msg, putting it in the gossip_store unless it's there already */
+static u64 persistent_broadcast(struct routing_state *rstate, const u8 *msg,
+				u32 timestamp, u64 store_offset)
+{
+	if (!store_offset)
+		store_offset = gossip_store_add(rstate->store, msg);
+	return insert_broadcast(rstate->broadcasts, store_offset, timestamp);
+}
+
+const u8 *get_broadcast_msg(const tal_t *ctx, struct routing_state *rstate,
+			    u64 index)
 {
-	u64 index = insert_broadcast(rstate->broadcasts, msg, timestamp);
-	if (index)
-		gossip_store_add(rstate->store, msg);
-	return index;
+	return gossip_store_get(ctx, rstate->store,
+				broadcast_store_offset(rstate->broadcasts,
+						       index));
+}
+
+const u8 *get_channel_update_msg(const tal_t *ctx,
+				 struct routing_state *rstate,
+				 const struct half_chan *hc)
+{
+	if (hc->channel_update)
+		return tal_dup_arr(ctx, u8, hc->channel_update,
+				   tal_count(hc->channel_update), 0);
+	if (hc->channel_update_index)
+		return get_broadcast_msg(ctx, rstate, hc->channel_update_index);
+	return NULL;
 }
 
 static void remove_chan_from_node(struct routing_state *rstate,
@@ -231,29 +487,49 @@ static void remove_chan_from_node(struct routing_state *rstate,
 	if (!node->node_announcement_index)
 		return;
 
-	/* Removed only public channel?  Remove node announcement. */
+	/* Removed only public channel?  Remove node announcement, but hold
+	 * onto it in case it gets another. */
 	if (!node_has_broadcastable_channels(node)) {
-		broadcast_del(rstate->broadcasts, node->node_announcement_index,
-			      node->node_announcement);
+		node->node_announcement
+			= get_broadcast_msg(node, rstate,
+					    node->node_announcement_index);
+		node->node_announcement_offset
+			= broadcast_store_offset(rstate->broadcasts,
+						 node->node_announcement_index);
+		broadcast_del(rstate->broadcasts, node->node_announcement_index);
 		node->node_announcement_index = 0;
 	} else if (node_announce_predates_channels(node)) {
 		/* node announcement predates all channel announcements?
 		 * Move to end (we could, in theory, move to just past next
 		 * channel_announce, but we don't care that much about spurious
-		 * retransmissions in this corner case */
-		broadcast_del(rstate->broadcasts, node->node_announcement_index,
-			      node->node_announcement);
-		node->node_announcement_index = persistent_broadcast(
-		    rstate, node->node_announcement, node->last_timestamp);
+		 * retransmissions in this corner case.  It can stay where it
+		 * is in the gossip_store though. */
+		u64 offset = broadcast_store_offset(rstate->broadcasts,
+						    node->node_announcement_index);
+		broadcast_del(rstate->broadcasts, node->node_announcement_index);
+		node->node_announcement_index
+			= insert_broadcast(rstate->broadcasts, offset,
+					   node->last_timestamp);
 	}
 }
 
 static void destroy_chan(struct chan *chan, struct routing_state *rstate)
 {
+	/* Stop broadcasting before the nodes reconsider their announcements */
+	if (chan->channel_announcement_index)
+		broadcast_del(rstate->broadcasts,
+			      chan->channel_announcement_index);
+	for (size_t i = 0; i < ARRAY_SIZE(chan->half); i++) {
+		if (chan->half[i].channel_update_index)
+			broadcast_del(rstate->broadcasts,
+				      chan->half[i].channel_update_index);
+	}
+
 	remove_chan_from_node(rstate, chan->nodes[0], chan);
 	remove_chan_from_node(rstate, chan->nodes[1], chan);
 
 	uintmap_del(&rstate->chanmap, chan->scid.u64);
+	invalidate_graph(rstate);
 }
 
 static void init_half_chan(struct routing_state *rstate,
@@ -263,7 +539,9 @@ static void init_half_chan(struct routing_state *rstate,
 	struct half_chan *c = &chan->half[channel_idx];
 
 	c->channel_update = NULL;
+	c->channel_update_index = 0;
 	c->unroutable_until = 0;
+	c->graph_edge = NO_GRAPH_EDGE;
 
 	/* Set the channel direction */
 	c->channel_flags = channel_idx;
@@ -308,6 +586,7 @@ struct chan *new_chan(struct routing_state *rstate,
 	chan->nodes[!n1idx] = n2;
 	chan->txout_script = NULL;
 	chan->channel_announce = NULL;
+	chan->channel_announce_offset = 0;
 	chan->channel_announcement_index = 0;
 	chan->satoshis = satoshis;
 	chan->local_disabled = false;
@@ -325,33 +604,16 @@ struct chan *new_chan(struct routing_state *rstate,
 	return chan;
 }
 
-/* Too big to reach, but don't overflow if added. */
-#define INFINITE 0x3FFFFFFFFFFFFFFFULL
-
-static void clear_bfg(struct node_map *nodes)
-{
-	struct node *n;
-	struct node_map_iter it;
-
-	for (n = node_map_first(nodes, &it); n; n = node_map_next(nodes, &it)) {
-		size_t i;
-		for (i = 0; i < ARRAY_SIZE(n->bfg); i++) {
-			n->bfg[i].total = INFINITE;
-			n->bfg[i].risk = 0;
-		}
-	}
-}
-
-static u64 connection_fee(const struct half_chan *c, u64 msatoshi)
+static u64 connection_fee(u32 base_fee, u32 proportional_fee, u64 msatoshi)
 {
 	u64 fee;
 
 	assert(msatoshi < MAX_MSATOSHI);
-	assert(c->proportional_fee < MAX_PROPORTIONAL_FEE);
+	assert(proportional_fee < MAX_PROPORTIONAL_FEE);
 
-	fee = (c->proportional_fee * msatoshi) / 1000000;
-	/* This can't overflow: c->base_fee is a u32 */
-	return c->base_fee + fee;
+	fee = (proportional_fee * msatoshi) / 1000000;
+	/* This can't overflow: base_fee is a u32 */
+	return base_fee + fee;
 }
 
 /* Risk of passing through this channel.  We insert a tiny constant here
@@ -364,25 +626,191 @@ static u64 risk_fee(u64 amount, u32 delay, double riskfactor)
 /* Check that we can fit through this channel's indicated
  * maximum_ and minimum_msat requirements.
  */
-static bool hc_can_carry(const struct half_chan *hc, u64 requiredcap)
+static bool edge_can_carry(const struct graph_edge *e, u64 requiredcap)
+{
+	return e->htlc_maximum_msat >= requiredcap &&
+		e->htlc_minimum_msat <= requiredcap;
+}
+
+/* Determine if the given edge is routable */
+static bool edge_is_routable(const struct graph_edge *e, time_t now)
 {
-	return hc->htlc_maximum_msat >= requiredcap &&
-		hc->htlc_minimum_msat <= requiredcap;
+	return !(e->channel_flags & ROUTING_FLAGS_DISABLED)
+		&& e->unroutable_until < now;
+}
+
+/* A path from some node to the destination, as found by find_route. */
+struct route_label {
+	/* Index of node this path starts at. */
+	u32 node;
+	/* Index of edge from node towards destination (or NO_GRAPH_EDGE). */
+	u32 edge;
+	/* The label this extends (which starts at other end of edge). */
+	u32 prev;
+	/* Number of channels in path. */
+	u32 hops;
+	/* Total to get to destination from here. */
+	u64 total;
+	/* Total risk premium of this path. */
+	u64 risk;
+	/* Have we popped it from by_cost yet? */
+	bool popped;
+};
+
+/* What find_route knows about each node, for each path length. */
+struct node_scratch {
+	/* Cheapest path from here of each length queued so far. */
+	u64 queued_cost[ROUTING_MAX_HOPS + 1];
+	/* Bit n is set once we've settled the path of length n from here. */
+	u32 settled;
+};
+
+/* We keep the ordering key in the heap itself, to avoid chasing labels. */
+struct heap_entry {
+	u64 key;
+	u32 hops;
+	u32 label;
+};
+
+/* Binary min-heap of labels, ordered by heap_before */
+struct label_heap {
+	struct heap_entry *ents;
+	size_t num;
+};
+
+/* Per-query state for find_route. */
+struct route_search {
+	const struct routing_graph *graph;
+
+	/* Indexed by node->graph_idx */
+	struct node_scratch *scratch;
+
+	/* All labels we've created: we never free one during a search. */
+	struct route_label *labels;
+	size_t num_labels;
+
+	/* Labels by cost, the order we settle them in. */
+	struct label_heap by_cost;
+	/* Labels by total, so we know when nothing left can beat our best:
+	 * we leave popped labels in here until they reach the top. */
+	struct label_heap by_total;
+};
+
+static u64 label_cost(const struct route_label *l)
+{
+	return l->total + l->risk;
+}
+
+/* Lowest key first; all things equal, prefer shorter. */
+static bool heap_before(const struct heap_entry *a, const struct heap_entry *b)
+{
+	if (a->key != b->key)
+		return a->key < b->key;
+	return a->hops < b->hops;
+}
+
+static void heap_push(struct label_heap *heap, u64 key, u32 hops, u32 label)
+{
+	struct heap_entry ent;
+	size_t i = heap->num++;
+
+	if (heap->num > tal_count(heap->ents))
+		tal_resize(&heap->ents, heap->num * 2);
+
+	ent.key = key;
+	ent.hops = hops;
+	ent.label = label;
+
+	/* Sift up: move parents down until we find our slot. */
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+		if (!heap_before(&ent, &heap->ents[parent]))
+			break;
+		heap->ents[i] = heap->ents[parent];
+		i = parent;
+	}
+	heap->ents[i] = ent;
+}
+
+static u32 heap_pop(struct label_heap *heap)
+{
+	u32 top;
+	struct heap_entry last;
+	size_t i = 0;
+
+	assert(heap->num);
+	top = heap->ents[0].label;
+	last = heap->ents[--heap->num];
+
+	/* Sift down: move children up until last fits. */
+	for (;;) {
+		size_t min = 2 * i + 1;
+		if (min >= heap->num)
+			break;
+		if (min + 1 < heap->num
+		    && heap_before(&heap->ents[min + 1], &heap->ents[min]))
+			min++;
+		if (!heap_before(&heap->ents[min], &last))
+			break;
+		heap->ents[i] = heap->ents[min];
+		i = min;
+	}
+	heap->ents[i] = last;
+	return top;
+}
+
+/* Lowest total of any label we haven't popped by cost yet.  Totals only
+ * grow along a path, so nothing we find from here on can be lower. */
+static u64 min_queued_total(struct route_search *rs)
+{
+	while (rs->by_total.num
+	       && rs->labels[rs->by_total.ents[0].label].popped)
+		heap_pop(&rs->by_total);
+
+	if (!rs->by_total.num)
+		return INFINITE;
+	return rs->by_total.ents[0].key;
+}
+
+static u32 add_label(struct route_search *rs, u32 node, u32 edge,
+		     u32 prev, u32 hops, u64 total, u64 risk)
+{
+	struct route_label *l;
+	u32 idx = rs->num_labels++;
+
+	if (rs->num_labels > tal_count(rs->labels))
+		tal_resize(&rs->labels, rs->num_labels * 2);
+
+	l = &rs->labels[idx];
+	l->node = node;
+	l->edge = edge;
+	l->prev = prev;
+	l->hops = hops;
+	l->total = total;
+	l->risk = risk;
+	l->popped = false;
+	heap_push(&rs->by_cost, label_cost(l), hops, idx);
+	heap_push(&rs->by_total, total, hops, idx);
+	return idx;
 }
 
 /* We track totals, rather than costs.  That's because the fee depends
  * on the current amount passing through. */
-static void bfg_one_edge(struct node *node,
-			 struct chan *chan, int idx,
-			 double riskfactor,
-			 double fuzz, const struct siphash_seed *base_seed)
+static void route_one_edge(struct route_search *rs, u32 label, u32 edge,
+			   double riskfactor,
+			   double fuzz, const struct siphash_seed *base_seed)
 {
-	size_t h;
+	/* Copy: add_label can move labels array */
+	const struct route_label l = rs->labels[label];
+	const struct graph_edge *e = &rs->graph->edges[edge];
 	double fee_scale = 1.0;
-	const struct half_chan *c = &chan->half[idx];
+	struct node_scratch *src;
+	/* FIXME: Bias against smaller channels. */
+	u64 fee, risk, requiredcap, cost;
+	u32 hops = l.hops + 1;
 
 	if (fuzz != 0.0) {
-		u64 h =	siphash24(base_seed, &chan->scid, sizeof(chan->scid));
+		u64 h = siphash24(base_seed, &e->scid, sizeof(e->scid));
 
 		/* Scale fees for this channel */
 		/* rand = (h / UINT64_MAX)  random number between 0.0 -> 1.0
@@ -392,54 +820,40 @@ static void bfg_one_edge(struct node *node,
 		fee_scale = 1.0 + (2.0 * fuzz * h / UINT64_MAX) - fuzz;
 	}
 
-	for (h = 0; h < ROUTING_MAX_HOPS; h++) {
-		struct node *src;
-		/* FIXME: Bias against smaller channels. */
-		u64 fee;
-		u64 risk;
-		u64 requiredcap;
+	fee = connection_fee(e->base_fee, e->proportional_fee, l.total)
+		* fee_scale;
+	requiredcap = l.total + fee;
+	risk = l.risk + risk_fee(requiredcap, e->delay, riskfactor);
 
-		if (node->bfg[h].total == INFINITE)
-			continue;
+	if (!edge_can_carry(e, requiredcap)) {
+		/* Skip a channel if it indicated that it won't route
+		 * the requested amount. */
+		return;
+	} else if (requiredcap >= MAX_MSATOSHI) {
+		SUPERVERBOSE("...extreme %"PRIu64
+			     " + fee %"PRIu64
+			     " + risk %"PRIu64" ignored",
+			     l.total, fee, risk);
+		return;
+	}
 
-		fee = connection_fee(c, node->bfg[h].total) * fee_scale;
-		requiredcap = node->bfg[h].total + fee;
-		risk = node->bfg[h].risk +
-		       risk_fee(requiredcap, c->delay, riskfactor);
+	src = &rs->scratch[e->src];
 
-		if (!hc_can_carry(c, requiredcap)) {
-			/* Skip a channel if it indicated that it won't route
-			 * the requested amount. */
-			continue;
-		} else if (requiredcap >= MAX_MSATOSHI) {
-			SUPERVERBOSE("...extreme %"PRIu64
-				     " + fee %"PRIu64
-				     " + risk %"PRIu64" ignored",
-				     node->bfg[h].total, fee, risk);
-			continue;
-		}
+	/* Settled paths of this length are cheaper, so ignore this. */
+	if (src->settled & (1U << hops))
+		return;
 
-		/* nodes[0] is src for connections[0] */
-		src = chan->nodes[idx];
-		if (requiredcap + risk <
-		    src->bfg[h + 1].total + src->bfg[h + 1].risk) {
-			SUPERVERBOSE("...%s can reach here in hoplen %zu total %"PRIu64,
-				     type_to_string(tmpctx, struct pubkey,
-						    &src->id),
-				     h, node->bfg[h].total + fee);
-			src->bfg[h+1].total = requiredcap;
-			src->bfg[h+1].risk = risk;
-			src->bfg[h+1].prev = chan;
-		}
-	}
-}
+	/* Similarly, don't bother queueing if we have a cheaper one. */
+	cost = requiredcap + risk;
+	if (cost >= src->queued_cost[hops])
+		return;
+	src->queued_cost[hops] = cost;
 
-/* Determine if the given half_chan is routable */
-static bool hc_is_routable(const struct chan *chan, int idx, time_t now)
-{
-	return !chan->local_disabled
-		&& is_halfchan_enabled(&chan->half[idx])
-		&& chan->half[idx].unroutable_until < now;
+	SUPERVERBOSE("...%s can reach here in hoplen %u total %"PRIu64,
+		     type_to_string(tmpctx, struct pubkey,
+				    &rs->graph->nodes[e->src]->id),
+		     hops, requiredcap);
+	add_label(rs, e->src, edge, label, hops, requiredcap, risk);
 }
 
 /* riskfactor is already scaled to per-block amount */
@@ -451,9 +865,10 @@ find_route(const tal_t *ctx, struct routing_state *rstate,
 	   u64 *fee)
 {
 	struct chan **route;
-	struct node *n, *src, *dst;
-	struct node_map_iter it;
-	int runs, i, best;
+	struct node *src, *dst;
+	struct route_search rs;
+	size_t i;
+	u32 best, label;
 	/* Call time_now() once at the start, so that our tight loop
 	 * does not keep calling into operating system for the
 	 * current time */
@@ -484,75 +899,127 @@ find_route(const tal_t *ctx, struct routing_state *rstate,
 		return NULL;
 	}
 
-	/* Reset all the information. */
-	clear_bfg(rstate->nodes);
-
-	/* Bellman-Ford-Gibson: like Bellman-Ford, but keep values for
-	 * every path length. */
-	src->bfg[0].total = msatoshi;
-	src->bfg[0].risk = 0;
-
-	for (runs = 0; runs < ROUTING_MAX_HOPS; runs++) {
-		SUPERVERBOSE("Run %i", runs);
-		/* Run through every edge. */
-		for (n = node_map_first(rstate->nodes, &it);
-		     n;
-		     n = node_map_next(rstate->nodes, &it)) {
-			size_t num_edges = tal_count(n->chans);
-			for (i = 0; i < num_edges; i++) {
-				struct chan *chan = n->chans[i];
-				int idx = half_chan_to(n, chan);
-
-				SUPERVERBOSE("Node %s edge %i/%zu",
-					     type_to_string(tmpctx, struct pubkey,
-							    &n->id),
-					     i, num_edges);
-
-				if (!hc_is_routable(chan, idx, now)) {
-					SUPERVERBOSE("...unroutable (local_disabled = %i, is_halfchan_enabled = %i, unroutable_until = %i",
-						     chan->local_disabled,
-						     is_halfchan_enabled(&chan->half[idx]),
-						     chan->half[idx].unroutable_until >= now);
-					continue;
-				}
-				bfg_one_edge(n, chan, idx,
-					     riskfactor, fuzz, base_seed);
-				SUPERVERBOSE("...done");
-			}
-		}
+	/* node_scratch.settled has a bit for each path length. */
+	BUILD_ASSERT(ROUTING_MAX_HOPS < 32);
+	rs.graph = get_graph(rstate);
+	rs.scratch = tal_arr(tmpctx, struct node_scratch,
+			     tal_count(rs.graph->nodes));
+	for (i = 0; i < tal_count(rs.scratch); i++) {
+		for (size_t h = 0; h <= ROUTING_MAX_HOPS; h++)
+			rs.scratch[i].queued_cost[h] = INFINITE;
+		rs.scratch[i].settled = 0;
 	}
+	rs.labels = tal_arr(tmpctx, struct route_label, 64);
+	rs.num_labels = 0;
+	rs.by_cost.ents = tal_arr(tmpctx, struct heap_entry, 64);
+	rs.by_cost.num = 0;
+	rs.by_total.ents = tal_arr(tmpctx, struct heap_entry, 64);
+	rs.by_total.num = 0;
+
+	/* Dijkstra, but since we have a hop limit a node is settled once for
+	 * each path length: the cheapest path of that length from there. */
+	add_label(&rs, src->graph_idx, NO_GRAPH_EDGE, 0, 0, msatoshi, 0);
+
+	best = UINT32_MAX;
+	while (rs.by_cost.num) {
+		u32 n, e;
+
+		/* We're looking for lowest total, but we settle by cost
+		 * (total plus risk), so a later path can still have a lower
+		 * total: stop once nothing queued can. */
+		if (best != UINT32_MAX
+		    && min_queued_total(&rs) >= rs.labels[best].total)
+			break;
+
+		label = heap_pop(&rs.by_cost);
+		rs.labels[label].popped = true;
+		n = rs.labels[label].node;
+
+		/* Already settled a cheaper path of this length? */
+		if (rs.scratch[n].settled & (1U << rs.labels[label].hops))
+			continue;
+		rs.scratch[n].settled |= (1U << rs.labels[label].hops);
+
+		/* This may not be our best: see above. */
+		if (n == dst->graph_idx) {
+			if (best == UINT32_MAX
+			    || rs.labels[label].total < rs.labels[best].total)
+				best = label;
+			continue;
+		}
 
-	best = 0;
-	for (i = 1; i <= ROUTING_MAX_HOPS; i++) {
-		if (dst->bfg[i].total < dst->bfg[best].total)
-			best = i;
+		if (rs.labels[label].hops == ROUTING_MAX_HOPS)
+			continue;
+
+		/* Run through every edge into this node. */
+		for (e = rs.graph->first_edge[n];
+		     e < rs.graph->first_edge[n+1];
+		     e++) {
+			SUPERVERBOSE("Node %s edge %u",
+				     type_to_string(tmpctx, struct pubkey,
+						    &rs.graph->nodes[n]->id),
+				     e);
+
+			if (!edge_is_routable(&rs.graph->edges[e], now)) {
+				SUPERVERBOSE("...unroutable (channel_flags = %u, unroutable_until = %i",
+					     rs.graph->edges[e].channel_flags,
+					     rs.graph->edges[e].unroutable_until >= now);
+				continue;
+			}
+			route_one_edge(&rs, label, e,
+				       riskfactor, fuzz, base_seed);
+		}
 	}
 
 	/* No route? */
-	if (dst->bfg[best].total >= INFINITE) {
+	if (best == UINT32_MAX) {
 		status_trace("find_route: No route to %s",
 			     type_to_string(tmpctx, struct pubkey, to));
-		return NULL;
+		route = NULL;
+		goto out;
 	}
 
 	/* We (dst) don't charge ourselves fees, so skip first hop */
-	n = other_node(dst, dst->bfg[best].prev);
-	*fee = n->bfg[best-1].total - msatoshi;
+	*fee = rs.labels[rs.labels[best].prev].total - msatoshi;
 
 	/* Lay out route */
-	route = tal_arr(ctx, struct chan *, best);
-	for (i = 0, n = dst;
-	     i < best;
-	     n = other_node(n, n->bfg[best-i].prev), i++) {
-		route[i] = n->bfg[best-i].prev;
+	route = tal_arr(ctx, struct chan *, rs.labels[best].hops);
+	for (i = 0, label = best;
+	     i < tal_count(route);
+	     label = rs.labels[label].prev, i++) {
+		route[i] = rs.graph->edges[rs.labels[label].edge].chan;
 	}
-	assert(n == src);
+	assert(rs.labels[label].node == src->graph_idx);
 
+out:
+	tal_free(rs.scratch);
+	tal_free(rs.labels);
+	tal_free(rs.by_cost.ents);
+	tal_free(rs.by_total.ents);
 	return route;
 }
 
+/* Like check_signed_hash, but we trust signatures we've already checked. */
+static bool check_gossip_sig(struct routing_state *rstate,
+			     const struct sha256_double *hash,
+			     const secp256k1_ecdsa_signature *sig,
+			     const struct pubkey *key)
+{
+	struct gossip_sig gsig;
+	const struct sig_cache_entry *e;
+
+	gsig.hash = *hash;
+	gsig.sig = *sig;
+	gsig.key = *key;
+	e = sig_htable_get(&rstate->sig_cache->htable, &gsig);
+	if (e && e->ok)
+		return true;
+	return check_signed_hash(hash, sig, key);
+}
+
 /* Verify the signature of a channel_update message */
 static u8 *check_channel_update(const tal_t *ctx,
+				struct routing_state *rstate,
 				const struct pubkey *node_key,
 				const secp256k1_ecdsa_signature *node_sig,
 				const u8 *update)
@@ -562,7 +1029,7 @@ static u8 *check_channel_update(const tal_t *ctx,
 	struct sha256_double hash;
 	sha256_double(&hash, update + offset, tal_count(update) - offset);
 
-	if (!check_signed_hash(&hash, node_sig, node_key))
+	if (!check_gossip_sig(rstate, &hash, node_sig, node_key))
 		return towire_errorfmt(ctx, NULL,
 				       "Bad signature for %s hash %s"
 				       " on channel_update %s",
@@ -577,6 +1044,7 @@ static u8 *check_channel_update(const tal_t *ctx,
 }
 
 static u8 *check_channel_announcement(const tal_t *ctx,
+	struct routing_state *rstate,
 	const struct pubkey *node1_key, const struct pubkey *node2_key,
 	const struct pubkey *bitcoin1_key, const struct pubkey *bitcoin2_key,
 	const secp256k1_ecdsa_signature *node1_sig,
@@ -590,7 +1058,7 @@ static u8 *check_channel_announcement(const tal_t *ctx,
 	sha256_double(&hash, announcement + offset,
 		      tal_count(announcement) - offset);
 
-	if (!check_signed_hash(&hash, node1_sig, node1_key)) {
+	if (!check_gossip_sig(rstate, &hash, node1_sig, node1_key)) {
 		return towire_errorfmt(ctx, NULL,
 				       "Bad node_signature_1 %s hash %s"
 				       " on node_announcement %s",
@@ -602,7 +1070,7 @@ static u8 *check_channel_announcement(const tal_t *ctx,
 						      &hash),
 				       tal_hex(ctx, announcement));
 	}
-	if (!check_signed_hash(&hash, node2_sig, node2_key)) {
+	if (!check_gossip_sig(rstate, &hash, node2_sig, node2_key)) {
 		return towire_errorfmt(ctx, NULL,
 				       "Bad node_signature_2 %s hash %s"
 				       " on node_announcement %s",
@@ -614,7 +1082,7 @@ static u8 *check_channel_announcement(const tal_t *ctx,
 						      &hash),
 				       tal_hex(ctx, announcement));
 	}
-	if (!check_signed_hash(&hash, bitcoin1_sig, bitcoin1_key)) {
+	if (!check_gossip_sig(rstate, &hash, bitcoin1_sig, bitcoin1_key)) {
 		return towire_errorfmt(ctx, NULL,
 				       "Bad bitcoin_signature_1 %s hash %s"
 				       " on node_announcement %s",
@@ -626,7 +1094,7 @@ static u8 *check_channel_announcement(const tal_t *ctx,
 						      &hash),
 				       tal_hex(ctx, announcement));
 	}
-	if (!check_signed_hash(&hash, bitcoin2_sig, bitcoin2_key)) {
+	if (!check_gossip_sig(rstate, &hash, bitcoin2_sig, bitcoin2_key)) {
 		return towire_errorfmt(ctx, NULL,
 				       "Bad bitcoin_signature_2 %s hash %s"
 				       " on node_announcement %s",
@@ -706,24 +1174,30 @@ static void add_channel_announce_to_broadcast(struct routing_state *rstate,
 					      u32 timestamp)
 {
 	chan->channel_announcement_index =
-	    persistent_broadcast(rstate, chan->channel_announce, timestamp);
+	    persistent_broadcast(rstate, chan->channel_announce, timestamp,
+				 chan->channel_announce_offset);
 	rstate->local_channel_announced |= is_local_channel(rstate, chan);
 
+	/* It's in the gossip_store now, so we don't need it. */
+	chan->channel_announce = tal_free(chan->channel_announce);
+	chan->channel_announce_offset = 0;
+
 	/* If we've been waiting for this, now we can announce node */
 	for (size_t i = 0; i < ARRAY_SIZE(chan->nodes); i++) {
 		struct node *node = chan->nodes[i];
 		if (!node->node_announcement)
 			continue;
-		if (!node->node_announcement_index) {
-			node->node_announcement_index = persistent_broadcast(
-			    rstate, node->node_announcement,
-			    node->last_timestamp);
-		}
+		node->node_announcement_index = persistent_broadcast(
+		    rstate, node->node_announcement, node->last_timestamp,
+		    node->node_announcement_offset);
+		node->node_announcement = tal_free(node->node_announcement);
+		node->node_announcement_offset = 0;
 	}
 }
 
 bool routing_add_channel_announcement(struct routing_state *rstate,
-				      const u8 *msg TAKES, u64 satoshis)
+				      const u8 *msg TAKES, u64 satoshis,
+				      u64 store_offset)
 {
 	struct chan *chan;
 	secp256k1_ecdsa_signature node_signature_1, node_signature_2;
@@ -749,8 +1223,9 @@ bool routing_add_channel_announcement(struct routing_state *rstate,
 	if (!chan)
 		chan = new_chan(rstate, &scid, &node_id_1, &node_id_2, satoshis);
 
-	/* Channel is now public. */
+	/* Channel is now public (we broadcast on first channel_update). */
 	chan->channel_announce = tal_dup_arr(chan, u8, msg, tal_count(msg), 0);
+	chan->channel_announce_offset = store_offset;
 
 	/* Apply any private updates. */
 	for (size_t i = 0; i < ARRAY_SIZE(chan->half); i++) {
@@ -760,7 +1235,7 @@ bool routing_add_channel_announcement(struct routing_state *rstate,
 
 		/* Remove from channel, otherwise it will be freed! */
 		chan->half[i].channel_update = NULL;
-		routing_add_channel_update(rstate, take(update));
+		routing_add_channel_update(rstate, take(update), 0);
 	}
 
 	return true;
@@ -857,7 +1332,7 @@ u8 *handle_channel_announcement(struct routing_state *rstate,
 		goto ignored;
 	}
 
-	err = check_channel_announcement(rstate,
+	err = check_channel_announcement(rstate, rstate,
 					 &pending->node_id_1,
 					 &pending->node_id_2,
 					 &pending->bitcoin_key_1,
@@ -974,7 +1449,8 @@ void handle_pending_cannouncement(struct routing_state *rstate,
 		return;
 	}
 
-	if (!routing_add_channel_announcement(rstate, pending->announce, satoshis))
+	if (!routing_add_channel_announcement(rstate, pending->announce, satoshis,
+					      0))
 		status_failed(STATUS_FAIL_INTERNAL_ERROR,
 			      "Could not add channel_announcement");
 
@@ -1006,7 +1482,8 @@ static void update_pending(struct pending_cannouncement *pending,
 	}
 }
 
-static void set_connection_values(struct chan *chan,
+static void set_connection_values(struct routing_state *rstate,
+				  struct chan *chan,
 				  int idx,
 				  u32 base_fee,
 				  u32 proportional_fee,
@@ -1045,10 +1522,13 @@ static void set_connection_values(struct chan *chan,
 			     c->proportional_fee);
 		c->channel_flags |= ROUTING_FLAGS_DISABLED;
 	}
+
+	update_graph_edge(rstate, chan, idx);
 }
 
 bool routing_add_channel_update(struct routing_state *rstate,
-				const u8 *update TAKES)
+				const u8 *update TAKES,
+				u64 store_offset)
 {
 	secp256k1_ecdsa_signature signature;
 	struct short_channel_id short_channel_id;
@@ -1061,6 +1541,7 @@ bool routing_add_channel_update(struct routing_state *rstate,
 	u64 htlc_maximum_msat;
 	struct bitcoin_blkid chain_hash;
 	struct chan *chan;
+	struct half_chan *hc;
 	u8 direction;
 
 	if (!fromwire_channel_update(update, &signature, &chain_hash,
@@ -1095,21 +1576,27 @@ bool routing_add_channel_update(struct routing_state *rstate,
 	}
 
 	direction = channel_flags & 0x1;
-	set_connection_values(chan, direction, fee_base_msat,
+	set_connection_values(rstate, chan, direction, fee_base_msat,
 			      fee_proportional_millionths, expiry,
 			      message_flags, channel_flags,
 			      timestamp, htlc_minimum_msat,
 			      htlc_maximum_msat);
 
 	/* Replace any old one. */
-	tal_free(chan->half[direction].channel_update);
-	chan->half[direction].channel_update
-		= tal_dup_arr(chan, u8, update, tal_count(update), 0);
+	hc = &chan->half[direction];
+	hc->channel_update = tal_free(hc->channel_update);
+	if (hc->channel_update_index) {
+		broadcast_del(rstate->broadcasts, hc->channel_update_index);
+		hc->channel_update_index = 0;
+	}
 
 	/* For private channels, we get updates without an announce: don't
-	 * broadcast them! */
-	if (!chan->channel_announce)
+	 * broadcast them, just remember them! */
+	if (!is_chan_public(chan)) {
+		hc->channel_update
+			= tal_dup_arr(chan, u8, update, tal_count(update), 0);
 		return true;
+	}
 
 	/* BOLT #7:
 	 *   - MUST consider the `timestamp` of the `channel_announcement` to be
@@ -1120,8 +1607,11 @@ bool routing_add_channel_update(struct routing_state *rstate,
 	if (chan->channel_announcement_index == 0)
 		add_channel_announce_to_broadcast(rstate, chan, timestamp);
 
-	persistent_broadcast(rstate, chan->half[direction].channel_update,
-			     timestamp);
+	hc->channel_update_index = persistent_broadcast(rstate, update,
+							timestamp,
+							store_offset);
+	if (taken(update))
+		tal_free(update);
 	return true;
 }
 
@@ -1224,22 +1714,25 @@ u8 *handle_channel_update(struct routing_state *rstate, const u8 *update TAKES,
 
 	if (is_halfchan_defined(c) && timestamp <= c->last_timestamp) {
 		/* They're not supposed to do this! */
-		if (timestamp == c->last_timestamp
-		    && !memeq(c->channel_update, tal_count(c->channel_update),
-			      serialized, tal_count(serialized))) {
-			status_unusual("Bad gossip repeated timestamp for %s(%u): %s then %s",
-				       type_to_string(tmpctx,
-						      struct short_channel_id,
-						      &short_channel_id),
-				       channel_flags,
-				       tal_hex(tmpctx, c->channel_update),
-				       tal_hex(tmpctx, serialized));
+		if (timestamp == c->last_timestamp) {
+			const u8 *old = get_channel_update_msg(tmpctx,
+							       rstate, c);
+			if (!memeq(old, tal_count(old),
+				   serialized, tal_count(serialized)))
+				status_unusual("Bad gossip repeated timestamp for %s(%u): %s then %s",
+					       type_to_string(tmpctx,
+							      struct short_channel_id,
+							      &short_channel_id),
+					       channel_flags,
+					       tal_hex(tmpctx, old),
+					       tal_hex(tmpctx, serialized));
 		}
 		SUPERVERBOSE("Ignoring outdated update.");
 		return NULL;
 	}
 
-	err = check_channel_update(rstate, &chan->nodes[direction]->id,
+	err = check_channel_update(rstate, rstate,
+				   &chan->nodes[direction]->id,
 				   &signature, serialized);
 	if (err) {
 		/* BOLT #7:
@@ -1264,7 +1757,7 @@ u8 *handle_channel_update(struct routing_state *rstate, const u8 *update TAKES,
 		     : "UNDEFINED",
 		     source);
 
-	if (!routing_add_channel_update(rstate, serialized))
+	if (!routing_add_channel_update(rstate, serialized, 0))
 		status_failed(STATUS_FAIL_INTERNAL_ERROR,
 			      "Failed adding channel_update");
 
@@ -1302,7 +1795,9 @@ static struct wireaddr *read_addresses(const tal_t *ctx, const u8 *ser)
 	return wireaddrs;
 }
 
-bool routing_add_node_announcement(struct routing_state *rstate, const u8 *msg TAKES)
+bool routing_add_node_announcement(struct routing_state *rstate,
+				   const u8 *msg TAKES,
+				   u64 store_offset)
 {
 	struct node *node;
 	secp256k1_ecdsa_signature signature;
@@ -1336,13 +1831,24 @@ bool routing_add_node_announcement(struct routing_state *rstate, const u8 *msg T
 	tal_free(node->globalfeatures);
 	node->globalfeatures = tal_steal(node, features);
 
-	tal_free(node->node_announcement);
-	node->node_announcement = tal_dup_arr(node, u8, msg, tal_count(msg), 0);
+	/* Replace any old one. */
+	node->node_announcement = tal_free(node->node_announcement);
+	node->node_announcement_offset = 0;
+	if (node->node_announcement_index) {
+		broadcast_del(rstate->broadcasts, node->node_announcement_index);
+		node->node_announcement_index = 0;
+	}
 
 	/* We might be waiting for channel_announce to be released. */
 	if (node_has_broadcastable_channels(node)) {
 		node->node_announcement_index = persistent_broadcast(
-		    rstate, node->node_announcement, timestamp);
+		    rstate, msg, timestamp, store_offset);
+		if (taken(msg))
+			tal_free(msg);
+	} else {
+		node->node_announcement
+			= tal_dup_arr(node, u8, msg, tal_count(msg), 0);
+		node->node_announcement_offset = store_offset;
 	}
 	return true;
 }
@@ -1397,7 +1903,7 @@ u8 *handle_node_announcement(struct routing_state *rstate, const u8 *node_ann)
 	}
 
 	sha256_double(&hash, serialized + 66, tal_count(serialized) - 66);
-	if (!check_signed_hash(&hash, &signature, &node_id)) {
+	if (!check_gossip_sig(rstate, &hash, &signature, &node_id)) {
 		/* BOLT #7:
 		 *
 		 * - if `signature` is NOT a valid signature (using `node_id`
@@ -1476,11 +1982,138 @@ u8 *handle_node_announcement(struct routing_state *rstate, const u8 *node_ann)
 	status_trace("Received node_announcement for node %s",
 		     type_to_string(tmpctx, struct pubkey, &node_id));
 
-	applied = routing_add_node_announcement(rstate, serialized);
+	applied = routing_add_node_announcement(rstate, serialized, 0);
 	assert(applied);
 	return NULL;
 }
 
+static void add_sig_to_check(struct routing_state *rstate,
+			     const struct sha256_double *hash,
+			     const secp256k1_ecdsa_signature *sig,
+			     const struct pubkey *key,
+			     struct gossip_sig **sigs)
+{
+	struct gossip_sig gsig;
+
+	gsig.hash = *hash;
+	gsig.sig = *sig;
+	gsig.key = *key;
+
+	/* Already checked, or being checked?  Many peers send us the same
+	 * gossip. */
+	if (sig_htable_get(&rstate->sig_cache->htable, &gsig))
+		return;
+
+	sig_cache_add(rstate->sig_cache, &gsig, false);
+	*tal_arr_expand(sigs) = gsig;
+}
+
+void gossip_sigs_to_check(struct routing_state *rstate, const u8 *msg,
+			  struct gossip_sig **sigs)
+{
+	secp256k1_ecdsa_signature sig[4];
+	struct pubkey key[4];
+	struct sha256_double hash;
+	struct bitcoin_blkid chain_hash;
+	struct short_channel_id scid;
+	struct pending_cannouncement *pending;
+	struct chan *chan;
+	u8 *features, *addresses, rgb_color[3], alias[32];
+	u8 message_flags, channel_flags;
+	u16 expiry;
+	u32 timestamp, fee_base_msat, fee_proportional_millionths;
+	u64 htlc_minimum_msat;
+
+	/* These mirror what handle_* will ignore before checking. */
+	switch (fromwire_peektype(msg)) {
+	case WIRE_CHANNEL_ANNOUNCEMENT:
+		if (!fromwire_channel_announcement(tmpctx, msg,
+						   &sig[0], &sig[1],
+						   &sig[2], &sig[3],
+						   &features, &chain_hash, &scid,
+						   &key[0], &key[1],
+						   &key[2], &key[3]))
+			return;
+		if (!bitcoin_blkid_eq(&chain_hash, &rstate->chain_hash))
+			return;
+		chan = get_channel(rstate, &scid);
+		if (chan && is_chan_public(chan))
+			return;
+		if (find_pending_cannouncement(rstate, &scid))
+			return;
+
+		/* 2 byte msg type + 256 byte signatures */
+		sha256_double(&hash, msg + 258, tal_count(msg) - 258);
+		for (size_t i = 0; i < ARRAY_SIZE(sig); i++)
+			add_sig_to_check(rstate, &hash, &sig[i], &key[i], sigs);
+		return;
+
+	case WIRE_CHANNEL_UPDATE:
+		if (!fromwire_channel_update(msg, &sig[0], &chain_hash, &scid,
+					     &timestamp, &message_flags,
+					     &channel_flags, &expiry,
+					     &htlc_minimum_msat,
+					     &fee_base_msat,
+					     &fee_proportional_millionths))
+			return;
+		if (!bitcoin_blkid_eq(&chain_hash, &rstate->chain_hash))
+			return;
+
+		/* It's checked once its channel_announcement is OK. */
+		pending = find_pending_cannouncement(rstate, &scid);
+		if (pending) {
+			if (channel_flags & 0x1)
+				key[0] = pending->node_id_2;
+			else
+				key[0] = pending->node_id_1;
+		} else {
+			const struct half_chan *c;
+
+			chan = get_channel(rstate, &scid);
+			if (!chan)
+				return;
+			c = &chan->half[channel_flags & 0x1];
+			if (is_halfchan_defined(c)
+			    && timestamp <= c->last_timestamp)
+				return;
+			key[0] = chan->nodes[channel_flags & 0x1]->id;
+		}
+
+		/* 2 byte msg type + 64 byte signatures */
+		sha256_double(&hash, msg + 66, tal_count(msg) - 66);
+		add_sig_to_check(rstate, &hash, &sig[0], &key[0], sigs);
+		return;
+
+	case WIRE_NODE_ANNOUNCEMENT:
+		/* Even stale ones get checked, so remember those too. */
+		if (!fromwire_node_announcement(tmpctx, msg, &sig[0],
+						&features, &timestamp,
+						&key[0], rgb_color, alias,
+						&addresses))
+			return;
+
+		sha256_double(&hash, msg + 66, tal_count(msg) - 66);
+		add_sig_to_check(rstate, &hash, &sig[0], &key[0], sigs);
+		return;
+	}
+}
+
+void gossip_sig_checked(struct routing_state *rstate,
+			const struct gossip_sig *gsig, bool ok)
+{
+	struct sig_cache_entry *e;
+
+	/* It may have been pushed out of the cache meanwhile. */
+	e = sig_htable_get(&rstate->sig_cache->htable, gsig);
+	if (!e) {
+		if (ok)
+			sig_cache_add(rstate->sig_cache, gsig, true);
+	} else if (ok)
+		e->ok = true;
+	else
+		sig_cache_del(rstate->sig_cache, e);
+}
+
 struct route_hop *get_route(const tal_t *ctx, struct routing_state *rstate,
 			    const struct pubkey *source,
 			    const struct pubkey *destination,
@@ -1519,7 +2152,9 @@ struct route_hop *get_route(const tal_t *ctx, struct routing_state *rstate,
 		hops[i].nodeid = n->id;
 		hops[i].amount = total_amount;
 		hops[i].delay = total_delay;
-		total_amount += connection_fee(c, total_amount);
+		total_amount += connection_fee(c->base_fee,
+					       c->proportional_fee,
+					       total_amount);
 		total_delay += c->delay;
 		n = other_node(n, route[i]);
 	}
@@ -1534,7 +2169,8 @@ struct route_hop *get_route(const tal_t *ctx, struct routing_state *rstate,
  *
  * If we want to delete the channel, we reparent it to disposal_context.
  */
-static void routing_failure_channel_out(const tal_t *disposal_context,
+static void routing_failure_channel_out(struct routing_state *rstate,
+					const tal_t *disposal_context,
 					struct node *node,
 					enum onion_type failcode,
 					struct chan *chan,
@@ -1547,10 +2183,11 @@ static void routing_failure_channel_out(const tal_t *disposal_context,
 	 * - if the PERM bit is NOT set:
 	 *   - SHOULD restore the channels as it receives new `channel_update`s.
 	 */
-	if (!(failcode & PERM))
+	if (!(failcode & PERM)) {
 		/* Prevent it for 20 seconds. */
 		hc->unroutable_until = now + 20;
-	else
+		update_graph_edge(rstate, chan, hc - chan->half);
+	} else
 		/* Set it up to be pruned. */
 		tal_steal(disposal_context, chan);
 }
@@ -1590,7 +2227,8 @@ void routing_failure(struct routing_state *rstate,
 	 */
 	if (failcode & NODE) {
 		for (int i = 0; i < tal_count(node->chans); ++i) {
-			routing_failure_channel_out(tmpctx, node, failcode,
+			routing_failure_channel_out(rstate, tmpctx,
+						    node, failcode,
 						    node->chans[i],
 						    now);
 		}
@@ -1612,7 +2250,7 @@ void routing_failure(struct routing_state *rstate,
 				       type_to_string(tmpctx, struct pubkey,
 						      erring_node_pubkey));
 		else
-			routing_failure_channel_out(tmpctx,
+			routing_failure_channel_out(rstate, tmpctx,
 						    node, failcode, chan, now);
 	}
 
@@ -1669,6 +2307,16 @@ void mark_channel_unroutable(struct routing_state *rstate,
 	}
 	chan->half[0].unroutable_until = now + 20;
 	chan->half[1].unroutable_until = now + 20;
+	update_graph_edge(rstate, chan, 0);
+	update_graph_edge(rstate, chan, 1);
+}
+
+void set_chan_local_disabled(struct routing_state *rstate,
+			     struct chan *chan, bool disabled)
+{
+	chan->local_disabled = disabled;
+	update_graph_edge(rstate, chan, 0);
+	update_graph_edge(rstate, chan, 1);
 }
 
 void route_prune(struct routing_state *rstate)
@@ -2,6 +2,7 @@
 #define LIGHTNING_GOSSIPD_ROUTING_H
 #include "config.h"
 #include <bitcoin/pubkey.h>
+#include <bitcoin/shadouble.h>
 #include <ccan/crypto/siphash24/siphash24.h>
 #include <ccan/htable/htable_type.h>
 #include <ccan/time/time.h>
@@ -12,8 +13,11 @@
 #include <wire/wire.h>
 
 struct half_chan {
-	/* Cached `channel_update` which initialized below (or NULL) */
+	/* `channel_update` of a private channel which initialized below (or
+	 * NULL).  Public ones are only in the gossip_store. */
 	const u8 *channel_update;
+	/* Index in broadcast map, if public (otherwise 0) */
+	u64 channel_update_index;
 
 	/* millisatoshi. */
 	u32 base_fee;
@@ -23,7 +27,7 @@ struct half_chan {
 	/* Delay for HTLC in blocks.*/
 	u32 delay;
 
-	/* -1 if channel_update is NULL */
+	/* -1 if channel_update not defined */
 	s64 last_timestamp;
 
 	/* Minimum number of msatoshi in an HTLC */
@@ -43,6 +47,9 @@ struct half_chan {
 	/* If greater than current time, this connection should not
 	 * be used for routing. */
 	time_t unroutable_until;
+
+	/* Index into routing_state's graph, if any */
+	u32 graph_edge;
 };
 
 struct chan {
@@ -57,9 +64,12 @@ struct chan {
 	/* node[0].id < node[1].id */
 	struct node *nodes[2];
 
-	/* NULL if not announced yet (ie. not public). */
+	/* `channel_announcement` we're holding until we can broadcast it
+	 * (otherwise NULL). */
 	const u8 *channel_announce;
-	/* Index in broadcast map, if public (otherwise 0) */
+	/* Where that is in the gossip_store, if we loaded it from there */
+	u64 channel_announce_offset;
+	/* Index in broadcast map, if announced (otherwise 0) */
 	u64 channel_announcement_index;
 
 	/* Disabled locally (due to peer disconnect) */
@@ -68,12 +78,6 @@ struct chan {
 	u64 satoshis;
 };
 
-/* A local channel can exist which isn't announcable. */
-static inline bool is_chan_public(const struct chan *chan)
-{
-	return chan->channel_announce != NULL;
-}
-
 /* A channel is only announced once we have a channel_update to send
  * with it. */
 static inline bool is_chan_announced(const struct chan *chan)
@@ -81,9 +85,15 @@ static inline bool is_chan_announced(const struct chan *chan)
 	return chan->channel_announcement_index != 0;
 }
 
+/* A local channel can exist which isn't announcable. */
+static inline bool is_chan_public(const struct chan *chan)
+{
+	return chan->channel_announce != NULL || is_chan_announced(chan);
+}
+
 static inline bool is_halfchan_defined(const struct half_chan *hc)
 {
-	return hc->channel_update != NULL;
+	return hc->channel_update != NULL || hc->channel_update_index != 0;
 }
 
 static inline bool is_halfchan_enabled(const struct half_chan *hc)
@@ -103,15 +113,8 @@ struct node {
 	/* Channels connecting us to other nodes */
 	struct chan **chans;
 
-	/* Temporary data for routefinding. */
-	struct {
-		/* Total to get to here from target. */
-		u64 total;
-		/* Total risk premium of this route. */
-		u64 risk;
-		/* Where that came from. */
-		struct chan *prev;
-	} bfg[ROUTING_MAX_HOPS+1];
+	/* Index into routing_state's graph, if any */
+	u32 graph_idx;
 
 	/* UTF-8 encoded alias, not zero terminated */
 	u8 alias[32];
@@ -122,8 +125,11 @@ struct node {
 	/* (Global) features */
 	u8 *globalfeatures;
 
-	/* Cached `node_announcement` we might forward to new peers (or NULL). */
+	/* `node_announcement` we're holding until we have a channel to
+	 * broadcast it with (otherwise NULL). */
 	const u8 *node_announcement;
+	/* Where that is in the gossip_store, if we loaded it from there */
+	u64 node_announcement_offset;
 	/* If public, this is non-zero. */
 	u64 node_announcement_index;
 };
@@ -171,6 +177,20 @@ static inline int half_chan_to(const struct node *n, const struct chan *chan)
 	return !idx;
 }
 
+/* A signature from a gossip message, unpacked so it can be checked in
+ * another thread. */
+struct gossip_sig {
+	struct sha256_double hash;
+	secp256k1_ecdsa_signature sig;
+	struct pubkey key;
+};
+
+/* How many checked signatures we remember: enough to cover channel_updates
+ * which arrive while their channel_announcement waits on the txout lookup. */
+#define SIG_CACHE_MAX 10000
+
+struct sig_cache;
+
 struct routing_state {
 	/* All known nodes. */
 	struct node_map *nodes;
@@ -201,6 +221,12 @@ struct routing_state {
 
 	/* Has one of our own channels been announced? */
 	bool local_channel_announced;
+
+	/* Compact form of network for find_route (NULL if needs rebuild). */
+	struct routing_graph *graph;
+
+	/* Signatures we've recently checked, or are checking. */
+	struct sig_cache *sig_cache;
 };
 
 static inline struct chan *
@@ -222,6 +248,26 @@ struct routing_state *new_routing_state(const tal_t *ctx,
 					const struct pubkey *local_id,
 					u32 prune_timeout);
 
+/* Size the node map for num_nodes, if it's still empty (eg. on load). */
+void routing_reserve_nodes(struct routing_state *rstate, size_t num_nodes);
+
+/**
+ * gossip_sigs_to_check - find the signatures handle_* will want to check
+ * @rstate: the routing state
+ * @msg: a channel_announcement, channel_update or node_announcement
+ * @sigs: tal_arr to append them to
+ *
+ * Signatures we've already seen, and messages handle_* will ignore anyway,
+ * are skipped.  Those appended are remembered as being checked: tell us how
+ * that went with gossip_sig_checked().
+ */
+void gossip_sigs_to_check(struct routing_state *rstate, const u8 *msg,
+			  struct gossip_sig **sigs);
+
+/* Once that's done, handle_* won't check a good signature again. */
+void gossip_sig_checked(struct routing_state *rstate,
+			const struct gossip_sig *gsig, bool ok);
+
 /**
  * Add a new bidirectional channel from id1 to id2 with the given
  * short_channel_id and capacity to the local network view. The channel may not
@@ -265,6 +311,15 @@ u8 *handle_node_announcement(struct routing_state *rstate, const u8 *node);
 /* Get a node: use this instead of node_map_get() */
 struct node *get_node(struct routing_state *rstate, const struct pubkey *id);
 
+/* Get a copy of the message we're broadcasting with this index */
+const u8 *get_broadcast_msg(const tal_t *ctx, struct routing_state *rstate,
+			    u64 index);
+
+/* Get a copy of the latest channel_update for this half (NULL if none) */
+const u8 *get_channel_update_msg(const tal_t *ctx,
+				 struct routing_state *rstate,
+				 const struct half_chan *hc);
+
 /* Compute a route to a destination, for a given amount and riskfactor. */
 struct route_hop *get_route(const tal_t *ctx, struct routing_state *rstate,
 			    const struct pubkey *source,
@@ -283,6 +338,10 @@ void routing_failure(struct routing_state *rstate,
 void mark_channel_unroutable(struct routing_state *rstate,
 			     const struct short_channel_id *channel);
 
+/* Set chan->local_disabled (don't set it directly!) */
+void set_chan_local_disabled(struct routing_state *rstate,
+			     struct chan *chan, bool disabled);
+
 void route_prune(struct routing_state *rstate);
 
 /* Utility function that, given a source and a destination, gives us
@@ -295,9 +354,13 @@ void route_prune(struct routing_state *rstate);
  * Directly add the channel to the local network, without checking it first. Use
  * this only for messages from trusted sources. Untrusted sources should use the
  * @see{handle_channel_announcement} entrypoint to check before adding.
+ *
+ * @store_offset is where @msg is in the gossip_store if we're loading it
+ * from there, otherwise 0 (and it's added to the gossip_store if broadcast).
  */
 bool routing_add_channel_announcement(struct routing_state *rstate,
-				      const u8 *msg TAKES, u64 satoshis);
+				      const u8 *msg TAKES, u64 satoshis,
+				      u64 store_offset);
 
 /**
  * Add a channel_update without checking for errors
@@ -308,7 +371,8 @@ bool routing_add_channel_announcement(struct routing_state *rstate,
  * @see{handle_channel_update}
  */
 bool routing_add_channel_update(struct routing_state *rstate,
-				const u8 *update TAKES);
+				const u8 *update TAKES,
+				u64 store_offset);
 
 /**
  * Add a node_announcement to the network view without checking it
@@ -318,7 +382,8 @@ bool routing_add_channel_update(struct routing_state *rstate,
  * sources (peers) please use @see{handle_node_announcement}.
  */
 bool routing_add_node_announcement(struct routing_state *rstate,
-                                  const u8 *msg TAKES);
+                                  const u8 *msg TAKES,
+                                  u64 store_offset);
 
 
 /**
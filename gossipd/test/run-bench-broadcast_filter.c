@@ -0,0 +1,149 @@
+#include "../broadcast.c"
+#include <ccan/err/err.h>
+#include <ccan/opt/opt.h>
+#include <ccan/time/time.h>
+#include <common/pseudorand.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+/* AUTOGENERATED MOCKS START */
+/* AUTOGENERATED MOCKS END */
+
+/* What next_broadcast() used to do: look at every message. */
+static size_t count_linear(struct broadcast_state *bstate,
+			   u32 timestamp_min, u32 timestamp_max)
+{
+	struct queued_message *m;
+	u64 index = 0;
+	size_t n = 0;
+
+	while ((m = uintmap_after(&bstate->broadcasts, &index)) != NULL) {
+		if (m->timestamp >= timestamp_min
+		    && m->timestamp <= timestamp_max)
+			n++;
+	}
+	return n;
+}
+
+static size_t count_filtered(struct broadcast_state *bstate,
+			     u32 timestamp_min, u32 timestamp_max)
+{
+	u64 index = 0;
+	size_t n = 0;
+
+	while (next_broadcast(bstate, timestamp_min, timestamp_max, &index))
+		n++;
+	return n;
+}
+
+/* Peer asks for recent gossip, but all we have is old: what arrives next
+ * goes into the same segment, and must still reach them. */
+static void test_tail_segment(void)
+{
+	struct broadcast_state *bstate = new_broadcast_state(NULL, NULL);
+	u64 index = 0;
+	struct queued_message *m;
+
+	for (size_t i = 0; i < 10; i++)
+		insert_broadcast(bstate, 1 + i, 1000);
+	assert(!next_broadcast(bstate, 2000, UINT32_MAX, &index));
+	assert(index < bstate->next_index);
+
+	for (size_t i = 0; i < 10; i++)
+		insert_broadcast(bstate, 11 + i, 2000 + i);
+	for (size_t i = 0; i < 10; i++) {
+		m = next_broadcast(bstate, 2000, UINT32_MAX, &index);
+		assert(m);
+		assert(m->timestamp == 2000 + i);
+		index = m->index;
+	}
+	assert(!next_broadcast(bstate, 2000, UINT32_MAX, &index));
+	tal_free(bstate);
+}
+
+static void bench(struct broadcast_state *bstate, const char *what,
+		  u32 timestamp_min, u32 timestamp_max, size_t runs)
+{
+	struct timemono start;
+	struct timerel linear, filtered;
+	size_t expect = 0, n = 0;
+
+	start = time_mono();
+	for (size_t i = 0; i < runs; i++)
+		expect = count_linear(bstate, timestamp_min, timestamp_max);
+	linear = timemono_since(start);
+
+	start = time_mono();
+	for (size_t i = 0; i < runs; i++)
+		n = count_filtered(bstate, timestamp_min, timestamp_max);
+	filtered = timemono_since(start);
+
+	assert(n == expect);
+	printf("%s: %zu of %zu messages, %"PRIu64" usec per peer (was %"PRIu64")\n",
+	       what, n, bstate->count,
+	       time_to_usec(time_divide(filtered, runs)),
+	       time_to_usec(time_divide(linear, runs)));
+}
+
+int main(int argc, char *argv[])
+{
+	setup_locale();
+
+	struct broadcast_state *bstate;
+	/* Small by default for make check: try 300000 10. */
+	size_t num_msgs = 3000, num_updates, runs = 1;
+	/* Pretend gossip arrives once a second, ending now. */
+	u32 now, start;
+
+	setup_tmpctx();
+
+	opt_parse(&argc, argv, opt_log_stderr_exit);
+	if (argc > 1)
+		num_msgs = atoi(argv[1]);
+	if (argc > 2)
+		runs = atoi(argv[2]);
+	if (argc > 3)
+		opt_usage_and_exit("[num_msgs [runs]]");
+
+	/* Half the messages get replaced by a later update: that's what
+	 * leaves holes in the older segments. */
+	num_updates = num_msgs / 2;
+	now = 1000000000;
+	start = now - num_msgs - num_updates;
+
+	test_tail_segment();
+
+	bstate = new_broadcast_state(NULL, NULL);
+	for (size_t i = 0; i < num_msgs; i++)
+		insert_broadcast(bstate, 1 + i, start + i);
+	for (size_t i = 0; i < num_updates; i++) {
+		u64 old;
+
+		/* Find one which hasn't already been replaced. */
+		do {
+			old = 1 + pseudorand(bstate->next_index - 1);
+		} while (!uintmap_get(&bstate->broadcasts, old));
+		broadcast_del(bstate, old);
+		insert_broadcast(bstate, 1 + num_msgs + i,
+				 start + num_msgs + i);
+	}
+	assert(bstate->count == num_msgs);
+
+	bench(bstate, "Everything", 0, UINT32_MAX, runs);
+	bench(bstate, "Last day", now - 24 * 3600, UINT32_MAX, runs);
+	bench(bstate, "Last hour", now - 3600, UINT32_MAX, runs);
+	bench(bstate, "A day, three days ago", now - 3 * 24 * 3600,
+	      now - 2 * 24 * 3600, runs);
+	bench(bstate, "Nothing", UINT32_MAX, 0, runs);
+
+	/* Segments go away as they empty. */
+	for (u64 i = 1; i < bstate->next_index; i++)
+		broadcast_del(bstate, i);
+	assert(bstate->count == 0);
+	assert(uintmap_empty(&bstate->segments));
+	tal_free(bstate);
+
+	tal_free(tmpctx);
+	opt_free_table();
+	return 0;
+}
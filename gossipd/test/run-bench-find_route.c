@@ -50,15 +50,22 @@ static int fake_pubkey_cmp(const struct pubkey *a, const struct pubkey *b)
 #include "../gossip_store.c"
 #undef type_to_string_
 
-struct broadcast_state *new_broadcast_state(tal_t *ctx UNNEEDED)
+struct broadcast_state *new_broadcast_state(tal_t *ctx UNNEEDED,
+					    struct gossip_store *gs UNNEEDED)
 {
 	return NULL;
 }
 
 /* AUTOGENERATED MOCKS START */
 /* Generated stub for broadcast_del */
-void broadcast_del(struct broadcast_state *bstate UNNEEDED, u64 index UNNEEDED, const u8 *payload UNNEEDED)
+void broadcast_del(struct broadcast_state *bstate UNNEEDED, u64 index UNNEEDED)
 { fprintf(stderr, "broadcast_del called!\n"); abort(); }
+/* Generated stub for broadcast_store_offset */
+u64 broadcast_store_offset(struct broadcast_state *bstate UNNEEDED, u64 index UNNEEDED)
+{ fprintf(stderr, "broadcast_store_offset called!\n"); abort(); }
+/* Generated stub for fromwire */
+const u8 *fromwire(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, void *copy UNNEEDED, size_t n UNNEEDED)
+{ fprintf(stderr, "fromwire called!\n"); abort(); }
 /* Generated stub for fromwire_channel_announcement */
 bool fromwire_channel_announcement(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, secp256k1_ecdsa_signature *node_signature_1 UNNEEDED, secp256k1_ecdsa_signature *node_signature_2 UNNEEDED, secp256k1_ecdsa_signature *bitcoin_signature_1 UNNEEDED, secp256k1_ecdsa_signature *bitcoin_signature_2 UNNEEDED, u8 **features UNNEEDED, struct bitcoin_blkid *chain_hash UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED, struct pubkey *node_id_1 UNNEEDED, struct pubkey *node_id_2 UNNEEDED, struct pubkey *bitcoin_key_1 UNNEEDED, struct pubkey *bitcoin_key_2 UNNEEDED)
 { fprintf(stderr, "fromwire_channel_announcement called!\n"); abort(); }
@@ -71,27 +78,28 @@ bool fromwire_channel_update_option_channel_htlc_max(const void *p UNNEEDED, sec
 /* Generated stub for fromwire_gossip_local_add_channel */
 bool fromwire_gossip_local_add_channel(const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED, struct pubkey *remote_node_id UNNEEDED, u64 *satoshis UNNEEDED)
 { fprintf(stderr, "fromwire_gossip_local_add_channel called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_channel_announcement */
-bool fromwire_gossip_store_channel_announcement(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **announcement UNNEEDED, u64 *satoshis UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_channel_announcement called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_channel_delete */
-bool fromwire_gossip_store_channel_delete(const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_channel_delete called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_channel_update */
-bool fromwire_gossip_store_channel_update(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **update UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_channel_update called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_local_add_channel */
-bool fromwire_gossip_store_local_add_channel(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **local_add UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_local_add_channel called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_node_announcement */
-bool fromwire_gossip_store_node_announcement(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **announcement UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_node_announcement called!\n"); abort(); }
 /* Generated stub for fromwire_node_announcement */
 bool fromwire_node_announcement(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, secp256k1_ecdsa_signature *signature UNNEEDED, u8 **features UNNEEDED, u32 *timestamp UNNEEDED, struct pubkey *node_id UNNEEDED, u8 rgb_color[3] UNNEEDED, u8 alias[32] UNNEEDED, u8 **addresses UNNEEDED)
 { fprintf(stderr, "fromwire_node_announcement called!\n"); abort(); }
+/* Generated stub for fromwire_pad */
+void fromwire_pad(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, size_t num UNNEEDED)
+{ fprintf(stderr, "fromwire_pad called!\n"); abort(); }
 /* Generated stub for fromwire_peektype */
 int fromwire_peektype(const u8 *cursor UNNEEDED)
 { fprintf(stderr, "fromwire_peektype called!\n"); abort(); }
+/* Generated stub for fromwire_short_channel_id */
+void fromwire_short_channel_id(const u8 **cursor UNNEEDED, size_t *max UNNEEDED,
+			       struct short_channel_id *short_channel_id UNNEEDED)
+{ fprintf(stderr, "fromwire_short_channel_id called!\n"); abort(); }
+/* Generated stub for fromwire_u16 */
+u16 fromwire_u16(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u16 called!\n"); abort(); }
+/* Generated stub for fromwire_u32 */
+u32 fromwire_u32(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u32 called!\n"); abort(); }
+/* Generated stub for fromwire_u64 */
+u64 fromwire_u64(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u64 called!\n"); abort(); }
 /* Generated stub for fromwire_u8 */
 u8 fromwire_u8(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
 { fprintf(stderr, "fromwire_u8 called!\n"); abort(); }
@@ -99,13 +107,13 @@ u8 fromwire_u8(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
 bool fromwire_wireaddr(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, struct wireaddr *addr UNNEEDED)
 { fprintf(stderr, "fromwire_wireaddr called!\n"); abort(); }
 /* Generated stub for insert_broadcast */
-u64 insert_broadcast(struct broadcast_state *bstate UNNEEDED, const u8 *msg UNNEEDED,
+u64 insert_broadcast(struct broadcast_state *bstate UNNEEDED, u64 store_offset UNNEEDED,
 		     u32 timestamp UNNEEDED)
 { fprintf(stderr, "insert_broadcast called!\n"); abort(); }
 /* Generated stub for next_broadcast */
-const u8 *next_broadcast(struct broadcast_state *bstate UNNEEDED,
-			 u32 timestamp_min UNNEEDED, u32 timestamp_max UNNEEDED,
-			 u64 *last_index UNNEEDED)
+struct queued_message *next_broadcast(struct broadcast_state *bstate UNNEEDED,
+				      u32 timestamp_min UNNEEDED, u32 timestamp_max UNNEEDED,
+				      u64 *last_index UNNEEDED)
 { fprintf(stderr, "next_broadcast called!\n"); abort(); }
 /* Generated stub for onion_type_name */
 const char *onion_type_name(int e UNNEEDED)
@@ -145,25 +153,35 @@ const char *wire_type_name(int e UNNEEDED)
 
 /* Updates existing route if required. */
 static void add_connection(struct routing_state *rstate,
-					const struct pubkey *from,
-					const struct pubkey *to,
-					u32 base_fee, s32 proportional_fee,
-					u32 delay)
+			   const struct pubkey *from,
+			   const struct pubkey *to,
+			   u32 base_fee, s32 proportional_fee,
+			   u32 delay)
 {
 	struct short_channel_id scid;
 	struct half_chan *c;
 	struct chan *chan;
+	u64 satoshis = 1000000;
+
+	/* Make a unique scid. */
+	memcpy(&scid, from, sizeof(scid) / 2);
+	memcpy((char *)&scid + sizeof(scid) / 2, to, sizeof(scid) / 2);
 
-	memset(&scid, 0, sizeof(scid));
 	chan = get_channel(rstate, &scid);
 	if (!chan)
-		chan = new_chan(rstate, &scid, from, to, 1000000);
+		chan = new_chan(rstate, &scid, from, to, satoshis);
 
 	c = &chan->half[pubkey_idx(from, to)];
+	/* Make sure it's seen as initialized (update non-NULL). */
+	c->channel_update = (void *)c;
 	c->base_fee = base_fee;
 	c->proportional_fee = proportional_fee;
 	c->delay = delay;
 	c->channel_flags = get_channel_direction(from, to);
+	c->htlc_minimum_msat = 0;
+	c->htlc_maximum_msat = satoshis * 1000;
+	/* We changed it behind routing's back. */
+	invalidate_graph(rstate);
 }
 
 static struct pubkey nodeid(size_t n)
@@ -197,6 +215,146 @@ static void populate_random_node(struct routing_state *rstate, u64 n)
 	}
 }
 
+/* The Bellman-Ford-Gibson engine find_route() used to use, for comparison.
+ * Our nodeids are simply indices, so use those to find scratch data. */
+struct bfg {
+	/* Total to get to here from target. */
+	u64 total;
+	/* Total risk premium of this route. */
+	u64 risk;
+	/* Where that came from. */
+	struct chan *prev;
+};
+
+struct bfg_node {
+	struct bfg bfg[ROUTING_MAX_HOPS+1];
+};
+
+static struct bfg *bfg_of(struct bfg_node *bfgs, const struct node *n)
+{
+	size_t idx;
+
+	memcpy(&idx, &n->id, sizeof(idx));
+	return bfgs[idx].bfg;
+}
+
+static void bfg_one_edge(struct bfg_node *bfgs,
+			 struct node *node,
+			 struct chan *chan, int idx,
+			 double riskfactor,
+			 double fuzz, const struct siphash_seed *base_seed)
+{
+	double fee_scale = 1.0;
+	const struct half_chan *c = &chan->half[idx];
+	struct bfg *nbfg = bfg_of(bfgs, node), *sbfg;
+
+	if (fuzz != 0.0) {
+		u64 h = siphash24(base_seed, &chan->scid, sizeof(chan->scid));
+		fee_scale = 1.0 + (2.0 * fuzz * h / UINT64_MAX) - fuzz;
+	}
+
+	/* nodes[0] is src for connections[0] */
+	sbfg = bfg_of(bfgs, chan->nodes[idx]);
+	for (size_t h = 0; h < ROUTING_MAX_HOPS; h++) {
+		u64 fee, risk, requiredcap;
+
+		if (nbfg[h].total == INFINITE)
+			continue;
+
+		fee = connection_fee(c->base_fee, c->proportional_fee,
+				     nbfg[h].total) * fee_scale;
+		requiredcap = nbfg[h].total + fee;
+		risk = nbfg[h].risk + risk_fee(requiredcap, c->delay, riskfactor);
+
+		if (c->htlc_maximum_msat < requiredcap
+		    || c->htlc_minimum_msat > requiredcap
+		    || requiredcap >= MAX_MSATOSHI)
+			continue;
+
+		if (requiredcap + risk < sbfg[h + 1].total + sbfg[h + 1].risk) {
+			sbfg[h+1].total = requiredcap;
+			sbfg[h+1].risk = risk;
+			sbfg[h+1].prev = chan;
+		}
+	}
+}
+
+static struct chan **bfg_find_route(const tal_t *ctx,
+				    struct routing_state *rstate,
+				    struct bfg_node *bfgs,
+				    const struct pubkey *from,
+				    const struct pubkey *to, u64 msatoshi,
+				    double riskfactor,
+				    double fuzz,
+				    const struct siphash_seed *base_seed,
+				    u64 *fee)
+{
+	struct chan **route;
+	struct node *n, *src, *dst;
+	struct node_map_iter it;
+	struct bfg *dbfg;
+	int i, best;
+	time_t now = time_now().ts.tv_sec;
+
+	dst = get_node(rstate, from);
+	src = get_node(rstate, to);
+	if (!src || !dst || src == dst)
+		return NULL;
+
+	for (n = node_map_first(rstate->nodes, &it);
+	     n;
+	     n = node_map_next(rstate->nodes, &it)) {
+		struct bfg *b = bfg_of(bfgs, n);
+		for (i = 0; i <= ROUTING_MAX_HOPS; i++) {
+			b[i].total = INFINITE;
+			b[i].risk = 0;
+		}
+	}
+
+	bfg_of(bfgs, src)[0].total = msatoshi;
+
+	for (size_t runs = 0; runs < ROUTING_MAX_HOPS; runs++) {
+		for (n = node_map_first(rstate->nodes, &it);
+		     n;
+		     n = node_map_next(rstate->nodes, &it)) {
+			for (i = 0; i < tal_count(n->chans); i++) {
+				struct chan *chan = n->chans[i];
+				int idx = half_chan_to(n, chan);
+
+				if (chan->local_disabled
+				    || !is_halfchan_enabled(&chan->half[idx])
+				    || chan->half[idx].unroutable_until >= now)
+					continue;
+				bfg_one_edge(bfgs, n, chan, idx,
+					     riskfactor, fuzz, base_seed);
+			}
+		}
+	}
+
+	dbfg = bfg_of(bfgs, dst);
+	best = 0;
+	for (i = 1; i <= ROUTING_MAX_HOPS; i++) {
+		if (dbfg[i].total < dbfg[best].total)
+			best = i;
+	}
+
+	if (dbfg[best].total >= INFINITE)
+		return NULL;
+
+	/* We (dst) don't charge ourselves fees, so skip first hop */
+	n = other_node(dst, dbfg[best].prev);
+	*fee = bfg_of(bfgs, n)[best-1].total - msatoshi;
+
+	route = tal_arr(ctx, struct chan *, best);
+	for (i = 0, n = dst;
+	     i < best;
+	     n = other_node(n, bfg_of(bfgs, n)[best-i].prev), i++) {
+		route[i] = bfg_of(bfgs, n)[best-i].prev;
+	}
+	assert(n == src);
+	return route;
+}
+
 static void run(const char *name)
 {
 	int status;
@@ -224,7 +382,13 @@ int main(int argc, char *argv[])
 	struct timemono start, end;
 	size_t num_success;
 	struct pubkey me = nodeid(0);
-	bool perfme = false;
+	bool perfme = false, bfg = false;
+	struct query {
+		struct pubkey from, to;
+		u64 msatoshi;
+		u64 fee;
+		size_t hops;
+	} *queries;
 	const double riskfactor = 0.01 / BLOCKS_PER_YEAR / 10000;
 	struct siphash_seed base_seed;
 
@@ -235,6 +399,8 @@ int main(int argc, char *argv[])
 	rstate = new_routing_state(tmpctx, &zerohash, &me, 0);
 	opt_register_noarg("--perfme", opt_set_bool, &perfme,
 			   "Run perfme-start and perfme-stop around benchmark");
+	opt_register_noarg("--bfg", opt_set_bool, &bfg,
+			   "Also run old Bellman-Ford-Gibson engine to compare");
 
 	opt_parse(&argc, argv, opt_log_stderr_exit);
 
@@ -245,27 +411,42 @@ int main(int argc, char *argv[])
 	if (argc > 3)
 		opt_usage_and_exit("[num_nodes [num_runs]]");
 
+	queries = tal_arr(tmpctx, struct query, num_runs);
 	memset(&base_seed, 0, sizeof(base_seed));
 	for (size_t i = 0; i < num_nodes; i++)
 		populate_random_node(rstate, i);
 
+	for (size_t i = 0; i < num_runs; i++) {
+		queries[i].from = nodeid(pseudorand(num_nodes));
+		queries[i].to = nodeid(pseudorand(num_nodes));
+		queries[i].msatoshi = pseudorand(100000);
+	}
+
 	in_bench = true;
+
+	/* Don't count initial graph build in per-route timings. */
+	start = time_mono();
+	get_graph(rstate);
+	end = time_mono();
+	printf("Built graph with %zu edges in %"PRIu64" usec\n",
+	       tal_count(rstate->graph->edges),
+	       time_to_usec(timemono_between(end, start)));
+
 	if (perfme)
 		run("perfme-start");
 
 	start = time_mono();
 	num_success = 0;
 	for (size_t i = 0; i < num_runs; i++) {
-		struct pubkey from = nodeid(pseudorand(num_nodes));
-		struct pubkey to = nodeid(pseudorand(num_nodes));
-		u64 fee;
 		struct chan **route;
 
-		route = find_route(tmpctx, rstate, &from, &to,
-				  pseudorand(100000),
-				  riskfactor,
-				  0.75, &base_seed,
-				  &fee);
+		route = find_route(tmpctx, rstate,
+				   &queries[i].from, &queries[i].to,
+				   queries[i].msatoshi,
+				   riskfactor,
+				   0.75, &base_seed,
+				   &queries[i].fee);
+		queries[i].hops = tal_count(route);
 		num_success += (route != NULL);
 		tal_free(route);
 	}
@@ -274,11 +455,54 @@ int main(int argc, char *argv[])
 	if (perfme)
 		run("perfme-stop");
 
-	printf("%zu (%zu succeeded) routes in %zu nodes in %"PRIu64" msec (%"PRIu64" nanoseconds per route)",
+	printf("%zu (%zu succeeded) routes in %zu nodes in %"PRIu64" msec (%"PRIu64" nanoseconds per route)\n",
 	       num_runs, num_success, num_nodes,
 	       time_to_msec(timemono_between(end, start)),
 	       time_to_nsec(time_divide(timemono_between(end, start), num_runs)));
 
+	if (bfg) {
+		struct bfg_node *bfgs = tal_arr(tmpctx, struct bfg_node,
+						num_nodes);
+		size_t num_worse = 0, num_better = 0;
+
+		start = time_mono();
+		num_success = 0;
+		for (size_t i = 0; i < num_runs; i++) {
+			struct chan **route;
+			u64 fee;
+
+			route = bfg_find_route(tmpctx, rstate, bfgs,
+					       &queries[i].from,
+					       &queries[i].to,
+					       queries[i].msatoshi,
+					       riskfactor,
+					       0.75, &base_seed,
+					       &fee);
+			num_success += (route != NULL);
+			/* Same routes should be found, modulo ties. */
+			if (!route != !queries[i].hops)
+				errx(1, "Query %zu: bfg %s, dijkstra %s",
+				     i, route ? "succeeded" : "failed",
+				     queries[i].hops ? "succeeded" : "failed");
+			if (route && fee < queries[i].fee)
+				num_worse++;
+			else if (route && fee > queries[i].fee)
+				num_better++;
+			tal_free(route);
+		}
+		end = time_mono();
+
+		printf("Bellman-Ford-Gibson: %zu (%zu succeeded) routes in %zu nodes in %"PRIu64" msec (%"PRIu64" nanoseconds per route)\n",
+		       num_runs, num_success, num_nodes,
+		       time_to_msec(timemono_between(end, start)),
+		       time_to_nsec(time_divide(timemono_between(end, start), num_runs)));
+		printf("Dijkstra fee higher in %zu, lower in %zu routes\n",
+		       num_worse, num_better);
+		/* Like it, we find the cheapest path of each length from
+		 * each node, so we should never find a worse route. */
+		assert(num_worse == 0);
+	}
+
 	tal_free(tmpctx);
 	secp256k1_context_destroy(secp256k1_ctx);
 	opt_free_table();
@@ -0,0 +1,203 @@
+#include "../broadcast.c"
+#include "../gen_gossip_store.c"
+#include "../gossip_store.c"
+#include "../routing.c"
+#include "../../wire/fromwire.c"
+#include "../../wire/gen_peer_wire.c"
+#include "../../wire/towire.c"
+#include <bitcoin/privkey.h>
+#include <ccan/err/err.h>
+#include <ccan/opt/opt.h>
+#include <ccan/time/time.h>
+#include <common/pseudorand.h>
+#include <stdio.h>
+
+void status_fmt(enum log_level level UNUSED, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	printf("\n");
+	va_end(ap);
+}
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for fromwire_gossip_local_add_channel */
+bool fromwire_gossip_local_add_channel(const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED, struct pubkey *remote_node_id UNNEEDED, u64 *satoshis UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_local_add_channel called!\n"); abort(); }
+/* Generated stub for fromwire_wireaddr */
+bool fromwire_wireaddr(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, struct wireaddr *addr UNNEEDED)
+{ fprintf(stderr, "fromwire_wireaddr called!\n"); abort(); }
+/* Generated stub for onion_type_name */
+const char *onion_type_name(int e UNNEEDED)
+{ fprintf(stderr, "onion_type_name called!\n"); abort(); }
+/* Generated stub for sanitize_error */
+char *sanitize_error(const tal_t *ctx UNNEEDED, const u8 *errmsg UNNEEDED,
+		     struct channel_id *channel_id UNNEEDED)
+{ fprintf(stderr, "sanitize_error called!\n"); abort(); }
+/* Generated stub for status_failed */
+void status_failed(enum status_failreason code UNNEEDED,
+		   const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "status_failed called!\n"); abort(); }
+/* Generated stub for towire_errorfmt */
+u8 *towire_errorfmt(const tal_t *ctx UNNEEDED,
+		    const struct channel_id *channel UNNEEDED,
+		    const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "towire_errorfmt called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+static void write_record(int fd, const u8 *inner, const u8 *msg)
+{
+	beint32_t hdr[2];
+
+	hdr[0] = cpu_to_be32(tal_count(msg));
+	hdr[1] = cpu_to_be32(crc32c(0, msg, tal_count(msg)));
+	if (!write_all(fd, hdr, sizeof(hdr))
+	    || !write_all(fd, msg, tal_count(msg)))
+		err(1, "writing gossip_store");
+	tal_free(inner);
+	tal_free(msg);
+}
+
+/* We don't check signatures on load, so these don't need to be valid. */
+static size_t write_store(const struct bitcoin_blkid *chain_hash,
+			  const struct pubkey *ids, size_t num_nodes,
+			  size_t num_channels)
+{
+	bool *has_channel = tal_arrz(tmpctx, bool, num_nodes);
+	size_t num_announced = 0;
+	secp256k1_ecdsa_signature sig;
+	u8 version = GOSSIP_STORE_VERSION;
+	u8 rgb_color[3], alias[32];
+	u8 *empty = tal_arr(tmpctx, u8, 0);
+	int fd;
+
+	memset(&sig, 0, sizeof(sig));
+	memset(rgb_color, 0, sizeof(rgb_color));
+	memset(alias, 0, sizeof(alias));
+
+	fd = open(GOSSIP_STORE_FILENAME, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+	if (fd < 0 || !write_all(fd, &version, sizeof(version)))
+		err(1, "creating gossip_store");
+
+	for (size_t i = 0; i < num_channels; i++) {
+		struct short_channel_id scid;
+		const struct pubkey *n1, *n2;
+		size_t a = pseudorand(num_nodes), b;
+		u8 *msg;
+
+		do {
+			b = pseudorand(num_nodes);
+		} while (b == a);
+		has_channel[a] = has_channel[b] = true;
+		if (pubkey_cmp(&ids[a], &ids[b]) < 0) {
+			n1 = &ids[a];
+			n2 = &ids[b];
+		} else {
+			n1 = &ids[b];
+			n2 = &ids[a];
+		}
+
+		mk_short_channel_id(&scid, i / 1000 + 1, i % 1000, 0);
+		msg = towire_channel_announcement(tmpctx, &sig, &sig,
+						  &sig, &sig, empty,
+						  chain_hash, &scid, n1, n2,
+						  n1, n2);
+		write_record(fd, msg, towire_gossip_store_channel_announcement(
+				     NULL, msg, 1000000));
+
+		for (int dir = 0; dir < 2; dir++) {
+			msg = towire_channel_update(tmpctx, &sig, chain_hash,
+						    &scid, 1000 + i, 0, dir,
+						    pseudorand(144),
+						    pseudorand(1000),
+						    pseudorand(1000),
+						    pseudorand(1000));
+			write_record(fd, msg,
+				     towire_gossip_store_channel_update(NULL,
+									msg));
+		}
+	}
+
+	/* We only accept node_announcements for nodes with channels. */
+	for (size_t i = 0; i < num_nodes; i++) {
+		u8 *msg;
+
+		if (!has_channel[i])
+			continue;
+		msg = towire_node_announcement(tmpctx, &sig, empty, 1000 + i,
+					       &ids[i], rgb_color, alias,
+					       empty);
+		write_record(fd, msg,
+			     towire_gossip_store_node_announcement(NULL, msg));
+		num_announced++;
+	}
+	close(fd);
+	return num_announced;
+}
+
+int main(int argc, char *argv[])
+{
+	setup_locale();
+
+	static const struct bitcoin_blkid zerohash;
+	struct routing_state *rstate;
+	size_t num_channels = 1000, num_nodes;
+	struct timemono start, end;
+	struct pubkey me, *ids;
+	struct privkey priv;
+	struct stat st;
+	char dir[] = "/tmp/run-bench-gossip_store.XXXXXX";
+
+	secp256k1_ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY
+						 | SECP256K1_CONTEXT_SIGN);
+	setup_tmpctx();
+
+	opt_parse(&argc, argv, opt_log_stderr_exit);
+	if (argc > 1)
+		num_channels = atoi(argv[1]);
+	if (argc > 2)
+		opt_usage_and_exit("[num_channels]");
+
+	/* Roughly what mainnet looks like. */
+	num_nodes = num_channels / 4 + 2;
+	ids = tal_arr(tmpctx, struct pubkey, num_nodes + 1);
+	for (size_t i = 0; i < num_nodes + 1; i++) {
+		memset(&priv, 0, sizeof(priv));
+		memcpy(&priv, &i, sizeof(i));
+		priv.secret.data[31] = 1;
+		if (!pubkey_from_privkey(&priv, &ids[i]))
+			abort();
+	}
+	/* We're not in the graph. */
+	me = ids[num_nodes];
+
+	if (!mkdtemp(dir) || chdir(dir) != 0)
+		err(1, "making temporary directory");
+	num_nodes = write_store(&zerohash, ids, num_nodes, num_channels);
+	if (stat(GOSSIP_STORE_FILENAME, &st) != 0)
+		err(1, "stat gossip_store");
+
+	start = time_mono();
+	rstate = new_routing_state(tmpctx, &zerohash, &me, 0);
+	gossip_store_load(rstate, rstate->store);
+	end = time_mono();
+
+	assert(rstate->broadcasts->count == num_channels * 3 + num_nodes);
+	printf("Loaded %zu channels, %zu nodes (%"PRIu64" bytes) in %"PRIu64" msec (%"PRIu64" nanoseconds per channel)\n",
+	       num_channels, num_nodes, (u64)st.st_size,
+	       time_to_msec(timemono_between(end, start)),
+	       time_to_nsec(time_divide(timemono_between(end, start),
+					num_channels)));
+
+	tal_free(rstate);
+	unlink(GOSSIP_STORE_FILENAME);
+	if (chdir("/") != 0 || rmdir(dir) != 0)
+		err(1, "removing %s", dir);
+
+	tal_free(tmpctx);
+	secp256k1_context_destroy(secp256k1_ctx);
+	opt_free_table();
+	return 0;
+}
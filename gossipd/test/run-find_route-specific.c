@@ -14,15 +14,22 @@
 #include "../routing.c"
 #include "../gossip_store.c"
 
-struct broadcast_state *new_broadcast_state(tal_t *ctx UNNEEDED)
+struct broadcast_state *new_broadcast_state(tal_t *ctx UNNEEDED,
+					    struct gossip_store *gs UNNEEDED)
 {
 	return NULL;
 }
 
 /* AUTOGENERATED MOCKS START */
 /* Generated stub for broadcast_del */
-void broadcast_del(struct broadcast_state *bstate UNNEEDED, u64 index UNNEEDED, const u8 *payload UNNEEDED)
+void broadcast_del(struct broadcast_state *bstate UNNEEDED, u64 index UNNEEDED)
 { fprintf(stderr, "broadcast_del called!\n"); abort(); }
+/* Generated stub for broadcast_store_offset */
+u64 broadcast_store_offset(struct broadcast_state *bstate UNNEEDED, u64 index UNNEEDED)
+{ fprintf(stderr, "broadcast_store_offset called!\n"); abort(); }
+/* Generated stub for fromwire */
+const u8 *fromwire(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, void *copy UNNEEDED, size_t n UNNEEDED)
+{ fprintf(stderr, "fromwire called!\n"); abort(); }
 /* Generated stub for fromwire_channel_announcement */
 bool fromwire_channel_announcement(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, secp256k1_ecdsa_signature *node_signature_1 UNNEEDED, secp256k1_ecdsa_signature *node_signature_2 UNNEEDED, secp256k1_ecdsa_signature *bitcoin_signature_1 UNNEEDED, secp256k1_ecdsa_signature *bitcoin_signature_2 UNNEEDED, u8 **features UNNEEDED, struct bitcoin_blkid *chain_hash UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED, struct pubkey *node_id_1 UNNEEDED, struct pubkey *node_id_2 UNNEEDED, struct pubkey *bitcoin_key_1 UNNEEDED, struct pubkey *bitcoin_key_2 UNNEEDED)
 { fprintf(stderr, "fromwire_channel_announcement called!\n"); abort(); }
@@ -35,27 +42,28 @@ bool fromwire_channel_update_option_channel_htlc_max(const void *p UNNEEDED, sec
 /* Generated stub for fromwire_gossip_local_add_channel */
 bool fromwire_gossip_local_add_channel(const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED, struct pubkey *remote_node_id UNNEEDED, u64 *satoshis UNNEEDED)
 { fprintf(stderr, "fromwire_gossip_local_add_channel called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_channel_announcement */
-bool fromwire_gossip_store_channel_announcement(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **announcement UNNEEDED, u64 *satoshis UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_channel_announcement called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_channel_delete */
-bool fromwire_gossip_store_channel_delete(const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_channel_delete called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_channel_update */
-bool fromwire_gossip_store_channel_update(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **update UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_channel_update called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_local_add_channel */
-bool fromwire_gossip_store_local_add_channel(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **local_add UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_local_add_channel called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_node_announcement */
-bool fromwire_gossip_store_node_announcement(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **announcement UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_node_announcement called!\n"); abort(); }
 /* Generated stub for fromwire_node_announcement */
 bool fromwire_node_announcement(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, secp256k1_ecdsa_signature *signature UNNEEDED, u8 **features UNNEEDED, u32 *timestamp UNNEEDED, struct pubkey *node_id UNNEEDED, u8 rgb_color[3] UNNEEDED, u8 alias[32] UNNEEDED, u8 **addresses UNNEEDED)
 { fprintf(stderr, "fromwire_node_announcement called!\n"); abort(); }
+/* Generated stub for fromwire_pad */
+void fromwire_pad(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, size_t num UNNEEDED)
+{ fprintf(stderr, "fromwire_pad called!\n"); abort(); }
 /* Generated stub for fromwire_peektype */
 int fromwire_peektype(const u8 *cursor UNNEEDED)
 { fprintf(stderr, "fromwire_peektype called!\n"); abort(); }
+/* Generated stub for fromwire_short_channel_id */
+void fromwire_short_channel_id(const u8 **cursor UNNEEDED, size_t *max UNNEEDED,
+			       struct short_channel_id *short_channel_id UNNEEDED)
+{ fprintf(stderr, "fromwire_short_channel_id called!\n"); abort(); }
+/* Generated stub for fromwire_u16 */
+u16 fromwire_u16(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u16 called!\n"); abort(); }
+/* Generated stub for fromwire_u32 */
+u32 fromwire_u32(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u32 called!\n"); abort(); }
+/* Generated stub for fromwire_u64 */
+u64 fromwire_u64(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u64 called!\n"); abort(); }
 /* Generated stub for fromwire_u8 */
 u8 fromwire_u8(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
 { fprintf(stderr, "fromwire_u8 called!\n"); abort(); }
@@ -63,13 +71,13 @@ u8 fromwire_u8(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
 bool fromwire_wireaddr(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, struct wireaddr *addr UNNEEDED)
 { fprintf(stderr, "fromwire_wireaddr called!\n"); abort(); }
 /* Generated stub for insert_broadcast */
-u64 insert_broadcast(struct broadcast_state *bstate UNNEEDED, const u8 *msg UNNEEDED,
+u64 insert_broadcast(struct broadcast_state *bstate UNNEEDED, u64 store_offset UNNEEDED,
 		     u32 timestamp UNNEEDED)
 { fprintf(stderr, "insert_broadcast called!\n"); abort(); }
 /* Generated stub for next_broadcast */
-const u8 *next_broadcast(struct broadcast_state *bstate UNNEEDED,
-			 u32 timestamp_min UNNEEDED, u32 timestamp_max UNNEEDED,
-			 u64 *last_index UNNEEDED)
+struct queued_message *next_broadcast(struct broadcast_state *bstate UNNEEDED,
+				      u32 timestamp_min UNNEEDED, u32 timestamp_max UNNEEDED,
+				      u64 *last_index UNNEEDED)
 { fprintf(stderr, "next_broadcast called!\n"); abort(); }
 /* Generated stub for onion_type_name */
 const char *onion_type_name(int e UNNEEDED)
@@ -131,6 +139,8 @@ get_or_make_connection(struct routing_state *rstate,
 	chan->half[idx].htlc_minimum_msat = 0;
 	chan->half[idx].htlc_maximum_msat = satoshis * 1000;
 
+	/* Caller will change it behind routing's back. */
+	invalidate_graph(rstate);
 	return &chan->half[idx];
 }
 
@@ -2,7 +2,8 @@
 #include "../gossip_store.c"
 #include <stdio.h>
 
-struct broadcast_state *new_broadcast_state(tal_t *ctx UNNEEDED)
+struct broadcast_state *new_broadcast_state(tal_t *ctx UNNEEDED,
+					    struct gossip_store *gs UNNEEDED)
 {
 	return NULL;
 }
@@ -19,8 +20,14 @@ void status_fmt(enum log_level level UNUSED, const char *fmt, ...)
 
 /* AUTOGENERATED MOCKS START */
 /* Generated stub for broadcast_del */
-void broadcast_del(struct broadcast_state *bstate UNNEEDED, u64 index UNNEEDED, const u8 *payload UNNEEDED)
+void broadcast_del(struct broadcast_state *bstate UNNEEDED, u64 index UNNEEDED)
 { fprintf(stderr, "broadcast_del called!\n"); abort(); }
+/* Generated stub for broadcast_store_offset */
+u64 broadcast_store_offset(struct broadcast_state *bstate UNNEEDED, u64 index UNNEEDED)
+{ fprintf(stderr, "broadcast_store_offset called!\n"); abort(); }
+/* Generated stub for fromwire */
+const u8 *fromwire(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, void *copy UNNEEDED, size_t n UNNEEDED)
+{ fprintf(stderr, "fromwire called!\n"); abort(); }
 /* Generated stub for fromwire_channel_announcement */
 bool fromwire_channel_announcement(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, secp256k1_ecdsa_signature *node_signature_1 UNNEEDED, secp256k1_ecdsa_signature *node_signature_2 UNNEEDED, secp256k1_ecdsa_signature *bitcoin_signature_1 UNNEEDED, secp256k1_ecdsa_signature *bitcoin_signature_2 UNNEEDED, u8 **features UNNEEDED, struct bitcoin_blkid *chain_hash UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED, struct pubkey *node_id_1 UNNEEDED, struct pubkey *node_id_2 UNNEEDED, struct pubkey *bitcoin_key_1 UNNEEDED, struct pubkey *bitcoin_key_2 UNNEEDED)
 { fprintf(stderr, "fromwire_channel_announcement called!\n"); abort(); }
@@ -33,27 +40,28 @@ bool fromwire_channel_update_option_channel_htlc_max(const void *p UNNEEDED, sec
 /* Generated stub for fromwire_gossip_local_add_channel */
 bool fromwire_gossip_local_add_channel(const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED, struct pubkey *remote_node_id UNNEEDED, u64 *satoshis UNNEEDED)
 { fprintf(stderr, "fromwire_gossip_local_add_channel called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_channel_announcement */
-bool fromwire_gossip_store_channel_announcement(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **announcement UNNEEDED, u64 *satoshis UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_channel_announcement called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_channel_delete */
-bool fromwire_gossip_store_channel_delete(const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_channel_delete called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_channel_update */
-bool fromwire_gossip_store_channel_update(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **update UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_channel_update called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_local_add_channel */
-bool fromwire_gossip_store_local_add_channel(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **local_add UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_local_add_channel called!\n"); abort(); }
-/* Generated stub for fromwire_gossip_store_node_announcement */
-bool fromwire_gossip_store_node_announcement(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **announcement UNNEEDED)
-{ fprintf(stderr, "fromwire_gossip_store_node_announcement called!\n"); abort(); }
 /* Generated stub for fromwire_node_announcement */
 bool fromwire_node_announcement(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, secp256k1_ecdsa_signature *signature UNNEEDED, u8 **features UNNEEDED, u32 *timestamp UNNEEDED, struct pubkey *node_id UNNEEDED, u8 rgb_color[3] UNNEEDED, u8 alias[32] UNNEEDED, u8 **addresses UNNEEDED)
 { fprintf(stderr, "fromwire_node_announcement called!\n"); abort(); }
+/* Generated stub for fromwire_pad */
+void fromwire_pad(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, size_t num UNNEEDED)
+{ fprintf(stderr, "fromwire_pad called!\n"); abort(); }
 /* Generated stub for fromwire_peektype */
 int fromwire_peektype(const u8 *cursor UNNEEDED)
 { fprintf(stderr, "fromwire_peektype called!\n"); abort(); }
+/* Generated stub for fromwire_short_channel_id */
+void fromwire_short_channel_id(const u8 **cursor UNNEEDED, size_t *max UNNEEDED,
+			       struct short_channel_id *short_channel_id UNNEEDED)
+{ fprintf(stderr, "fromwire_short_channel_id called!\n"); abort(); }
+/* Generated stub for fromwire_u16 */
+u16 fromwire_u16(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u16 called!\n"); abort(); }
+/* Generated stub for fromwire_u32 */
+u32 fromwire_u32(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u32 called!\n"); abort(); }
+/* Generated stub for fromwire_u64 */
+u64 fromwire_u64(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u64 called!\n"); abort(); }
 /* Generated stub for fromwire_u8 */
 u8 fromwire_u8(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
 { fprintf(stderr, "fromwire_u8 called!\n"); abort(); }
@@ -61,13 +69,13 @@ u8 fromwire_u8(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
 bool fromwire_wireaddr(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, struct wireaddr *addr UNNEEDED)
 { fprintf(stderr, "fromwire_wireaddr called!\n"); abort(); }
 /* Generated stub for insert_broadcast */
-u64 insert_broadcast(struct broadcast_state *bstate UNNEEDED, const u8 *msg UNNEEDED,
+u64 insert_broadcast(struct broadcast_state *bstate UNNEEDED, u64 store_offset UNNEEDED,
 		     u32 timestamp UNNEEDED)
 { fprintf(stderr, "insert_broadcast called!\n"); abort(); }
 /* Generated stub for next_broadcast */
-const u8 *next_broadcast(struct broadcast_state *bstate UNNEEDED,
-			 u32 timestamp_min UNNEEDED, u32 timestamp_max UNNEEDED,
-			 u64 *last_index UNNEEDED)
+struct queued_message *next_broadcast(struct broadcast_state *bstate UNNEEDED,
+				      u32 timestamp_min UNNEEDED, u32 timestamp_max UNNEEDED,
+				      u64 *last_index UNNEEDED)
 { fprintf(stderr, "next_broadcast called!\n"); abort(); }
 /* Generated stub for onion_type_name */
 const char *onion_type_name(int e UNNEEDED)
@@ -134,6 +142,8 @@ static void add_connection(struct routing_state *rstate,
 	c->channel_flags = get_channel_direction(from, to);
 	c->htlc_minimum_msat = 0;
 	c->htlc_maximum_msat = satoshis * 1000;
+	/* We changed it behind routing's back. */
+	invalidate_graph(rstate);
 }
 
 /* Returns chan connecting from and to: *idx set to refer
@@ -194,7 +204,8 @@ int main(void)
 
 	static const struct bitcoin_blkid zerohash;
 	struct routing_state *rstate;
-	struct pubkey a, b, c, d;
+	struct pubkey a, b, c, d, m, z;
+	struct pubkey chain[ROUTING_MAX_HOPS - 2];
 	struct privkey tmp;
 	u64 fee;
 	struct chan **route;
@@ -264,6 +275,7 @@ int main(void)
 
 	/* Make B->C inactive, force it back via D */
 	get_connection(rstate, &b, &c)->channel_flags |= ROUTING_FLAGS_DISABLED;
+	invalidate_graph(rstate);
 	route = find_route(tmpctx, rstate, &a, &c, 3000000, riskfactor, 0.0, NULL, &fee);
 	assert(route);
 	assert(tal_count(route) == 2);
@@ -271,6 +283,38 @@ int main(void)
 	assert(channel_is_between(route[1], &d, &c));
 	assert(fee == 0 + 6);
 
+	/* M->c1->...->c18->Z is cheap, M->Z is expensive.  But A->B->M
+	 * means the cheap path would be too long. */
+	memset(&tmp, 'm', sizeof(tmp));
+	pubkey_from_privkey(&tmp, &m);
+	new_node(rstate, &m);
+	memset(&tmp, 'z', sizeof(tmp));
+	pubkey_from_privkey(&tmp, &z);
+	new_node(rstate, &z);
+	for (size_t i = 0; i < ARRAY_SIZE(chain); i++) {
+		memset(&tmp, 'A' + i, sizeof(tmp));
+		pubkey_from_privkey(&tmp, &chain[i]);
+		new_node(rstate, &chain[i]);
+		add_connection(rstate, i ? &chain[i-1] : &m, &chain[i], 0, 0, 1);
+	}
+	add_connection(rstate, &chain[ARRAY_SIZE(chain)-1], &z, 0, 0, 1);
+	add_connection(rstate, &m, &z, 1000, 0, 1);
+	add_connection(rstate, &a, &b, 0, 0, 1);
+	add_connection(rstate, &b, &m, 0, 0, 1);
+
+	route = find_route(tmpctx, rstate, &m, &z, 1000, riskfactor, 0.0, NULL, &fee);
+	assert(route);
+	assert(tal_count(route) == ARRAY_SIZE(chain) + 1);
+	assert(fee == 0);
+
+	route = find_route(tmpctx, rstate, &a, &z, 1000, riskfactor, 0.0, NULL, &fee);
+	assert(route);
+	assert(tal_count(route) == 3);
+	assert(channel_is_between(route[0], &a, &b));
+	assert(channel_is_between(route[1], &b, &m));
+	assert(channel_is_between(route[2], &m, &z));
+	assert(fee == 1000);
+
 	tal_free(tmpctx);
 	secp256k1_context_destroy(secp256k1_ctx);
 	return 0;
@@ -0,0 +1,520 @@
+#include <ccan/err/err.h>
+#include <common/status.h>
+#include <stdio.h>
+#include <sys/socket.h>
+
+#define main unused_main
+int main(int argc, char *argv[]);
+/* We count these, rather than spend time on them. */
+#define check_signed_hash fake_check_signed_hash
+#include <bitcoin/signature.h>
+#include "../gossipd.c"
+#undef check_signed_hash
+#undef main
+#include "../../common/threadpool.c"
+#include "../../wire/fromwire.c"
+#include "../../wire/towire.c"
+
+/* We only use node_announcements: we record the order they're handled in. */
+static u32 *handled;
+static size_t expect_handled;
+/* Did the peer waiting for room in the queue get woken? */
+static bool woken;
+/* We pretend each message has sigs_per_msg signatures, and track what the
+ * cache in routing.c would still hold: the last SIG_CACHE_MAX added. */
+static size_t sigs_per_msg, sigs_added, sigs_checked;
+static size_t *first_sig;
+
+static void maybe_done(void)
+{
+	if (woken && tal_count(handled) == expect_handled)
+		io_break(&handled);
+}
+
+u8 *handle_node_announcement(struct routing_state *rstate UNUSED,
+			     const u8 *node)
+{
+	u32 num;
+
+	assert(fromwire_peektype(node) == WIRE_NODE_ANNOUNCEMENT);
+	memcpy(&num, node + 2, sizeof(num));
+	/* Its signatures must still be cached, or they'd be checked again
+	 * now, one at a time. */
+	if (sigs_per_msg)
+		assert(sigs_added - first_sig[num] <= SIG_CACHE_MAX);
+	*tal_arr_expand(&handled) = num;
+	maybe_done();
+	return NULL;
+}
+
+/* Signatures are tested in run-gossip_sigs: this is about the queue. */
+void gossip_sigs_to_check(struct routing_state *rstate UNUSED,
+			  const u8 *msg, struct gossip_sig **sigs)
+{
+	u32 num;
+
+	memcpy(&num, msg + 2, sizeof(num));
+	if (!sigs_per_msg)
+		return;
+	first_sig[num] = sigs_added;
+	for (size_t i = 0; i < sigs_per_msg; i++)
+		memset(tal_arr_expand(sigs), 0, sizeof(struct gossip_sig));
+	sigs_added += sigs_per_msg;
+}
+
+bool fake_check_signed_hash(const struct sha256_double *hash UNUSED,
+			    const secp256k1_ecdsa_signature *signature UNUSED,
+			    const struct pubkey *key UNUSED)
+{
+	sigs_checked++;
+	return true;
+}
+
+void gossip_sig_checked(struct routing_state *rstate UNUSED,
+			const struct gossip_sig *gsig UNUSED, bool ok UNUSED)
+{
+}
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for check_ping_make_pong */
+bool check_ping_make_pong(const tal_t *ctx UNNEEDED, const u8 *ping UNNEEDED, u8 **pong UNNEEDED)
+{ fprintf(stderr, "check_ping_make_pong called!\n"); abort(); }
+/* Generated stub for daemon_conn_new_ */
+struct daemon_conn *daemon_conn_new_(const tal_t *ctx UNNEEDED, int fd UNNEEDED,
+				     struct io_plan *(*recv)(struct io_conn * UNNEEDED,
+							     const u8 * UNNEEDED,
+							     void *) UNNEEDED,
+				     bool (*outq_empty)(void *) UNNEEDED,
+				     void *arg UNNEEDED)
+{ fprintf(stderr, "daemon_conn_new_ called!\n"); abort(); }
+/* Generated stub for daemon_conn_queue_length */
+size_t daemon_conn_queue_length(const struct daemon_conn *dc UNNEEDED)
+{ fprintf(stderr, "daemon_conn_queue_length called!\n"); abort(); }
+/* Generated stub for daemon_conn_read_next */
+struct io_plan *daemon_conn_read_next(struct io_conn *conn UNNEEDED,
+				      struct daemon_conn *dc UNNEEDED)
+{ fprintf(stderr, "daemon_conn_read_next called!\n"); abort(); }
+/* Generated stub for daemon_conn_send */
+void daemon_conn_send(struct daemon_conn *dc UNNEEDED, const u8 *msg UNNEEDED)
+{ fprintf(stderr, "daemon_conn_send called!\n"); abort(); }
+/* Generated stub for daemon_conn_send_fd */
+void daemon_conn_send_fd(struct daemon_conn *dc UNNEEDED, int fd UNNEEDED)
+{ fprintf(stderr, "daemon_conn_send_fd called!\n"); abort(); }
+/* Generated stub for daemon_conn_wake */
+void daemon_conn_wake(struct daemon_conn *dc UNNEEDED)
+{ fprintf(stderr, "daemon_conn_wake called!\n"); abort(); }
+/* Generated stub for daemon_shutdown */
+void daemon_shutdown(void)
+{ fprintf(stderr, "daemon_shutdown called!\n"); abort(); }
+/* Generated stub for decode_short_ids */
+struct short_channel_id *decode_short_ids(const tal_t *ctx UNNEEDED, const u8 *encoded UNNEEDED)
+{ fprintf(stderr, "decode_short_ids called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_dev_gossip_queues */
+bool fromwire_gossip_dev_gossip_queues(const void *p UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_dev_gossip_queues called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_dev_set_max_scids_encode_size */
+bool fromwire_gossip_dev_set_max_scids_encode_size(const void *p UNNEEDED, u32 *max UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_dev_set_max_scids_encode_size called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_dev_suppress */
+bool fromwire_gossip_dev_suppress(const void *p UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_dev_suppress called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_get_addrs */
+bool fromwire_gossip_get_addrs(const void *p UNNEEDED, struct pubkey *id UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_get_addrs called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_get_channel_peer */
+bool fromwire_gossip_get_channel_peer(const void *p UNNEEDED, struct short_channel_id *channel_id UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_get_channel_peer called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_get_incoming_channels */
+bool fromwire_gossip_get_incoming_channels(const void *p UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_get_incoming_channels called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_get_txout_reply */
+bool fromwire_gossip_get_txout_reply(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED, u64 *satoshis UNNEEDED, u8 **outscript UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_get_txout_reply called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_get_update */
+bool fromwire_gossip_get_update(const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_get_update called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_getchannels_request */
+bool fromwire_gossip_getchannels_request(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, struct short_channel_id **short_channel_id UNNEEDED, struct short_channel_id **prev UNNEEDED, u32 *max UNNEEDED, struct pubkey **source UNNEEDED, u32 *since UNNEEDED, u64 *changed_since UNNEEDED, bool *active_only UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_getchannels_request called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_getnodes_request */
+bool fromwire_gossip_getnodes_request(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, struct pubkey **id UNNEEDED, u32 *since UNNEEDED, u64 *changed_since UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_getnodes_request called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_getroute_request */
+bool fromwire_gossip_getroute_request(const void *p UNNEEDED, struct pubkey *source UNNEEDED, struct pubkey *destination UNNEEDED, u64 *msatoshi UNNEEDED, u16 *riskfactor UNNEEDED, u32 *final_cltv UNNEEDED, double *fuzz UNNEEDED, struct siphash_seed *seed UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_getroute_request called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_local_channel_close */
+bool fromwire_gossip_local_channel_close(const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_local_channel_close called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_local_channel_update */
+bool fromwire_gossip_local_channel_update(const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED, bool *disable UNNEEDED, u16 *cltv_expiry_delta UNNEEDED, u64 *htlc_minimum_msat UNNEEDED, u32 *fee_base_msat UNNEEDED, u32 *fee_proportional_millionths UNNEEDED, u64 *htlc_maximum_msat UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_local_channel_update called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_mark_channel_unroutable */
+bool fromwire_gossip_mark_channel_unroutable(const void *p UNNEEDED, struct short_channel_id *channel UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_mark_channel_unroutable called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_new_peer */
+bool fromwire_gossip_new_peer(const void *p UNNEEDED, struct pubkey *id UNNEEDED, bool *gossip_queries_feature UNNEEDED, bool *initial_routing_sync UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_new_peer called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_outpoint_spent */
+bool fromwire_gossip_outpoint_spent(const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_outpoint_spent called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_ping */
+bool fromwire_gossip_ping(const void *p UNNEEDED, struct pubkey *id UNNEEDED, u16 *num_pong_bytes UNNEEDED, u16 *len UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_ping called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_query_channel_range */
+bool fromwire_gossip_query_channel_range(const void *p UNNEEDED, struct pubkey *id UNNEEDED, u32 *first_blocknum UNNEEDED, u32 *number_of_blocks UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_query_channel_range called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_query_scids */
+bool fromwire_gossip_query_scids(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, struct pubkey *id UNNEEDED, struct short_channel_id **ids UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_query_scids called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_routing_failure */
+bool fromwire_gossip_routing_failure(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, struct pubkey *erring_node UNNEEDED, struct short_channel_id *erring_channel UNNEEDED, u16 *failcode UNNEEDED, u8 **channel_update UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_routing_failure called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_send_timestamp_filter */
+bool fromwire_gossip_send_timestamp_filter(const void *p UNNEEDED, struct pubkey *id UNNEEDED, u32 *first_timestamp UNNEEDED, u32 *timestamp_range UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_send_timestamp_filter called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_timestamp_filter */
+bool fromwire_gossip_timestamp_filter(const void *p UNNEEDED, struct bitcoin_blkid *chain_hash UNNEEDED, u32 *first_timestamp UNNEEDED, u32 *timestamp_range UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_timestamp_filter called!\n"); abort(); }
+/* Generated stub for fromwire_gossipctl_init */
+bool fromwire_gossipctl_init(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u32 *broadcast_interval_msec UNNEEDED, struct bitcoin_blkid *chain_hash UNNEEDED, struct pubkey *id UNNEEDED, u8 **globalfeatures UNNEEDED, u8 rgb[3] UNNEEDED, u8 alias[32] UNNEEDED, u32 *update_channel_interval UNNEEDED, struct wireaddr **announcable UNNEEDED)
+{ fprintf(stderr, "fromwire_gossipctl_init called!\n"); abort(); }
+/* Generated stub for fromwire_hsm_cupdate_sig_reply */
+bool fromwire_hsm_cupdate_sig_reply(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **cu UNNEEDED)
+{ fprintf(stderr, "fromwire_hsm_cupdate_sig_reply called!\n"); abort(); }
+/* Generated stub for fromwire_hsm_node_announcement_sig_reply */
+bool fromwire_hsm_node_announcement_sig_reply(const void *p UNNEEDED, secp256k1_ecdsa_signature *signature UNNEEDED)
+{ fprintf(stderr, "fromwire_hsm_node_announcement_sig_reply called!\n"); abort(); }
+/* Generated stub for fromwire_query_channel_range */
+bool fromwire_query_channel_range(const void *p UNNEEDED, struct bitcoin_blkid *chain_hash UNNEEDED, u32 *first_blocknum UNNEEDED, u32 *number_of_blocks UNNEEDED)
+{ fprintf(stderr, "fromwire_query_channel_range called!\n"); abort(); }
+/* Generated stub for fromwire_query_short_channel_ids */
+bool fromwire_query_short_channel_ids(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, struct bitcoin_blkid *chain_hash UNNEEDED, u8 **encoded_short_ids UNNEEDED)
+{ fprintf(stderr, "fromwire_query_short_channel_ids called!\n"); abort(); }
+/* Generated stub for fromwire_reply_channel_range */
+bool fromwire_reply_channel_range(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, struct bitcoin_blkid *chain_hash UNNEEDED, u32 *first_blocknum UNNEEDED, u32 *number_of_blocks UNNEEDED, u8 *complete UNNEEDED, u8 **encoded_short_ids UNNEEDED)
+{ fprintf(stderr, "fromwire_reply_channel_range called!\n"); abort(); }
+/* Generated stub for fromwire_reply_short_channel_ids_end */
+bool fromwire_reply_short_channel_ids_end(const void *p UNNEEDED, struct bitcoin_blkid *chain_hash UNNEEDED, u8 *complete UNNEEDED)
+{ fprintf(stderr, "fromwire_reply_short_channel_ids_end called!\n"); abort(); }
+/* Generated stub for get_broadcast_msg */
+const u8 *get_broadcast_msg(const tal_t *ctx UNNEEDED, struct routing_state *rstate UNNEEDED,
+			    u64 index UNNEEDED)
+{ fprintf(stderr, "get_broadcast_msg called!\n"); abort(); }
+/* Generated stub for get_channel_update_msg */
+const u8 *get_channel_update_msg(const tal_t *ctx UNNEEDED,
+				 struct routing_state *rstate UNNEEDED,
+				 const struct half_chan *hc UNNEEDED)
+{ fprintf(stderr, "get_channel_update_msg called!\n"); abort(); }
+/* Generated stub for get_node */
+struct node *get_node(struct routing_state *rstate UNNEEDED, const struct pubkey *id UNNEEDED)
+{ fprintf(stderr, "get_node called!\n"); abort(); }
+/* Generated stub for get_route */
+struct route_hop *get_route(const tal_t *ctx UNNEEDED, struct routing_state *rstate UNNEEDED,
+			    const struct pubkey *source UNNEEDED,
+			    const struct pubkey *destination UNNEEDED,
+			    const u64 msatoshi UNNEEDED, double riskfactor UNNEEDED,
+			    u32 final_cltv UNNEEDED,
+			    double fuzz UNNEEDED,
+			    const struct siphash_seed *base_seed UNNEEDED)
+{ fprintf(stderr, "get_route called!\n"); abort(); }
+/* Generated stub for gossip_store_add */
+u64 gossip_store_add(struct gossip_store *gs UNNEEDED, const u8 *gossip_msg UNNEEDED)
+{ fprintf(stderr, "gossip_store_add called!\n"); abort(); }
+/* Generated stub for gossip_store_add_channel_delete */
+void gossip_store_add_channel_delete(struct gossip_store *gs UNNEEDED,
+				     const struct short_channel_id *scid UNNEEDED)
+{ fprintf(stderr, "gossip_store_add_channel_delete called!\n"); abort(); }
+/* Generated stub for gossip_store_compact_step */
+bool gossip_store_compact_step(struct gossip_store *gs UNNEEDED)
+{ fprintf(stderr, "gossip_store_compact_step called!\n"); abort(); }
+/* Generated stub for gossip_store_get */
+const u8 *gossip_store_get(const tal_t *ctx UNNEEDED,
+			   struct gossip_store *gs UNNEEDED, u64 offset UNNEEDED)
+{ fprintf(stderr, "gossip_store_get called!\n"); abort(); }
+/* Generated stub for gossip_store_load */
+void gossip_store_load(struct routing_state *rstate UNNEEDED, struct gossip_store *gs UNNEEDED)
+{ fprintf(stderr, "gossip_store_load called!\n"); abort(); }
+/* Generated stub for gossip_wire_type_name */
+const char *gossip_wire_type_name(int e UNNEEDED)
+{ fprintf(stderr, "gossip_wire_type_name called!\n"); abort(); }
+/* Generated stub for got_pong */
+const char *got_pong(const u8 *pong UNNEEDED, size_t *num_pings_outstanding UNNEEDED)
+{ fprintf(stderr, "got_pong called!\n"); abort(); }
+/* Generated stub for handle_channel_announcement */
+u8 *handle_channel_announcement(struct routing_state *rstate UNNEEDED,
+				const u8 *announce TAKES UNNEEDED,
+				const struct short_channel_id **scid UNNEEDED)
+{ fprintf(stderr, "handle_channel_announcement called!\n"); abort(); }
+/* Generated stub for handle_channel_update */
+u8 *handle_channel_update(struct routing_state *rstate UNNEEDED, const u8 *update TAKES UNNEEDED,
+			  const char *source UNNEEDED)
+{ fprintf(stderr, "handle_channel_update called!\n"); abort(); }
+/* Generated stub for handle_local_add_channel */
+void handle_local_add_channel(struct routing_state *rstate UNNEEDED, const u8 *msg UNNEEDED)
+{ fprintf(stderr, "handle_local_add_channel called!\n"); abort(); }
+/* Generated stub for handle_pending_cannouncement */
+void handle_pending_cannouncement(struct routing_state *rstate UNNEEDED,
+				  const struct short_channel_id *scid UNNEEDED,
+				  const u64 satoshis UNNEEDED,
+				  const u8 *txscript UNNEEDED)
+{ fprintf(stderr, "handle_pending_cannouncement called!\n"); abort(); }
+/* Generated stub for make_ping */
+u8 *make_ping(const tal_t *ctx UNNEEDED, u16 num_pong_bytes UNNEEDED, u16 padlen UNNEEDED)
+{ fprintf(stderr, "make_ping called!\n"); abort(); }
+/* Generated stub for mark_channel_unroutable */
+void mark_channel_unroutable(struct routing_state *rstate UNNEEDED,
+			     const struct short_channel_id *channel UNNEEDED)
+{ fprintf(stderr, "mark_channel_unroutable called!\n"); abort(); }
+/* Generated stub for master_badmsg */
+void master_badmsg(u32 type_expected UNNEEDED, const u8 *msg)
+{ fprintf(stderr, "master_badmsg called!\n"); abort(); }
+/* Generated stub for new_reltimer_ */
+struct oneshot *new_reltimer_(struct timers *timers UNNEEDED,
+			      const tal_t *ctx UNNEEDED,
+			      struct timerel expire UNNEEDED,
+			      void (*cb)(void *) UNNEEDED, void *arg UNNEEDED)
+{ fprintf(stderr, "new_reltimer_ called!\n"); abort(); }
+/* Generated stub for new_routing_state */
+struct routing_state *new_routing_state(const tal_t *ctx UNNEEDED,
+					const struct bitcoin_blkid *chain_hash UNNEEDED,
+					const struct pubkey *local_id UNNEEDED,
+					u32 prune_timeout UNNEEDED)
+{ fprintf(stderr, "new_routing_state called!\n"); abort(); }
+/* Generated stub for next_broadcast */
+struct queued_message *next_broadcast(struct broadcast_state *bstate UNNEEDED,
+				      u32 timestamp_min UNNEEDED, u32 timestamp_max UNNEEDED,
+				      u64 *last_index UNNEEDED)
+{ fprintf(stderr, "next_broadcast called!\n"); abort(); }
+/* Generated stub for route_prune */
+void route_prune(struct routing_state *rstate UNNEEDED)
+{ fprintf(stderr, "route_prune called!\n"); abort(); }
+/* Generated stub for routing_failure */
+void routing_failure(struct routing_state *rstate UNNEEDED,
+		     const struct pubkey *erring_node UNNEEDED,
+		     const struct short_channel_id *erring_channel UNNEEDED,
+		     enum onion_type failcode UNNEEDED,
+		     const u8 *channel_update UNNEEDED)
+{ fprintf(stderr, "routing_failure called!\n"); abort(); }
+/* Generated stub for set_chan_local_disabled */
+void set_chan_local_disabled(struct routing_state *rstate UNNEEDED,
+			     struct chan *chan UNNEEDED, bool disabled UNNEEDED)
+{ fprintf(stderr, "set_chan_local_disabled called!\n"); abort(); }
+/* Generated stub for status_failed */
+void status_failed(enum status_failreason code UNNEEDED,
+		   const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "status_failed called!\n"); abort(); }
+/* Generated stub for status_fmt */
+void status_fmt(enum log_level level UNNEEDED, const char *fmt UNNEEDED, ...)
+
+{ fprintf(stderr, "status_fmt called!\n"); abort(); }
+/* Generated stub for status_setup_async */
+void status_setup_async(struct daemon_conn *master UNNEEDED)
+{ fprintf(stderr, "status_setup_async called!\n"); abort(); }
+/* Generated stub for subdaemon_setup */
+void subdaemon_setup(int argc UNNEEDED, char *argv[])
+{ fprintf(stderr, "subdaemon_setup called!\n"); abort(); }
+/* Generated stub for timer_expired */
+void timer_expired(tal_t *ctx UNNEEDED, struct timer *timer UNNEEDED)
+{ fprintf(stderr, "timer_expired called!\n"); abort(); }
+/* Generated stub for towire_channel_update_option_channel_htlc_max */
+u8 *towire_channel_update_option_channel_htlc_max(const tal_t *ctx UNNEEDED, const secp256k1_ecdsa_signature *signature UNNEEDED, const struct bitcoin_blkid *chain_hash UNNEEDED, const struct short_channel_id *short_channel_id UNNEEDED, u32 timestamp UNNEEDED, u8 message_flags UNNEEDED, u8 channel_flags UNNEEDED, u16 cltv_expiry_delta UNNEEDED, u64 htlc_minimum_msat UNNEEDED, u32 fee_base_msat UNNEEDED, u32 fee_proportional_millionths UNNEEDED, u64 htlc_maximum_msat UNNEEDED)
+{ fprintf(stderr, "towire_channel_update_option_channel_htlc_max called!\n"); abort(); }
+/* Generated stub for towire_errorfmtv */
+u8 *towire_errorfmtv(const tal_t *ctx UNNEEDED,
+		     const struct channel_id *channel UNNEEDED,
+		     const char *fmt UNNEEDED,
+		     va_list ap UNNEEDED)
+{ fprintf(stderr, "towire_errorfmtv called!\n"); abort(); }
+/* Generated stub for towire_gossip_dev_gossip_queues_reply */
+u8 *towire_gossip_dev_gossip_queues_reply(const tal_t *ctx UNNEEDED, const struct pubkey *id UNNEEDED, const u64 *behind UNNEEDED, const u64 *queued UNNEEDED, const u64 *sent UNNEEDED, const u64 *batches UNNEEDED)
+{ fprintf(stderr, "towire_gossip_dev_gossip_queues_reply called!\n"); abort(); }
+/* Generated stub for towire_gossip_get_addrs_reply */
+u8 *towire_gossip_get_addrs_reply(const tal_t *ctx UNNEEDED, const struct wireaddr *addrs UNNEEDED)
+{ fprintf(stderr, "towire_gossip_get_addrs_reply called!\n"); abort(); }
+/* Generated stub for towire_gossip_get_channel_peer_reply */
+u8 *towire_gossip_get_channel_peer_reply(const tal_t *ctx UNNEEDED, const struct pubkey *peer_id UNNEEDED)
+{ fprintf(stderr, "towire_gossip_get_channel_peer_reply called!\n"); abort(); }
+/* Generated stub for towire_gossip_get_incoming_channels_reply */
+u8 *towire_gossip_get_incoming_channels_reply(const tal_t *ctx UNNEEDED, const struct route_info *route_info UNNEEDED)
+{ fprintf(stderr, "towire_gossip_get_incoming_channels_reply called!\n"); abort(); }
+/* Generated stub for towire_gossip_get_txout */
+u8 *towire_gossip_get_txout(const tal_t *ctx UNNEEDED, const struct short_channel_id *short_channel_id UNNEEDED)
+{ fprintf(stderr, "towire_gossip_get_txout called!\n"); abort(); }
+/* Generated stub for towire_gossip_get_update_reply */
+u8 *towire_gossip_get_update_reply(const tal_t *ctx UNNEEDED, const u8 *update UNNEEDED)
+{ fprintf(stderr, "towire_gossip_get_update_reply called!\n"); abort(); }
+/* Generated stub for towire_gossip_getchannels_reply */
+u8 *towire_gossip_getchannels_reply(const tal_t *ctx UNNEEDED, const struct gossip_getchannels_entry *nodes UNNEEDED, const struct short_channel_id *last UNNEEDED, u64 broadcast_index UNNEEDED)
+{ fprintf(stderr, "towire_gossip_getchannels_reply called!\n"); abort(); }
+/* Generated stub for towire_gossip_getnodes_reply */
+u8 *towire_gossip_getnodes_reply(const tal_t *ctx UNNEEDED, u64 broadcast_index UNNEEDED, const struct gossip_getnodes_entry **nodes UNNEEDED)
+{ fprintf(stderr, "towire_gossip_getnodes_reply called!\n"); abort(); }
+/* Generated stub for towire_gossip_getroute_reply */
+u8 *towire_gossip_getroute_reply(const tal_t *ctx UNNEEDED, const struct route_hop *hops UNNEEDED)
+{ fprintf(stderr, "towire_gossip_getroute_reply called!\n"); abort(); }
+/* Generated stub for towire_gossip_new_peer_reply */
+u8 *towire_gossip_new_peer_reply(const tal_t *ctx UNNEEDED, bool success UNNEEDED)
+{ fprintf(stderr, "towire_gossip_new_peer_reply called!\n"); abort(); }
+/* Generated stub for towire_gossip_ping_reply */
+u8 *towire_gossip_ping_reply(const tal_t *ctx UNNEEDED, const struct pubkey *id UNNEEDED, bool sent UNNEEDED, u16 totlen UNNEEDED)
+{ fprintf(stderr, "towire_gossip_ping_reply called!\n"); abort(); }
+/* Generated stub for towire_gossip_query_channel_range_reply */
+u8 *towire_gossip_query_channel_range_reply(const tal_t *ctx UNNEEDED, u32 final_first_block UNNEEDED, u32 final_num_blocks UNNEEDED, bool final_complete UNNEEDED, const struct short_channel_id *scids UNNEEDED)
+{ fprintf(stderr, "towire_gossip_query_channel_range_reply called!\n"); abort(); }
+/* Generated stub for towire_gossip_scids_reply */
+u8 *towire_gossip_scids_reply(const tal_t *ctx UNNEEDED, bool ok UNNEEDED, bool complete UNNEEDED)
+{ fprintf(stderr, "towire_gossip_scids_reply called!\n"); abort(); }
+/* Generated stub for towire_gossip_send_gossip */
+u8 *towire_gossip_send_gossip(const tal_t *ctx UNNEEDED, const u8 *gossip UNNEEDED)
+{ fprintf(stderr, "towire_gossip_send_gossip called!\n"); abort(); }
+/* Generated stub for towire_gossip_send_gossip_batch */
+u8 *towire_gossip_send_gossip_batch(const tal_t *ctx UNNEEDED, const u8 *batch UNNEEDED)
+{ fprintf(stderr, "towire_gossip_send_gossip_batch called!\n"); abort(); }
+/* Generated stub for towire_gossip_timestamp_filter */
+u8 *towire_gossip_timestamp_filter(const tal_t *ctx UNNEEDED, const struct bitcoin_blkid *chain_hash UNNEEDED, u32 first_timestamp UNNEEDED, u32 timestamp_range UNNEEDED)
+{ fprintf(stderr, "towire_gossip_timestamp_filter called!\n"); abort(); }
+/* Generated stub for towire_hsm_cupdate_sig_req */
+u8 *towire_hsm_cupdate_sig_req(const tal_t *ctx UNNEEDED, const u8 *cu UNNEEDED)
+{ fprintf(stderr, "towire_hsm_cupdate_sig_req called!\n"); abort(); }
+/* Generated stub for towire_hsm_node_announcement_sig_req */
+u8 *towire_hsm_node_announcement_sig_req(const tal_t *ctx UNNEEDED, const u8 *announcement UNNEEDED)
+{ fprintf(stderr, "towire_hsm_node_announcement_sig_req called!\n"); abort(); }
+/* Generated stub for towire_node_announcement */
+u8 *towire_node_announcement(const tal_t *ctx UNNEEDED, const secp256k1_ecdsa_signature *signature UNNEEDED, const u8 *features UNNEEDED, u32 timestamp UNNEEDED, const struct pubkey *node_id UNNEEDED, const u8 rgb_color[3] UNNEEDED, const u8 alias[32] UNNEEDED, const u8 *addresses UNNEEDED)
+{ fprintf(stderr, "towire_node_announcement called!\n"); abort(); }
+/* Generated stub for towire_query_channel_range */
+u8 *towire_query_channel_range(const tal_t *ctx UNNEEDED, const struct bitcoin_blkid *chain_hash UNNEEDED, u32 first_blocknum UNNEEDED, u32 number_of_blocks UNNEEDED)
+{ fprintf(stderr, "towire_query_channel_range called!\n"); abort(); }
+/* Generated stub for towire_query_short_channel_ids */
+u8 *towire_query_short_channel_ids(const tal_t *ctx UNNEEDED, const struct bitcoin_blkid *chain_hash UNNEEDED, const u8 *encoded_short_ids UNNEEDED)
+{ fprintf(stderr, "towire_query_short_channel_ids called!\n"); abort(); }
+/* Generated stub for towire_reply_channel_range */
+u8 *towire_reply_channel_range(const tal_t *ctx UNNEEDED, const struct bitcoin_blkid *chain_hash UNNEEDED, u32 first_blocknum UNNEEDED, u32 number_of_blocks UNNEEDED, u8 complete UNNEEDED, const u8 *encoded_short_ids UNNEEDED)
+{ fprintf(stderr, "towire_reply_channel_range called!\n"); abort(); }
+/* Generated stub for towire_reply_short_channel_ids_end */
+u8 *towire_reply_short_channel_ids_end(const tal_t *ctx UNNEEDED, const struct bitcoin_blkid *chain_hash UNNEEDED, u8 complete UNNEEDED)
+{ fprintf(stderr, "towire_reply_short_channel_ids_end called!\n"); abort(); }
+/* Generated stub for towire_wireaddr */
+void towire_wireaddr(u8 **pptr UNNEEDED, const struct wireaddr *addr UNNEEDED)
+{ fprintf(stderr, "towire_wireaddr called!\n"); abort(); }
+/* Generated stub for wire_sync_read */
+u8 *wire_sync_read(const tal_t *ctx UNNEEDED, int fd UNNEEDED)
+{ fprintf(stderr, "wire_sync_read called!\n"); abort(); }
+/* Generated stub for wire_sync_write */
+bool wire_sync_write(int fd UNNEEDED, const void *msg TAKES UNNEEDED)
+{ fprintf(stderr, "wire_sync_write called!\n"); abort(); }
+/* Generated stub for wireaddr_eq */
+bool wireaddr_eq(const struct wireaddr *a UNNEEDED, const struct wireaddr *b UNNEEDED)
+{ fprintf(stderr, "wireaddr_eq called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+static u8 *gossip_msg(const tal_t *ctx, u32 num)
+{
+	u8 *msg = tal_arr(ctx, u8, 0);
+
+	towire_u16(&msg, WIRE_NODE_ANNOUNCEMENT);
+	towire(&msg, &num, sizeof(num));
+	return msg;
+}
+
+static struct io_plan *room_again(struct io_conn *conn,
+				  struct daemon *daemon UNUSED)
+{
+	woken = true;
+	maybe_done();
+	return io_close(conn);
+}
+
+/* Like owner_msg_in() when queue_gossip_in() says it's full. */
+static struct io_plan *wait_for_room(struct io_conn *conn,
+				     struct daemon *daemon)
+{
+	return io_wait(conn, &daemon->gossip_in, room_again, daemon);
+}
+
+int main(void)
+{
+	struct daemon *daemon;
+	struct peer *a, *b;
+	u32 num = 0;
+	int fds[2];
+
+	setup_locale();
+	setup_tmpctx();
+
+	daemon = talz(NULL, struct daemon);
+	list_head_init(&daemon->gossip_in);
+	daemon->sigpool = threadpool_new(daemon, 0);
+	a = talz(daemon, struct peer);
+	a->daemon = daemon;
+	b = talz(daemon, struct peer);
+	b->daemon = daemon;
+	handled = tal_arr(daemon, u32, 0);
+
+	/* The first one goes straight into a batch. */
+	assert(queue_gossip_in(b, gossip_msg(tmpctx, num++)));
+	assert(daemon->gossip_checking);
+	assert(daemon->num_gossip_in == 0);
+
+	/* Now they pile up until we tell peers to wait. */
+	while (queue_gossip_in(num % 2 ? a : b, gossip_msg(tmpctx, num)))
+		num++;
+	num++;
+	assert(daemon->num_gossip_in == MAX_GOSSIP_IN);
+	assert(num == MAX_GOSSIP_IN + 1);
+
+	if (socketpair(AF_LOCAL, SOCK_STREAM, 0, fds) != 0)
+		err(1, "socketpair");
+	io_new_conn(daemon, fds[0], wait_for_room, daemon);
+
+	/* b goes away, with its gossip in the batch and in the queue. */
+	tal_free(b);
+	assert(daemon->num_gossip_in == MAX_GOSSIP_IN / 2);
+
+	/* Once the first batch is done, the next starts and there's room. */
+	expect_handled = MAX_GOSSIP_IN / 2;
+	io_loop(NULL, NULL);
+	assert(woken);
+
+	/* Only a's gossip, all of it, in order. */
+	assert(tal_count(handled) == MAX_GOSSIP_IN / 2);
+	for (size_t i = 0; i < tal_count(handled); i++)
+		assert(handled[i] == 1 + i * 2);
+	assert(!daemon->gossip_checking);
+	assert(daemon->num_gossip_in == 0);
+	assert(list_empty(&daemon->gossip_in));
+
+	close(fds[1]);
+	tal_free(daemon);
+
+	/* A full queue of channel_announcements has more signatures than
+	 * the cache holds, so it has to be checked in several batches. */
+	daemon = talz(NULL, struct daemon);
+	list_head_init(&daemon->gossip_in);
+	daemon->sigpool = threadpool_new(daemon, 0);
+	a = talz(daemon, struct peer);
+	a->daemon = daemon;
+	handled = tal_arr(daemon, u32, 0);
+	sigs_per_msg = 4;
+	first_sig = tal_arr(daemon, size_t, MAX_GOSSIP_IN + 1);
+	assert(MAX_GOSSIP_IN * sigs_per_msg > SIG_CACHE_MAX);
+
+	num = 0;
+	while (queue_gossip_in(a, gossip_msg(tmpctx, num)))
+		num++;
+	num++;
+	assert(num == MAX_GOSSIP_IN + 1);
+
+	expect_handled = num;
+	io_loop(NULL, NULL);
+	assert(tal_count(handled) == num);
+	for (size_t i = 0; i < tal_count(handled); i++)
+		assert(handled[i] == i);
+	/* Each checked once, by the pool. */
+	assert(sigs_checked == sigs_added);
+	assert(sigs_added == num * sigs_per_msg);
+	assert(!daemon->gossip_checking);
+	tal_free(daemon);
+	tal_free(tmpctx);
+	return 0;
+}
@@ -0,0 +1,242 @@
+#include "../broadcast.c"
+#include "../gen_gossip_store.c"
+#include "../gossip_store.c"
+#include "../routing.c"
+#include "../../common/threadpool.c"
+#include "../../wire/fromwire.c"
+#include "../../wire/gen_peer_wire.c"
+#include "../../wire/towire.c"
+#include <bitcoin/privkey.h>
+#include <bitcoin/signature.h>
+#include <ccan/err/err.h>
+#include <ccan/time/time.h>
+#include <common/pseudorand.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+void status_fmt(enum log_level level UNUSED, const char *fmt, ...)
+{
+}
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for fromwire_gossip_local_add_channel */
+bool fromwire_gossip_local_add_channel(const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED, struct pubkey *remote_node_id UNNEEDED, u64 *satoshis UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_local_add_channel called!\n"); abort(); }
+/* Generated stub for fromwire_wireaddr */
+bool fromwire_wireaddr(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, struct wireaddr *addr UNNEEDED)
+{ fprintf(stderr, "fromwire_wireaddr called!\n"); abort(); }
+/* Generated stub for onion_type_name */
+const char *onion_type_name(int e UNNEEDED)
+{ fprintf(stderr, "onion_type_name called!\n"); abort(); }
+/* Generated stub for sanitize_error */
+char *sanitize_error(const tal_t *ctx UNNEEDED, const u8 *errmsg UNNEEDED,
+		     struct channel_id *channel_id UNNEEDED)
+{ fprintf(stderr, "sanitize_error called!\n"); abort(); }
+/* Generated stub for status_failed */
+void status_failed(enum status_failreason code UNNEEDED,
+		   const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "status_failed called!\n"); abort(); }
+/* Generated stub for towire_errorfmt */
+u8 *towire_errorfmt(const tal_t *ctx UNNEEDED,
+		    const struct channel_id *channel UNNEEDED,
+		    const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "towire_errorfmt called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+static u8 *node_announcement(const tal_t *ctx, const struct privkey *priv,
+			     u32 timestamp, bool good)
+{
+	struct pubkey id;
+	secp256k1_ecdsa_signature sig;
+	struct sha256_double hash;
+	u8 rgb_color[3], alias[32], *empty, *msg;
+
+	if (!pubkey_from_privkey(priv, &id))
+		abort();
+	memset(&sig, 0, sizeof(sig));
+	memset(rgb_color, 0, sizeof(rgb_color));
+	memset(alias, 0, sizeof(alias));
+	empty = tal_arr(tmpctx, u8, 0);
+
+	/* The signature covers everything after it. */
+	msg = towire_node_announcement(tmpctx, &sig, empty, timestamp, &id,
+				       rgb_color, alias, empty);
+	sha256_double(&hash, msg + 66, tal_count(msg) - 66);
+	sign_hash(priv, &hash, &sig);
+	if (!good)
+		timestamp++;
+	return towire_node_announcement(ctx, &sig, empty, timestamp, &id,
+					rgb_color, alias, empty);
+}
+
+static struct privkey random_privkey(void)
+{
+	struct privkey priv;
+
+	for (size_t i = 0; i < sizeof(priv.secret.data); i++)
+		priv.secret.data[i] = pseudorand(256);
+	return priv;
+}
+
+/* Runs in a worker thread */
+static void check_one(struct gossip_sig *sigs, size_t i)
+{
+	/* We only ever give it good ones. */
+	if (!check_signed_hash(&sigs[i].hash, &sigs[i].sig, &sigs[i].key))
+		abort();
+}
+
+static void test_cache(struct routing_state *rstate)
+{
+	struct privkey priv = random_privkey();
+	struct gossip_sig *sigs = tal_arr(tmpctx, struct gossip_sig, 0);
+	struct short_channel_id scid;
+	secp256k1_ecdsa_signature sig;
+	const u8 *good = node_announcement(tmpctx, &priv, 1000, true);
+	const u8 *bad = node_announcement(tmpctx, &priv, 1000, false);
+
+	/* Each only needs checking once, even while it's being checked. */
+	gossip_sigs_to_check(rstate, good, &sigs);
+	assert(tal_count(sigs) == 1);
+	gossip_sigs_to_check(rstate, good, &sigs);
+	gossip_sigs_to_check(rstate, bad, &sigs);
+	gossip_sigs_to_check(rstate, bad, &sigs);
+	assert(tal_count(sigs) == 2);
+
+	assert(check_signed_hash(&sigs[0].hash, &sigs[0].sig, &sigs[0].key));
+	assert(!check_signed_hash(&sigs[1].hash, &sigs[1].sig, &sigs[1].key));
+	gossip_sig_checked(rstate, &sigs[0], true);
+	gossip_sig_checked(rstate, &sigs[1], false);
+
+	/* Good one is remembered, bad one is forgotten. */
+	tal_resize(&sigs, 0);
+	gossip_sigs_to_check(rstate, good, &sigs);
+	assert(tal_count(sigs) == 0);
+	gossip_sigs_to_check(rstate, bad, &sigs);
+	assert(tal_count(sigs) == 1);
+	gossip_sig_checked(rstate, &sigs[0], false);
+
+	/* Garbage and unknown channels don't need checking. */
+	tal_resize(&sigs, 0);
+	memset(&sig, 0, sizeof(sig));
+	mk_short_channel_id(&scid, 1, 2, 3);
+	gossip_sigs_to_check(rstate, tal_dup_arr(tmpctx, u8, bad + 1,
+						  tal_count(bad) - 1, 0), &sigs);
+	gossip_sigs_to_check(rstate,
+			     towire_channel_update(tmpctx, &sig,
+						   &rstate->chain_hash, &scid,
+						   1000, 0, 0, 6, 1, 1, 1),
+			     &sigs);
+	assert(tal_count(sigs) == 0);
+
+	/* It doesn't grow without bound. */
+	for (size_t i = 0; i < SIG_CACHE_MAX + 10; i++) {
+		struct gossip_sig gsig;
+
+		memset(&gsig, 0, sizeof(gsig));
+		memcpy(&gsig.hash, &i, sizeof(i));
+		gossip_sig_checked(rstate, &gsig, true);
+	}
+	assert(rstate->sig_cache->count == SIG_CACHE_MAX);
+}
+
+/* Initial sync from several peers: they mostly send the same gossip. */
+static void bench(struct routing_state *rstate, struct threadpool *pool,
+		  size_t num_msgs, size_t num_peers)
+{
+	const u8 **msgs = tal_arr(tmpctx, const u8 *, num_msgs);
+	struct gossip_sig *sigs = tal_arr(tmpctx, struct gossip_sig, 0);
+	struct timemono start;
+	struct timerel each, batched;
+
+	for (size_t i = 0; i < num_msgs; i++) {
+		struct privkey priv = random_privkey();
+		msgs[i] = node_announcement(msgs, &priv, 1000, true);
+	}
+
+	/* What handle_node_announcement used to do for each one. */
+	start = time_mono();
+	for (size_t p = 0; p < num_peers; p++) {
+		for (size_t i = 0; i < num_msgs; i++) {
+			struct gossip_sig gsig;
+			u8 *features, *addresses, rgb_color[3], alias[32];
+			u32 timestamp;
+
+			if (!fromwire_node_announcement(tmpctx, msgs[i],
+							&gsig.sig, &features,
+							&timestamp, &gsig.key,
+							rgb_color, alias,
+							&addresses))
+				abort();
+			sha256_double(&gsig.hash, msgs[i] + 66,
+				      tal_count(msgs[i]) - 66);
+			if (!check_signed_hash(&gsig.hash, &gsig.sig,
+					       &gsig.key))
+				abort();
+		}
+	}
+	each = timemono_since(start);
+
+	start = time_mono();
+	for (size_t p = 0; p < num_peers; p++) {
+		for (size_t i = 0; i < num_msgs; i++)
+			gossip_sigs_to_check(rstate, msgs[i], &sigs);
+		threadpool_run(pool, tal_count(sigs), check_one, sigs);
+		for (size_t i = 0; i < tal_count(sigs); i++)
+			gossip_sig_checked(rstate, &sigs[i], true);
+		tal_resize(&sigs, 0);
+	}
+	batched = timemono_since(start);
+
+	printf("%zu messages from %zu peers: %"PRIu64" msec one at a time,"
+	       " %"PRIu64" msec deduplicated with %zu threads\n",
+	       num_msgs, num_peers,
+	       time_to_msec(each), time_to_msec(batched),
+	       tal_count(pool->threads));
+}
+
+int main(int argc, char *argv[])
+{
+	setup_locale();
+
+	static const struct bitcoin_blkid zerohash;
+	struct routing_state *rstate;
+	struct threadpool *pool;
+	struct pubkey me;
+	size_t num_msgs = 1000, num_peers = 3;
+	size_t nthreads = threadpool_default_threads();
+	char dir[] = "/tmp/run-gossip_sigs.XXXXXX";
+
+	secp256k1_ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY
+						 | SECP256K1_CONTEXT_SIGN);
+	setup_tmpctx();
+
+	if (argc > 1)
+		num_msgs = atoi(argv[1]);
+	if (argc > 2)
+		num_peers = atoi(argv[2]);
+	if (argc > 3)
+		nthreads = atoi(argv[3]);
+
+	/* routing_state wants a gossip_store. */
+	if (!mkdtemp(dir) || chdir(dir) != 0)
+		err(1, "making temporary directory");
+
+	memset(&me, 2, sizeof(me));
+	rstate = new_routing_state(tmpctx, &zerohash, &me, 0);
+	test_cache(rstate);
+	tal_free(rstate);
+
+	rstate = new_routing_state(tmpctx, &zerohash, &me, 0);
+	pool = threadpool_new(tmpctx, nthreads);
+	bench(rstate, pool, num_msgs, num_peers);
+	tal_free(rstate);
+
+	unlink(GOSSIP_STORE_FILENAME);
+	if (chdir("/") != 0 || rmdir(dir) != 0)
+		err(1, "removing %s", dir);
+
+	tal_free(tmpctx);
+	secp256k1_context_destroy(secp256k1_ctx);
+	return 0;
+}
@@ -0,0 +1,175 @@
+#include "../broadcast.c"
+#include "../gen_gossip_store.c"
+#include "../gossip_store.c"
+#include "../routing.c"
+#include "../../wire/fromwire.c"
+#include "../../wire/gen_peer_wire.c"
+#include "../../wire/towire.c"
+#include <ccan/err/err.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+void status_fmt(enum log_level level UNUSED, const char *fmt UNUSED, ...)
+{
+}
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for fromwire_gossip_local_add_channel */
+bool fromwire_gossip_local_add_channel(const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED, struct pubkey *remote_node_id UNNEEDED, u64 *satoshis UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_local_add_channel called!\n"); abort(); }
+/* Generated stub for fromwire_wireaddr */
+bool fromwire_wireaddr(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, struct wireaddr *addr UNNEEDED)
+{ fprintf(stderr, "fromwire_wireaddr called!\n"); abort(); }
+/* Generated stub for onion_type_name */
+const char *onion_type_name(int e UNNEEDED)
+{ fprintf(stderr, "onion_type_name called!\n"); abort(); }
+/* Generated stub for sanitize_error */
+char *sanitize_error(const tal_t *ctx UNNEEDED, const u8 *errmsg UNNEEDED,
+		     struct channel_id *channel_id UNNEEDED)
+{ fprintf(stderr, "sanitize_error called!\n"); abort(); }
+/* Generated stub for status_failed */
+void status_failed(enum status_failreason code UNNEEDED,
+		   const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "status_failed called!\n"); abort(); }
+/* Generated stub for towire_errorfmt */
+u8 *towire_errorfmt(const tal_t *ctx UNNEEDED,
+		    const struct channel_id *channel UNNEEDED,
+		    const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "towire_errorfmt called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+/* What each broadcast should read back as (NULL once deleted). */
+static const u8 **msgs;
+
+/* The store only looks at the type, so these don't need to be valid. */
+static void add_msg(struct routing_state *rstate, u32 timestamp)
+{
+	u8 *msg = tal_arr(tmpctx, u8, 0);
+	u64 index;
+
+	towire_u16(&msg, WIRE_NODE_ANNOUNCEMENT);
+	towire_u32(&msg, timestamp);
+	/* Vary the length, so offsets don't line up by accident. */
+	for (size_t i = 0; i < timestamp % 37; i++)
+		towire_u8(&msg, i);
+
+	index = insert_broadcast(rstate->broadcasts,
+				 gossip_store_add(rstate->store, msg),
+				 timestamp);
+	if (index >= tal_count(msgs))
+		tal_resizez(&msgs, index + 1);
+	msgs[index] = tal_steal(msgs, msg);
+}
+
+static void del_msg(struct routing_state *rstate, u64 index)
+{
+	assert(msgs[index]);
+	broadcast_del(rstate->broadcasts, index);
+	msgs[index] = tal_free(msgs[index]);
+}
+
+/* Delete the first live broadcast at or after index, if any. */
+static void del_msg_from(struct routing_state *rstate, u64 index)
+{
+	while (index < tal_count(msgs) && !msgs[index])
+		index++;
+	if (index < tal_count(msgs))
+		del_msg(rstate, index);
+}
+
+static void check_store(struct routing_state *rstate)
+{
+	struct queued_message *q;
+	u64 index = 0;
+	size_t n = 0;
+
+	while ((q = next_broadcast(rstate->broadcasts, 0, UINT32_MAX, &index))
+	       != NULL) {
+		const u8 *msg = gossip_store_get(tmpctx, rstate->store,
+						 q->store_offset);
+		assert(msgs[q->index]);
+		assert(tal_count(msg) == tal_count(msgs[q->index]));
+		assert(memcmp(msg, msgs[q->index], tal_count(msg)) == 0);
+		n++;
+	}
+	assert(n == rstate->broadcasts->count);
+
+	for (size_t i = 0; i < tal_count(msgs); i++)
+		assert(!msgs[i] || broadcast_store_offset(rstate->broadcasts, i));
+}
+
+int main(void)
+{
+	setup_locale();
+
+	static const struct bitcoin_blkid zerohash;
+	struct routing_state *rstate;
+	struct gossip_store *gs;
+	struct pubkey me;
+	struct stat st;
+	size_t steps = 0;
+	u32 timestamp = 1;
+	char dir[] = "/tmp/run-gossip_store_compact.XXXXXX";
+
+	setup_tmpctx();
+	memset(&me, 0, sizeof(me));
+
+	if (!mkdtemp(dir) || chdir(dir) != 0)
+		err(1, "making temporary directory");
+
+	rstate = new_routing_state(tmpctx, &zerohash, &me, 0);
+	gs = rstate->store;
+	msgs = tal_arrz(tmpctx, const u8 *, 1);
+
+	/* Enough garbage that we'd compact anyway. */
+	for (size_t i = 0; i < 3000; i++)
+		add_msg(rstate, timestamp++);
+	for (size_t i = 1; i < tal_count(msgs); i++)
+		if (i % 3)
+			del_msg(rstate, i);
+	assert(gs->count >= 1000);
+	assert(gs->count > rstate->broadcasts->count * 1.25);
+
+	assert(compact_start(gs));
+	for (;;) {
+		bool rest = (gs->compact_index + 1 >= gs->compact_end);
+		u64 copied = gs->compact_index;
+
+		steps++;
+		if (!compact_step(gs, 10)) {
+			/* We add faster than we copy past the end, so we only
+			 * finish by copying the rest in one go. */
+			assert(rest);
+			assert(steps > 1);
+			break;
+		}
+		assert(!rest);
+
+		/* Broadcasts come and go while we're compacting: some we
+		 * already copied, some we haven't yet, some added since we
+		 * started. */
+		add_msg(rstate, timestamp++);
+		add_msg(rstate, timestamp++);
+		del_msg_from(rstate, copied);
+		del_msg_from(rstate, gs->compact_index + 1);
+		del_msg_from(rstate, gs->compact_end);
+	}
+	assert(gs->compact_fd < 0);
+	assert(!gs->disable_compaction);
+	assert(stat(GOSSIP_STORE_TEMP_FILENAME, &st) != 0);
+	assert(stat(GOSSIP_STORE_FILENAME, &st) == 0);
+	assert(st.st_size == gs->len);
+	check_store(rstate);
+
+	/* We keep appending to the new store. */
+	add_msg(rstate, timestamp++);
+	check_store(rstate);
+
+	tal_free(rstate);
+	unlink(GOSSIP_STORE_FILENAME);
+	if (chdir("/") != 0 || rmdir(dir) != 0)
+		err(1, "removing %s", dir);
+
+	tal_free(tmpctx);
+	return 0;
+}
@@ -32,6 +32,7 @@
 #include <common/key_derive.h>
 #include <common/status.h>
 #include <common/subdaemon.h>
+#include <common/threadpool.h>
 #include <common/type_to_string.h>
 #include <common/utils.h>
 #include <common/version.h>
@@ -44,6 +45,7 @@
 #include <inttypes.h>
 #include <secp256k1_ecdh.h>
 #include <sodium/randombytes.h>
+#include <sodium/utils.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -854,6 +856,152 @@ static struct io_plan *handle_sign_remote_htlc_tx(struct io_conn *conn,
 	return req_reply(conn, c, take(towire_hsm_sign_tx_reply(NULL, &sig)));
 }
 
+/*~ Signing is pure CPU work, and with many channels busy it's where all our
+ * time goes.  So we hash each transaction here (that needs tal, which isn't
+ * thread-safe), then hand just the hashes and keys to a pool of worker
+ * threads.  We don't read the client's next request until we've replied,
+ * so each client's replies still come back in order. */
+static struct threadpool *signpool;
+
+struct sign_job {
+	/* NULL if the client went away while we were signing. */
+	struct client *c;
+	struct sha256_double *hashes;
+	struct privkey *privkeys;
+	secp256k1_ecdsa_signature *sigs;
+};
+
+/* Don't leave the keys lying around in freed memory. */
+static void destroy_privkeys(struct privkey *privkeys)
+{
+	sodium_memzero(privkeys, tal_bytelen(privkeys));
+}
+
+static void sign_one(struct sign_job *job, size_t i)
+{
+	sign_hash(&job->privkeys[i], &job->hashes[i], &job->sigs[i]);
+}
+
+static void sign_job_client_gone(struct client *c UNUSED, struct sign_job *job)
+{
+	job->c = NULL;
+}
+
+static void sign_job_done(struct sign_job *job)
+{
+	if (!job->c)
+		tal_free(job);
+	else
+		io_wake(job);
+}
+
+static struct io_plan *sign_job_reply(struct io_conn *conn,
+				      struct sign_job *job)
+{
+	struct client *c = job->c;
+	secp256k1_ecdsa_signature *htlc_sigs;
+	u8 *msg;
+
+	tal_del_destructor2(c, sign_job_client_gone, job);
+
+	/* The first is the commitment tx signature, the rest are HTLCs. */
+	htlc_sigs = tal_dup_arr(tmpctx, secp256k1_ecdsa_signature,
+				job->sigs + 1, tal_count(job->sigs) - 1, 0);
+	msg = towire_hsm_sign_remote_commitment_txs_reply(NULL, &job->sigs[0],
+							  htlc_sigs);
+	tal_free(job);
+	return req_reply(conn, c, take(msg));
+}
+
+/*~ This is what channeld actually uses: it's the two above combined, so
+ * a commitment with hundreds of HTLCs costs one round trip, not hundreds.
+ * The HTLC transactions all spend outputs of the commitment transaction,
+ * which is where we get their amounts from. */
+static struct io_plan *handle_sign_remote_commitment_txs(struct io_conn *conn,
+							 struct client *c,
+							 const u8 *msg_in)
+{
+	struct pubkey remote_funding_pubkey, local_funding_pubkey;
+	struct pubkey remote_per_commit_point;
+	struct privkey htlc_privkey;
+	u64 funding_amount;
+	struct secret channel_seed;
+	struct bitcoin_tx *tx;
+	struct bitcoin_txid txid;
+	struct unsigned_htlc_tx **htlc_txs;
+	struct secrets secrets;
+	struct basepoints basepoints;
+	const u8 *funding_wscript;
+	struct sign_job *job;
+	size_t n;
+
+	if (!fromwire_hsm_sign_remote_commitment_txs(tmpctx, msg_in,
+						     &tx,
+						     &remote_funding_pubkey,
+						     &funding_amount,
+						     &remote_per_commit_point,
+						     &htlc_txs))
+		return bad_req(conn, c, msg_in);
+
+	get_channel_seed(&c->id, c->dbid, &channel_seed);
+	derive_basepoints(&channel_seed,
+			  &local_funding_pubkey, &basepoints, &secrets, NULL);
+
+	/* The same HTLC key signs all of them. */
+	if (!derive_simple_privkey(&secrets.htlc_basepoint_secret,
+				   &basepoints.htlc,
+				   &remote_per_commit_point,
+				   &htlc_privkey))
+		return bad_req_fmt(conn, c, msg_in,
+				   "Failed deriving htlc privkey");
+
+	/* The job outlives this request's tmpctx (and maybe the client). */
+	n = 1 + tal_count(htlc_txs);
+	job = tal(NULL, struct sign_job);
+	job->c = c;
+	job->hashes = tal_arr(job, struct sha256_double, n);
+	job->privkeys = tal_arr(job, struct privkey, n);
+	tal_add_destructor(job->privkeys, destroy_privkeys);
+	job->sigs = tal_arr(job, secp256k1_ecdsa_signature, n);
+
+	funding_wscript = bitcoin_redeem_2of2(tmpctx,
+					      &local_funding_pubkey,
+					      &remote_funding_pubkey);
+	tx->input[0].amount = tal_dup(tx->input, u64, &funding_amount);
+	sha256_tx_for_sig(&job->hashes[0], tx, 0, funding_wscript);
+	job->privkeys[0] = secrets.funding_privkey;
+
+	bitcoin_txid(tx, &txid);
+	for (size_t i = 0; i < tal_count(htlc_txs); i++) {
+		struct bitcoin_tx *htx = htlc_txs[i]->tx;
+		u32 outnum;
+
+		if (tal_count(htx->input) != 1
+		    || !bitcoin_txid_eq(&htx->input[0].txid, &txid)) {
+			tal_free(job);
+			return bad_req_fmt(conn, c, msg_in,
+					   "HTLC tx %zu doesn't spend commitment",
+					   i);
+		}
+		outnum = htx->input[0].index;
+		if (outnum >= tal_count(tx->output)) {
+			tal_free(job);
+			return bad_req_fmt(conn, c, msg_in,
+					   "HTLC tx %zu bad output %u", i, outnum);
+		}
+
+		htx->input[0].amount = tal_dup(htx->input, u64,
+					       &tx->output[outnum].amount);
+		sha256_tx_for_sig(&job->hashes[1 + i], htx, 0,
+				  htlc_txs[i]->wscript);
+		job->privkeys[1 + i] = htlc_privkey;
+	}
+
+	tal_add_destructor2(c, sign_job_client_gone, job);
+	threadpool_start(signpool, n, sign_one, sign_job_done, job);
+	return io_wait(conn, job, sign_job_reply, job);
+}
+
 /*~ This covers several cases where onchaind is creating a transaction which
  * sends funds to our internal wallet. */
 /* FIXME: Derive output address for this client, and check it here! */
@@ -1576,6 +1724,7 @@ static bool check_client_capabilities(struct client *client,
 
 	case WIRE_HSM_SIGN_REMOTE_COMMITMENT_TX:
 	case WIRE_HSM_SIGN_REMOTE_HTLC_TX:
+	case WIRE_HSM_SIGN_REMOTE_COMMITMENT_TXS:
 		return (client->capabilities & HSM_CAP_SIGN_REMOTE_TX) != 0;
 
 	case WIRE_HSM_SIGN_MUTUAL_CLOSE_TX:
@@ -1608,6 +1757,7 @@ static bool check_client_capabilities(struct client *client,
 	case WIRE_HSM_GET_PER_COMMITMENT_POINT_REPLY:
 	case WIRE_HSM_CHECK_FUTURE_SECRET_REPLY:
 	case WIRE_HSM_GET_CHANNEL_BASEPOINTS_REPLY:
+	case WIRE_HSM_SIGN_REMOTE_COMMITMENT_TXS_REPLY:
 		break;
 	}
 	return false;
@@ -1685,6 +1835,9 @@ static struct io_plan *handle_client(struct io_conn *conn, struct client *c)
 	case WIRE_HSM_SIGN_REMOTE_HTLC_TX:
 		return handle_sign_remote_htlc_tx(conn, c, c->msg_in);
 
+	case WIRE_HSM_SIGN_REMOTE_COMMITMENT_TXS:
+		return handle_sign_remote_commitment_txs(conn, c, c->msg_in);
+
 	case WIRE_HSM_SIGN_MUTUAL_CLOSE_TX:
 		return handle_sign_mutual_close_tx(conn, c, c->msg_in);
 
@@ -1703,6 +1856,7 @@ static struct io_plan *handle_client(struct io_conn *conn, struct client *c)
 	case WIRE_HSM_GET_PER_COMMITMENT_POINT_REPLY:
 	case WIRE_HSM_CHECK_FUTURE_SECRET_REPLY:
 	case WIRE_HSM_GET_CHANNEL_BASEPOINTS_REPLY:
+	case WIRE_HSM_SIGN_REMOTE_COMMITMENT_TXS_REPLY:
 		break;
 	}
 
@@ -1729,6 +1883,7 @@ int main(int argc, char *argv[])
 	status_conn = daemon_conn_new(NULL, STDIN_FILENO, NULL, NULL, NULL);
 	status_setup_async(status_conn);
 	uintmap_init(&clients);
+	signpool = threadpool_new(NULL, threadpool_default_threads());
 
 	master = new_client(NULL, NULL, 0, HSM_CAP_MASTER | HSM_CAP_SIGN_GOSSIP,
 			    REQ_FD);
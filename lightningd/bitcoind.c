@@ -1,9 +1,11 @@
-/* Code for talking to bitcoind.  We use bitcoin-cli. */
+/* Code for talking to bitcoind.  We use bitcoin-cli, or talk JSON-RPC
+ * directly with --bitcoin-rpc-direct. */
 #include "bitcoin/base58.h"
 #include "bitcoin/block.h"
 #include "bitcoin/feerate.h"
 #include "bitcoin/shadouble.h"
 #include "bitcoind.h"
+#include "bitcoind_rpc.h"
 #include "lightningd.h"
 #include "log.h"
 #include <ccan/cast/cast.h>
@@ -38,10 +40,15 @@ static void add_arg(const char ***args, const char *arg)
 static const char **gather_args(const struct bitcoind *bitcoind,
 				const tal_t *ctx, const char *cmd, va_list ap)
 {
-	const char **args = tal_arr(ctx, const char *, 1);
+	const char **args = tal_arr(ctx, const char *, 0);
 	const char *arg;
 
-	args[0] = bitcoind->cli ? bitcoind->cli : bitcoind->chainparams->cli;
+	/* Talking directly to bitcoind, we only need the command itself. */
+	if (bitcoind->rpc)
+		goto command;
+
+	add_arg(&args,
+		bitcoind->cli ? bitcoind->cli : bitcoind->chainparams->cli);
 	if (bitcoind->chainparams->cli_args)
 		add_arg(&args, bitcoind->chainparams->cli_args);
 
@@ -64,6 +71,7 @@ static const char **gather_args(const struct bitcoind *bitcoind,
 		add_arg(&args,
 			tal_fmt(args, "-rpcpassword=%s", bitcoind->rpcpass));
 
+command:
 	add_arg(&args, cmd);
 
 	while ((arg = va_arg(ap, const char *)) != NULL)
@@ -159,9 +167,8 @@ static void bcli_failure(struct bitcoind *bitcoind,
 		     retry_bcli, bcli);
 }
 
-static void bcli_finished(struct io_conn *conn UNUSED, struct bitcoin_cli *bcli)
+static void bcli_done(struct bitcoin_cli *bcli, int exitstatus)
 {
-	int ret, status;
 	struct bitcoind *bitcoind = bcli->bitcoind;
 	enum bitcoind_prio prio = bcli->prio;
 	bool ok;
@@ -175,27 +182,16 @@ static void bcli_finished(struct io_conn *conn UNUSED, struct bitcoin_cli *bcli)
 
 	assert(bitcoind->num_requests[prio] > 0);
 
-	/* FIXME: If we waited for SIGCHILD, this could never hang! */
-	while ((ret = waitpid(bcli->pid, &status, 0)) < 0 && errno == EINTR);
-	if (ret != bcli->pid)
-		fatal("%s %s", bcli_args(tmpctx, bcli),
-		      ret == 0 ? "not exited?" : strerror(errno));
-
-	if (!WIFEXITED(status))
-		fatal("%s died with signal %i",
-		      bcli_args(tmpctx, bcli),
-		      WTERMSIG(status));
-
 	if (!bcli->exitstatus) {
-		if (WEXITSTATUS(status) != 0) {
-			bcli_failure(bitcoind, bcli, WEXITSTATUS(status));
+		if (exitstatus != 0) {
+			bcli_failure(bitcoind, bcli, exitstatus);
 			bitcoind->num_requests[prio]--;
 			goto done;
 		}
 	} else
-		*bcli->exitstatus = WEXITSTATUS(status);
+		*bcli->exitstatus = exitstatus;
 
-	if (WEXITSTATUS(status) == 0)
+	if (exitstatus == 0)
 		bitcoind->error_count = 0;
 
 	bitcoind->num_requests[bcli->prio]--;
@@ -209,7 +205,7 @@ static void bcli_finished(struct io_conn *conn UNUSED, struct bitcoin_cli *bcli)
 	db_commit_transaction(bitcoind->ld->wallet->db);
 
 	if (!ok)
-		bcli_failure(bitcoind, bcli, WEXITSTATUS(status));
+		bcli_failure(bitcoind, bcli, exitstatus);
 	else
 		tal_free(bcli);
 
@@ -217,6 +213,33 @@ done:
 	next_bcli(bitcoind, prio);
 }
 
+static void bcli_finished(struct io_conn *conn UNUSED, struct bitcoin_cli *bcli)
+{
+	int ret, status;
+
+	/* FIXME: If we waited for SIGCHILD, this could never hang! */
+	while ((ret = waitpid(bcli->pid, &status, 0)) < 0 && errno == EINTR);
+	if (ret != bcli->pid)
+		fatal("%s %s", bcli_args(tmpctx, bcli),
+		      ret == 0 ? "not exited?" : strerror(errno));
+
+	if (!WIFEXITED(status))
+		fatal("%s died with signal %i",
+		      bcli_args(tmpctx, bcli),
+		      WTERMSIG(status));
+
+	bcli_done(bcli, WEXITSTATUS(status));
+}
+
+static void bcli_rpc_done(int exitstatus,
+			  const char *output, size_t output_bytes,
+			  struct bitcoin_cli *bcli)
+{
+	bcli->output = tal_dup_arr(bcli, char, output, output_bytes, 0);
+	bcli->output_bytes = output_bytes;
+	bcli_done(bcli, exitstatus);
+}
+
 static void next_bcli(struct bitcoind *bitcoind, enum bitcoind_prio prio)
 {
 	struct bitcoin_cli *bcli;
@@ -229,13 +252,20 @@ static void next_bcli(struct bitcoind *bitcoind, enum bitcoind_prio prio)
 	if (!bcli)
 		return;
 
+	bcli->start = time_now();
+
+	/* Same queueing, but we send it down one of our open connections. */
+	if (bitcoind->rpc) {
+		bitcoind->num_requests[prio]++;
+		bitcoind_rpc_call(bitcoind->rpc, bcli->args, bcli_rpc_done, bcli);
+		return;
+	}
+
 	bcli->pid = pipecmdarr(&bcli->fd, NULL, &bcli->fd,
 			       cast_const2(char **, bcli->args));
 	if (bcli->pid < 0)
 		fatal("%s exec failed: %s", bcli->args[0], strerror(errno));
 
-	bcli->start = time_now();
-
 	bitcoind->num_requests[prio]++;
 
 	/* This lifetime is attached to bitcoind command fd */
@@ -438,6 +468,9 @@ void bitcoind_sendrawtx_(struct bitcoind *bitcoind,
 			 void *arg)
 {
 	log_debug(bitcoind->log, "sendrawtransaction: %s", hextx);
+	/* This races our commit, so at least don't delay it. */
+	if (bitcoind->ld->wallet->db->in_transaction)
+		db_commit_immediately(bitcoind->ld->wallet->db);
 	start_bitcoin_cli(bitcoind, NULL, process_sendrawtx, true,
 			  BITCOIND_HIGH_PRIO,
 			  cb, arg,
@@ -798,13 +831,130 @@ static void fatal_bitcoind_failure(struct bitcoind *bitcoind, const char *error_
 	exit(1);
 }
 
+/* Where bitcoind writes its .cookie, if not given rpcuser/rpcpassword.
+ * NULL if we can't tell (no datadir, and no $HOME to guess from). */
+static char *bitcoind_cookie_file(const tal_t *ctx,
+				  const struct bitcoind *bitcoind)
+{
+	const char *network = bitcoind->chainparams->network_name;
+	const char *datadir = bitcoind->datadir;
+
+	if (!datadir) {
+		const char *home = getenv("HOME");
+		if (!home)
+			return NULL;
+		datadir = path_join(tmpctx, home,
+				    strstarts(network, "litecoin")
+				    ? ".litecoin" : ".bitcoin");
+	}
+
+	if (streq(network, "regtest"))
+		datadir = path_join(tmpctx, datadir, "regtest");
+	else if (streq(network, "testnet"))
+		datadir = path_join(tmpctx, datadir, "testnet3");
+	else if (streq(network, "litecoin-testnet"))
+		datadir = path_join(tmpctx, datadir, "testnet4");
+
+	return path_join(ctx, datadir, ".cookie");
+}
+
+static bool start_bitcoind_rpc(struct bitcoind *bitcoind)
+{
+	const char *user = bitcoind->rpcuser, *pass = bitcoind->rpcpass;
+	const char *port = bitcoind->rpcport;
+
+	if (!user || !pass) {
+		char *cookiefile = bitcoind_cookie_file(tmpctx, bitcoind);
+		char *cookie, *colon;
+
+		if (!cookiefile) {
+			log_unusual(bitcoind->log,
+				    "No bitcoin-rpcuser/bitcoin-rpcpassword,"
+				    " no bitcoin-datadir and HOME is not set");
+			return false;
+		}
+
+		cookie = grab_file(tmpctx, cookiefile);
+		if (!cookie || !(colon = strchr(cookie, ':'))) {
+			log_unusual(bitcoind->log,
+				    "No bitcoin-rpcuser/bitcoin-rpcpassword,"
+				    " and could not read %s",
+				    cookiefile);
+			return false;
+		}
+		*colon = '\0';
+		colon[1 + strcspn(colon + 1, "\r\n")] = '\0';
+		user = cookie;
+		pass = colon + 1;
+	}
+
+	if (!port)
+		port = tal_fmt(tmpctx, "%i", bitcoind->chainparams->rpc_port);
+
+	bitcoind->rpc = new_bitcoind_rpc(bitcoind, bitcoind->log,
+					 bitcoind->rpcconnect
+					 ? bitcoind->rpcconnect : "127.0.0.1",
+					 port, user, pass);
+	return bitcoind->rpc != NULL;
+}
+
+/* Returns false if we should fall back to bitcoin-cli. */
+static bool wait_for_bitcoind_rpc(struct bitcoind *bitcoind)
+{
+	const char *args[] = { "echo", NULL };
+	bool printed = false;
+
+	if (!start_bitcoind_rpc(bitcoind))
+		goto fallback;
+
+	for (;;) {
+		char *output;
+		int status;
+
+		status = bitcoind_rpc_call_sync(tmpctx, bitcoind->rpc, args,
+						&output);
+		if (status == 0)
+			return true;
+
+		/* Same as bitcoin-cli's exit status, see below. */
+		if (status != 28) {
+			if (status == 1) {
+				log_unusual(bitcoind->log,
+					    "Could not talk to bitcoind"
+					    " directly: %s", output);
+				bitcoind->rpc = tal_free(bitcoind->rpc);
+				goto fallback;
+			}
+			fatal("bitcoind echo failed with code %i: %s",
+			      status, output);
+		}
+
+		if (!printed) {
+			log_unusual(bitcoind->log,
+				    "Waiting for bitcoind to warm up...");
+			printed = true;
+		}
+		sleep(1);
+	}
+
+fallback:
+	log_unusual(bitcoind->log, "Falling back to %s",
+		    bitcoind->cli ? bitcoind->cli : bitcoind->chainparams->cli);
+	return false;
+}
+
 void wait_for_bitcoind(struct bitcoind *bitcoind)
 {
 	int from, status, ret;
 	pid_t child;
-	const char **cmd = cmdarr(bitcoind, bitcoind, "echo", NULL);
+	const char **cmd;
 	bool printed = false;
 
+	if (bitcoind->rpc_direct && wait_for_bitcoind_rpc(bitcoind))
+		return;
+
+	cmd = cmdarr(bitcoind, bitcoind, "echo", NULL);
+
 	for (;;) {
 		child = pipecmdarr(&from, NULL, &from, cast_const2(char **,cmd));
 		if (child < 0) {
@@ -872,6 +1022,8 @@ struct bitcoind *new_bitcoind(const tal_t *ctx,
 	bitcoind->rpcpass = NULL;
 	bitcoind->rpcconnect = NULL;
 	bitcoind->rpcport = NULL;
+	bitcoind->rpc_direct = false;
+	bitcoind->rpc = NULL;
 	tal_add_destructor(bitcoind, destroy_bitcoind);
 
 	return bitcoind;
@@ -11,6 +11,7 @@
 #include <stdbool.h>
 
 struct bitcoin_blkid;
+struct bitcoind_rpc;
 struct bitcoin_tx_output;
 struct block;
 struct lightningd;
@@ -61,6 +62,12 @@ struct bitcoind {
 
 	/* Passthrough parameters for bitcoin-cli */
 	char *rpcuser, *rpcpass, *rpcconnect, *rpcport;
+
+	/* Talk JSON-RPC to bitcoind ourselves, instead of bitcoin-cli? */
+	bool rpc_direct;
+
+	/* If so, and it worked, this is our connection(s) to it. */
+	struct bitcoind_rpc *rpc;
 };
 
 struct bitcoind *new_bitcoind(const tal_t *ctx,
@@ -0,0 +1,517 @@
+/* Talking JSON-RPC directly to bitcoind, rather than via bitcoin-cli. */
+#include "bitcoind_rpc.h"
+#include "json_escaped.h"
+#include "log.h"
+#include <ccan/array_size/array_size.h>
+#include <ccan/cast/cast.h>
+#include <ccan/io/io.h>
+#include <ccan/list/list.h>
+#include <ccan/mem/mem.h>
+#include <ccan/noerr/noerr.h>
+#include <ccan/read_write_all/read_write_all.h>
+#include <ccan/str/str.h>
+#include <ccan/tal/str/str.h>
+#include <common/json.h>
+#include <common/utils.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* What bitcoin-cli exits with if it can't talk to bitcoind at all. */
+#define RPC_EXIT_FAILURE 1
+
+struct bitcoind_rpc {
+	struct log *log;
+	struct addrinfo *addr;
+
+	/* "Host:" and "Authorization:" headers for every request. */
+	char *headers;
+
+	/* Connections waiting for their next request. */
+	struct list_head idle;
+
+	/* Set when we're being freed: don't call back any more. */
+	bool freeing;
+
+	u64 next_id;
+};
+
+struct rpc_request {
+	/* The whole HTTP request. */
+	char *http;
+
+	/* We retry once if a kept-alive connection turns out to be closed. */
+	bool retried;
+
+	void (*cb)(int exitstatus, const char *output, size_t output_bytes,
+		   void *arg);
+	void *cb_arg;
+};
+
+struct rpc_conn {
+	/* In rpc->idle if we're not busy. */
+	struct list_node list;
+	bool idle;
+	struct bitcoind_rpc *rpc;
+
+	/* What we're doing (NULL if idle). */
+	struct rpc_request *req;
+
+	/* Response so far. */
+	char *buf;
+	size_t used, len_read;
+
+	/* Did it tell us to close after this response? */
+	bool keepalive;
+};
+
+/* Which parameters does bitcoin-cli parse as JSON, rather than pass as
+ * strings?  (From bitcoin/src/rpc/client.cpp, for the commands we use.) */
+static const struct {
+	const char *method;
+	size_t param;
+} json_params[] = {
+	{ "estimatesmartfee", 0 },
+	{ "getblock", 1 },
+	{ "getblockhash", 0 },
+	{ "gettxout", 1 },
+	{ "gettxout", 2 },
+	{ "sendrawtransaction", 1 },
+};
+
+static bool is_json_param(const char *method, size_t param)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(json_params); i++) {
+		if (streq(json_params[i].method, method)
+		    && json_params[i].param == param)
+			return true;
+	}
+	return false;
+}
+
+static char *rpc_request_body(const tal_t *ctx, u64 id, const char **args)
+{
+	char *body;
+
+	body = tal_fmt(ctx,
+		       "{\"jsonrpc\":\"1.0\",\"id\":%"PRIu64","
+		       "\"method\":\"%s\",\"params\":[",
+		       id, json_escape(tmpctx, args[0])->s);
+	for (size_t i = 1; args[i]; i++) {
+		if (i > 1)
+			tal_append_fmt(&body, ",");
+		if (is_json_param(args[0], i - 1))
+			tal_append_fmt(&body, "%s", args[i]);
+		else
+			tal_append_fmt(&body, "\"%s\"",
+				       json_escape(tmpctx, args[i])->s);
+	}
+	tal_append_fmt(&body, "]}");
+	return body;
+}
+
+static char *rpc_request_http(const tal_t *ctx, struct bitcoind_rpc *rpc,
+			      const char **args)
+{
+	char *body = rpc_request_body(tmpctx, rpc->next_id++, args);
+
+	return tal_fmt(ctx,
+		       "POST / HTTP/1.1\r\n"
+		       "%s"
+		       "Content-Type: application/json\r\n"
+		       "Content-Length: %zu\r\n"
+		       "\r\n"
+		       "%s",
+		       rpc->headers, strlen(body), body);
+}
+
+/* Find a header's value (case-insensitively), or NULL. */
+static const char *find_header(const tal_t *ctx,
+			       const char *hdrs, size_t hdrlen,
+			       const char *name)
+{
+	const char *end = hdrs + hdrlen, *p = hdrs;
+	size_t namelen = strlen(name);
+
+	while (p < end) {
+		const char *eol = memmem(p, end - p, "\r\n", 2);
+		if (!eol)
+			eol = end;
+		if (eol - p > namelen && p[namelen] == ':'
+		    && strncasecmp(p, name, namelen) == 0) {
+			p += namelen + 1;
+			while (p < eol && *p == ' ')
+				p++;
+			return tal_strndup(ctx, p, eol - p);
+		}
+		p = eol + 2;
+	}
+	return NULL;
+}
+
+/* Returns 0 if we need more, -1 if it's malformed, otherwise the HTTP status,
+ * with the body and whether to keep the connection open. */
+static int parse_http_response(const char *buf, size_t len,
+			       const char **body, size_t *bodylen,
+			       bool *keepalive)
+{
+	const char *hdrend = memmem(buf, len, "\r\n\r\n", 4);
+	const char *clen, *conn;
+	size_t hdrlen;
+	char *end;
+	int status;
+
+	if (!hdrend)
+		return 0;
+	hdrlen = hdrend - buf + 2;
+
+	/* HTTP/1.1 200 OK */
+	if (!strstarts(buf, "HTTP/1."))
+		return -1;
+	status = strtol(buf + strlen("HTTP/1.x"), &end, 10);
+	if (end == buf + strlen("HTTP/1.x") || status <= 0)
+		return -1;
+
+	conn = find_header(tmpctx, buf, hdrlen, "Connection");
+	if (conn)
+		*keepalive = strcasecmp(conn, "close") != 0;
+	else
+		*keepalive = (buf[strlen("HTTP/1.")] == '1');
+
+	/* bitcoind always tells us how long the body is */
+	clen = find_header(tmpctx, buf, hdrlen, "Content-Length");
+	if (!clen)
+		return -1;
+
+	*body = hdrend + 4;
+	*bodylen = strtoul(clen, &end, 10);
+	if (end == clen || *end)
+		return -1;
+	if (*body + *bodylen > buf + len)
+		return 0;
+	return status;
+}
+
+static char *json_unescape_tok(const tal_t *ctx,
+			       const char *buffer, const jsmntok_t *tok)
+{
+	struct json_escaped *esc = json_to_escaped_string(tmpctx, buffer, tok);
+	const char *s = esc ? json_escaped_unescape(ctx, esc) : NULL;
+
+	if (!s)
+		return tal_strndup(ctx, buffer + tok->start,
+				   tok->end - tok->start);
+	return cast_const(char *, s);
+}
+
+/* Turn bitcoind's reply into what bitcoin-cli would have given us. */
+static int rpc_response_output(const tal_t *ctx,
+			       int http_status,
+			       const char *body, size_t bodylen,
+			       char **output)
+{
+	const jsmntok_t *toks, *result, *error, *code, *message;
+	bool valid;
+	long errcode;
+
+	/* json_parse_input wants a tal object. */
+	body = tal_dup_arr(tmpctx, char, body, bodylen, 0);
+	toks = json_parse_input(body, bodylen, &valid);
+	if (!toks || toks[0].type != JSMN_OBJECT) {
+		if (http_status == 401)
+			*output = tal_fmt(ctx, "error: Authorization failed:"
+					  " Incorrect rpcuser or rpcpassword\n");
+		else
+			*output = tal_fmt(ctx, "error: server returned HTTP"
+					  " status %i: %.*s\n",
+					  http_status, (int)bodylen, body);
+		return RPC_EXIT_FAILURE;
+	}
+
+	error = json_get_member(body, toks, "error");
+	if (error && !json_tok_is_null(body, error)) {
+		code = json_get_member(body, error, "code");
+		message = json_get_member(body, error, "message");
+		if (!code || !message) {
+			*output = tal_fmt(ctx, "error: %.*s\n",
+					  json_tok_len(error),
+					  json_tok_contents(body, error));
+			return RPC_EXIT_FAILURE;
+		}
+		errcode = strtol(json_tok_contents(body, code), NULL, 10);
+		*output = tal_fmt(ctx, "error code: %li\nerror message:\n%s\n",
+				  errcode,
+				  json_unescape_tok(tmpctx, body, message));
+		/* bitcoin-cli exits with abs(code), which the shell sees
+		 * modulo 256. */
+		return labs(errcode) & 0xFF;
+	}
+
+	result = json_get_member(body, toks, "result");
+	if (!result || json_tok_is_null(body, result))
+		*output = tal_strdup(ctx, "");
+	else if (result->type == JSMN_STRING)
+		*output = tal_fmt(ctx, "%s\n",
+				  json_unescape_tok(tmpctx, body, result));
+	else
+		*output = tal_fmt(ctx, "%.*s\n",
+				  json_tok_len(result),
+				  json_tok_contents(body, result));
+	return 0;
+}
+
+static void rpc_request_done(struct bitcoind_rpc *rpc,
+			     struct rpc_request *req,
+			     int exitstatus, const char *output)
+{
+	tal_steal(tmpctx, req);
+	if (!rpc->freeing)
+		req->cb(exitstatus, output, strlen(output), req->cb_arg);
+}
+
+static struct io_plan *read_response(struct io_conn *conn,
+				     struct rpc_conn *rc);
+
+static struct io_plan *send_request(struct io_conn *conn, struct rpc_conn *rc)
+{
+	rc->used = rc->len_read = 0;
+	return io_write(conn, rc->req->http, strlen(rc->req->http),
+			read_response, rc);
+}
+
+static struct io_plan *read_response(struct io_conn *conn,
+				     struct rpc_conn *rc)
+{
+	const char *body;
+	size_t bodylen;
+	int status;
+	char *output;
+	struct rpc_request *req;
+
+	rc->used += rc->len_read;
+	rc->len_read = 0;
+	status = parse_http_response(rc->buf, rc->used, &body, &bodylen,
+				     &rc->keepalive);
+	if (status < 0) {
+		log_unusual(rc->rpc->log, "Bad response from bitcoind: %.*s",
+			    (int)rc->used, rc->buf);
+		return io_close(conn);
+	}
+
+	if (status == 0) {
+		if (rc->used == tal_count(rc->buf))
+			tal_resize(&rc->buf, rc->used * 2);
+		return io_read_partial(conn, rc->buf + rc->used,
+				       tal_count(rc->buf) - rc->used,
+				       &rc->len_read, read_response, rc);
+	}
+
+	req = rc->req;
+	rc->req = NULL;
+	status = rpc_response_output(tmpctx, status, body, bodylen, &output);
+	rpc_request_done(rc->rpc, req, status, output);
+
+	if (!rc->keepalive)
+		return io_close(conn);
+
+	list_add(&rc->rpc->idle, &rc->list);
+	rc->idle = true;
+	return io_wait(conn, rc, send_request, rc);
+}
+
+static void start_request(struct bitcoind_rpc *rpc, struct rpc_request *req);
+
+static void destroy_rpc_conn(struct rpc_conn *rc)
+{
+	if (rc->idle)
+		list_del(&rc->list);
+}
+
+static void rpc_conn_finished(struct io_conn *conn UNUSED,
+			      struct rpc_conn *rc)
+{
+	struct rpc_request *req = rc->req;
+
+	if (!req || rc->rpc->freeing)
+		return;
+
+	/* A connection which was idle may have been closed by the server
+	 * before it saw our request: try again with a new one. */
+	if (rc->used == 0 && !req->retried) {
+		req->retried = true;
+		tal_steal(rc->rpc, req);
+		start_request(rc->rpc, req);
+		return;
+	}
+
+	log_unusual(rc->rpc->log, "Lost connection to bitcoind: %s",
+		    strerror(errno));
+	rpc_request_done(rc->rpc, req, RPC_EXIT_FAILURE,
+			 "error: couldn't connect to server\n");
+}
+
+static struct io_plan *rpc_conn_init(struct io_conn *conn,
+				     struct rpc_conn *rc)
+{
+	io_set_finish(conn, rpc_conn_finished, rc);
+	return io_connect(conn, rc->rpc->addr, send_request, rc);
+}
+
+static void start_request(struct bitcoind_rpc *rpc, struct rpc_request *req)
+{
+	struct rpc_conn *rc;
+	int fd;
+
+	rc = list_pop(&rpc->idle, struct rpc_conn, list);
+	if (rc) {
+		rc->idle = false;
+		rc->req = tal_steal(rc, req);
+		io_wake(rc);
+		return;
+	}
+
+	fd = socket(rpc->addr->ai_family, SOCK_STREAM, 0);
+	if (fd < 0) {
+		log_broken(rpc->log, "Creating socket: %s", strerror(errno));
+		rpc_request_done(rpc, req, RPC_EXIT_FAILURE,
+				 "error: couldn't connect to server\n");
+		return;
+	}
+
+	log_debug(rpc->log, "New connection to bitcoind");
+	rc = tal(rpc, struct rpc_conn);
+	rc->rpc = rpc;
+	rc->idle = false;
+	rc->req = tal_steal(rc, req);
+	rc->buf = tal_arr(rc, char, 1024);
+	rc->used = 0;
+	tal_add_destructor(rc, destroy_rpc_conn);
+	/* Connection owns rc, so it's freed when we close. */
+	tal_steal(io_new_conn(rpc, fd, rpc_conn_init, rc), rc);
+}
+
+void bitcoind_rpc_call_(struct bitcoind_rpc *rpc, const char **args,
+			void (*cb)(int exitstatus,
+				   const char *output, size_t output_bytes,
+				   void *arg),
+			void *arg)
+{
+	struct rpc_request *req = tal(rpc, struct rpc_request);
+
+	req->http = rpc_request_http(req, rpc, args);
+	req->retried = false;
+	req->cb = cb;
+	req->cb_arg = arg;
+	start_request(rpc, req);
+}
+
+int bitcoind_rpc_call_sync(const tal_t *ctx, struct bitcoind_rpc *rpc,
+			   const char **args, char **output)
+{
+	char *http = rpc_request_http(tmpctx, rpc, args);
+	char *buf = tal_arr(tmpctx, char, 1024);
+	size_t used = 0;
+	const char *body;
+	size_t bodylen;
+	bool keepalive;
+	int fd, status;
+
+	fd = socket(rpc->addr->ai_family, SOCK_STREAM, 0);
+	if (fd < 0
+	    || connect(fd, rpc->addr->ai_addr, rpc->addr->ai_addrlen) != 0
+	    || !write_all(fd, http, strlen(http)))
+		goto fail;
+
+	while ((status = parse_http_response(buf, used, &body, &bodylen,
+					     &keepalive)) == 0) {
+		ssize_t r;
+
+		if (used == tal_count(buf))
+			tal_resize(&buf, used * 2);
+		r = read(fd, buf + used, tal_count(buf) - used);
+		if (r <= 0)
+			goto fail;
+		used += r;
+	}
+	close(fd);
+	if (status < 0) {
+		*output = tal_fmt(ctx, "error: bad response from server\n");
+		return RPC_EXIT_FAILURE;
+	}
+	return rpc_response_output(ctx, status, body, bodylen, output);
+
+fail:
+	if (fd >= 0)
+		close_noerr(fd);
+	*output = tal_fmt(ctx, "error: couldn't connect to server: %s\n",
+			  strerror(errno));
+	return RPC_EXIT_FAILURE;
+}
+
+/* We don't have ccan/base64 */
+static char *base64(const tal_t *ctx, const char *str)
+{
+	static const char enc[]
+		= "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+		  "0123456789+/";
+	size_t len = strlen(str);
+	char *out = tal_arr(ctx, char, (len + 2) / 3 * 4 + 1), *p = out;
+	const u8 *in = (const u8 *)str;
+
+	for (size_t i = 0; i < len; i += 3) {
+		u32 v = in[i] << 16;
+
+		if (i + 1 < len)
+			v |= in[i+1] << 8;
+		if (i + 2 < len)
+			v |= in[i+2];
+		*(p++) = enc[(v >> 18) & 0x3F];
+		*(p++) = enc[(v >> 12) & 0x3F];
+		*(p++) = i + 1 < len ? enc[(v >> 6) & 0x3F] : '=';
+		*(p++) = i + 2 < len ? enc[v & 0x3F] : '=';
+	}
+	*p = '\0';
+	return out;
+}
+
+static void destroy_bitcoind_rpc(struct bitcoind_rpc *rpc)
+{
+	rpc->freeing = true;
+	freeaddrinfo(rpc->addr);
+}
+
+struct bitcoind_rpc *new_bitcoind_rpc(const tal_t *ctx, struct log *log,
+				      const char *host, const char *port,
+				      const char *user, const char *pass)
+{
+	struct bitcoind_rpc *rpc = tal(ctx, struct bitcoind_rpc);
+	struct addrinfo hints;
+	int err;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	err = getaddrinfo(host, port, &hints, &rpc->addr);
+	if (err != 0) {
+		log_unusual(log, "Could not resolve %s:%s: %s",
+			    host, port, gai_strerror(err));
+		return tal_free(rpc);
+	}
+
+	rpc->log = log;
+	rpc->freeing = false;
+	rpc->next_id = 0;
+	list_head_init(&rpc->idle);
+	rpc->headers = tal_fmt(rpc,
+			       "Host: %s\r\n"
+			       "Authorization: Basic %s\r\n",
+			       host,
+			       base64(tmpctx, tal_fmt(tmpctx, "%s:%s",
+						      user, pass)));
+	tal_add_destructor(rpc, destroy_bitcoind_rpc);
+	return rpc;
+}
@@ -0,0 +1,42 @@
+#ifndef LIGHTNING_LIGHTNINGD_BITCOIND_RPC_H
+#define LIGHTNING_LIGHTNINGD_BITCOIND_RPC_H
+#include "config.h"
+#include <ccan/tal/tal.h>
+#include <ccan/typesafe_cb/typesafe_cb.h>
+#include <stdbool.h>
+
+struct log;
+
+/* A client for bitcoind's HTTP JSON-RPC interface, which keeps connections
+ * open between requests.  Results are presented exactly as bitcoin-cli would
+ * present them (output and exit status), so callers needn't care which they
+ * are talking to. */
+struct bitcoind_rpc;
+
+/* Returns NULL (and logs) if we can't resolve host:port. */
+struct bitcoind_rpc *new_bitcoind_rpc(const tal_t *ctx, struct log *log,
+				      const char *host, const char *port,
+				      const char *user, const char *pass);
+
+/* Make a request: args[0] is the method, the rest are parameters as you
+ * would give them to bitcoin-cli, and it's NULL terminated.  cb is called
+ * with bitcoin-cli's exit status and output. */
+void bitcoind_rpc_call_(struct bitcoind_rpc *rpc, const char **args,
+			void (*cb)(int exitstatus,
+				   const char *output, size_t output_bytes,
+				   void *arg),
+			void *arg);
+
+#define bitcoind_rpc_call(rpc, args, cb, arg)				\
+	bitcoind_rpc_call_((rpc), (args),				\
+			   typesafe_cb_preargs(void, void *,		\
+					       (cb), (arg),		\
+					       int, const char *, size_t), \
+			   (arg))
+
+/* Synchronous version for startup, on a connection of its own: returns the
+ * exit status, and the output in *output. */
+int bitcoind_rpc_call_sync(const tal_t *ctx, struct bitcoind_rpc *rpc,
+			   const char **args, char **output);
+
+#endif /* LIGHTNING_LIGHTNINGD_BITCOIND_RPC_H */
@@ -56,26 +56,48 @@ static bool we_broadcast(const struct chain_topology *topo,
 	return false;
 }
 
+/* Does this pay to any of our scripts? */
+static bool block_tx_owned(const struct txfilter *filter,
+			   const struct bitcoin_block_tx *btx)
+{
+	const u8 *cursor = btx->outputs;
+
+	for (size_t i = 0; i < btx->num_outputs; i++) {
+		const u8 *script;
+		size_t script_len;
+		u64 amount;
+
+		bitcoin_block_tx_output(&cursor, &amount, &script, &script_len);
+		if (txfilter_match_scriptpubkey(filter, script, script_len))
+			return true;
+	}
+	return false;
+}
+
 static void filter_block_txs(struct chain_topology *topo, struct block *b)
 {
 	size_t i;
 	u64 satoshi_owned;
 
-	/* Now we see if any of those txs are interesting. */
-	for (i = 0; i < tal_count(b->full_txs); i++) {
-		const struct bitcoin_tx *tx = b->full_txs[i];
-		struct bitcoin_txid txid;
+	/* Now we see if any of those txs are interesting: we only unpack
+	 * the ones which are. */
+	for (i = 0; i < tal_count(b->full_block->tx); i++) {
+		const struct bitcoin_block_tx *btx = &b->full_block->tx[i];
+		struct bitcoin_tx *tx = NULL;
+		const u8 *cursor;
 		size_t j;
 
 		/* Tell them if it spends a txo we care about. */
-		for (j = 0; j < tal_count(tx->input); j++) {
+		cursor = btx->inputs;
+		for (j = 0; j < btx->num_inputs; j++) {
 			struct txwatch_output out;
 			struct txowatch *txo;
-			out.txid = tx->input[j].txid;
-			out.index = tx->input[j].index;
 
+			bitcoin_block_tx_input(&cursor, &out.txid, &out.index);
 			txo = txowatch_hash_get(&topo->txowatches, &out);
 			if (txo) {
+				if (!tx)
+					tx = bitcoin_block_tx_get(tmpctx, btx);
 				wallet_transaction_add(topo->ld->wallet,
 						       tx, b->height, i);
 				txowatch_fire(txo, tx, j, b);
@@ -83,21 +105,25 @@ static void filter_block_txs(struct chain_topology *topo, struct block *b)
 		}
 
 		satoshi_owned = 0;
-		if (txfilter_match(topo->bitcoind->ld->owned_txfilter, tx)) {
+		if (block_tx_owned(topo->bitcoind->ld->owned_txfilter, btx)) {
+			if (!tx)
+				tx = bitcoin_block_tx_get(tmpctx, btx);
 			wallet_extract_owned_outputs(topo->bitcoind->ld->wallet,
 						     tx, &b->height,
 						     &satoshi_owned);
 		}
 
 		/* We did spends first, in case that tells us to watch tx. */
-		bitcoin_txid(tx, &txid);
-		if (watching_txid(topo, &txid) || we_broadcast(topo, &txid) ||
-		    satoshi_owned != 0) {
+		if (watching_txid(topo, &btx->txid)
+		    || we_broadcast(topo, &btx->txid) || satoshi_owned != 0) {
+			if (!tx)
+				tx = bitcoin_block_tx_get(tmpctx, btx);
 			wallet_transaction_add(topo->ld->wallet,
 					       tx, b->height, i);
 		}
+		tal_free(tx);
 	}
-	b->full_txs = tal_free(b->full_txs);
+	b->full_block = tal_free(b->full_block);
 }
 
 size_t get_tx_depth(const struct chain_topology *topo,
@@ -565,13 +591,16 @@ static void updates_complete(struct chain_topology *topo)
 static void topo_update_spends(struct chain_topology *topo, struct block *b)
 {
 	const struct short_channel_id *scid;
-	for (size_t i = 0; i < tal_count(b->full_txs); i++) {
-		const struct bitcoin_tx *tx = b->full_txs[i];
-		for (size_t j = 0; j < tal_count(tx->input); j++) {
-			const struct bitcoin_tx_input *input = &tx->input[j];
+	for (size_t i = 0; i < tal_count(b->full_block->tx); i++) {
+		const struct bitcoin_block_tx *btx = &b->full_block->tx[i];
+		const u8 *cursor = btx->inputs;
+		for (size_t j = 0; j < btx->num_inputs; j++) {
+			struct bitcoin_txid txid;
+			u32 outnum;
+
+			bitcoin_block_tx_input(&cursor, &txid, &outnum);
 			scid = wallet_outpoint_spend(topo->ld->wallet, tmpctx,
-						     b->height, &input->txid,
-						     input->index);
+						     b->height, &txid, outnum);
 			if (scid) {
 				gossipd_notify_spend(topo->bitcoind->ld, scid);
 				tal_free(scid);
@@ -582,15 +611,28 @@ static void topo_update_spends(struct chain_topology *topo, struct block *b)
 
 static void topo_add_utxos(struct chain_topology *topo, struct block *b)
 {
-	for (size_t i = 0; i < tal_count(b->full_txs); i++) {
-		const struct bitcoin_tx *tx = b->full_txs[i];
-		for (size_t j = 0; j < tal_count(tx->output); j++) {
-			const struct bitcoin_tx_output *output = &tx->output[j];
-			if (is_p2wsh(output->script, NULL)) {
-				wallet_utxoset_add(topo->ld->wallet, tx, j,
-						   b->height, i, output->script,
-						   output->amount);
-			}
+	for (size_t i = 0; i < tal_count(b->full_block->tx); i++) {
+		const struct bitcoin_block_tx *btx = &b->full_block->tx[i];
+		const u8 *cursor = btx->outputs;
+		for (size_t j = 0; j < btx->num_outputs; j++) {
+			const u8 *script;
+			u8 *p2wsh;
+			size_t script_len;
+			u64 amount;
+
+			bitcoin_block_tx_output(&cursor, &amount,
+						&script, &script_len);
+			if (script_len != BITCOIN_SCRIPTPUBKEY_P2WSH_LEN)
+				continue;
+
+			/* is_p2wsh() and the db want a tal object. */
+			p2wsh = tal_dup_arr(tmpctx, u8, script, script_len, 0);
+			if (is_p2wsh(p2wsh, NULL))
+				wallet_utxoset_add(topo->ld->wallet,
+						   &btx->txid, j,
+						   b->height, i, p2wsh,
+						   amount);
+			tal_free(p2wsh);
 		}
 	}
 }
@@ -633,7 +675,7 @@ static struct block *new_block(struct chain_topology *topo,
 	b->hdr = blk->hdr;
 
 	b->txnums = tal_arr(b, u32, 0);
-	b->full_txs = tal_steal(b, blk->tx);
+	b->full_block = tal_steal(b, blk);
 
 	return b;
 }
@@ -58,8 +58,8 @@ struct block {
 	/* And their associated index in the block */
 	u32 *txnums;
 
-	/* Full copy of txs (trimmed to txs list in connect_block) */
-	struct bitcoin_tx **full_txs;
+	/* Full block (freed once we've filtered it in add_tip) */
+	struct bitcoin_block *full_block;
 };
 
 /* Hash blocks by sha */
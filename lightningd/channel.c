@@ -97,6 +97,9 @@ static void destroy_channel(struct channel *channel)
 	/* Free any old owner still hanging around. */
 	channel_set_owner(channel, NULL, false);
 
+	if (channel->scid)
+		uintmap_del(&channel->peer->ld->channels_by_scid,
+			    channel->scid->u64);
 	list_del_from(&channel->peer->channels, &channel->list);
 }
 
@@ -236,6 +239,9 @@ struct channel *new_channel(struct peer *peer, u64 dbid,
 		= tal_steal(channel, future_per_commitment_point);
 
 	list_add_tail(&peer->channels, &channel->list);
+	if (channel->scid)
+		uintmap_add(&peer->ld->channels_by_scid, channel->scid->u64,
+			    channel);
 	tal_add_destructor(channel, destroy_channel);
 
 	/* Make sure we see any spends using this key */
@@ -310,6 +316,20 @@ struct channel *channel_by_dbid(struct lightningd *ld, const u64 dbid)
 	return NULL;
 }
 
+void channel_set_scid(struct channel *channel,
+		      const struct short_channel_id *scid)
+{
+	assert(!channel->scid);
+	channel->scid = tal_dup(channel, struct short_channel_id, scid);
+	uintmap_add(&channel->peer->ld->channels_by_scid, scid->u64, channel);
+}
+
+struct channel *channel_by_scid(struct lightningd *ld,
+				const struct short_channel_id *scid)
+{
+	return uintmap_get(&ld->channels_by_scid, scid->u64);
+}
+
 void channel_set_last_tx(struct channel *channel,
 			 struct bitcoin_tx *tx,
 			 const secp256k1_ecdsa_signature *sig)
@@ -188,6 +188,14 @@ struct channel *active_channel_by_id(struct lightningd *ld,
 
 struct channel *channel_by_dbid(struct lightningd *ld, const u64 dbid);
 
+/* Once funding is deep enough, we know its short_channel_id. */
+void channel_set_scid(struct channel *channel,
+		      const struct short_channel_id *scid);
+
+/* One of our channels, by short_channel_id (NULL if not ours). */
+struct channel *channel_by_scid(struct lightningd *ld,
+				const struct short_channel_id *scid);
+
 void channel_set_last_tx(struct channel *channel,
 			 struct bitcoin_tx *tx,
 			 const secp256k1_ecdsa_signature *sig);
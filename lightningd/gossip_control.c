@@ -11,7 +11,6 @@
 #include <ccan/take/take.h>
 #include <ccan/tal/str/str.h>
 #include <common/features.h>
-#include <common/type_to_string.h>
 #include <common/utils.h>
 #include <errno.h>
 #include <gossipd/gen_gossip_wire.h>
@@ -109,6 +108,7 @@ static unsigned gossip_msg(struct subd *gossip, const u8 *msg, const int *fds)
 	case WIRE_GOSSIP_GET_CHANNEL_PEER:
 	case WIRE_GOSSIP_GET_UPDATE:
 	case WIRE_GOSSIP_SEND_GOSSIP:
+	case WIRE_GOSSIP_SEND_GOSSIP_BATCH:
 	case WIRE_GOSSIP_GET_TXOUT_REPLY:
 	case WIRE_GOSSIP_OUTPOINT_SPENT:
 	case WIRE_GOSSIP_ROUTING_FAILURE:
@@ -119,6 +119,7 @@ static unsigned gossip_msg(struct subd *gossip, const u8 *msg, const int *fds)
 	case WIRE_GOSSIP_GET_INCOMING_CHANNELS:
 	case WIRE_GOSSIP_DEV_SET_MAX_SCIDS_ENCODE_SIZE:
 	case WIRE_GOSSIP_DEV_SUPPRESS:
+	case WIRE_GOSSIP_DEV_GOSSIP_QUEUES:
 	/* This is a reply, so never gets through to here. */
 	case WIRE_GOSSIP_GET_UPDATE_REPLY:
 	case WIRE_GOSSIP_GETNODES_REPLY:
@@ -128,6 +129,7 @@ static unsigned gossip_msg(struct subd *gossip, const u8 *msg, const int *fds)
 	case WIRE_GOSSIP_QUERY_CHANNEL_RANGE_REPLY:
 	case WIRE_GOSSIP_GET_CHANNEL_PEER_REPLY:
 	case WIRE_GOSSIP_GET_INCOMING_CHANNELS_REPLY:
+	case WIRE_GOSSIP_DEV_GOSSIP_QUEUES_REPLY:
 	/* These are inter-daemon messages, not received by us */
 	case WIRE_GOSSIP_LOCAL_ADD_CHANNEL:
 	case WIRE_GOSSIP_LOCAL_CHANNEL_UPDATE:
@@ -202,8 +204,10 @@ static void json_getnodes_reply(struct subd *gossip UNUSED, const u8 *reply,
 	struct gossip_getnodes_entry **nodes;
 	struct json_stream *response;
 	size_t i, j;
+	u64 broadcast_index;
 
-	if (!fromwire_gossip_getnodes_reply(reply, reply, &nodes)) {
+	if (!fromwire_gossip_getnodes_reply(reply, reply, &broadcast_index,
+					    &nodes)) {
 		command_fail(cmd, LIGHTNINGD, "Malformed gossip_getnodes response");
 		return;
 	}
@@ -243,6 +247,7 @@ static void json_getnodes_reply(struct subd *gossip UNUSED, const u8 *reply,
 		json_object_end(response);
 	}
 	json_array_end(response);
+	json_add_u64(response, "broadcast_index", broadcast_index);
 	json_object_end(response);
 	command_success(cmd, response);
 }
@@ -252,13 +257,17 @@ static void json_listnodes(struct command *cmd, const char *buffer,
 {
 	u8 *req;
 	struct pubkey *id;
+	unsigned int *since;
+	u64 *changed_since;
 
 	if (!param(cmd, buffer, params,
 		   p_opt("id", json_tok_pubkey, &id),
+		   p_opt_def("since", json_tok_number, &since, 0),
+		   p_opt_def("changed_since", json_tok_u64, &changed_since, 0),
 		   NULL))
 		return;
 
-	req = towire_gossip_getnodes_request(cmd, id);
+	req = towire_gossip_getnodes_request(cmd, id, *since, *changed_since);
 	subd_req(cmd, cmd->ld->gossip, req, -1, 0, json_getnodes_reply, cmd);
 	command_still_pending(cmd);
 }
@@ -266,7 +275,9 @@ static void json_listnodes(struct command *cmd, const char *buffer,
 static const struct json_command listnodes_command = {
 	"listnodes",
 	json_listnodes,
-	"Show node {id} (or all, if no {id}), in our local network view"
+	"Show node {id} (or all, if no {id}), in our local network view. "
+	"Only nodes announced {since} a timestamp, or {changed_since} a previous "
+	"call's broadcast_index, if specified."
 };
 AUTODATA(json_command, &listnodes_command);
 
@@ -349,30 +360,92 @@ static const struct json_command getroute_command = {
 };
 AUTODATA(json_command, &getroute_command);
 
+struct channels_stream {
+	struct command *cmd;
+	struct json_stream *response;
+	/* Just one channel? */
+	struct short_channel_id *scid;
+	/* Last one gossipd looked at, if there are more. */
+	struct short_channel_id *prev;
+	/* Filters */
+	struct pubkey *source;
+	unsigned int *since;
+	u64 *changed_since;
+	bool *active_only;
+	/* Maximum number of channels (or NULL), and how many so far. */
+	unsigned int *limit;
+	size_t count;
+	/* From gossipd's first reply. */
+	u64 broadcast_index;
+};
+
+static void json_listchannels_reply(struct subd *gossip, const u8 *reply,
+				    const int *fds, struct channels_stream *cs);
+
+static void json_listchannels_next(struct command *cmd,
+				   struct channels_stream *cs)
+{
+	u8 *req;
+	u32 max = JSONRPC_STREAM_BATCH;
+
+	if (cs->limit && *cs->limit - cs->count < max)
+		max = *cs->limit - cs->count;
+
+	req = towire_gossip_getchannels_request(cmd, cs->scid, cs->prev, max,
+						cs->source, *cs->since,
+						*cs->changed_since,
+						*cs->active_only);
+	subd_req(cmd->ld->gossip, cmd->ld->gossip,
+		 req, -1, 0, json_listchannels_reply, cs);
+}
+
 /* Called upon receiving a getchannels_reply from `gossipd` */
 static void json_listchannels_reply(struct subd *gossip UNUSED, const u8 *reply,
-				   const int *fds UNUSED, struct command *cmd)
+				    const int *fds UNUSED,
+				    struct channels_stream *cs)
 {
 	size_t i;
 	struct gossip_getchannels_entry *entries;
+	struct command *cmd = cs->cmd;
 	struct json_stream *response;
-
-	if (!fromwire_gossip_getchannels_reply(reply, reply, &entries)) {
+	u64 broadcast_index;
+
+	tal_free(cs->prev);
+	if (!fromwire_gossip_getchannels_reply(reply, reply, &entries,
+					       &cs->prev, &broadcast_index)) {
+		/* Too late for an error if we've started streaming. */
+		if (cs->response)
+			fatal("Invalid getchannels_reply from gossipd: %s",
+			      tal_hex(tmpctx, reply));
 		command_fail(cmd, LIGHTNINGD, "Invalid reply from gossipd");
 		return;
 	}
+	tal_steal(cs, cs->prev);
+
+	/* First reply? */
+	if (!cs->response) {
+		/* Anything changed after this might be missed, so it's what
+		 * they should use for changed_since next time. */
+		cs->broadcast_index = broadcast_index;
+		cs->response = json_stream_success(cmd);
+		json_object_start(cs->response, NULL);
+		json_array_start(cs->response, "channels");
+	}
+	response = cs->response;
 
-	response = json_stream_success(cmd);
-	json_object_start(response, NULL);
-	json_array_start(response, "channels");
 	for (i = 0; i < tal_count(entries); i++) {
+		/* Both halves of a channel are next to each other. */
+		if (i == 0
+		    || !short_channel_id_eq(&entries[i].short_channel_id,
+					    &entries[i-1].short_channel_id))
+			cs->count++;
+
 		json_object_start(response, NULL);
 		json_add_raw_pubkey(response, "source", entries[i].source);
 		json_add_raw_pubkey(response, "destination",
 				    entries[i].destination);
-		json_add_string(response, "short_channel_id",
-				type_to_string(reply, struct short_channel_id,
-					       &entries[i].short_channel_id));
+		json_add_short_channel_id(response, "short_channel_id",
+					  &entries[i].short_channel_id);
 		json_add_bool(response, "public", entries[i].public);
 		json_add_u64(response, "satoshis", entries[i].satoshis);
 		json_add_num(response, "message_flags", entries[i].message_flags);
@@ -392,7 +465,21 @@ static void json_listchannels_reply(struct subd *gossip UNUSED, const u8 *reply,
 		json_add_num(response, "delay", entries[i].delay);
 		json_object_end(response);
 	}
+
+	if (cs->prev && (!cs->limit || cs->count < *cs->limit)) {
+		/* Let the client catch up before asking for more. */
+		if (command_output_full(cmd))
+			command_wait_output(cmd, json_listchannels_next, cs);
+		else
+			json_listchannels_next(cmd, cs);
+		return;
+	}
+
 	json_array_end(response);
+	/* Hit the limit?  Tell them where to continue from. */
+	if (cs->prev)
+		json_add_short_channel_id(response, "after", cs->prev);
+	json_add_u64(response, "broadcast_index", cs->broadcast_index);
 	json_object_end(response);
 	command_success(cmd, response);
 }
@@ -400,23 +487,43 @@ static void json_listchannels_reply(struct subd *gossip UNUSED, const u8 *reply,
 static void json_listchannels(struct command *cmd, const char *buffer,
 			     const jsmntok_t *params)
 {
-	u8 *req;
-	struct short_channel_id *id;
+	struct channels_stream *cs = tal(cmd, struct channels_stream);
+
 	if (!param(cmd, buffer, params,
-		   p_opt("short_channel_id", json_tok_short_channel_id, &id),
+		   p_opt("short_channel_id", json_tok_short_channel_id,
+			 &cs->scid),
+		   p_opt("source", json_tok_pubkey, &cs->source),
+		   p_opt_def("since", json_tok_number, &cs->since, 0),
+		   p_opt_def("active_only", json_tok_bool, &cs->active_only,
+			     false),
+		   p_opt_def("changed_since", json_tok_u64,
+			     &cs->changed_since, 0),
+		   p_opt("after", json_tok_short_channel_id, &cs->prev),
+		   p_opt("limit", json_tok_number, &cs->limit),
 		   NULL))
 		return;
 
-	req = towire_gossip_getchannels_request(cmd, id);
-	subd_req(cmd->ld->gossip, cmd->ld->gossip,
-		 req, -1, 0, json_listchannels_reply, cmd);
+	if (cs->limit && *cs->limit == 0) {
+		command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+			     "limit must be greater than 0");
+		return;
+	}
+
+	cs->cmd = cmd;
+	cs->response = NULL;
+	cs->count = 0;
+	json_listchannels_next(cmd, cs);
 	command_still_pending(cmd);
 }
 
 static const struct json_command listchannels_command = {
 	"listchannels",
 	json_listchannels,
-	"Show channel {short_channel_id} (or all known channels, if no {short_channel_id})"
+	"Show channel {short_channel_id} (or all known channels, if no {short_channel_id}). "
+	"Only those from node {source}, updated {since} a timestamp, "
+	"{active_only}, or {changed_since} a previous call's broadcast_index, "
+	"if specified.  Show at most {limit} channels {after} a short_channel_id: "
+	"if there are more, 'after' says where to continue."
 };
 AUTODATA(json_command, &listchannels_command);
 
@@ -629,4 +736,58 @@ static const struct json_command dev_suppress_gossip = {
 	"Stop this node from sending any more gossip."
 };
 AUTODATA(json_command, &dev_suppress_gossip);
+
+static void json_gossip_queues_reply(struct subd *gossip UNUSED,
+				     const u8 *reply,
+				     const int *fds UNUSED,
+				     struct command *cmd)
+{
+	struct json_stream *response;
+	struct pubkey *ids;
+	u64 *behind, *queued, *sent, *batches;
+
+	if (!fromwire_gossip_dev_gossip_queues_reply(tmpctx, reply, &ids,
+						     &behind, &queued,
+						     &sent, &batches)) {
+		command_fail(cmd, LIGHTNINGD,
+			     "Gossip gave bad gossip_dev_gossip_queues_reply");
+		return;
+	}
+
+	response = json_stream_success(cmd);
+	json_object_start(response, NULL);
+	json_array_start(response, "peers");
+	for (size_t i = 0; i < tal_count(ids); i++) {
+		json_object_start(response, NULL);
+		json_add_pubkey(response, "id", &ids[i]);
+		json_add_u64(response, "behind", behind[i]);
+		json_add_u64(response, "queued", queued[i]);
+		json_add_u64(response, "sent", sent[i]);
+		json_add_u64(response, "batches", batches[i]);
+		json_object_end(response);
+	}
+	json_array_end(response);
+	json_object_end(response);
+	command_success(cmd, response);
+}
+
+static void json_dev_gossip_queues(struct command *cmd,
+				   const char *buffer,
+				   const jsmntok_t *params)
+{
+	if (!param(cmd, buffer, params, NULL))
+		return;
+
+	subd_req(cmd->ld->gossip, cmd->ld->gossip,
+		 take(towire_gossip_dev_gossip_queues(NULL)), -1, 0,
+		 json_gossip_queues_reply, cmd);
+	command_still_pending(cmd);
+}
+
+static const struct json_command dev_gossip_queues = {
+	"dev-gossip-queues",
+	json_dev_gossip_queues,
+	"Show how far behind gossip to each peer is, and how it's being sent"
+};
+AUTODATA(json_command, &dev_gossip_queues);
 #endif /* DEVELOPER */
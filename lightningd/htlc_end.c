@@ -31,6 +31,7 @@ struct htlc_in *find_htlc_in(const struct htlc_in_map *map,
 static void destroy_htlc_in(struct htlc_in *hend, struct htlc_in_map *map)
 {
 	htlc_in_map_del(map, hend);
+	list_del_init(&hend->deadline_list);
 }
 
 void connect_htlc_in(struct htlc_in_map *map, struct htlc_in *hend)
@@ -50,6 +51,7 @@ struct htlc_out *find_htlc_out(const struct htlc_out_map *map,
 static void destroy_htlc_out(struct htlc_out *hend, struct htlc_out_map *map)
 {
 	htlc_out_map_del(map, hend);
+	list_del_init(&hend->deadline_list);
 }
 
 void connect_htlc_out(struct htlc_out_map *map, struct htlc_out *hend)
@@ -58,6 +60,58 @@ void connect_htlc_out(struct htlc_out_map *map, struct htlc_out *hend)
 	htlc_out_map_add(map, hend);
 }
 
+static void destroy_htlc_deadlines(struct htlc_deadlines *deadlines)
+{
+	struct list_node *n;
+
+	/* HTLCs may outlive us on shutdown: don't leave them in our lists. */
+	while ((n = htlc_deadlines_pop(deadlines, UINT32_MAX)) != NULL);
+	uintmap_clear(&deadlines->heights);
+}
+
+struct htlc_deadlines *new_htlc_deadlines(const tal_t *ctx)
+{
+	struct htlc_deadlines *deadlines = tal(ctx, struct htlc_deadlines);
+
+	uintmap_init(&deadlines->heights);
+	tal_add_destructor(deadlines, destroy_htlc_deadlines);
+	return deadlines;
+}
+
+void htlc_deadlines_add(struct htlc_deadlines *deadlines, u32 height,
+			struct list_node *deadline_list)
+{
+	struct list_head *h = uintmap_get(&deadlines->heights, height);
+
+	if (!h) {
+		/* Only pointed to by the uintmap */
+		h = notleak(tal(deadlines, struct list_head));
+		list_head_init(h);
+		uintmap_add(&deadlines->heights, height, h);
+	}
+	list_add_tail(h, deadline_list);
+}
+
+struct list_node *htlc_deadlines_pop(struct htlc_deadlines *deadlines,
+				     u32 height)
+{
+	struct list_head *h;
+	u64 idx;
+
+	/* HTLCs freed since leave empty lists behind: clean up as we go. */
+	while ((h = uintmap_first(&deadlines->heights, &idx)) != NULL
+	       && idx <= height) {
+		if (!list_empty(h)) {
+			struct list_node *n = h->n.next;
+			list_del_init(n);
+			return n;
+		}
+		uintmap_del(&deadlines->heights, idx);
+		tal_free(h);
+	}
+	return NULL;
+}
+
 static void *PRINTF_FMT(2,3)
 	corrupt(const char *abortstr, const char *fmt, ...)
 {
@@ -130,6 +184,7 @@ struct htlc_in *new_htlc_in(const tal_t *ctx,
 	hin->failcode = 0;
 	hin->failuremsg = NULL;
 	hin->preimage = NULL;
+	list_node_init(&hin->deadline_list);
 
 	return htlc_in_check(hin, "new_htlc_in");
 }
@@ -263,6 +318,7 @@ struct htlc_out *new_htlc_out(const tal_t *ctx,
 
 	hout->am_origin = am_origin;
 	hout->in = NULL;
+	list_node_init(&hout->deadline_list);
 	if (in)
 		htlc_out_connect_htlc_in(hout, in);
 
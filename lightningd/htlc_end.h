@@ -2,6 +2,8 @@
 #define LIGHTNING_LIGHTNINGD_HTLC_END_H
 #include "config.h"
 #include <ccan/htable/htable_type.h>
+#include <ccan/intmap/intmap.h>
+#include <ccan/list/list.h>
 #include <ccan/short_types/short_types.h>
 #include <common/htlc_state.h>
 #include <common/sphinx.h>
@@ -46,6 +48,8 @@ struct htlc_in {
 	/* If they fulfilled, here's the preimage. */
 	struct preimage *preimage;
 
+	/* Once fulfilled, in ld->htlc_in_deadlines. */
+	struct list_node deadline_list;
 };
 
 struct htlc_out {
@@ -79,6 +83,9 @@ struct htlc_out {
 
 	/* Where it's from, if not going to us. */
 	struct htlc_in *in;
+
+	/* In ld->htlc_out_deadlines. */
+	struct list_node deadline_list;
 };
 
 static inline const struct htlc_key *keyof_htlc_in(const struct htlc_in *in)
@@ -139,6 +146,23 @@ struct htlc_out *new_htlc_out(const tal_t *ctx,
 void connect_htlc_in(struct htlc_in_map *map, struct htlc_in *hin);
 void connect_htlc_out(struct htlc_out_map *map, struct htlc_out *hout);
 
+/* HTLCs we have to check on at a certain block height, by height: so
+ * each block we only look at those whose time has come. */
+struct htlc_deadlines {
+	UINTMAP(struct list_head *) heights;
+};
+
+struct htlc_deadlines *new_htlc_deadlines(const tal_t *ctx);
+
+/* Add an HTLC's deadline_list; it's removed when it's freed (it must be
+ * connected with connect_htlc_in/connect_htlc_out). */
+void htlc_deadlines_add(struct htlc_deadlines *deadlines, u32 height,
+			struct list_node *deadline_list);
+
+/* Remove and return one with deadline <= height, or NULL. */
+struct list_node *htlc_deadlines_pop(struct htlc_deadlines *deadlines,
+				     u32 height);
+
 /* Set up hout->in to be hin (non-NULL), and clear if hin freed. */
 void htlc_out_connect_htlc_in(struct htlc_out *hout, struct htlc_in *hin);
 
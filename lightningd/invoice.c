@@ -390,28 +390,33 @@ static const struct json_command invoice_command = {
 			     "(default autogenerated)"};
 AUTODATA(json_command, &invoice_command);
 
-static void json_add_invoices(struct json_stream *response,
-			      struct wallet *wallet,
-			      const struct json_escaped *label)
-{
+struct invoice_stream {
+	struct json_stream *response;
 	struct invoice_iterator it;
-	const struct invoice_details *details;
+};
 
-	/* Don't iterate entire db if we're just after one. */
-	if (label) {
-		struct invoice invoice;
-		if (wallet_invoice_find_by_label(wallet, &invoice, label)) {
-			details = wallet_invoice_details(response, wallet, invoice);
-			json_add_invoice(response, details);
+/* There can be millions, so we stream them as the client reads. */
+static void json_add_invoices(struct command *cmd, struct invoice_stream *is)
+{
+	struct wallet *wallet = cmd->ld->wallet;
+
+	while (wallet_invoice_iterate(wallet, &is->it)) {
+		const struct invoice_details *details;
+
+		details = wallet_invoice_iterator_deref(NULL, wallet, &is->it);
+		json_add_invoice(is->response, details);
+		tal_free(details);
+
+		if (command_output_full(cmd)) {
+			wallet_invoice_iterator_pause(wallet, &is->it);
+			command_wait_output(cmd, json_add_invoices, is);
+			return;
 		}
-		return;
 	}
 
-	memset(&it, 0, sizeof(it));
-	while (wallet_invoice_iterate(wallet, &it)) {
-		details = wallet_invoice_iterator_deref(response, wallet, &it);
-		json_add_invoice(response, details);
-	}
+	json_array_end(is->response);
+	json_object_end(is->response);
+	command_success(cmd, is->response);
 }
 
 static void json_listinvoices(struct command *cmd,
@@ -419,6 +424,7 @@ static void json_listinvoices(struct command *cmd,
 {
 	struct json_escaped *label;
 	struct json_stream *response;
+	struct invoice_stream *is;
 	struct wallet *wallet = cmd->ld->wallet;
 	if (!param(cmd, buffer, params,
 		   p_opt("label", json_tok_label, &label),
@@ -427,10 +433,26 @@ static void json_listinvoices(struct command *cmd,
 	response = json_stream_success(cmd);
 	json_object_start(response, NULL);
 	json_array_start(response, "invoices");
-	json_add_invoices(response, wallet, label);
-	json_array_end(response);
-	json_object_end(response);
-	command_success(cmd, response);
+
+	/* Don't iterate entire db if we're just after one. */
+	if (label) {
+		struct invoice invoice;
+		if (wallet_invoice_find_by_label(wallet, &invoice, label)) {
+			const struct invoice_details *details;
+			details = wallet_invoice_details(response, wallet,
+							 invoice);
+			json_add_invoice(response, details);
+		}
+		json_array_end(response);
+		json_object_end(response);
+		command_success(cmd, response);
+		return;
+	}
+
+	is = tal(cmd, struct invoice_stream);
+	is->response = response;
+	memset(&is->it, 0, sizeof(is->it));
+	json_add_invoices(cmd, is);
 }
 
 static const struct json_command listinvoices_command = {
@@ -5,7 +5,6 @@
 #include <ccan/tal/str/str.h>
 #include <common/json.h>
 #include <common/memleak.h>
-#include <common/type_to_string.h>
 #include <common/wireaddr.h>
 #include <gossipd/routing.h>
 #include <lightningd/json_escaped.h>
@@ -284,14 +283,6 @@ bool json_tok_pubkey(struct command *cmd, const char *name,
 	return false;
 }
 
-void json_add_short_channel_id(struct json_stream *response,
-			       const char *fieldname,
-			       const struct short_channel_id *id)
-{
-	json_add_string(response, fieldname,
-			type_to_string(response, struct short_channel_id, id));
-}
-
 bool json_to_short_channel_id(const char *buffer, const jsmntok_t *tok,
 			      struct short_channel_id *scid)
 {
@@ -487,6 +478,9 @@ struct json_stream {
 	/* True if we haven't yet put an element in current wrapping */
 	bool empty;
 
+	/* No newlines or indentation. */
+	bool compact;
+
 	/* The command we're attached to */
 	struct command *cmd;
 };
@@ -502,6 +496,45 @@ static void result_append(struct json_stream *res, const char *str)
 	jcon_append(jcon, str);
 }
 
+/* Returns NULL if they're disconnected, otherwise len bytes to fill. */
+static char *result_append_space(struct json_stream *res, size_t len)
+{
+	struct json_connection *jcon = res->cmd->jcon;
+
+	if (!jcon)
+		return NULL;
+
+	return jcon_append_space(jcon, len);
+}
+
+static void result_append_len(struct json_stream *res,
+			      const char *str, size_t len)
+{
+	char *dest = result_append_space(res, len);
+
+	if (dest)
+		memcpy(dest, str, len);
+}
+
+/* Writes value's digits so they end at end: returns where they start. */
+static char *u64_digits(char *end, u64 value)
+{
+	do {
+		*--end = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	return end;
+}
+
+/* These are common enough that we don't want to go through printf. */
+static void result_append_u64(struct json_stream *res, u64 value)
+{
+	char buf[sizeof("18446744073709551615") - 1];
+	char *start = u64_digits(buf + sizeof(buf), value);
+
+	result_append_len(res, start, buf + sizeof(buf) - start);
+}
+
 static void PRINTF_FMT(2,3)
 result_append_fmt(struct json_stream *res, const char *fmt, ...)
 {
@@ -551,16 +584,24 @@ static void result_append_indent(struct json_stream *result)
 static void json_start_member(struct json_stream *result, const char *fieldname)
 {
 	/* Prepend comma if required. */
-	if (!result->empty)
-		result_append(result, ", \n");
-	else
-		result_append(result, "\n");
+	if (result->compact) {
+		if (!result->empty)
+			result_append(result, ",");
+	} else {
+		if (!result->empty)
+			result_append(result, ", \n");
+		else
+			result_append(result, "\n");
 
-	result_append_indent(result);
+		result_append_indent(result);
+	}
 
 	check_fieldname(result, fieldname);
-	if (fieldname)
-		result_append_fmt(result, "\"%s\": ", fieldname);
+	if (fieldname) {
+		result_append(result, "\"");
+		result_append(result, fieldname);
+		result_append(result, result->compact ? "\":" : "\": ");
+	}
 	result->empty = false;
 }
 
@@ -594,9 +635,11 @@ void json_array_start(struct json_stream *result, const char *fieldname)
 
 void json_array_end(struct json_stream *result)
 {
-	result_append(result, "\n");
+	if (!result->compact)
+		result_append(result, "\n");
 	result_unindent(result, JSMN_ARRAY);
-	result_append_indent(result);
+	if (!result->compact)
+		result_append_indent(result);
 	result_append(result, "]");
 }
 
@@ -609,16 +652,18 @@ void json_object_start(struct json_stream *result, const char *fieldname)
 
 void json_object_end(struct json_stream *result)
 {
-	result_append(result, "\n");
+	if (!result->compact)
+		result_append(result, "\n");
 	result_unindent(result, JSMN_OBJECT);
-	result_append_indent(result);
+	if (!result->compact)
+		result_append_indent(result);
 	result_append(result, "}");
 }
 
 void json_add_num(struct json_stream *result, const char *fieldname, unsigned int value)
 {
 	json_start_member(result, fieldname);
-	result_append_fmt(result, "%u", value);
+	result_append_u64(result, value);
 }
 
 void json_add_double(struct json_stream *result, const char *fieldname, double value)
@@ -631,14 +676,14 @@ void json_add_u64(struct json_stream *result, const char *fieldname,
 		  uint64_t value)
 {
 	json_start_member(result, fieldname);
-	result_append_fmt(result, "%"PRIu64, value);
+	result_append_u64(result, value);
 }
 
 void json_add_literal(struct json_stream *result, const char *fieldname,
 		      const char *literal, int len)
 {
 	json_start_member(result, fieldname);
-	result_append_fmt(result, "%.*s", len, literal);
+	result_append_len(result, literal, len);
 }
 
 void json_add_string(struct json_stream *result, const char *fieldname, const char *value)
@@ -646,7 +691,9 @@ void json_add_string(struct json_stream *result, const char *fieldname, const ch
 	struct json_escaped *esc = json_partial_escape(NULL, value);
 
 	json_start_member(result, fieldname);
-	result_append_fmt(result, "\"%s\"", esc->s);
+	result_append(result, "\"");
+	result_append(result, esc->s);
+	result_append(result, "\"");
 	tal_free(esc);
 }
 
@@ -659,11 +706,37 @@ void json_add_bool(struct json_stream *result, const char *fieldname, bool value
 void json_add_hex(struct json_stream *result, const char *fieldname,
 		  const void *data, size_t len)
 {
-	char *hex = tal_arr(NULL, char, hex_str_size(len));
+	/* Hex never needs escaping, so we encode it straight into output:
+	 * hex_encode's NUL terminator lands where the closing quote goes. */
+	char *dest;
 
-	hex_encode(data, len, hex, hex_str_size(len));
-	json_add_string(result, fieldname, hex);
-	tal_free(hex);
+	json_start_member(result, fieldname);
+	dest = result_append_space(result, hex_str_size(len) + 1);
+	if (!dest)
+		return;
+	dest[0] = '"';
+	hex_encode(data, len, dest + 1, hex_str_size(len));
+	dest[hex_str_size(len)] = '"';
+}
+
+void json_add_short_channel_id(struct json_stream *response,
+			       const char *fieldname,
+			       const struct short_channel_id *id)
+{
+	/* Same as short_channel_id_to_str: "<block>:<txnum>:<outnum>" */
+	char buf[sizeof("\"4294967295:4294967295:65535\"") - 1];
+	char *start = buf + sizeof(buf);
+
+	*--start = '"';
+	start = u64_digits(start, short_channel_id_outnum(id));
+	*--start = ':';
+	start = u64_digits(start, short_channel_id_txnum(id));
+	*--start = ':';
+	start = u64_digits(start, short_channel_id_blocknum(id));
+	*--start = '"';
+
+	json_start_member(response, fieldname);
+	result_append_len(response, start, buf + sizeof(buf) - start);
 }
 
 void json_add_hex_talarr(struct json_stream *result,
@@ -696,7 +769,9 @@ void json_add_escaped_string(struct json_stream *result, const char *fieldname,
 			     const struct json_escaped *esc TAKES)
 {
 	json_start_member(result, fieldname);
-	result_append_fmt(result, "\"%s\"", esc->s);
+	result_append(result, "\"");
+	result_append(result, esc->s);
+	result_append(result, "\"");
 	if (taken(esc))
 		tal_free(esc);
 }
@@ -711,6 +786,7 @@ static struct json_stream *new_json_stream(struct command *cmd)
 #endif
 	r->indent = 0;
 	r->empty = true;
+	r->compact = cmd->compact;
 
 	assert(!cmd->have_json_stream);
 	cmd->have_json_stream = true;
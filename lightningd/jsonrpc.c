@@ -48,6 +48,9 @@ static void destroy_jcon(struct json_connection *jcon)
 	if (jcon->command) {
 		log_debug(jcon->log, "Abandoning command");
 		jcon->command->jcon = NULL;
+		/* Nobody to stream the rest to. */
+		if (jcon->command->drained)
+			tal_free(jcon->command);
 	}
 
 	/* Make sure this happens last! */
@@ -304,6 +307,15 @@ void jcon_append(struct json_connection *jcon, const char *str)
 	io_wake(jcon);
 }
 
+char *jcon_append_space(struct json_connection *jcon, size_t len)
+{
+	json_connection_mkroom(jcon, len);
+
+	/* Wake writer. */
+	io_wake(jcon);
+	return membuf_add(&jcon->outbuf, len);
+}
+
 void jcon_append_vfmt(struct json_connection *jcon, const char *fmt, va_list ap)
 {
 	size_t fmtlen;
@@ -403,6 +415,40 @@ void command_still_pending(struct command *cmd)
 	cmd->pending = true;
 }
 
+bool command_output_full(const struct command *cmd)
+{
+	if (!cmd->jcon)
+		return true;
+	return membuf_num_elems(&cmd->jcon->outbuf) > JSONRPC_OUTPUT_HIGHWATER;
+}
+
+void command_wait_output_(struct command *cmd,
+			  void (*cb)(struct command *cmd, void *arg),
+			  void *arg)
+{
+	if (!cmd->jcon) {
+		tal_free(cmd);
+		return;
+	}
+
+	/* write_json_done() will call this once it's written everything. */
+	assert(membuf_num_elems(&cmd->jcon->outbuf));
+	assert(!cmd->drained);
+	cmd->drained = cb;
+	cmd->drained_arg = arg;
+	command_still_pending(cmd);
+}
+
+static void command_drained(struct command *cmd)
+{
+	void (*cb)(struct command *cmd, void *arg) = cmd->drained;
+
+	cmd->drained = NULL;
+	db_begin_transaction(cmd->ld->wallet->db);
+	cb(cmd, cmd->drained_arg);
+	db_commit_transaction(cmd->ld->wallet->db);
+}
+
 static void jcon_start(struct json_connection *jcon, const char *id)
 {
 	jcon_append(jcon, "{ \"jsonrpc\": \"2.0\", \"id\" : ");
@@ -425,7 +471,7 @@ static void json_command_malformed(struct json_connection *jcon,
 /* Returns true if command already completed. */
 static bool parse_request(struct json_connection *jcon, const jsmntok_t tok[])
 {
-	const jsmntok_t *method, *id, *params;
+	const jsmntok_t *method, *id, *params, *compact;
 	struct command *c;
 
 	if (tok[0].type != JSMN_OBJECT) {
@@ -437,6 +483,7 @@ static bool parse_request(struct json_connection *jcon, const jsmntok_t tok[])
 	method = json_get_member(jcon->buffer, tok, "method");
 	params = json_get_member(jcon->buffer, tok, "params");
 	id = json_get_member(jcon->buffer, tok, "id");
+	compact = json_get_member(jcon->buffer, tok, "compact");
 
 	if (!id) {
 		json_command_malformed(jcon, "null", "No id");
@@ -460,6 +507,8 @@ static bool parse_request(struct json_connection *jcon, const jsmntok_t tok[])
 			    json_tok_len(id));
 	c->mode = CMD_NORMAL;
 	c->ok = NULL;
+	c->drained = NULL;
+	c->compact = compact && json_tok_streq(jcon->buffer, compact, "true");
 	jcon->command = c;
 	tal_add_destructor(c, destroy_command);
 
@@ -516,6 +565,11 @@ static struct io_plan *write_json_done(struct io_conn *conn,
 {
 	membuf_consume(&jcon->outbuf, jcon->out_amount);
 
+	/* Streaming command waiting for the client to catch up? */
+	if (jcon->command && jcon->command->drained
+	    && !membuf_num_elems(&jcon->outbuf))
+		command_drained(jcon->command);
+
  	/* If we have more to write, do it now. */
  	if (membuf_num_elems(&jcon->outbuf))
 		return write_json(conn, jcon);
@@ -540,6 +594,10 @@ static struct io_plan *write_json_done(struct io_conn *conn,
 static struct io_plan *write_json(struct io_conn *conn,
 				  struct json_connection *jcon)
 {
+	/* Don't tell them it's done before it's on disk. */
+	if (db_commit_pending(jcon->ld->wallet->db))
+		return io_out_wait(conn, jcon->ld->wallet->db, write_json, jcon);
+
 	jcon->out_amount = membuf_num_elems(&jcon->outbuf);
 	return io_write(conn,
 			membuf_elems(&jcon->outbuf), jcon->out_amount,
@@ -552,10 +610,19 @@ static struct io_plan *locked_write_json(struct io_conn *conn,
 	return io_lock_acquire_out(conn, jcon->lock, write_json, jcon);
 }
 
+/* Remove whatever the parser is finished with from the buffer. */
+static void discard_input(struct json_connection *jcon)
+{
+	size_t discard = json_parser_discard(jcon->parser);
+
+	memmove(jcon->buffer, jcon->buffer + discard, jcon->used - discard);
+	jcon->used -= discard;
+}
+
 static struct io_plan *read_json(struct io_conn *conn,
 				 struct json_connection *jcon)
 {
-	jsmntok_t *toks;
+	const jsmntok_t *toks;
 	bool valid, completed;
 
 	if (jcon->len_read)
@@ -567,7 +634,8 @@ static struct io_plan *read_json(struct io_conn *conn,
 	if (jcon->used == tal_count(jcon->buffer))
 		tal_resize(&jcon->buffer, jcon->used * 2);
 
-	toks = json_parse_input(jcon->buffer, jcon->used, &valid);
+	/* This only looks at what's new since last time. */
+	toks = json_parser_next(jcon->parser, jcon->buffer, jcon->used, &valid);
 	if (!toks) {
 		if (!valid) {
 			log_unusual(jcon->log,
@@ -582,37 +650,26 @@ static struct io_plan *read_json(struct io_conn *conn,
 		goto read_more;
 	}
 
-	/* Empty buffer? (eg. just whitespace). */
-	if (tal_count(toks) == 1) {
-		jcon->used = 0;
-		goto read_more;
-	}
-
 	completed = parse_request(jcon, toks);
 
-	/* Remove first {}. */
-	memmove(jcon->buffer, jcon->buffer + toks[0].end,
-		tal_count(jcon->buffer) - toks[0].end);
-	jcon->used -= toks[0].end;
+	/* If we've handled everything we've read, we can forget it. */
+	discard_input(jcon);
 
 	/* If we haven't completed, wait for cmd completion. */
 	jcon->len_read = 0;
-	if (!completed) {
-		tal_free(toks);
+	if (!completed)
 		return io_wait(conn, conn, read_json, jcon);
-	}
 
 	/* If we have more to process, try again.  FIXME: this still gets
 	 * first priority in io_loop, so can starve others.  Hack would be
 	 * a (non-zero) timer, but better would be to have io_loop avoid
 	 * such livelock */
-	if (jcon->used) {
-		tal_free(toks);
+	if (jcon->used)
 		return io_always(conn, read_json, jcon);
-	}
 
 read_more:
-	tal_free(toks);
+	/* eg. trailing whitespace. */
+	discard_input(jcon);
 	return io_read_partial(conn, jcon->buffer + jcon->used,
 			       tal_count(jcon->buffer) - jcon->used,
 			       &jcon->len_read, read_json, jcon);
@@ -628,6 +685,7 @@ static struct io_plan *jcon_connected(struct io_conn *conn,
 	jcon->ld = ld;
 	jcon->used = 0;
 	jcon->buffer = tal_arr(jcon, char, 64);
+	jcon->parser = json_parser_new(jcon);
 	jcon->stop = false;
 	jcon->lock = io_lock_new(jcon);
 	membuf_init(&jcon->outbuf,
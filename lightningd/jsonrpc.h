@@ -5,6 +5,7 @@
 #include <ccan/autodata/autodata.h>
 #include <ccan/list/list.h>
 #include <ccan/membuf/membuf.h>
+#include <ccan/typesafe_cb/typesafe_cb.h>
 #include <common/io_lock.h>
 #include <common/json.h>
 #include <stdarg.h>
@@ -41,6 +42,12 @@ struct command {
 	bool *ok;
 	/* Have we started a json stream already?  For debugging. */
 	bool have_json_stream;
+	/* If non-NULL, call this once output is drained (command_wait_output) */
+	void (*drained)(struct command *cmd, void *arg);
+	void *drained_arg;
+	/* Leave out newlines and indentation in the result (if the request
+	 * had "compact": true): for machines, not humans. */
+	bool compact;
 };
 
 struct json_connection {
@@ -55,6 +62,8 @@ struct json_connection {
 
 	/* The buffer (required to interpret tokens). */
 	char *buffer;
+	/* Incremental parser for what's in it. */
+	struct json_parser *parser;
 
 	/* Internal state: */
 	/* How much is already filled. */
@@ -94,9 +103,35 @@ void PRINTF_FMT(3, 4) command_fail(struct command *cmd, int code,
 /* Mainly for documentation, that we plan to close this later. */
 void command_still_pending(struct command *cmd);
 
+/* Large responses are streamed, so we never buffer much more than this. */
+#define JSONRPC_OUTPUT_HIGHWATER (256 * 1024)
+
+/* How many entries streaming commands fetch at once. */
+#define JSONRPC_STREAM_BATCH 100
+
+/* Should a streaming command stop and wait for the client to catch up?
+ * Also true if the client has gone away. */
+bool command_output_full(const struct command *cmd);
+
+/* Call cb once everything output so far has been written: use this
+ * instead of command_still_pending.  If the client has gone away, this
+ * frees cmd (and anything allocated off it) instead! */
+#define command_wait_output(cmd, cb, arg)				\
+	command_wait_output_((cmd),					\
+			     typesafe_cb_preargs(void, void *,		\
+						 (cb), (arg),		\
+						 struct command *),	\
+			     (arg))
+void command_wait_output_(struct command *cmd,
+			  void (*cb)(struct command *cmd, void *arg),
+			  void *arg);
+
 /* Low level jcon routines. */
 void jcon_append(struct json_connection *jcon, const char *str);
 void jcon_append_vfmt(struct json_connection *jcon, const char *fmt, va_list ap);
+/* Returns len bytes at the end of the output, which caller must fill in
+ * before appending anything else. */
+char *jcon_append_space(struct json_connection *jcon, size_t len);
 
 /* For initialization */
 void setup_jsonrpc(struct lightningd *ld, const char *rpc_filename);
@@ -158,6 +158,16 @@ static struct lightningd *new_lightningd(const tal_t *ctx)
 	htlc_in_map_init(&ld->htlcs_in);
 	htlc_out_map_init(&ld->htlcs_out);
 
+	/*~ Every block, we need to check that no HTLC is getting too close
+	 * to its expiry.  Rather than look at every one, we file them by
+	 * the block height at which we need to look. */
+	ld->htlc_in_deadlines = new_htlc_deadlines(ld);
+	ld->htlc_out_deadlines = new_htlc_deadlines(ld);
+
+	/*~ When we forward an HTLC, the onion tells us the short_channel_id
+	 * to send it over: if it's one of ours, we can find it ourselves. */
+	uintmap_init(&ld->channels_by_scid);
+
 	/*~ We have a two-level log-book infrastructure: we define a 20MB log
 	 * book to hold all the entries (and trims as necessary), and multiple
 	 * log objects which each can write into it, each with a unique
@@ -595,6 +605,8 @@ int main(int argc, char *argv[])
 	 * bitcoin wallet (though it's that too).  It also stores channel
 	 * states, invoices, payments, blocks and bitcoin transactions. */
 	ld->wallet = wallet_new(ld, ld->log, &ld->timers);
+	if (ld->config.db_wal)
+		db_set_wal(ld->wallet->db);
 
 	/*~ We keep a filter of scriptpubkeys we're interested in. */
 	ld->owned_txfilter = txfilter_new(ld);
@@ -730,6 +742,12 @@ int main(int argc, char *argv[])
 	 * a backtrace if we fail during startup. */
 	crashlog = ld->log;
 
+	/*~ Startup is done with the db in lock-step; from now on we can let
+	 * commits pile up for a little while, if they asked. */
+	if (ld->config.db_group_commit_ms)
+		db_group_commit(ld->wallet->db, &ld->timers,
+				time_from_msec(ld->config.db_group_commit_ms));
+
 	/*~ The root of every backtrace (almost).  This is our main event
 	 *  loop. */
 	for (;;) {
@@ -757,6 +775,8 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	/* Everything we've committed should be on disk as we shut down. */
+	db_group_commit(ld->wallet->db, NULL, time_from_msec(0));
 	shutdown_subdaemons(ld);
 
 	/* Clean up the JSON-RPC. This needs to happen in a DB transaction since
@@ -4,6 +4,7 @@
 #include <bitcoin/chainparams.h>
 #include <bitcoin/privkey.h>
 #include <ccan/container_of/container_of.h>
+#include <ccan/intmap/intmap.h>
 #include <ccan/time/time.h>
 #include <ccan/timer/timer.h>
 #include <lightningd/htlc_end.h>
@@ -66,6 +67,12 @@ struct config {
 
 	/* Are we allowed to use DNS lookup for peers. */
 	bool use_dns;
+
+	/* How long to group db commits together (0 = don't). */
+	u32 db_group_commit_ms;
+
+	/* Use sqlite's write-ahead log. */
+	bool db_wal;
 };
 
 struct lightningd {
@@ -153,6 +160,13 @@ struct lightningd {
 	struct htlc_in_map htlcs_in;
 	struct htlc_out_map htlcs_out;
 
+	/* ... and when we'll have to fail the channel over them. */
+	struct htlc_deadlines *htlc_in_deadlines;
+	struct htlc_deadlines *htlc_out_deadlines;
+
+	/* Our channels which have a short_channel_id, by it. */
+	UINTMAP(struct channel *) channels_by_scid;
+
 	struct wallet *wallet;
 
 	/* Outstanding waitsendpay commands. */
@@ -324,6 +324,12 @@ static void config_register_opts(struct lightningd *ld)
 			 opt_set_u32, opt_show_u32,
 			 &ld->config.commit_time_ms,
 			 "Time after changes before sending out COMMIT");
+	opt_register_arg("--db-group-commit=<millseconds>",
+			 opt_set_u32, opt_show_u32,
+			 &ld->config.db_group_commit_ms,
+			 "Group database commits for up to this long (0 = off)");
+	opt_register_noarg("--db-wal", opt_set_bool, &ld->config.db_wal,
+			   "Use a write-ahead log for the database");
 	opt_register_arg("--fee-base", opt_set_u32, opt_show_u32,
 			 &ld->config.fee_base,
 			 "Millisatoshi minimum to charge for HTLC");
@@ -732,6 +738,9 @@ void register_opts(struct lightningd *ld)
 	opt_register_arg("--bitcoin-rpcport", opt_set_talstr, NULL,
 			 &ld->topology->bitcoind->rpcport,
 			 "bitcoind RPC port");
+	opt_register_noarg("--bitcoin-rpc-direct", opt_set_bool,
+			   &ld->topology->bitcoind->rpc_direct,
+			   "Talk JSON-RPC to bitcoind directly, not via bitcoin-cli");
 	opt_register_arg("--pid-file=<file>", opt_set_talstr, opt_show_charp,
 			 &ld->pidfile,
 			 "Specify pid file");
@@ -1054,11 +1054,56 @@ static const struct json_command waitsendpay_command = {
 };
 AUTODATA(json_command, &waitsendpay_command);
 
+struct payment_stream {
+	struct json_stream *response;
+	const struct sha256 *rhash;
+	u64 after_id;
+};
+
+static void json_add_payments_arr(struct json_stream *response,
+				  const struct wallet_payment **payments)
+{
+	for (size_t i = 0; i < tal_count(payments); i++) {
+		json_object_start(response, NULL);
+		json_add_payment_fields(response, payments[i]);
+		json_object_end(response);
+	}
+}
+
+/* There can be very many, so we stream them as the client reads. */
+static void json_add_payments(struct command *cmd, struct payment_stream *ps)
+{
+	const struct wallet_payment **payments;
+	size_t n;
+
+	do {
+		payments = wallet_payment_list(NULL, cmd->ld->wallet,
+					       ps->rhash, &ps->after_id,
+					       JSONRPC_STREAM_BATCH);
+		n = tal_count(payments);
+		json_add_payments_arr(ps->response, payments);
+		tal_free(payments);
+
+		if (n == JSONRPC_STREAM_BATCH && command_output_full(cmd)) {
+			command_wait_output(cmd, json_add_payments, ps);
+			return;
+		}
+	} while (n == JSONRPC_STREAM_BATCH);
+
+	/* Now add payments not yet in db. */
+	payments = wallet_payment_list_unstored(tmpctx, cmd->ld->wallet,
+						ps->rhash);
+	json_add_payments_arr(ps->response, payments);
+
+	json_array_end(ps->response);
+	json_object_end(ps->response);
+	command_success(cmd, ps->response);
+}
+
 static void json_listpayments(struct command *cmd, const char *buffer,
 			       const jsmntok_t *params)
 {
-	const struct wallet_payment **payments;
-	struct json_stream *response;
+	struct payment_stream *ps;
 	struct sha256 *rhash;
 	const char *b11str;
 
@@ -1088,21 +1133,13 @@ static void json_listpayments(struct command *cmd, const char *buffer,
 		rhash = &b11->payment_hash;
 	}
 
-	payments = wallet_payment_list(cmd, cmd->ld->wallet, rhash);
-
-	response = json_stream_success(cmd);
-	json_object_start(response, NULL);
-
-	json_array_start(response, "payments");
-	for (size_t i = 0; i < tal_count(payments); i++) {
-		json_object_start(response, NULL);
-		json_add_payment_fields(response, payments[i]);
-		json_object_end(response);
-	}
-	json_array_end(response);
-
-	json_object_end(response);
-	command_success(cmd, response);
+	ps = tal(cmd, struct payment_stream);
+	ps->rhash = rhash;
+	ps->after_id = 0;
+	ps->response = json_stream_success(cmd);
+	json_object_start(ps->response, NULL);
+	json_array_start(ps->response, "payments");
+	json_add_payments(cmd, ps);
 }
 
 static const struct json_command listpayments_command = {
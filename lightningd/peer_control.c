@@ -526,12 +526,13 @@ static enum watch_result funding_lockin_cb(struct lightningd *ld,
 	/* If we restart, we could already have peer->scid from database */
 	if (!channel->scid) {
 		struct txlocator *loc;
+		struct short_channel_id scid;
 
 		loc = wallet_transaction_locate(tmpctx, ld->wallet, txid);
-		channel->scid = tal(channel, struct short_channel_id);
-		mk_short_channel_id(channel->scid,
+		mk_short_channel_id(&scid,
 				    loc->blkheight, loc->index,
 				    channel->funding_outnum);
+		channel_set_scid(channel, &scid);
 		/* We've added scid, update */
 		wallet_channel_save(ld->wallet, channel);
 	}
@@ -206,6 +206,32 @@ static bool check_cltv(struct htlc_in *hin,
 	return false;
 }
 
+/* BOLT #2:
+ *
+ * 2. the deadline for offered HTLCs: the deadline after which the channel has
+ *    to be failed and timed out on-chain. This is `G` blocks after the HTLC's
+ *    `cltv_expiry`: 1 block is reasonable.
+ */
+static u32 htlc_out_deadline(const struct htlc_out *hout)
+{
+	return hout->cltv_expiry + 1;
+}
+
+/* BOLT #2:
+ *
+ * 3. the deadline for received HTLCs this node has fulfilled: the deadline
+ * after which the channel has to be failed and the HTLC fulfilled on-chain
+ * before its `cltv_expiry`. See steps 4-7 above, which imply a deadline of
+ * `2R+G+S` blocks before `cltv_expiry`: 7 blocks is reasonable.
+ */
+/* We approximate this, by using half the cltv_expiry_delta (3R+2G+2S),
+ * rounded up. */
+static u32 htlc_in_deadline(const struct lightningd *ld,
+			    const struct htlc_in *hin)
+{
+	return hin->cltv_expiry - (ld->config.cltv_expiry_delta + 1)/2;
+}
+
 static void fulfill_htlc(struct htlc_in *hin, const struct preimage *preimage)
 {
 	u8 *msg;
@@ -213,6 +239,9 @@ static void fulfill_htlc(struct htlc_in *hin, const struct preimage *preimage)
 	struct wallet *wallet = channel->peer->ld->wallet;
 
 	hin->preimage = tal_dup(hin, struct preimage, preimage);
+	htlc_deadlines_add(channel->peer->ld->htlc_in_deadlines,
+			   htlc_in_deadline(channel->peer->ld, hin),
+			   &hin->deadline_list);
 
 	/* We update state now to signal it's in progress, for persistence. */
 	htlc_in_update_state(channel, hin, SENT_REMOVE_HTLC);
@@ -408,6 +437,8 @@ static void rcvd_htlc_reply(struct subd *subd, const u8 *msg, const int *fds UNU
 
 	/* Add it to lookup table now we know id. */
 	connect_htlc_out(&subd->ld->htlcs_out, hout);
+	htlc_deadlines_add(subd->ld->htlc_out_deadlines,
+			   htlc_out_deadline(hout), &hout->deadline_list);
 
 	/* When channeld includes it in commitment, we'll make it persistent. */
 }
@@ -589,21 +620,21 @@ static void channel_resolve_reply(struct subd *gossip, const u8 *msg,
 	tal_free(gr);
 }
 
-/* Everyone is committed to this htlc of theirs */
+/* Everyone is committed to this htlc of theirs: channeld has unwrapped
+ * the onion for us. */
 static bool peer_accepted_htlc(struct channel *channel,
-			       u64 id,
+			       const struct peeled_htlc *peeled,
 			       enum onion_type *failcode)
 {
 	struct htlc_in *hin;
 	u8 *req;
-	struct route_step *rs;
-	struct onionpacket *op;
 	struct lightningd *ld = channel->peer->ld;
 
-	hin = find_htlc_in(&ld->htlcs_in, channel, id);
+	hin = find_htlc_in(&ld->htlcs_in, channel, peeled->id);
 	if (!hin) {
 		channel_internal_error(channel,
-				    "peer_got_revoke unknown htlc %"PRIu64, id);
+				    "peer_got_revoke unknown htlc %"PRIu64,
+				    peeled->id);
 		return false;
 	}
 
@@ -614,7 +645,7 @@ static bool peer_accepted_htlc(struct channel *channel,
 #if DEVELOPER
 	if (channel->peer->ignore_htlcs) {
 		log_debug(channel->log, "their htlc %"PRIu64" dev_ignore_htlcs",
-			  id);
+			  peeled->id);
 		return true;
 	}
 #endif
@@ -639,50 +670,34 @@ static bool peer_accepted_htlc(struct channel *channel,
 	 * a subset of the cltv check done in handle_localpay and
 	 * forward_htlc. */
 
-	/* channeld tests this, so it should have set ss to zeroes. */
-	op = parse_onionpacket(tmpctx, hin->onion_routing_packet,
-			       sizeof(hin->onion_routing_packet));
-	if (!op) {
-		if (!memeqzero(&hin->shared_secret, sizeof(hin->shared_secret))){
-			channel_internal_error(channel,
-				   "bad onion in got_revoke: %s",
-				   tal_hexstr(channel, hin->onion_routing_packet,
-					     sizeof(hin->onion_routing_packet)));
-			return false;
-		}
-		/* FIXME: could be bad version, bad key. */
-		*failcode = WIRE_INVALID_ONION_VERSION;
+	/* Bad onion, or unknown realm. */
+	if (peeled->failcode) {
+		*failcode = peeled->failcode;
 		goto out;
 	}
 
-	/* Channeld sets this to zero if HSM won't ecdh it */
-	if (memeqzero(&hin->shared_secret, sizeof(hin->shared_secret))) {
-		*failcode = WIRE_INVALID_ONION_KEY;
-		goto out;
-	}
-
-	/* If it's crap, not channeld's fault, just fail it */
-	rs = process_onionpacket(tmpctx, op, hin->shared_secret.data,
-				 hin->payment_hash.u.u8,
-				 sizeof(hin->payment_hash));
-	if (!rs) {
-		*failcode = WIRE_INVALID_ONION_HMAC;
-		goto out;
-	}
-
-	/* Unknown realm isn't a bad onion, it's a normal failure. */
-	if (rs->hop_data.realm != 0) {
-		*failcode = WIRE_INVALID_REALM;
-		goto out;
-	}
-
-	if (rs->nextcase == ONION_FORWARD) {
-		struct gossip_resolve *gr = tal(ld, struct gossip_resolve);
+	if (peeled->next_onion) {
+		struct gossip_resolve *gr;
+		struct channel *next;
+
+		/* gossipd only knows peers for our own channels anyway, so
+		 * don't ask it about those: it's a round trip per HTLC. */
+		next = channel_by_scid(ld, &peeled->next_channel);
+		if (next) {
+			forward_htlc(hin, hin->cltv_expiry,
+				     peeled->amt_forward,
+				     peeled->outgoing_cltv,
+				     &next->peer->id,
+				     peeled->next_onion);
+			goto forwarded;
+		}
 
-		gr->next_onion = serialize_onionpacket(gr, rs->next);
-		gr->next_channel = rs->hop_data.channel_id;
-		gr->amt_to_forward = rs->hop_data.amt_forward;
-		gr->outgoing_cltv_value = rs->hop_data.outgoing_cltv;
+		gr = tal(ld, struct gossip_resolve);
+		gr->next_onion = tal_dup_arr(gr, u8, peeled->next_onion,
+					     TOTAL_PACKET_SIZE, 0);
+		gr->next_channel = peeled->next_channel;
+		gr->amt_to_forward = peeled->amt_forward;
+		gr->outgoing_cltv_value = peeled->outgoing_cltv;
 		gr->hin = hin;
 
 		req = towire_gossip_get_channel_peer(tmpctx, &gr->next_channel);
@@ -693,13 +708,14 @@ static bool peer_accepted_htlc(struct channel *channel,
 			 channel_resolve_reply, gr);
 	} else
 		handle_localpay(hin, hin->cltv_expiry, &hin->payment_hash,
-				rs->hop_data.amt_forward,
-				rs->hop_data.outgoing_cltv);
+				peeled->amt_forward,
+				peeled->outgoing_cltv);
 
+forwarded:
 	*failcode = 0;
 out:
 	log_debug(channel->log, "their htlc %"PRIu64" %s",
-		  id, *failcode ? onion_type_name(*failcode) : "locked");
+		  peeled->id, *failcode ? onion_type_name(*failcode) : "locked");
 
 	return true;
 }
@@ -1279,8 +1295,9 @@ void peer_got_revoke(struct channel *channel, const u8 *msg)
 	struct secret per_commitment_secret;
 	struct pubkey next_per_commitment_point;
 	struct changed_htlc *changed;
+	struct peeled_htlc **peeled;
 	enum onion_type *failcodes;
-	size_t i;
+	size_t i, num_peeled = 0;
 	struct lightningd *ld = channel->peer->ld;
 	u32 feerate;
 
@@ -1288,7 +1305,8 @@ void peer_got_revoke(struct channel *channel, const u8 *msg)
 					 &revokenum, &per_commitment_secret,
 					 &next_per_commitment_point,
 					 &feerate,
-					 &changed)) {
+					 &changed,
+					 &peeled)) {
 		channel_internal_error(channel, "bad fromwire_channel_got_revoke %s",
 				    tal_hex(channel, msg));
 		return;
@@ -1303,7 +1321,15 @@ void peer_got_revoke(struct channel *channel, const u8 *msg)
 	for (i = 0; i < tal_count(changed); i++) {
 		/* If we're doing final accept, we need to forward */
 		if (changed[i].newstate == RCVD_ADD_ACK_REVOCATION) {
-			if (!peer_accepted_htlc(channel, changed[i].id,
+			if (num_peeled == tal_count(peeled)
+			    || peeled[num_peeled]->id != changed[i].id) {
+				channel_internal_error(channel,
+						       "got_revoke: no onion"
+						       " for htlc %"PRIu64,
+						       changed[i].id);
+				return;
+			}
+			if (!peer_accepted_htlc(channel, peeled[num_peeled++],
 						&failcodes[i]))
 				return;
 		} else {
@@ -1539,35 +1565,9 @@ void free_htlcs(struct lightningd *ld, const struct channel *channel)
 	} while (deleted);
 }
 
-/* BOLT #2:
- *
- * 2. the deadline for offered HTLCs: the deadline after which the channel has
- *    to be failed and timed out on-chain. This is `G` blocks after the HTLC's
- *    `cltv_expiry`: 1 block is reasonable.
- */
-static u32 htlc_out_deadline(const struct htlc_out *hout)
-{
-	return hout->cltv_expiry + 1;
-}
-
-/* BOLT #2:
- *
- * 3. the deadline for received HTLCs this node has fulfilled: the deadline
- * after which the channel has to be failed and the HTLC fulfilled on-chain
- * before its `cltv_expiry`. See steps 4-7 above, which imply a deadline of
- * `2R+G+S` blocks before `cltv_expiry`: 7 blocks is reasonable.
- */
-/* We approximate this, by using half the cltv_expiry_delta (3R+2G+2S),
- * rounded up. */
-static u32 htlc_in_deadline(const struct lightningd *ld,
-			    const struct htlc_in *hin)
-{
-	return hin->cltv_expiry - (ld->config.cltv_expiry_delta + 1)/2;
-}
-
 void htlcs_notify_new_block(struct lightningd *ld, u32 height)
 {
-	bool removed;
+	struct list_node *n;
 
 	/* BOLT #2:
 	 *
@@ -1575,39 +1575,26 @@ void htlcs_notify_new_block(struct lightningd *ld, u32 height)
 	 *   commitment transaction, AND is past this timeout deadline:
 	 *     - MUST fail the channel.
 	 */
-	/* FIXME: use db to look this up in one go (earliest deadline per-peer) */
-	do {
-		struct htlc_out *hout;
-		struct htlc_out_map_iter outi;
-
-		removed = false;
-
-		for (hout = htlc_out_map_first(&ld->htlcs_out, &outi);
-		     hout;
-		     hout = htlc_out_map_next(&ld->htlcs_out, &outi)) {
-			/* Not timed out yet? */
-			if (height < htlc_out_deadline(hout))
-				continue;
-
-			/* Peer on chain already? */
-			if (channel_on_chain(hout->key.channel))
-				continue;
+	/* Failing a channel can free HTLCs, so we pop one at a time. */
+	while ((n = htlc_deadlines_pop(ld->htlc_out_deadlines, height))) {
+		struct htlc_out *hout = container_of(n, struct htlc_out,
+						     deadline_list);
 
-			/* Peer already failed, or we hit it? */
-			if (hout->key.channel->error)
-				continue;
+		/* Peer on chain already? */
+		if (channel_on_chain(hout->key.channel))
+			continue;
 
-			channel_fail_permanent(hout->key.channel,
-					    "Offered HTLC %"PRIu64
-					    " %s cltv %u hit deadline",
-					    hout->key.id,
-					    htlc_state_name(hout->hstate),
-					    hout->cltv_expiry);
-			removed = true;
-		}
-	/* Iteration while removing is safe, but can skip entries! */
-	} while (removed);
+		/* Peer already failed, or we hit it? */
+		if (hout->key.channel->error)
+			continue;
 
+		channel_fail_permanent(hout->key.channel,
+				       "Offered HTLC %"PRIu64
+				       " %s cltv %u hit deadline",
+				       hout->key.id,
+				       htlc_state_name(hout->hstate),
+				       hout->cltv_expiry);
+	}
 
 	/* BOLT #2:
 	 *
@@ -1618,43 +1605,28 @@ void htlcs_notify_new_block(struct lightningd *ld, u32 height)
 	 *   transaction, AND is past this fulfillment deadline:
 	 *     - MUST fail the connection.
 	 */
-	do {
-		struct htlc_in *hin;
-		struct htlc_in_map_iter ini;
-
-		removed = false;
-
-		for (hin = htlc_in_map_first(&ld->htlcs_in, &ini);
-		     hin;
-		     hin = htlc_in_map_next(&ld->htlcs_in, &ini)) {
-			struct channel *channel = hin->key.channel;
-
-			/* Not fulfilled?  If overdue, that's their problem... */
-			if (!hin->preimage)
-				continue;
-
-			/* Not timed out yet? */
-			if (height < htlc_in_deadline(ld, hin))
-				continue;
-
-			/* Peer on chain already? */
-			if (channel_on_chain(channel))
-				continue;
+	/* Only fulfilled ones are in here: if overdue before that, that's
+	 * their problem... */
+	while ((n = htlc_deadlines_pop(ld->htlc_in_deadlines, height))) {
+		struct htlc_in *hin = container_of(n, struct htlc_in,
+						   deadline_list);
+		struct channel *channel = hin->key.channel;
+
+		/* Peer on chain already? */
+		if (channel_on_chain(channel))
+			continue;
 
-			/* Peer already failed, or we hit it? */
-			if (channel->error)
-				continue;
+		/* Peer already failed, or we hit it? */
+		if (channel->error)
+			continue;
 
-			channel_fail_permanent(channel,
-					    "Fulfilled HTLC %"PRIu64
-					    " %s cltv %u hit deadline",
-					    hin->key.id,
-					    htlc_state_name(hin->hstate),
-					    hin->cltv_expiry);
-			removed = true;
-		}
-	/* Iteration while removing is safe, but can skip entries! */
-	} while (removed);
+		channel_fail_permanent(channel,
+				       "Fulfilled HTLC %"PRIu64
+				       " %s cltv %u hit deadline",
+				       hin->key.id,
+				       htlc_state_name(hin->hstate),
+				       hin->cltv_expiry);
+	}
 }
 
 #ifdef COMPAT_V061
@@ -1776,6 +1748,20 @@ void htlcs_reconnect(struct lightningd *ld,
 			htlc_in_map_del(&unprocessed, hout->in);
 	}
 
+	/* Now file them all by deadline for htlcs_notify_new_block() */
+	for (hin = htlc_in_map_first(htlcs_in, &ini); hin;
+	     hin = htlc_in_map_next(htlcs_in, &ini)) {
+		if (hin->preimage)
+			htlc_deadlines_add(ld->htlc_in_deadlines,
+					   htlc_in_deadline(ld, hin),
+					   &hin->deadline_list);
+	}
+	for (hout = htlc_out_map_first(htlcs_out, &outi); hout;
+	     hout = htlc_out_map_next(htlcs_out, &outi))
+		htlc_deadlines_add(ld->htlc_out_deadlines,
+				   htlc_out_deadline(hout),
+				   &hout->deadline_list);
+
 	/* Now fail any which were stuck. */
 	for (hin = htlc_in_map_first(&unprocessed, &ini); hin;
 	     hin = htlc_in_map_next(&unprocessed, &ini)) {
@@ -1823,43 +1809,66 @@ static const struct json_command dev_ignore_htlcs = {
 AUTODATA(json_command, &dev_ignore_htlcs);
 #endif /* DEVELOPER */
 
-static void listforwardings_add_forwardings(struct json_stream *response, struct wallet *wallet)
+struct forwarding_stream {
+	struct json_stream *response;
+	u64 after_id;
+};
+
+/* There can be very many, so we stream them as the client reads. */
+static void listforwardings_add_forwardings(struct command *cmd,
+					    struct forwarding_stream *fs)
 {
 	const struct forwarding *forwardings;
-	forwardings = wallet_forwarded_payments_get(wallet, tmpctx);
+	struct json_stream *response = fs->response;
+	size_t n;
 
-	json_array_start(response, "forwards");
-	for (size_t i=0; i<tal_count(forwardings); i++) {
-		const struct forwarding *cur = &forwardings[i];
-		json_object_start(response, NULL);
+	do {
+		forwardings = wallet_forwarded_payments_get(cmd->ld->wallet,
+							    NULL,
+							    &fs->after_id,
+							    JSONRPC_STREAM_BATCH);
+		n = tal_count(forwardings);
+		for (size_t i=0; i<n; i++) {
+			const struct forwarding *cur = &forwardings[i];
+			json_object_start(response, NULL);
+
+			json_add_short_channel_id(response, "in_channel", &cur->channel_in);
+			json_add_short_channel_id(response, "out_channel", &cur->channel_out);
+			json_add_num(response, "in_msatoshi", cur->msatoshi_in);
+			json_add_num(response, "out_msatoshi", cur->msatoshi_out);
+			json_add_num(response, "fee", cur->fee);
+			json_add_string(response, "status", forward_status_name(cur->status));
+			json_object_end(response);
+		}
+		tal_free(forwardings);
 
-		json_add_short_channel_id(response, "in_channel", &cur->channel_in);
-		json_add_short_channel_id(response, "out_channel", &cur->channel_out);
-		json_add_num(response, "in_msatoshi", cur->msatoshi_in);
-		json_add_num(response, "out_msatoshi", cur->msatoshi_out);
-		json_add_num(response, "fee", cur->fee);
-		json_add_string(response, "status", forward_status_name(cur->status));
-		json_object_end(response);
-	}
-	json_array_end(response);
+		if (n == JSONRPC_STREAM_BATCH && command_output_full(cmd)) {
+			command_wait_output(cmd,
+					    listforwardings_add_forwardings,
+					    fs);
+			return;
+		}
+	} while (n == JSONRPC_STREAM_BATCH);
 
-	tal_free(forwardings);
+	json_array_end(response);
+	json_object_end(response);
+	command_success(cmd, response);
 }
 
 static void json_listforwards(struct command *cmd, const char *buffer,
 			       const jsmntok_t *params)
 {
-	struct json_stream *response;
+	struct forwarding_stream *fs;
 
 	if (!param(cmd, buffer, params, NULL))
 		return;
 
-	response = json_stream_success(cmd);
-	json_object_start(response, NULL);
-	listforwardings_add_forwardings(response, cmd->ld->wallet);
-	json_object_end(response);
-
-	command_success(cmd, response);
+	fs = tal(cmd, struct forwarding_stream);
+	fs->after_id = 0;
+	fs->response = json_stream_success(cmd);
+	json_object_start(fs->response, NULL);
+	json_array_start(fs->response, "forwards");
+	listforwardings_add_forwardings(cmd, fs);
 }
 
 static const struct json_command listforwards_command = {
@@ -577,9 +577,15 @@ static void destroy_subd(struct subd *sd)
 
 static struct io_plan *msg_send_next(struct io_conn *conn, struct subd *sd)
 {
-	const u8 *msg = msg_dequeue(sd->outq);
+	const u8 *msg;
 	int fd;
 
+	/* What we tell subdaemons gets acted on (eg. sent to peers), so it
+	 * mustn't get ahead of the db: wait for any grouped commit. */
+	if (db_commit_pending(sd->ld->wallet->db))
+		return io_out_wait(conn, sd->ld->wallet->db, msg_send_next, sd);
+
+	msg = msg_dequeue(sd->outq);
 	/* Nothing to do?  Wait for msg_enqueue. */
 	if (!msg)
 		return msg_queue_wait(conn, sd->outq, msg_send_next, sd);
@@ -0,0 +1,116 @@
+#include "../htlc_end.c"
+#include <ccan/opt/opt.h>
+#include <ccan/time/time.h>
+#include <common/pseudorand.h>
+#include <stdio.h>
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for fatal */
+void   fatal(const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "fatal called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+/* What htlcs_notify_new_block() used to do: look at every one. */
+static size_t scan_expired(const struct htlc_out_map *map, u32 height)
+{
+	struct htlc_out *hout;
+	struct htlc_out_map_iter outi;
+	size_t n = 0;
+
+	for (hout = htlc_out_map_first(map, &outi);
+	     hout;
+	     hout = htlc_out_map_next(map, &outi)) {
+		if (height < hout->cltv_expiry + 1)
+			continue;
+		n++;
+	}
+	return n;
+}
+
+int main(int argc, char *argv[])
+{
+	setup_locale();
+
+	struct htlc_out_map map;
+	struct htlc_deadlines *deadlines;
+	struct htlc_out **houts, **expired;
+	struct sha256 payment_hash;
+	u8 onion[TOTAL_PACKET_SIZE];
+	/* Small by default for make check: try 100000 150. */
+	size_t num_htlcs = 1000, num_blocks = 150;
+	size_t popped = 0, scanned = 0;
+	struct timemono start;
+	struct timerel pop_time = time_from_sec(0), scan_time = time_from_sec(0);
+
+	setup_tmpctx();
+	opt_parse(&argc, argv, opt_log_stderr_exit);
+	if (argc > 1)
+		num_htlcs = atoi(argv[1]);
+	if (argc > 2)
+		num_blocks = atoi(argv[2]);
+	if (argc > 3)
+		opt_usage_and_exit("[num_htlcs [num_blocks]]");
+
+	memset(&payment_hash, 0, sizeof(payment_hash));
+	memset(onion, 0, sizeof(onion));
+	htlc_out_map_init(&map);
+	deadlines = new_htlc_deadlines(tmpctx);
+	houts = tal_arr(tmpctx, struct htlc_out *, num_htlcs);
+	expired = tal_arr(tmpctx, struct htlc_out *, 0);
+
+	/* Expiries spread over the blocks, as if they're all in flight. */
+	for (size_t i = 0; i < num_htlcs; i++) {
+		houts[i] = new_htlc_out(houts, NULL, 1000,
+					1000 + pseudorand(num_blocks),
+					&payment_hash, onion, true, NULL);
+		houts[i]->key.channel = (struct channel *)houts;
+		houts[i]->key.id = i;
+		connect_htlc_out(&map, houts[i]);
+		htlc_deadlines_add(deadlines, houts[i]->cltv_expiry + 1,
+				   &houts[i]->deadline_list);
+	}
+
+	/* Some get resolved before their deadline. */
+	for (size_t i = 0; i < num_htlcs; i += 3)
+		houts[i] = tal_free(houts[i]);
+
+	for (u32 height = 1000; height < 1000 + num_blocks + 1; height++) {
+		struct list_node *n;
+		size_t expected;
+
+		start = time_mono();
+		expected = scan_expired(&map, height);
+		scan_time = timerel_add(scan_time,
+					timemono_since(start));
+
+		start = time_mono();
+		while ((n = htlc_deadlines_pop(deadlines, height)) != NULL)
+			*tal_arr_expand(&expired) = container_of(n, struct htlc_out,
+								deadline_list);
+		pop_time = timerel_add(pop_time, timemono_since(start));
+
+		for (size_t i = 0; i < tal_count(expired); i++) {
+			assert(expired[i]->cltv_expiry + 1 <= height);
+			/* Resolve it, as failing the channel would. */
+			tal_free(expired[i]);
+			popped++;
+		}
+		tal_resize(&expired, 0);
+
+		/* Everything due is gone from the map too. */
+		assert(scan_expired(&map, height) == 0);
+		scanned += expected;
+	}
+	assert(popped == scanned);
+	assert(popped == num_htlcs - (num_htlcs + 2) / 3);
+	assert(htlc_out_map_first(&map, &(struct htlc_out_map_iter){0}) == NULL);
+
+	printf("%zu HTLCs over %zu blocks: full scans took %"PRIu64" usec, deadline index %"PRIu64" usec\n",
+	       num_htlcs, num_blocks,
+	       time_to_usec(scan_time), time_to_usec(pop_time));
+
+	htlc_out_map_clear(&map);
+	tal_free(tmpctx);
+	opt_free_table();
+	return 0;
+}
@@ -0,0 +1,275 @@
+#include "../bitcoind_rpc.c"
+#include "../json_escaped.c"
+#include <arpa/inet.h>
+#include <assert.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/wait.h>
+
+/* AUTOGENERATED MOCKS START */
+/* AUTOGENERATED MOCKS END */
+
+void log_(struct log *log UNUSED, enum log_level level UNUSED,
+	  const char *fmt UNUSED, ...)
+{
+}
+
+/* "user:pass" */
+#define AUTH "Authorization: Basic dXNlcjpwYXNz\r\n"
+
+static void reply(int fd, const char *status, const char *extra,
+		  const char *body)
+{
+	char *r = tal_fmt(NULL, "HTTP/1.1 %s\r\n%sContent-Length: %zu\r\n\r\n%s",
+			  status, extra, strlen(body), body);
+	if (!write_all(fd, r, strlen(r)))
+		exit(1);
+	tal_free(r);
+}
+
+/* A stand-in for bitcoind: every reply says which connection it came on. */
+static void serve_conn(int fd, int connnum)
+{
+	char buf[4096];
+	size_t used = 0;
+
+	for (;;) {
+		char *hdrend, *clen, *method;
+		size_t len;
+		ssize_t r;
+
+		hdrend = memmem(buf, used, "\r\n\r\n", 4);
+		clen = hdrend ? memmem(buf, used, "Content-Length: ", 16) : NULL;
+		if (!clen
+		    || hdrend + 4 + atoi(clen + 16) > buf + used) {
+			r = read(fd, buf + used, sizeof(buf) - used);
+			if (r <= 0)
+				exit(0);
+			used += r;
+			continue;
+		}
+		len = hdrend + 4 + atoi(clen + 16) - buf;
+		buf[len - 1] = '\0';
+		method = strstr(hdrend, "\"method\":\"") + strlen("\"method\":\"");
+
+		if (!memmem(buf, hdrend - buf, AUTH, strlen(AUTH)))
+			reply(fd, "401 Unauthorized", "", "");
+		else if (strstarts(method, "fail"))
+			reply(fd, "500 Internal Server Error", "",
+			      "{\"result\":null,\"error\":{\"code\":-8,"
+			      "\"message\":\"bad \\\"thing\\\"\"},\"id\":0}");
+		else if (strstarts(method, "close")) {
+			reply(fd, "200 OK", "Connection: close\r\n",
+			      tal_fmt(tmpctx, "{\"result\":%i,\"error\":null,"
+				      "\"id\":0}", connnum));
+			exit(0);
+		} else if (strstarts(method, "drop")) {
+			/* Closes without telling us. */
+			reply(fd, "200 OK", "",
+			      tal_fmt(tmpctx, "{\"result\":%i,\"error\":null,"
+				      "\"id\":0}", connnum));
+			exit(0);
+		} else
+			reply(fd, "200 OK", "",
+			      tal_fmt(tmpctx, "{\"result\":%i,\"error\":null,"
+				      "\"id\":0}", connnum));
+
+		memmove(buf, buf + len, used - len);
+		used -= len;
+	}
+}
+
+static pid_t start_server(int *port)
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	int fd, connnum = 0;
+	pid_t pid;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (fd < 0
+	    || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+	    || listen(fd, 5) != 0
+	    || getsockname(fd, (struct sockaddr *)&addr, &addrlen) != 0)
+		abort();
+	*port = ntohs(addr.sin_port);
+
+	pid = fork();
+	if (pid != 0) {
+		close(fd);
+		return pid;
+	}
+
+	for (;;) {
+		int c = accept(fd, NULL, NULL);
+		if (c < 0)
+			exit(1);
+		connnum++;
+		if (fork() == 0) {
+			close(fd);
+			serve_conn(c, connnum);
+		}
+		close(c);
+	}
+}
+
+struct result {
+	int exitstatus;
+	char *output;
+};
+
+static size_t num_waiting;
+
+static void got_result(int exitstatus, const char *output, size_t output_bytes,
+		       struct result *res)
+{
+	res->exitstatus = exitstatus;
+	res->output = tal_strndup(tmpctx, output, output_bytes);
+	if (--num_waiting == 0)
+		io_break(&num_waiting);
+}
+
+/* Make all these calls at once, and wait for them all. */
+static void call_all(struct bitcoind_rpc *rpc, const char *method,
+		     struct result *res, size_t num)
+{
+	const char *args[] = { method, NULL };
+
+	num_waiting = num;
+	for (size_t i = 0; i < num; i++)
+		bitcoind_rpc_call(rpc, args, got_result, &res[i]);
+	io_loop(NULL, NULL);
+}
+
+static void test_request(void)
+{
+	const char *getblock[] = { "getblock", "00ab", "false", NULL };
+	const char *estimate[] = { "estimatesmartfee", "2", "CONSERVATIVE",
+				   NULL };
+	const char *quote[] = { "echo", "\"", NULL };
+
+	assert(streq(rpc_request_body(tmpctx, 0, getblock),
+		     "{\"jsonrpc\":\"1.0\",\"id\":0,\"method\":\"getblock\","
+		     "\"params\":[\"00ab\",false]}"));
+	assert(streq(rpc_request_body(tmpctx, 1, estimate),
+		     "{\"jsonrpc\":\"1.0\",\"id\":1,"
+		     "\"method\":\"estimatesmartfee\","
+		     "\"params\":[2,\"CONSERVATIVE\"]}"));
+	assert(streq(rpc_request_body(tmpctx, 2, quote),
+		     "{\"jsonrpc\":\"1.0\",\"id\":2,\"method\":\"echo\","
+		     "\"params\":[\"\\\"\"]}"));
+}
+
+static int output(const char *body, char **out)
+{
+	return rpc_response_output(tmpctx, 200, body, strlen(body), out);
+}
+
+static void test_response(void)
+{
+	char *out;
+
+	/* Strings are printed unquoted, everything else as JSON. */
+	assert(output("{\"result\":\"00ab\\\"\",\"error\":null}", &out) == 0);
+	assert(streq(out, "00ab\"\n"));
+	assert(output("{\"result\":102,\"error\":null}", &out) == 0);
+	assert(streq(out, "102\n"));
+	assert(output("{\"result\":{\"a\":[1]},\"error\":null}", &out) == 0);
+	assert(streq(out, "{\"a\":[1]}\n"));
+	assert(output("{\"result\":null,\"error\":null}", &out) == 0);
+	assert(streq(out, ""));
+
+	/* Errors exit with the (positive) code. */
+	assert(output("{\"result\":null,\"error\":"
+		      "{\"code\":-5,\"message\":\"No such tx\"}}", &out) == 5);
+	assert(streq(out, "error code: -5\nerror message:\nNo such tx\n"));
+
+	assert(rpc_response_output(tmpctx, 401, "", 0, &out) == 1);
+	assert(strstarts(out, "error: Authorization failed"));
+}
+
+static void test_server(void)
+{
+	struct bitcoind_rpc *rpc, *badrpc;
+	struct result res[3];
+	const char *args[] = { "getblockcount", NULL };
+	const char *failargs[] = { "fail", NULL };
+	char *out, *port;
+	int portnum;
+	pid_t server;
+
+	server = start_server(&portnum);
+	port = tal_fmt(tmpctx, "%i", portnum);
+	rpc = new_bitcoind_rpc(tmpctx, NULL, "127.0.0.1", port, "user", "pass");
+	badrpc = new_bitcoind_rpc(tmpctx, NULL, "127.0.0.1", port,
+				  "user", "wrong");
+
+	/* Startup calls get their own connection. */
+	assert(bitcoind_rpc_call_sync(tmpctx, rpc, args, &out) == 0);
+	assert(streq(out, "1\n"));
+	assert(bitcoind_rpc_call_sync(tmpctx, badrpc, args, &out) == 1);
+	assert(strstarts(out, "error: Authorization failed"));
+	assert(bitcoind_rpc_call_sync(tmpctx, rpc, failargs, &out) == 8);
+	assert(streq(out, "error code: -8\nerror message:\nbad \"thing\"\n"));
+
+	/* Connection 4 is kept open and reused. */
+	call_all(rpc, "getblockcount", res, 1);
+	assert(res[0].exitstatus == 0);
+	assert(streq(res[0].output, "4\n"));
+	call_all(rpc, "getblockcount", res, 1);
+	assert(streq(res[0].output, "4\n"));
+	call_all(rpc, "fail", res, 1);
+	assert(res[0].exitstatus == 8);
+	call_all(rpc, "getblockcount", res, 1);
+	assert(streq(res[0].output, "4\n"));
+
+	/* Parallel requests need more connections. */
+	call_all(rpc, "getblockcount", res, 3);
+	assert(streq(res[0].output, "4\n"));
+	assert(streq(res[1].output, "5\n"));
+	assert(streq(res[2].output, "6\n"));
+
+	/* ... which are all now idle. */
+	call_all(rpc, "getblockcount", res, 3);
+	for (size_t i = 0; i < 3; i++)
+		assert(res[i].exitstatus == 0);
+	assert(!streq(res[0].output, res[1].output));
+	assert(!streq(res[1].output, res[2].output));
+	assert(!streq(res[0].output, res[2].output));
+
+	/* If the server closes them, we open new ones. */
+	call_all(rpc, "close", res, 3);
+	call_all(rpc, "getblockcount", res, 1);
+	assert(streq(res[0].output, "7\n"));
+
+	/* Even if it doesn't tell us first. */
+	call_all(rpc, "drop", res, 1);
+	assert(streq(res[0].output, "7\n"));
+	call_all(rpc, "getblockcount", res, 1);
+	assert(res[0].exitstatus == 0);
+	assert(streq(res[0].output, "8\n"));
+
+	tal_free(rpc);
+	tal_free(badrpc);
+	kill(server, SIGTERM);
+	waitpid(server, NULL, 0);
+}
+
+int main(void)
+{
+	setup_locale();
+	setup_tmpctx();
+	/* We get EPIPE instead */
+	signal(SIGPIPE, SIG_IGN);
+
+	test_request();
+	test_response();
+	test_server();
+
+	tal_free(tmpctx);
+	return 0;
+}
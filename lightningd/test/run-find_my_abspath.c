@@ -42,15 +42,25 @@ void db_begin_transaction_(struct db *db UNNEEDED, const char *location UNNEEDED
 /* Generated stub for db_close_for_fork */
 void db_close_for_fork(struct db *db UNNEEDED)
 { fprintf(stderr, "db_close_for_fork called!\n"); abort(); }
+/* Generated stub for db_commit_pending */
+bool db_commit_pending(const struct db *db UNNEEDED)
+{ fprintf(stderr, "db_commit_pending called!\n"); abort(); }
 /* Generated stub for db_commit_transaction */
 void db_commit_transaction(struct db *db UNNEEDED)
 { fprintf(stderr, "db_commit_transaction called!\n"); abort(); }
 /* Generated stub for db_get_intvar */
 s64 db_get_intvar(struct db *db UNNEEDED, char *varname UNNEEDED, s64 defval UNNEEDED)
 { fprintf(stderr, "db_get_intvar called!\n"); abort(); }
+/* Generated stub for db_group_commit */
+void db_group_commit(struct db *db UNNEEDED, struct timers *timers UNNEEDED,
+		     struct timerel delay UNNEEDED)
+{ fprintf(stderr, "db_group_commit called!\n"); abort(); }
 /* Generated stub for db_reopen_after_fork */
 void db_reopen_after_fork(struct db *db UNNEEDED)
 { fprintf(stderr, "db_reopen_after_fork called!\n"); abort(); }
+/* Generated stub for db_set_wal */
+void db_set_wal(struct db *db UNNEEDED)
+{ fprintf(stderr, "db_set_wal called!\n"); abort(); }
 /* Generated stub for fatal */
 void   fatal(const char *fmt UNNEEDED, ...)
 { fprintf(stderr, "fatal called!\n"); abort(); }
@@ -106,6 +116,9 @@ const char *log_prefix(const struct log *log UNNEEDED)
 /* Generated stub for log_status_msg */
 bool log_status_msg(struct log *log UNNEEDED, const u8 *msg UNNEEDED)
 { fprintf(stderr, "log_status_msg called!\n"); abort(); }
+/* Generated stub for new_htlc_deadlines */
+struct htlc_deadlines *new_htlc_deadlines(const tal_t *ctx UNNEEDED)
+{ fprintf(stderr, "new_htlc_deadlines called!\n"); abort(); }
 /* Generated stub for new_log */
 struct log *new_log(const tal_t *ctx UNNEEDED, struct log_book *record UNNEEDED, const char *fmt UNNEEDED, ...)
 { fprintf(stderr, "new_log called!\n"); abort(); }
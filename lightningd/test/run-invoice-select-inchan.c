@@ -51,12 +51,20 @@ void  command_fail(struct command *cmd UNNEEDED, int code UNNEEDED,
 /* Generated stub for command_failed */
 void command_failed(struct command *cmd UNNEEDED, struct json_stream *result UNNEEDED)
 { fprintf(stderr, "command_failed called!\n"); abort(); }
+/* Generated stub for command_output_full */
+bool command_output_full(const struct command *cmd UNNEEDED)
+{ fprintf(stderr, "command_output_full called!\n"); abort(); }
 /* Generated stub for command_still_pending */
 void command_still_pending(struct command *cmd UNNEEDED)
 { fprintf(stderr, "command_still_pending called!\n"); abort(); }
 /* Generated stub for command_success */
 void command_success(struct command *cmd UNNEEDED, struct json_stream *response UNNEEDED)
 { fprintf(stderr, "command_success called!\n"); abort(); }
+/* Generated stub for command_wait_output_ */
+void command_wait_output_(struct command *cmd UNNEEDED,
+			  void (*cb)(struct command *cmd UNNEEDED, void *arg) UNNEEDED,
+			  void *arg UNNEEDED)
+{ fprintf(stderr, "command_wait_output_ called!\n"); abort(); }
 /* Generated stub for connect_succeeded */
 void connect_succeeded(struct lightningd *ld UNNEEDED, const struct pubkey *id UNNEEDED)
 { fprintf(stderr, "connect_succeeded called!\n"); abort(); }
@@ -439,6 +447,10 @@ const struct invoice_details *wallet_invoice_iterator_deref(const tal_t *ctx UNN
 			      struct wallet *wallet UNNEEDED,
 			      const struct invoice_iterator *it UNNEEDED)
 { fprintf(stderr, "wallet_invoice_iterator_deref called!\n"); abort(); }
+/* Generated stub for wallet_invoice_iterator_pause */
+void wallet_invoice_iterator_pause(struct wallet *wallet UNNEEDED,
+				   struct invoice_iterator *it UNNEEDED)
+{ fprintf(stderr, "wallet_invoice_iterator_pause called!\n"); abort(); }
 /* Generated stub for wallet_invoice_waitany */
 void wallet_invoice_waitany(const tal_t *ctx UNNEEDED,
 			    struct wallet *wallet UNNEEDED,
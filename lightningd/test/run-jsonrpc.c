@@ -2,13 +2,22 @@
 #include "../jsonrpc.c"
 #include "../json.c"
 
-/* AUTOGENERATED MOCKS START */
-/* Generated stub for db_begin_transaction_ */
 void db_begin_transaction_(struct db *db UNNEEDED, const char *location UNNEEDED)
-{ fprintf(stderr, "db_begin_transaction_ called!\n"); abort(); }
-/* Generated stub for db_commit_transaction */
+{
+}
+
 void db_commit_transaction(struct db *db UNNEEDED)
-{ fprintf(stderr, "db_commit_transaction called!\n"); abort(); }
+{
+}
+
+void log_(struct log *log UNNEEDED, enum log_level level UNNEEDED, const char *fmt UNNEEDED, ...)
+{
+}
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for db_commit_pending */
+bool db_commit_pending(const struct db *db UNNEEDED)
+{ fprintf(stderr, "db_commit_pending called!\n"); abort(); }
 /* Generated stub for fatal */
 void   fatal(const char *fmt UNNEEDED, ...)
 { fprintf(stderr, "fatal called!\n"); abort(); }
@@ -31,10 +40,6 @@ const struct chainparams *get_chainparams(const struct lightningd *ld UNNEEDED)
 bool json_feerate_estimate(struct command *cmd UNNEEDED,
 			   u32 **feerate_per_kw UNNEEDED, enum feerate feerate UNNEEDED)
 { fprintf(stderr, "json_feerate_estimate called!\n"); abort(); }
-/* Generated stub for log_ */
-void log_(struct log *log UNNEEDED, enum log_level level UNNEEDED, const char *fmt UNNEEDED, ...)
-
-{ fprintf(stderr, "log_ called!\n"); abort(); }
 /* Generated stub for log_io */
 void log_io(struct log *log UNNEEDED, enum log_level dir UNNEEDED, const char *comment UNNEEDED,
 	    const void *data UNNEEDED, size_t len UNNEEDED)
@@ -214,7 +219,449 @@ static void test_json_stream(void)
 	tal_free(talstr);
 }
 
-int main(void)
+/* Feed it a byte at a time, as the worst case. */
+static void test_json_parser(void)
+{
+	const char *input = "{\"x\":\"x\"}{\"y\":[1,2]} {\"z\":\"z";
+	struct json_parser *p = json_parser_new(NULL);
+	const jsmntok_t *toks;
+	bool valid;
+	size_t len;
+
+	for (len = 0; len < strlen("{\"x\":\"x\"}"); len++) {
+		assert(!json_parser_next(p, input, len, &valid));
+		assert(valid);
+		assert(json_parser_discard(p) == 0);
+	}
+	toks = json_parser_next(p, input, len, &valid);
+	assert(toks);
+	assert(toks[0].type == JSMN_OBJECT);
+	assert(toks[0].start == 0 && toks[0].end == 9);
+	assert(json_get_member(input, toks, "x"));
+	/* Last one is always referenceable. */
+	assert(json_next(toks)->type == -1);
+
+	/* Nothing left, so can discard it all. */
+	assert(json_parser_discard(p) == 9);
+	input += 9;
+
+	/* Now the rest arrive at once: we get one at a time. */
+	len = strlen(input);
+	toks = json_parser_next(p, input, len, &valid);
+	assert(toks);
+	assert(toks[0].start == 0 && toks[0].end == 11);
+	assert(json_get_member(input, toks, "y")->size == 2);
+	/* Third one's not finished, but we're done with the first two. */
+	assert(json_parser_discard(p) == 12);
+	input += 12;
+	len -= 12;
+	assert(!json_parser_next(p, input, len, &valid));
+	assert(valid);
+	assert(json_parser_discard(p) == 0);
+
+	/* Finish it off. */
+	input = tal_fmt(p, "%s\"}  ", input);
+	len = strlen(input);
+	toks = json_parser_next(p, input, len, &valid);
+	assert(toks);
+	assert(toks[0].start == 0 && toks[0].end == 9);
+	assert(json_get_member(input, toks, "z"));
+	assert(!json_parser_next(p, input, len, &valid));
+	assert(valid);
+	assert(json_parser_discard(p) == len);
+
+	/* Invalid is invalid. */
+	assert(!json_parser_next(p, "{]", 2, &valid));
+	assert(!valid);
+	tal_free(p);
+}
+
+/* A client which pipelines always has part of a request pending. */
+static void test_json_parser_pipelined(void)
+{
+	const char *req = "{\"id\":1,\"params\":[\"a\",{\"b\":2}]}";
+	size_t half = strlen(req) / 2, rest = strlen(req) - half;
+	struct json_parser *p = json_parser_new(NULL);
+	char *buf = tal_arr(p, char, 0);
+	const jsmntok_t *toks;
+	size_t used, discard;
+	bool valid;
+
+	/* Start with half a request. */
+	tal_resize(&buf, half);
+	memcpy(buf, req, half);
+	used = half;
+	assert(!json_parser_next(p, buf, used, &valid));
+	assert(valid);
+
+	for (size_t i = 0; i < 1000; i++) {
+		/* The rest of that one arrives, with half the next. */
+		tal_resize(&buf, used + rest + half);
+		memcpy(buf + used, req + half, rest);
+		memcpy(buf + used + rest, req, half);
+		used += rest + half;
+
+		toks = json_parser_next(p, buf, used, &valid);
+		assert(toks);
+		assert(toks[0].end - toks[0].start == strlen(req));
+		assert(json_get_member(buf, toks, "params")->size == 2);
+		assert(!json_parser_next(p, buf, used, &valid));
+		assert(valid);
+
+		/* Only the partial one is kept. */
+		discard = json_parser_discard(p);
+		memmove(buf, buf + discard, used - discard);
+		used -= discard;
+		assert(used == half);
+		/* And the tokens don't pile up either. */
+		assert(p->jsmn.toknext < 10);
+	}
+	tal_free(p);
+}
+
+static struct command *output_cmd(const tal_t *ctx, bool compact)
+{
+	struct command *cmd = talz(ctx, struct command);
+
+	cmd->jcon = talz(cmd, struct json_connection);
+	cmd->jcon->lock = io_lock_new(cmd->jcon);
+	membuf_init(&cmd->jcon->outbuf,
+		    tal_arr(cmd, char, 64), 64, membuf_tal_realloc);
+	cmd->compact = compact;
+	return cmd;
+}
+
+static const char *output_of(struct command *cmd)
+{
+	return tal_strndup(cmd, membuf_elems(&cmd->jcon->outbuf),
+			   membuf_num_elems(&cmd->jcon->outbuf));
+}
+
+static void add_values(struct json_stream *result)
+{
+	struct short_channel_id scid;
+	u8 bytes[] = { 0x00, 0x01, 0xab, 0xff };
+
+	json_object_start(result, NULL);
+	json_add_num(result, "zero", 0);
+	json_add_num(result, "num", UINT_MAX);
+	json_add_u64(result, "u64", UINT64_MAX);
+	json_add_hex(result, "hex", bytes, sizeof(bytes));
+	json_add_hex(result, "empty", NULL, 0);
+	json_array_start(result, "scids");
+	mk_short_channel_id(&scid, 0, 0, 0);
+	json_add_short_channel_id(result, NULL, &scid);
+	mk_short_channel_id(&scid, 0xFFFFFF, 0xFFFFFF, 0xFFFF);
+	json_add_short_channel_id(result, NULL, &scid);
+	json_array_end(result);
+	json_object_start(result, "empty");
+	json_object_end(result);
+	json_add_string(result, "str", "a \"b\"");
+	json_add_literal(result, "lit", "nullxxx", 4);
+	json_add_bool(result, "bool", false);
+	json_object_end(result);
+}
+
+static void test_json_compact(void)
+{
+	struct command *pretty = output_cmd(NULL, false);
+	struct command *compact = output_cmd(pretty, true);
+
+	/* Stream is created before jcon is connected, so no "result". */
+	add_values(new_json_stream(pretty));
+	add_values(new_json_stream(compact));
+
+	assert(streq(output_of(pretty),
+		     "\n{\n"
+		     "  \"zero\": 0, \n"
+		     "  \"num\": 4294967295, \n"
+		     "  \"u64\": 18446744073709551615, \n"
+		     "  \"hex\": \"0001abff\", \n"
+		     "  \"empty\": \"\", \n"
+		     "  \"scids\": [\n"
+		     "    \"0:0:0\", \n"
+		     "    \"16777215:16777215:65535\"\n"
+		     "  ], \n"
+		     "  \"empty\": {\n"
+		     "  }, \n"
+		     "  \"str\": \"a \\\"b\\\"\", \n"
+		     "  \"lit\": null, \n"
+		     "  \"bool\": false\n"
+		     "}"));
+	assert(streq(output_of(compact),
+		     "{\"zero\":0,\"num\":4294967295,"
+		     "\"u64\":18446744073709551615,"
+		     "\"hex\":\"0001abff\",\"empty\":\"\","
+		     "\"scids\":[\"0:0:0\",\"16777215:16777215:65535\"],"
+		     "\"empty\":{},\"str\":\"a \\\"b\\\"\","
+		     "\"lit\":null,\"bool\":false}"));
+
+	/* Nothing happens if they've disconnected. */
+	compact->jcon = NULL;
+	compact->have_json_stream = false;
+	add_values(new_json_stream(compact));
+	tal_free(pretty);
+}
+
+/* Like listpayments: fetches a batch at a time, by id. */
+struct number_stream {
+	struct json_stream *response;
+	u64 after_id, max;
+	size_t pauses;
+	bool *freed;
+};
+
+static void destroy_number_stream(struct number_stream *ns)
+{
+	*ns->freed = true;
+}
+
+static void json_add_numbers(struct command *cmd, struct number_stream *ns)
+{
+	size_t n;
+
+	do {
+		for (n = 0; n < JSONRPC_STREAM_BATCH && ns->after_id < ns->max; n++) {
+			json_object_start(ns->response, NULL);
+			json_add_u64(ns->response, "id", ++ns->after_id);
+			json_add_string(ns->response, "padding",
+					"0123456789012345678901234567890123456789");
+			json_object_end(ns->response);
+		}
+
+		if (n == JSONRPC_STREAM_BATCH && command_output_full(cmd)) {
+			ns->pauses++;
+			command_wait_output(cmd, json_add_numbers, ns);
+			return;
+		}
+	} while (n == JSONRPC_STREAM_BATCH);
+
+	json_array_end(ns->response);
+	json_object_end(ns->response);
+	command_success(cmd, ns->response);
+}
+
+static struct number_stream *start_numbers(struct json_connection *jcon,
+					   u64 max, bool *freed)
+{
+	struct command *cmd = talz(jcon->ld, struct command);
+	struct number_stream *ns = tal(cmd, struct number_stream);
+
+	cmd->ld = jcon->ld;
+	cmd->jcon = jcon;
+	jcon->command = cmd;
+	tal_add_destructor(cmd, destroy_command);
+
+	ns->after_id = 0;
+	ns->max = max;
+	ns->pauses = 0;
+	ns->freed = freed;
+	*freed = false;
+	tal_add_destructor(ns, destroy_number_stream);
+
+	ns->response = json_stream_success(cmd);
+	json_object_start(ns->response, NULL);
+	json_array_start(ns->response, "numbers");
+	json_add_numbers(cmd, ns);
+	return ns;
+}
+
+/* What write_json_done() does once the client has read it all. */
+static const char *client_reads(struct json_connection *jcon)
+{
+	size_t len = membuf_num_elems(&jcon->outbuf);
+	const char *str = tal_strndup(jcon->ld, membuf_elems(&jcon->outbuf),
+				      len);
+
+	/* We stop not long after the highwater mark. */
+	assert(len < 2 * JSONRPC_OUTPUT_HIGHWATER);
+
+	jcon->out_amount = len;
+	membuf_consume(&jcon->outbuf, jcon->out_amount);
+	if (jcon->command && jcon->command->drained
+	    && !membuf_num_elems(&jcon->outbuf))
+		command_drained(jcon->command);
+	return str;
+}
+
+static void test_json_stream_pause(void)
+{
+	struct lightningd *ld = talz(NULL, struct lightningd);
+	struct json_connection *jcon = talz(ld, struct json_connection);
+	struct number_stream *ns;
+	const jsmntok_t *toks, *numbers, *t;
+	char *output;
+	bool valid, freed;
+	u64 num = 20000, id;
+	size_t reads = 0;
+
+	ld->wallet = talz(ld, struct wallet);
+	jcon->ld = ld;
+	jcon->lock = io_lock_new(jcon);
+	membuf_init(&jcon->outbuf,
+		    tal_arr(jcon, char, 64), 64, membuf_tal_realloc);
+	tal_add_destructor(jcon, destroy_jcon);
+
+	/* It stops until the client catches up. */
+	ns = start_numbers(jcon, num, &freed);
+	assert(ns->pauses == 1);
+	assert(!freed);
+	assert(jcon->command->drained);
+	assert(membuf_num_elems(&jcon->outbuf) > JSONRPC_OUTPUT_HIGHWATER);
+
+	/* A "result" object, so wrap it to parse it. */
+	output = tal_strdup(ld, "{");
+	while (jcon->command) {
+		tal_append_fmt(&output, "%s", client_reads(jcon));
+		reads++;
+	}
+	tal_append_fmt(&output, "%s", client_reads(jcon));
+	assert(freed);
+	assert(reads > 2);
+
+	/* Every one exactly once, in order. */
+	toks = json_parse_input(output, strlen(output), &valid);
+	assert(valid && toks);
+	numbers = json_get_member(output, json_get_member(output, toks, "result"),
+				  "numbers");
+	assert(numbers->size == num);
+	t = numbers + 1;
+	for (id = 1; id <= num; id++) {
+		u64 n;
+		assert(json_to_u64(output, json_get_member(output, t, "id"), &n));
+		assert(n == id);
+		t = json_next(t);
+	}
+
+	/* Client disconnects while it's paused: it's freed. */
+	ns = start_numbers(jcon, num, &freed);
+	assert(ns->pauses == 1);
+	assert(!freed);
+	client_reads(jcon);
+	assert(ns->pauses == 2);
+	assert(!freed);
+	tal_free(jcon);
+	assert(freed);
+
+	tal_free(ld);
+}
+
+/* Roughly what listinvoices outputs for each invoice. */
+static void add_invoice(struct json_stream *response, u64 i)
+{
+	u8 hash[32], id[PUBKEY_DER_LEN];
+	struct short_channel_id scid;
+
+	memset(hash, i, sizeof(hash));
+	memset(id, i, sizeof(id));
+	mk_short_channel_id(&scid, 500000 + i, i % 2000, i % 4);
+	json_object_start(response, NULL);
+	json_add_string(response, "label", "some invoice label");
+	json_add_string(response, "bolt11",
+			"lnbc1pvjluezpp5qqqsyqcyq5rqwzqfqqqsyqcyq5rqwzqfqqqsyqcyq5rqwzqfqypqdpl2pkx2ctnv5sxxmmwwd5kgetjypeh2ursdae8g6twvus8g6rfwvs8qun0dfjkxaq8rkx3yf5tcsyz3d73gafnh3cax9rn449d9p5uxz9ezhhypd0elx87sjle52x86fux2ypatgddc6k63n7erqz25le42c4u4ecky03ylcqca784w");
+	json_add_hex(response, "payment_hash", hash, sizeof(hash));
+	/* What json_add_pubkey does, without needing secp256k1. */
+	json_add_hex(response, "payee", id, sizeof(id));
+	json_add_short_channel_id(response, "short_channel_id", &scid);
+	json_add_u64(response, "msatoshi", 1000000 + i);
+	json_add_string(response, "status", "paid");
+	json_add_u64(response, "pay_index", i);
+	json_add_u64(response, "msatoshi_received", 1000000 + i);
+	json_add_u64(response, "paid_at", 1540000000 + i);
+	json_add_u64(response, "expires_at", 1540003600 + i);
+	json_object_end(response);
+}
+
+static void bench_json_output(size_t num)
+{
+	for (int compact = 0; compact < 2; compact++) {
+		struct command *cmd = output_cmd(NULL, compact);
+		struct json_stream *response = new_json_stream(cmd);
+		struct timemono start = time_mono();
+		struct timerel t;
+
+		json_object_start(response, NULL);
+		json_array_start(response, "invoices");
+		for (size_t i = 0; i < num; i++)
+			add_invoice(response, i);
+		json_array_end(response);
+		json_object_end(response);
+		t = timemono_since(start);
+
+		printf("%zu invoices %s: %zu bytes in %"PRIu64" usec"
+		       " (%"PRIu64" nsec per invoice)\n",
+		       num, compact ? "compact" : "indented",
+		       membuf_num_elems(&cmd->jcon->outbuf),
+		       time_to_usec(t),
+		       time_to_nsec(time_divide(t, num)));
+		tal_free(cmd);
+	}
+}
+
+/* Something like a sendpay with a very long route. */
+static char *big_request(const tal_t *ctx, size_t size)
+{
+	char *req = tal_strdup(ctx, "{\"method\":\"sendpay\",\"id\":1,"
+			       "\"params\":[[");
+
+	while (strlen(req) < size)
+		tal_append_fmt(&req, "{\"id\":\"02%064x\","
+			       "\"channel\":\"%zux1x0\","
+			       "\"msatoshi\":%zu,\"delay\":9},",
+			       0, strlen(req), size);
+	req[strlen(req)-1] = ']';
+	tal_append_fmt(&req, ",\"%064x\"]}", 0);
+	return req;
+}
+
+static void bench_json_parser(size_t size, size_t chunk)
+{
+	char *req = big_request(NULL, size);
+	size_t len = strlen(req), ntoks;
+	struct json_parser *p = json_parser_new(req);
+	struct timemono start;
+	struct timerel old, incr;
+	const jsmntok_t *toks;
+	bool valid;
+
+	/* What we used to do: reparse everything on every read. */
+	start = time_mono();
+	for (size_t used = chunk;; used += chunk) {
+		jsmntok_t *t;
+		if (used > len)
+			used = len;
+		t = json_parse_input(req, used, &valid);
+		assert(valid);
+		if (t) {
+			assert(used == len);
+			ntoks = tal_count(t);
+			tal_free(t);
+			break;
+		}
+	}
+	old = timemono_since(start);
+
+	start = time_mono();
+	for (size_t used = chunk;; used += chunk) {
+		if (used > len)
+			used = len;
+		toks = json_parser_next(p, req, used, &valid);
+		assert(valid);
+		if (toks) {
+			assert(used == len);
+			break;
+		}
+	}
+	incr = timemono_since(start);
+
+	assert(json_next(toks) - toks == ntoks - 1);
+	printf("Parsed %zu bytes (%zu tokens) in %zu byte reads:"
+	       " %"PRIu64" usec reparsing, %"PRIu64" usec incrementally\n",
+	       len, ntoks - 1, chunk, time_to_usec(old), time_to_usec(incr));
+	tal_free(req);
+}
+
+int main(int argc, char *argv[])
 {
 	setup_locale();
 
@@ -222,6 +669,15 @@ int main(void)
 	test_json_escape();
 	test_json_partial();
 	test_json_stream();
+	test_json_parser();
+	test_json_parser_pipelined();
+	test_json_compact();
+	test_json_stream_pause();
+	/* Small by default for make check: try 2097152 8192. */
+	bench_json_parser(argc > 1 ? atol(argv[1]) : 16384,
+			  argc > 2 ? atol(argv[2]) : 1024);
+	/* Try 100000. */
+	bench_json_output(argc > 3 ? atol(argv[3]) : 100);
 	assert(!taken_any());
 	take_cleanup();
 }
@@ -1151,6 +1151,8 @@ int main(int argc, char *argv[])
 
 	msg = NULL;
 	while (!msg) {
+		/* Send any gossip we queued before we sleep. */
+		sync_crypto_flush(PEER_FD);
 		poll(pollfd, ARRAY_SIZE(pollfd), -1);
 		/* Subtle: handle_master_in can do its own poll loop, so
 		 * don't try to service more than one fd per loop. */
@@ -1165,6 +1167,7 @@ int main(int argc, char *argv[])
 	}
 
 	/* Write message and hand back the fd. */
+	sync_crypto_flush(PEER_FD);
 	wire_sync_write(REQ_FD, msg);
 	fdpass_send(REQ_FD, PEER_FD);
 	fdpass_send(REQ_FD, GOSSIP_FD);
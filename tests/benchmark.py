@@ -4,8 +4,10 @@ from time import time
 from tqdm import tqdm
 
 
+import os
 import pytest
 import random
+import subprocess
 
 
 num_workers = 480
@@ -106,3 +108,24 @@ def test_pay(node_factory, benchmark):
 
 def test_start(node_factory, benchmark):
     benchmark(node_factory.get_node)
+
+
+def test_initial_sync(node_factory):
+    """Time a peer doing initial sync of a large gossip_store"""
+    l1 = node_factory.get_node(start=False)
+    out = subprocess.run(['devtools/create-gossipstore',
+                          '--channels=20000',
+                          os.path.join(l1.daemon.lightning_dir, 'gossip_store')],
+                         check=True, stdout=subprocess.PIPE).stdout
+    num_msgs = int(out.decode('ascii'))
+    l1.start()
+
+    start = time()
+    out = subprocess.run(['devtools/gossipwith',
+                          '--initial-sync',
+                          '--stats',
+                          '--max-messages={}'.format(num_msgs),
+                          '{}@localhost:{}'.format(l1.info['id'], l1.port)],
+                         check=True, stderr=subprocess.PIPE).stderr
+    print("{} gossip messages in {:.2f} seconds: {}"
+          .format(num_msgs, time() - start, out.decode('ascii').strip()))
@@ -250,6 +250,44 @@ def test_connect_by_gossip(node_factory, bitcoind):
     l1.rpc.connect(l3.info['id'])
 
 
+@unittest.skipIf(not DEVELOPER, "DEVELOPER=1 needed to speed up gossip propagation, would be too long otherwise")
+def test_listchannels_filters(node_factory):
+    l1, l2, l3 = node_factory.line_graph(3, announce=True)
+    wait_for(lambda: len(l1.rpc.listchannels()['channels']) == 4)
+
+    full = l1.rpc.listchannels()
+    assert 'after' not in full
+    scids = set(c['short_channel_id'] for c in full['channels'])
+    assert len(scids) == 2
+
+    # Both halves of a channel count as one.
+    page1 = l1.rpc.listchannels(limit=1)
+    assert len(page1['channels']) == 2
+    assert page1['after'] == page1['channels'][0]['short_channel_id']
+    page2 = l1.rpc.listchannels(after=page1['after'], limit=1)
+    assert len(page2['channels']) == 2
+    assert 'after' not in page2
+    assert set(c['short_channel_id'] for c in page1['channels'] + page2['channels']) == scids
+
+    chans = l1.rpc.listchannels(source=l2.info['id'])['channels']
+    assert len(chans) == 2
+    assert all(c['source'] == l2.info['id'] for c in chans)
+    assert l1.rpc.listchannels(source=l1.info['id'], limit=1)['channels'][0]['destination'] == l2.info['id']
+
+    assert len(l1.rpc.listchannels(active_only=True)['channels']) == 4
+    assert l1.rpc.listchannels(since=2**32 - 1)['channels'] == []
+
+    # Nothing has changed since last time.
+    assert l1.rpc.listchannels(changed_since=full['broadcast_index'])['channels'] == []
+    nodes = l1.rpc.listnodes()
+    assert len(nodes['nodes']) == 3
+    assert l1.rpc.listnodes(changed_since=nodes['broadcast_index'])['nodes'] == []
+    assert l1.rpc.listnodes(since=2**32 - 1)['nodes'] == []
+
+    # But everything has changed since the start.
+    assert len(l1.rpc.listchannels(changed_since=1)['channels']) == 4
+
+
 @unittest.skipIf(not DEVELOPER, "DEVELOPER=1 needed to speed up gossip propagation, would be too long otherwise")
 def test_gossip_jsonrpc(node_factory):
     l1, l2 = node_factory.line_graph(2, fundchannel=True, announce=False)
@@ -838,7 +876,7 @@ def test_gossip_store_load(node_factory):
 
     l1.start()
     # May preceed the Started msg waited for in 'start'.
-    wait_for(lambda: l1.daemon.is_in_log('gossip_store: Read 1/1/1/0 cannounce/cupdate/nannounce/cdelete from store in 744 bytes'))
+    wait_for(lambda: l1.daemon.is_in_log('gossip_store: Read 1/1/1/0 cannounce/cupdate/nannounce/cdelete from store in 756 bytes'))
     assert not l1.daemon.is_in_log('gossip_store.*truncating')
 
 
@@ -941,3 +979,42 @@ def test_gossip_notices_close(node_factory, bitcoind):
     l1.start()
     assert(l1.rpc.listchannels()['channels'] == [])
     assert(l1.rpc.listnodes()['nodes'] == [])
+
+
+@unittest.skipIf(not DEVELOPER, "needs dev-gossip-queues")
+def test_gossip_batches(node_factory):
+    """Initial sync of more than one (64k) batch of gossip"""
+    l1 = node_factory.get_node(start=False)
+    out = subprocess.run(['devtools/create-gossipstore',
+                          '--channels=500',
+                          os.path.join(l1.daemon.lightning_dir, 'gossip_store')],
+                         check=True, timeout=TIMEOUT,
+                         stdout=subprocess.PIPE).stdout
+    num_msgs = int(out.decode('ascii'))
+    l1.start()
+
+    # Stays connected until we kill it, so we can ask about it.
+    proc = subprocess.Popen(['devtools/gossipwith',
+                             '--initial-sync',
+                             '{}@localhost:{}'.format(l1.info['id'], l1.port)],
+                            stdout=subprocess.PIPE)
+
+    msgs = set()
+    num_bytes = 0
+    for i in range(num_msgs):
+        length = struct.unpack('>H', proc.stdout.read(2))[0]
+        msg = proc.stdout.read(length)
+        # channel_announcement node_announcement or channel_update
+        assert struct.unpack('>H', msg[0:2])[0] in [256, 257, 258]
+        msgs.add(msg)
+        num_bytes += length
+    # Every message arrived, once.
+    assert len(msgs) == num_msgs
+    assert num_bytes > 65535
+
+    peer = only_one(l1.rpc.call('dev-gossip-queues')['peers'])
+    assert peer['sent'] == num_msgs
+    assert peer['batches'] < peer['sent']
+
+    proc.kill()
+    proc.wait()
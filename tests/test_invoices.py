@@ -4,6 +4,7 @@ from utils import only_one, DEVELOPER, wait_for, wait_channel_quiescent
 
 
 import pytest
+import socket
 import time
 import unittest
 
@@ -229,6 +230,33 @@ def test_invoice_expiry(node_factory, executor):
     assert len(l2.rpc.listinvoices()['invoices']) == 0
 
 
+def test_listinvoices_streaming(node_factory):
+    """More than JSONRPC_OUTPUT_HIGHWATER of invoices is streamed in pieces"""
+    l1 = node_factory.get_node()
+
+    # Long descriptions make for long bolt11s too: ~600k of output.
+    num = 300
+    for i in range(num):
+        l1.rpc.invoice(msatoshi=1000 + i, label='inv{}'.format(i),
+                       description='x' * 600)
+
+    # Every one, exactly once.
+    invoices = l1.rpc.listinvoices()['invoices']
+    assert sorted([i['label'] for i in invoices]) == sorted(['inv{}'.format(i) for i in range(num)])
+    assert sorted([i['msatoshi'] for i in invoices]) == list(range(1000, 1000 + num))
+
+    # Client goes away before it's read it all.
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(l1.rpc.socket_path)
+    sock.sendall(b'{"id":1,"jsonrpc":"2.0","method":"listinvoices","params":[]}')
+    sock.recv(1024)
+    sock.close()
+
+    # Still works (and memleak check at the end makes sure it was freed).
+    assert len(l1.rpc.listinvoices()['invoices']) == num
+    assert len(l1.rpc.listinvoices('inv7')['invoices']) == 1
+
+
 @unittest.skipIf(not DEVELOPER, "Too slow without --dev-bitcoind-poll")
 def test_waitinvoice(node_factory, executor):
     """Test waiting for one invoice will not return if another invoice is paid.
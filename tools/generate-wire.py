@@ -34,6 +34,8 @@ varlen_structs = [
     'peer_features',
     'gossip_getnodes_entry',
     'failed_htlc',
+    'peeled_htlc',
+    'unsigned_htlc_tx',
     'utxo',
     'bitcoin_tx',
     'wirestring',
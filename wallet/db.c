@@ -1,6 +1,12 @@
 #include "db.h"
 
+#include <ccan/crypto/siphash24/siphash24.h>
+#include <ccan/htable/htable_type.h>
+#include <ccan/io/io.h>
 #include <ccan/tal/str/str.h>
+#include <common/memleak.h>
+#include <common/pseudorand.h>
+#include <common/timeout.h>
 #include <common/version.h>
 #include <inttypes.h>
 #include <lightningd/json_escaped.h>
@@ -416,25 +422,150 @@ void db_assert_no_outstanding_statements(void)
 }
 #endif
 
+/* Almost every location prepares the same SQL every time, and the hot ones
+ * (eg. HTLC updates) would otherwise be parsed and planned every time. */
+struct cached_stmt {
+	/* The __FILE__:__LINE__ string literal it was prepared at. */
+	const char *location;
+	const char *query;
+	sqlite3_stmt *stmt;
+	/* Handed out, and not yet db_stmt_done()? */
+	bool in_use;
+};
+
+static size_t hash_ptr(const void *p)
+{
+	return siphash24(siphash_seed(), &p, sizeof(p));
+}
+
+static const char *cached_stmt_location(const struct cached_stmt *c)
+{
+	return c->location;
+}
+
+static bool cached_stmt_location_eq(const struct cached_stmt *c,
+				    const char *location)
+{
+	return c->location == location;
+}
+
+HTABLE_DEFINE_TYPE(struct cached_stmt, cached_stmt_location, hash_ptr,
+		   cached_stmt_location_eq, stmt_cache);
+
+static const sqlite3_stmt *cached_stmt_stmt(const struct cached_stmt *c)
+{
+	return c->stmt;
+}
+
+static bool cached_stmt_stmt_eq(const struct cached_stmt *c,
+				const sqlite3_stmt *stmt)
+{
+	return c->stmt == stmt;
+}
+
+HTABLE_DEFINE_TYPE(struct cached_stmt, cached_stmt_stmt, hash_ptr,
+		   cached_stmt_stmt_eq, cached_stmt_map);
+
+/* db_stmt_done() has no db either, so this is global too. */
+static struct cached_stmt_map cached_stmts
+= { HTABLE_INITIALIZER(cached_stmts.raw, cached_stmt_map_hash, NULL) };
+
+static void destroy_stmt_cache(struct stmt_cache *cache)
+{
+	stmt_cache_clear(cache);
+}
+
+static struct stmt_cache *new_stmt_cache(struct db *db)
+{
+	struct stmt_cache *cache = tal(db, struct stmt_cache);
+
+	stmt_cache_init(cache);
+	tal_add_destructor(cache, destroy_stmt_cache);
+	return cache;
+}
+
+/* Finalize them all: sqlite3_close() fails if any are left. */
+static void db_stmt_cache_flush(struct db *db)
+{
+	struct stmt_cache_iter it;
+	struct cached_stmt *c;
+
+	for (c = stmt_cache_first(db->stmt_cache, &it);
+	     c;
+	     c = stmt_cache_next(db->stmt_cache, &it)) {
+		assert(!c->in_use);
+		cached_stmt_map_del(&cached_stmts, c);
+		sqlite3_finalize(c->stmt);
+		tal_free(c);
+	}
+	stmt_cache_clear(db->stmt_cache);
+	stmt_cache_init(db->stmt_cache);
+}
+
+size_t db_stmt_cache_count(const struct db *db)
+{
+	return db->stmt_cache->raw.elems;
+}
+
 void db_stmt_done(sqlite3_stmt *stmt)
 {
+	struct cached_stmt *c = cached_stmt_map_get(&cached_stmts, stmt);
+
 	dev_statement_end(stmt);
-	sqlite3_finalize(stmt);
+	if (!c) {
+		sqlite3_finalize(stmt);
+		return;
+	}
+
+	/* This also releases any locks it held, as finalize would. */
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	c->in_use = false;
 }
 
 sqlite3_stmt *db_prepare_(const char *location, struct db *db, const char *query)
 {
 	int err;
 	sqlite3_stmt *stmt;
+	struct cached_stmt *c;
 
 	assert(db->in_transaction);
 
+	c = stmt_cache_get(db->stmt_cache, location);
+	if (c && !c->in_use && streq(c->query, query)) {
+		db->stmt_cache_hits++;
+		c->in_use = true;
+		dev_statement_start(c->stmt, location);
+		return c->stmt;
+	}
+	db->stmt_cache_misses++;
+
 	err = sqlite3_prepare_v2(db->sql, query, -1, &stmt, NULL);
 
 	if (err != SQLITE_OK)
 		db_fatal("%s: %s: %s", location, query, sqlite3_errmsg(db->sql));
 
 	dev_statement_start(stmt, location);
+
+	/* If this location's is busy (we're nested), don't cache this one */
+	if (!stmt || (c && c->in_use))
+		return stmt;
+
+	if (c) {
+		/* Same place, different query: newest wins. */
+		cached_stmt_map_del(&cached_stmts, c);
+		sqlite3_finalize(c->stmt);
+		tal_free(c->query);
+	} else {
+		/* Only pointed to by the htables. */
+		c = notleak(tal(db->stmt_cache, struct cached_stmt));
+		c->location = location;
+		stmt_cache_add(db->stmt_cache, c);
+	}
+	c->query = tal_strdup(c, query);
+	c->stmt = stmt;
+	c->in_use = true;
+	cached_stmt_map_add(&cached_stmts, c);
 	return stmt;
 }
 
@@ -514,9 +645,26 @@ sqlite3_stmt *PRINTF_FMT(3, 4)
 	return stmt;
 }
 
+/* Commit everything (caller must not be in a transaction). */
+static void db_commit_pending_now(struct db *db)
+{
+	assert(!db->in_transaction);
+	if (!db->commit_pending)
+		return;
+
+	db_do_exec(__func__, db, "COMMIT;");
+	db->commit_pending = false;
+	db->commit_timer = tal_free(db->commit_timer);
+	io_wake(db);
+}
+
 static void destroy_db(struct db *db)
 {
 	db_assert_no_outstanding_statements();
+	db_stmt_cache_flush(db);
+	/* Don't lose things we said were committed. */
+	if (db->commit_pending && !db->in_transaction)
+		db_do_exec(__func__, db, "COMMIT;");
 	sqlite3_close(db->sql);
 }
 
@@ -525,16 +673,79 @@ void db_begin_transaction_(struct db *db, const char *location)
 	if (db->in_transaction)
 		db_fatal("Already in transaction from %s", db->in_transaction);
 
-	db_do_exec(location, db, "BEGIN TRANSACTION;");
+	/* If a commit is pending, we simply join that transaction. */
+	if (!db->commit_pending)
+		db_do_exec(location, db, "BEGIN TRANSACTION;");
 	db->in_transaction = location;
 }
 
+static void db_commit_timeout(struct db *db)
+{
+	/* timer_expired() has stolen it onto tmpctx. */
+	db->commit_timer = NULL;
+
+	/* lightningd runs timers inside a transaction: commit at its end. */
+	if (db->in_transaction)
+		db->commit_now = true;
+	else
+		db_commit_pending_now(db);
+}
+
 void db_commit_transaction(struct db *db)
 {
 	assert(db->in_transaction);
 	db_assert_no_outstanding_statements();
-	db_exec(__func__, db, "COMMIT;");
 	db->in_transaction = NULL;
+
+	db->commit_pending = true;
+	if (!db->timers || db->commit_now) {
+		db->commit_now = false;
+		db_commit_pending_now(db);
+	} else if (!db->commit_timer)
+		db->commit_timer = new_reltimer(db->timers, db,
+						db->commit_delay,
+						db_commit_timeout, db);
+}
+
+void db_group_commit(struct db *db, struct timers *timers,
+		     struct timerel delay)
+{
+	assert(!db->in_transaction);
+	db->timers = timers;
+	db->commit_delay = delay;
+	if (!timers)
+		db_commit_pending_now(db);
+}
+
+bool db_commit_pending(const struct db *db)
+{
+	return db->commit_pending;
+}
+
+void db_commit_immediately(struct db *db)
+{
+	assert(db->in_transaction);
+	db->commit_now = true;
+}
+
+void db_set_wal(struct db *db)
+{
+	sqlite3_stmt *stmt;
+	const char *mode;
+
+	/* This replies with the new mode, which tells us if it worked. */
+	if (sqlite3_prepare_v2(db->sql, "PRAGMA journal_mode = WAL;", -1,
+			       &stmt, NULL) != SQLITE_OK
+	    || sqlite3_step(stmt) != SQLITE_ROW)
+		db_fatal("Setting journal_mode: %s", sqlite3_errmsg(db->sql));
+	mode = (const char *)sqlite3_column_text(stmt, 0);
+	if (!mode || !streq(mode, "wal"))
+		db_fatal("Could not set journal_mode to wal: got %s", mode);
+	sqlite3_finalize(stmt);
+
+	/* We leave synchronous at its default (FULL), which syncs the log
+	 * on every commit: NORMAL would be faster, but can lose the last
+	 * commits on power failure, and we can't afford that. */
 }
 
 /**
@@ -563,6 +774,11 @@ static struct db *db_open(const tal_t *ctx, char *filename)
 	db->sql = sql;
 	tal_add_destructor(db, destroy_db);
 	db->in_transaction = NULL;
+	db->timers = NULL;
+	db->commit_pending = db->commit_now = false;
+	db->commit_timer = NULL;
+	db->stmt_cache = new_stmt_cache(db);
+	db->stmt_cache_hits = db->stmt_cache_misses = 0;
 	db_do_exec(__func__, db, "PRAGMA foreign_keys = ON;");
 
 	return db;
@@ -661,6 +877,8 @@ void db_close_for_fork(struct db *db)
 	 *
 	 * Under Unix, you should not carry an open SQLite database across a
 	 * fork() system call into the child process. */
+	db_commit_pending_now(db);
+	db_stmt_cache_flush(db);
 	if (sqlite3_close(db->sql) != SQLITE_OK)
 		db_fatal("sqlite3_close: %s", sqlite3_errmsg(db->sql));
 	db->sql = NULL;
@@ -8,16 +8,35 @@
 #include <bitcoin/tx.h>
 #include <ccan/short_types/short_types.h>
 #include <ccan/tal/tal.h>
+#include <ccan/time/time.h>
 #include <secp256k1_ecdh.h>
 #include <sqlite3.h>
 #include <stdbool.h>
 
 struct log;
+struct oneshot;
+struct stmt_cache;
+struct timers;
 
 struct db {
 	char *filename;
 	const char *in_transaction;
 	sqlite3 *sql;
+
+	/* If set, we group commits: see db_group_commit(). */
+	struct timers *timers;
+	struct timerel commit_delay;
+
+	/* Transactions have been "committed" but sqlite's is still open. */
+	bool commit_pending;
+	/* Commit for real at the end of this transaction. */
+	bool commit_now;
+	/* Bounds how long commit_pending can last. */
+	struct oneshot *commit_timer;
+
+	/* Statements we keep prepared, by location: see db_prepare(). */
+	struct stmt_cache *stmt_cache;
+	u64 stmt_cache_hits, stmt_cache_misses;
 };
 
 /**
@@ -58,6 +77,47 @@ void db_begin_transaction_(struct db *db, const char *location);
  */
 void db_commit_transaction(struct db *db);
 
+/**
+ * db_group_commit - Coalesce commits of transactions
+ *
+ * Every transaction costs an fsync() when committed, which limits how
+ * many things (eg. HTLC state changes) we can do per second.  Once this
+ * is called, db_commit_transaction() leaves the sqlite transaction open,
+ * and following transactions join it until it's committed for real @delay
+ * later.  Calling it with @timers NULL turns this off again, committing
+ * anything pending.
+ *
+ * Until that happens, db_commit_pending() is true: nothing which depends on
+ * the state should leave our process!
+ */
+void db_group_commit(struct db *db, struct timers *timers,
+		     struct timerel delay);
+
+/**
+ * db_commit_pending - Are there committed transactions not yet on disk?
+ *
+ * When this becomes false, we io_wake(db).
+ */
+bool db_commit_pending(const struct db *db);
+
+/**
+ * db_commit_immediately - Don't group the commit of this transaction
+ *
+ * For things we can't hold back until the commit, such as broadcasting a
+ * transaction: the current transaction (and any pending before it) is
+ * committed as soon as db_commit_transaction() is called.
+ */
+void db_commit_immediately(struct db *db);
+
+/**
+ * db_set_wal - Use sqlite's write-ahead log
+ *
+ * Commits only append to the log, rather than writing the database
+ * and a rollback journal, and are still synced to disk every time.  The
+ * journal mode persists in the database file.
+ */
+void db_set_wal(struct db *db);
+
 /**
  * db_set_intvar - Set an integer variable in the database
  *
@@ -83,6 +143,9 @@ s64 db_get_intvar(struct db *db, char *varname, s64 defval);
  * statement, `NULL` otherwise. On failure `db->err` will be set with
  * the human readable error.
  *
+ * The statement is kept around for next time this location prepares the
+ * same query: db_stmt_done() only resets it.
+ *
  * @db: Database to query/exec
  * @query: The SQL statement to compile
  */
@@ -115,9 +178,13 @@ bool db_exec_prepared_mayfail_(const char *caller,
 			       struct db *db,
 			       sqlite3_stmt *stmt);
 
-/* Wrapper around sqlite3_finalize(), for tracking statements. */
+/* Wrapper around sqlite3_finalize(), for tracking statements (if it came
+ * from the cache, it's reset and returned there instead). */
 void db_stmt_done(sqlite3_stmt *stmt);
 
+/* How many statements are in the cache. */
+size_t db_stmt_cache_count(const struct db *db);
+
 /* Call when you know there should be no outstanding db statements. */
 void db_assert_no_outstanding_statements(void);
 
@@ -469,8 +469,11 @@ bool invoices_iterate(struct invoices *invoices,
 	sqlite3_stmt *stmt;
 	int res;
 	if (!it->p) {
+		/* id goes last, so wallet_stmt2invoice_details() works. */
 		stmt = db_prepare(invoices->db, "SELECT " INVOICE_TBL_FIELDS
-						" FROM invoices;");
+						", id FROM invoices"
+						" WHERE id > ? ORDER BY id;");
+		sqlite3_bind_int64(stmt, 1, it->last_id);
 		it->p = stmt;
 	} else
 		stmt = it->p;
@@ -482,9 +485,19 @@ bool invoices_iterate(struct invoices *invoices,
 		return false;
 	} else {
 		assert(res == SQLITE_ROW);
+		it->last_id = sqlite3_column_int64(stmt, 11);
 		return true;
 	}
 }
+
+void invoices_iterator_pause(struct invoices *invoices UNUSED,
+			     struct invoice_iterator *it)
+{
+	if (it->p) {
+		db_stmt_done(it->p);
+		it->p = NULL;
+	}
+}
 const struct invoice_details *
 invoices_iterator_deref(const tal_t *ctx, struct invoices *invoices UNUSED,
 			const struct invoice_iterator *it)
@@ -154,6 +154,18 @@ void invoices_autoclean_set(struct invoices *invoices,
 bool invoices_iterate(struct invoices *invoices,
 		      struct invoice_iterator *it);
 
+/**
+ * invoices_iterator_pause - Release the iterator's db resources
+ *
+ * @invoices - the invoice handler.
+ * @iterator - the iterator object to use.
+ *
+ * The next invoices_iterate() resumes after the current invoice, even
+ * in a later db transaction.
+ */
+void invoices_iterator_pause(struct invoices *invoices,
+			     struct invoice_iterator *it);
+
 /**
  * wallet_invoice_iterator_deref - Read the details of the
  * invoice currently pointed to by the given iterator.
@@ -0,0 +1,136 @@
+#include "../txfilter.c"
+#include <bitcoin/block.h>
+#include <bitcoin/pullpush.h>
+#include <ccan/opt/opt.h>
+#include <ccan/str/hex/hex.h>
+#include <ccan/time/time.h>
+#include <common/pseudorand.h>
+#include <stdio.h>
+
+/* AUTOGENERATED MOCKS START */
+/* AUTOGENERATED MOCKS END */
+
+static void random_derkey(u8 derkey[PUBKEY_DER_LEN])
+{
+	/* Scripts only hash it, so it needn't be a valid point. */
+	derkey[0] = 2;
+	for (size_t i = 1; i < PUBKEY_DER_LEN; i++)
+		derkey[i] = pseudorand(256);
+}
+
+static u8 *random_script(const tal_t *ctx)
+{
+	u8 derkey[PUBKEY_DER_LEN];
+	u8 *script;
+
+	random_derkey(derkey);
+	script = scriptpubkey_p2wpkh_derkey(ctx, derkey);
+	switch (pseudorand(3)) {
+	case 0:
+		return script;
+	case 1:
+		return scriptpubkey_p2sh(ctx, script);
+	default:
+		return scriptpubkey_p2wsh(ctx, script);
+	}
+}
+
+/* Roughly mainnet-shaped: 2 inputs and 3 outputs per tx. */
+static char *make_block(const tal_t *ctx, size_t num_txs,
+			u8 **ours, size_t every)
+{
+	struct bitcoin_block_hdr hdr;
+	u8 *raw = tal_arr(tmpctx, u8, 0);
+
+	memset(&hdr, 0, sizeof(hdr));
+	push(&hdr, sizeof(hdr), &raw);
+	push_varint(num_txs, push, &raw);
+	for (size_t i = 0; i < num_txs; i++) {
+		struct bitcoin_tx *tx = bitcoin_tx(tmpctx, 2, 3);
+		u8 *lin;
+
+		for (size_t j = 0; j < tal_count(tx->input); j++) {
+			for (size_t k = 0; k < sizeof(tx->input[j].txid); k++)
+				tx->input[j].txid.shad.sha.u.u8[k]
+					= pseudorand(256);
+		}
+		for (size_t j = 0; j < tal_count(tx->output); j++) {
+			tx->output[j].amount = pseudorand(100000000);
+			tx->output[j].script = random_script(tx);
+		}
+		/* Every so often, one pays us. */
+		if (i % every == 0)
+			tx->output[0].script = ours[pseudorand(tal_count(ours))];
+		lin = linearize_tx(tmpctx, tx);
+		push(lin, tal_count(lin), &raw);
+		tal_free(tx);
+	}
+	return tal_hex(ctx, raw);
+}
+
+int main(int argc, char *argv[])
+{
+	setup_locale();
+
+	struct txfilter *filter;
+	struct bitcoin_block *b;
+	/* Small by default for make check: try 100000 2500. */
+	size_t num_keys = 1000, num_txs = 250, every = 100;
+	size_t matches = 0;
+	struct timemono start, end;
+	u8 **ours;
+	char *hex;
+
+	setup_tmpctx();
+	opt_parse(&argc, argv, opt_log_stderr_exit);
+	if (argc > 1)
+		num_keys = atoi(argv[1]);
+	if (argc > 2)
+		num_txs = atoi(argv[2]);
+	if (argc > 3)
+		opt_usage_and_exit("[num_keys [num_txs]]");
+
+	filter = txfilter_new(tmpctx);
+	ours = tal_arr(tmpctx, u8 *, num_keys);
+	for (size_t i = 0; i < num_keys; i++) {
+		u8 derkey[PUBKEY_DER_LEN];
+
+		random_derkey(derkey);
+		txfilter_add_derkey(filter, derkey);
+		ours[i] = scriptpubkey_p2wpkh_derkey(ours, derkey);
+	}
+
+	hex = make_block(tmpctx, num_txs, ours, every);
+	b = bitcoin_block_from_hex(tmpctx, hex, strlen(hex));
+	assert(b);
+
+	/* This is what filter_block_txs() does for each tx. */
+	start = time_mono();
+	for (size_t i = 0; i < tal_count(b->tx); i++) {
+		const u8 *cursor = b->tx[i].outputs;
+
+		for (size_t j = 0; j < b->tx[i].num_outputs; j++) {
+			const u8 *script;
+			size_t script_len;
+			u64 amount;
+
+			bitcoin_block_tx_output(&cursor, &amount,
+						&script, &script_len);
+			if (txfilter_match_scriptpubkey(filter, script,
+							script_len))
+				matches++;
+		}
+	}
+	end = time_mono();
+
+	assert(matches == (num_txs + every - 1) / every);
+	printf("Filtered %zu txs (%zu outputs) against %zu keys in %"PRIu64" usec (%"PRIu64" nanoseconds per output)\n",
+	       num_txs, num_txs * 3, num_keys,
+	       time_to_usec(timemono_between(end, start)),
+	       time_to_nsec(time_divide(timemono_between(end, start),
+					num_txs * 3)));
+
+	tal_free(tmpctx);
+	opt_free_table();
+	return 0;
+}
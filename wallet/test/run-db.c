@@ -114,15 +114,179 @@ static bool test_vars(void)
 	return true;
 }
 
+/* Always the same location */
+static sqlite3_stmt *prepare(struct db *db, const char *query)
+{
+	return db_prepare(db, query);
+}
+
+static bool test_stmt_cache(void)
+{
+	struct db *db = create_test_db();
+	sqlite3_stmt *stmt, *stmt2;
+	const char *query = "SELECT ?;";
+
+	db_begin_transaction(db);
+	stmt = prepare(db, query);
+	CHECK(db->stmt_cache_misses == 1);
+	CHECK(db_stmt_cache_count(db) == 1);
+	sqlite3_bind_int(stmt, 1, 7);
+	CHECK(sqlite3_step(stmt) == SQLITE_ROW);
+	CHECK(sqlite3_column_int(stmt, 0) == 7);
+	db_stmt_done(stmt);
+
+	/* Second time, it's reset and reused, with bindings cleared. */
+	stmt2 = prepare(db, query);
+	CHECK(stmt2 == stmt);
+	CHECK(db->stmt_cache_hits == 1);
+	CHECK(sqlite3_step(stmt) == SQLITE_ROW);
+	CHECK(sqlite3_column_type(stmt, 0) == SQLITE_NULL);
+
+	/* While it's in use, we get a fresh one. */
+	stmt2 = prepare(db, query);
+	CHECK(stmt2 != stmt);
+	CHECK(db->stmt_cache_misses == 2);
+	CHECK(db_stmt_cache_count(db) == 1);
+	db_stmt_done(stmt2);
+	db_stmt_done(stmt);
+	stmt2 = prepare(db, query);
+	CHECK(stmt2 == stmt);
+	db_stmt_done(stmt2);
+
+	/* Different query from the same location replaces it. */
+	stmt = prepare(db, "SELECT 2;");
+	CHECK(sqlite3_step(stmt) == SQLITE_ROW);
+	CHECK(sqlite3_column_int(stmt, 0) == 2);
+	db_stmt_done(stmt);
+	stmt2 = prepare(db, "SELECT 2;");
+	CHECK(stmt2 == stmt);
+	CHECK(db->stmt_cache_hits == 3);
+	CHECK(db->stmt_cache_misses == 3);
+	CHECK(db_stmt_cache_count(db) == 1);
+	db_stmt_done(stmt2);
+	db_commit_transaction(db);
+
+	/* Cached statements don't stop us closing. */
+	db_close_for_fork(db);
+	CHECK(db_stmt_cache_count(db) == 0);
+	db_reopen_after_fork(db);
+
+	tal_free(db);
+	return true;
+}
+
+/* What another process would see. */
+static s64 other_intvar(struct db *db, const char *varname)
+{
+	sqlite3 *sql;
+	sqlite3_stmt *stmt;
+	s64 val = -1;
+
+	if (sqlite3_open_v2(db->filename, &sql, SQLITE_OPEN_READONLY, NULL)
+	    != SQLITE_OK)
+		abort();
+	sqlite3_prepare_v2(sql, "SELECT val FROM vars WHERE name=?;", -1,
+			   &stmt, NULL);
+	sqlite3_bind_text(stmt, 1, varname, -1, SQLITE_TRANSIENT);
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+		val = sqlite3_column_int64(stmt, 0);
+	sqlite3_finalize(stmt);
+	sqlite3_close(sql);
+	return val;
+}
+
+static bool test_group_commit(bool wal)
+{
+	struct db *db = create_test_db();
+	char *varname = "testvar";
+	struct timers timers;
+	struct timer *expired;
+
+	CHECK(db);
+	db_migrate(db, NULL);
+	if (wal)
+		db_set_wal(db);
+	timers_init(&timers, time_mono());
+	db_group_commit(db, &timers, time_from_msec(10));
+
+	db_begin_transaction(db);
+	db_set_intvar(db, varname, 1);
+	db_commit_transaction(db);
+	CHECK(db_commit_pending(db));
+	CHECK(other_intvar(db, varname) == -1);
+
+	/* Later transactions join in. */
+	db_begin_transaction(db);
+	CHECK(db_get_intvar(db, varname, 42) == 1);
+	db_set_intvar(db, varname, 2);
+	db_commit_transaction(db);
+	CHECK(db_commit_pending(db));
+	CHECK(other_intvar(db, varname) == -1);
+
+	/* Until the timer goes off. */
+	expired = timers_expire(&timers,
+				timemono_add(time_mono(), time_from_msec(20)));
+	CHECK(expired);
+	timer_expired(NULL, expired);
+	CHECK(!db_commit_pending(db));
+	CHECK(other_intvar(db, varname) == 2);
+
+	/* If the timer goes off inside a transaction, it commits at the end. */
+	db_begin_transaction(db);
+	db_set_intvar(db, varname, 3);
+	db_commit_transaction(db);
+	expired = timers_expire(&timers,
+				timemono_add(time_mono(), time_from_msec(20)));
+	CHECK(expired);
+	db_begin_transaction(db);
+	timer_expired(NULL, expired);
+	CHECK(db_commit_pending(db));
+	db_set_intvar(db, varname, 4);
+	db_commit_transaction(db);
+	CHECK(!db_commit_pending(db));
+	CHECK(other_intvar(db, varname) == 4);
+
+	/* Some things can't wait. */
+	db_begin_transaction(db);
+	db_set_intvar(db, varname, 5);
+	db_commit_transaction(db);
+	db_begin_transaction(db);
+	db_set_intvar(db, varname, 6);
+	db_commit_immediately(db);
+	db_commit_transaction(db);
+	CHECK(!db_commit_pending(db));
+	CHECK(other_intvar(db, varname) == 6);
+
+	/* Turning it off commits anything pending. */
+	db_begin_transaction(db);
+	db_set_intvar(db, varname, 7);
+	db_commit_transaction(db);
+	db_group_commit(db, NULL, time_from_msec(0));
+	CHECK(!db_commit_pending(db));
+	CHECK(other_intvar(db, varname) == 7);
+	CHECK(!timers_expire(&timers,
+			     timemono_add(time_mono(), time_from_sec(1))));
+
+	tal_free(db);
+	timers_cleanup(&timers);
+	return true;
+}
+
 int main(void)
 {
 	setup_locale();
+	setup_tmpctx();
 
 	bool ok = true;
 
 	ok &= test_empty_db_migrate();
 	ok &= test_vars();
 	ok &= test_primitives();
+	ok &= test_stmt_cache();
+	ok &= test_group_commit(false);
+	ok &= test_group_commit(true);
+
+	tal_free(tmpctx);
 
 	return !ok;
 }
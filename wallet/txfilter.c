@@ -1,16 +1,49 @@
 #include "txfilter.h"
 
 #include <bitcoin/script.h>
+#include <ccan/array_size/array_size.h>
 #include <ccan/build_assert/build_assert.h>
 #include <ccan/crypto/ripemd160/ripemd160.h>
+#include <ccan/htable/htable_type.h>
 #include <ccan/mem/mem.h>
 #include <common/memleak.h>
 #include <common/pseudorand.h>
 #include <common/utils.h>
 #include <wallet/wallet.h>
 
+/* Scripts we own mostly end in a hash, so their last bytes index a bitmap
+ * well enough to skip the hash table for almost every script which isn't
+ * ours.  A false positive just costs us the lookup. */
+#define TXFILTER_BLOOM_BITS (1 << 20)
+
+struct scriptpubkey {
+	const u8 *script;
+	size_t len;
+};
+
+static const struct scriptpubkey *
+scriptpubkey_keyof(const struct scriptpubkey *spk)
+{
+	return spk;
+}
+
+static size_t scriptpubkey_hash(const struct scriptpubkey *spk)
+{
+	return siphash24(siphash_seed(), spk->script, spk->len);
+}
+
+static bool scriptpubkey_eq(const struct scriptpubkey *a,
+			    const struct scriptpubkey *b)
+{
+	return memeq(a->script, a->len, b->script, b->len);
+}
+
+HTABLE_DEFINE_TYPE(struct scriptpubkey, scriptpubkey_keyof, scriptpubkey_hash,
+		   scriptpubkey_eq, scriptpubkeyset);
+
 struct txfilter {
-	const u8 **scriptpubkeys;
+	struct scriptpubkeyset scriptpubkeys;
+	u64 bloom[TXFILTER_BLOOM_BITS / 64];
 };
 
 struct outpointfilter_entry {
@@ -45,17 +78,53 @@ struct outpointfilter {
 	struct outpointset *set;
 };
 
+/* Two bits from the last 8 bytes (mixed with the length). */
+static void bloom_bits(const u8 *script, size_t len, size_t bits[2])
+{
+	u64 v = len * 0x9E3779B97F4A7C15ULL;
+	size_t n = len < sizeof(u64) ? len : sizeof(u64);
+
+	for (size_t i = 0; i < n; i++)
+		v ^= (u64)script[len - 1 - i] << (i * 8);
+	bits[0] = v % TXFILTER_BLOOM_BITS;
+	bits[1] = (v >> 32) % TXFILTER_BLOOM_BITS;
+}
+
+static void destroy_txfilter(struct txfilter *filter)
+{
+	scriptpubkeyset_clear(&filter->scriptpubkeys);
+}
+
 struct txfilter *txfilter_new(const tal_t *ctx)
 {
 	struct txfilter *filter = tal(ctx, struct txfilter);
-	filter->scriptpubkeys = tal_arr(filter, const u8 *, 0);
+	scriptpubkeyset_init(&filter->scriptpubkeys);
+	memset(filter->bloom, 0, sizeof(filter->bloom));
+	tal_add_destructor(filter, destroy_txfilter);
 	return filter;
 }
 
 void txfilter_add_scriptpubkey(struct txfilter *filter, const u8 *script TAKES)
 {
-	*tal_arr_expand(&filter->scriptpubkeys)
-		= tal_dup_arr(filter, u8, script, tal_count(script), 0);
+	struct scriptpubkey *spk;
+	size_t bits[2];
+
+	if (txfilter_match_scriptpubkey(filter, script, tal_count(script))) {
+		if (taken(script))
+			tal_free(script);
+		return;
+	}
+
+	/* Have to mark the entries as notleak since they'll not be
+	 * pointed to by anything other than the htable */
+	spk = notleak(tal(filter, struct scriptpubkey));
+	spk->len = tal_count(script);
+	spk->script = tal_dup_arr(spk, u8, script, spk->len, 0);
+	scriptpubkeyset_add(&filter->scriptpubkeys, spk);
+
+	bloom_bits(spk->script, spk->len, bits);
+	for (size_t i = 0; i < ARRAY_SIZE(bits); i++)
+		filter->bloom[bits[i] / 64] |= (u64)1 << (bits[i] % 64);
 }
 
 void txfilter_add_derkey(struct txfilter *filter,
@@ -71,15 +140,31 @@ void txfilter_add_derkey(struct txfilter *filter,
 }
 
 
+bool txfilter_match_scriptpubkey(const struct txfilter *filter,
+				 const u8 *script, size_t script_len)
+{
+	struct scriptpubkey spk;
+	size_t bits[2];
+
+	bloom_bits(script, script_len, bits);
+	for (size_t i = 0; i < ARRAY_SIZE(bits); i++) {
+		if (!(filter->bloom[bits[i] / 64] & ((u64)1 << (bits[i] % 64))))
+			return false;
+	}
+
+	spk.script = script;
+	spk.len = script_len;
+	return scriptpubkeyset_get(&filter->scriptpubkeys, &spk) != NULL;
+}
+
 bool txfilter_match(const struct txfilter *filter, const struct bitcoin_tx *tx)
 {
 	for (size_t i = 0; i < tal_count(tx->output); i++) {
 		u8 *oscript = tx->output[i].script;
 
-		for (size_t j = 0; j < tal_count(filter->scriptpubkeys); j++) {
-			if (scripteq(oscript, filter->scriptpubkeys[j]))
-				return true;
-		}
+		if (txfilter_match_scriptpubkey(filter, oscript,
+						tal_count(oscript)))
+			return true;
 	}
 	return false;
 }
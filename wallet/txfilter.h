@@ -34,6 +34,12 @@ void txfilter_add_derkey(struct txfilter *filter,
  */
 bool txfilter_match(const struct txfilter *filter, const struct bitcoin_tx *tx);
 
+/**
+ * txfilter_match_scriptpubkey -- Check whether one output script matches
+ */
+bool txfilter_match_scriptpubkey(const struct txfilter *filter,
+				 const u8 *script, size_t script_len);
+
 /**
  * txfilter_add_scriptpubkey -- Add a serialized scriptpubkey to the filter
  */
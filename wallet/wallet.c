@@ -750,43 +750,45 @@ bool wallet_channels_load_active(const tal_t *ctx, struct wallet *w)
 	return ok;
 }
 
-static
-void wallet_channel_stats_incr_x(struct wallet *w,
-				 char const *dir,
-				 char const *typ,
-				 u64 cdbid,
-				 u64 msatoshi)
-{
-	char const *payments_stat = tal_fmt(tmpctx, "%s_payments_%s",
-					    dir, typ);
-	char const *msatoshi_stat = tal_fmt(tmpctx, "%s_msatoshi_%s",
-					    dir, typ);
-	char const *qry = tal_fmt(tmpctx,
-				  "UPDATE channels"
-				  "   SET %s = COALESCE(%s, 0) + 1"
-				  "     , %s = COALESCE(%s, 0) + %"PRIu64""
-				  " WHERE id = %"PRIu64";",
-				  payments_stat, payments_stat,
-				  msatoshi_stat, msatoshi_stat, msatoshi,
-				  cdbid);
-	sqlite3_stmt *stmt = db_prepare(w->db, qry);
+/* A literal per counter, so each gets its own cached statement. */
+#define CHANNEL_STATS_INCR(dir, typ)					\
+	"UPDATE channels"						\
+	"   SET " dir "_payments_" typ " = COALESCE(" dir "_payments_" typ ", 0) + 1" \
+	"     , " dir "_msatoshi_" typ " = COALESCE(" dir "_msatoshi_" typ ", 0) + ?" \
+	" WHERE id = ?;"
+
+static void wallet_channel_stats_incr_x(struct wallet *w,
+					sqlite3_stmt *stmt,
+					u64 cdbid,
+					u64 msatoshi)
+{
+	sqlite3_bind_int64(stmt, 1, msatoshi);
+	sqlite3_bind_int64(stmt, 2, cdbid);
 	db_exec_prepared(w->db, stmt);
 }
 void wallet_channel_stats_incr_in_offered(struct wallet *w, u64 id, u64 m)
 {
-	wallet_channel_stats_incr_x(w, "in", "offered", id, m);
+	wallet_channel_stats_incr_x(w, db_prepare(w->db,
+						  CHANNEL_STATS_INCR("in", "offered")),
+				    id, m);
 }
 void wallet_channel_stats_incr_in_fulfilled(struct wallet *w, u64 id, u64 m)
 {
-	wallet_channel_stats_incr_x(w, "in", "fulfilled", id, m);
+	wallet_channel_stats_incr_x(w, db_prepare(w->db,
+						  CHANNEL_STATS_INCR("in", "fulfilled")),
+				    id, m);
 }
 void wallet_channel_stats_incr_out_offered(struct wallet *w, u64 id, u64 m)
 {
-	wallet_channel_stats_incr_x(w, "out", "offered", id, m);
+	wallet_channel_stats_incr_x(w, db_prepare(w->db,
+						  CHANNEL_STATS_INCR("out", "offered")),
+				    id, m);
 }
 void wallet_channel_stats_incr_out_fulfilled(struct wallet *w, u64 id, u64 m)
 {
-	wallet_channel_stats_incr_x(w, "out", "fulfilled", id, m);
+	wallet_channel_stats_incr_x(w, db_prepare(w->db,
+						  CHANNEL_STATS_INCR("out", "fulfilled")),
+				    id, m);
 }
 
 void wallet_channel_stats_load(struct wallet *w,
@@ -1317,6 +1319,7 @@ static bool wallet_stmt2htlc_in(struct channel *channel,
 	memcpy(&in->shared_secret, sqlite3_column_blob(stmt, 11),
 	       sizeof(struct secret));
 
+	list_node_init(&in->deadline_list);
 	return ok;
 }
 
@@ -1357,6 +1360,7 @@ static bool wallet_stmt2htlc_out(struct channel *channel,
 	/* Need to defer wiring until we can look up all incoming
 	 * htlcs, will wire using origin_htlc_id */
 	out->in = NULL;
+	list_node_init(&out->deadline_list);
 
 	return ok;
 }
@@ -1501,6 +1505,11 @@ bool wallet_invoice_iterate(struct wallet *wallet,
 {
 	return invoices_iterate(wallet->invoices, it);
 }
+void wallet_invoice_iterator_pause(struct wallet *wallet,
+				   struct invoice_iterator *it)
+{
+	invoices_iterator_pause(wallet->invoices, it);
+}
 const struct invoice_details *
 wallet_invoice_iterator_deref(const tal_t *ctx, struct wallet *wallet,
 			      const struct invoice_iterator *it)
@@ -1937,37 +1946,52 @@ void wallet_payment_set_failinfo(struct wallet *wallet,
 const struct wallet_payment **
 wallet_payment_list(const tal_t *ctx,
 		    struct wallet *wallet,
-		    const struct sha256 *payment_hash)
+		    const struct sha256 *payment_hash,
+		    u64 *after_id, size_t max)
 {
 	const struct wallet_payment **payments;
 	sqlite3_stmt *stmt;
-	struct wallet_payment *p;
 	size_t i;
+	int col = 1;
 
 	payments = tal_arr(ctx, const struct wallet_payment *, 0);
 	if (payment_hash) {
 		stmt = db_prepare(wallet->db,
 				  "SELECT " PAYMENT_FIELDS " FROM payments "
-				  "WHERE payment_hash = ?;");
-		sqlite3_bind_sha256(stmt, 1, payment_hash);
+				  "WHERE payment_hash = ? AND id > ?"
+				  " ORDER BY id LIMIT ?;");
+		sqlite3_bind_sha256(stmt, col++, payment_hash);
 	} else {
 		stmt = db_prepare(wallet->db,
-				  "SELECT " PAYMENT_FIELDS " FROM payments;");
+				  "SELECT " PAYMENT_FIELDS " FROM payments "
+				  "WHERE id > ? ORDER BY id LIMIT ?;");
 	}
+	sqlite3_bind_int64(stmt, col++, *after_id);
+	sqlite3_bind_int64(stmt, col++, max);
 
 	for (i = 0; sqlite3_step(stmt) == SQLITE_ROW; i++) {
 		tal_resize(&payments, i+1);
 		payments[i] = wallet_stmt2payment(payments, stmt);
+		*after_id = payments[i]->id;
 	}
 
 	db_stmt_done(stmt);
+	return payments;
+}
 
-	/* Now attach payments not yet in db. */
+const struct wallet_payment **
+wallet_payment_list_unstored(const tal_t *ctx,
+			     struct wallet *wallet,
+			     const struct sha256 *payment_hash)
+{
+	const struct wallet_payment **payments;
+	struct wallet_payment *p;
+
+	payments = tal_arr(ctx, const struct wallet_payment *, 0);
 	list_for_each(&wallet->unstored_payments, p, list) {
 		if (payment_hash && !sha256_eq(&p->payment_hash, payment_hash))
 			continue;
-		tal_resize(&payments, i+1);
-		payments[i++] = p;
+		*tal_arr_expand(&payments) = p;
 	}
 
 	return payments;
@@ -2145,14 +2169,12 @@ wallet_outpoint_spend(struct wallet *w, const tal_t *ctx, const u32 blockheight,
 	return NULL;
 }
 
-void wallet_utxoset_add(struct wallet *w, const struct bitcoin_tx *tx,
+void wallet_utxoset_add(struct wallet *w, const struct bitcoin_txid *txid,
 			const u32 outnum, const u32 blockheight,
 			const u32 txindex, const u8 *scriptpubkey,
 			const u64 satoshis)
 {
 	sqlite3_stmt *stmt;
-	struct bitcoin_txid txid;
-	bitcoin_txid(tx, &txid);
 
 	stmt = db_prepare(w->db, "INSERT INTO utxoset ("
 			  " txid,"
@@ -2163,7 +2185,7 @@ void wallet_utxoset_add(struct wallet *w, const struct bitcoin_tx *tx,
 			  " scriptpubkey,"
 			  " satoshis"
 			  ") VALUES(?, ?, ?, ?, ?, ?, ?);");
-	sqlite3_bind_sha256_double(stmt, 1, &txid.shad);
+	sqlite3_bind_sha256_double(stmt, 1, &txid->shad);
 	sqlite3_bind_int(stmt, 2, outnum);
 	sqlite3_bind_int(stmt, 3, blockheight);
 	sqlite3_bind_null(stmt, 4);
@@ -2172,7 +2194,7 @@ void wallet_utxoset_add(struct wallet *w, const struct bitcoin_tx *tx,
 	sqlite3_bind_int64(stmt, 7, satoshis);
 	db_exec_prepared(w->db, stmt);
 
-	outpointfilter_add(w->utxoset_outpoints, &txid, outnum);
+	outpointfilter_add(w->utxoset_outpoints, txid, outnum);
 }
 
 struct outpoint *wallet_outpoint_for_scid(struct wallet *w, tal_t *ctx,
@@ -2448,7 +2470,9 @@ u64 wallet_total_forward_fees(struct wallet *w)
 }
 
 const struct forwarding *wallet_forwarded_payments_get(struct wallet *w,
-						       const tal_t *ctx)
+						       const tal_t *ctx,
+						       u64 *after_id,
+						       size_t max)
 {
 	struct forwarding *results = tal_arr(ctx, struct forwarding, 0);
 	size_t count = 0;
@@ -2460,9 +2484,13 @@ const struct forwarding *wallet_forwarded_payments_get(struct wallet *w,
 			  ", out_msatoshi"
 			  ", hin.payment_hash as payment_hash"
 			  ", in_channel_scid"
-			  ", out_channel_scid "
+			  ", out_channel_scid"
+			  ", f.rowid "
 			  "FROM forwarded_payments f "
-			  "LEFT JOIN channel_htlcs hin ON (f.in_htlc_id == hin.id)");
+			  "LEFT JOIN channel_htlcs hin ON (f.in_htlc_id == hin.id) "
+			  "WHERE f.rowid > ? ORDER BY f.rowid LIMIT ?");
+	sqlite3_bind_int64(stmt, 1, *after_id);
+	sqlite3_bind_int64(stmt, 2, max);
 
 	for (count=0; sqlite3_step(stmt) == SQLITE_ROW; count++) {
 		tal_resize(&results, count+1);
@@ -2473,7 +2501,7 @@ const struct forwarding *wallet_forwarded_payments_get(struct wallet *w,
 		cur->fee = cur->msatoshi_in - cur->msatoshi_out;
 
 		if (sqlite3_column_type(stmt, 3) != SQLITE_NULL) {
-			cur->payment_hash = tal(ctx, struct sha256_double);
+			cur->payment_hash = tal(results, struct sha256_double);
 			sqlite3_column_sha256_double(stmt, 3, cur->payment_hash);
 		} else {
 			cur->payment_hash = NULL;
@@ -2481,6 +2509,7 @@ const struct forwarding *wallet_forwarded_payments_get(struct wallet *w,
 
 		cur->channel_in.u64 = sqlite3_column_int64(stmt, 4);
 		cur->channel_out.u64 = sqlite3_column_int64(stmt, 5);
+		*after_id = sqlite3_column_int64(stmt, 6);
 	}
 
 	db_stmt_done(stmt);
@@ -596,6 +596,7 @@ struct invoice_iterator {
 	/* The contents of this object is subject to change
 	 * and should not be depended upon */
 	void *p;
+	u64 last_id;
 };
 
 struct invoice {
@@ -725,6 +726,19 @@ void wallet_invoice_autoclean(struct wallet * wallet,
 bool wallet_invoice_iterate(struct wallet *wallet,
 			    struct invoice_iterator *it);
 
+/**
+ * wallet_invoice_iterator_pause - Stop iterating for now
+ *
+ * @wallet - the wallet whose invoices are being iterated over.
+ * @iterator - the iterator object to use.
+ *
+ * This releases the underlying db statement, so you can return to the
+ * event loop (eg. to stream the output): the next wallet_invoice_iterate
+ * continues where this left off.
+ */
+void wallet_invoice_iterator_pause(struct wallet *wallet,
+				   struct invoice_iterator *it);
+
 /**
  * wallet_invoice_iterator_deref - Read the details of the
  * invoice currently pointed to by the given iterator.
@@ -913,13 +927,26 @@ void wallet_payment_set_failinfo(struct wallet *wallet,
 				 const char *faildetail);
 
 /**
- * wallet_payment_list - Retrieve a list of payments
+ * wallet_payment_list - Retrieve a list of payments from the db
  *
  * payment_hash: optional filter for only this payment hash.
+ * after_id: only payments after this (start at 0), updated to the last one.
+ * max: the maximum number of payments to return.
  */
 const struct wallet_payment **wallet_payment_list(const tal_t *ctx,
 						  struct wallet *wallet,
-						  const struct sha256 *payment_hash);
+						  const struct sha256 *payment_hash,
+						  u64 *after_id, size_t max);
+
+/**
+ * wallet_payment_list_unstored - Retrieve payments not yet in the db
+ *
+ * payment_hash: optional filter for only this payment hash.
+ */
+const struct wallet_payment **
+wallet_payment_list_unstored(const tal_t *ctx,
+			     struct wallet *wallet,
+			     const struct sha256 *payment_hash);
 
 /**
  * wallet_htlc_sigs_save - Store the latest HTLC sigs for the channel
@@ -968,7 +995,7 @@ wallet_outpoint_spend(struct wallet *w, const tal_t *ctx, const u32 blockheight,
 struct outpoint *wallet_outpoint_for_scid(struct wallet *w, tal_t *ctx,
 					  const struct short_channel_id *scid);
 
-void wallet_utxoset_add(struct wallet *w, const struct bitcoin_tx *tx,
+void wallet_utxoset_add(struct wallet *w, const struct bitcoin_txid *txid,
 			const u32 outnum, const u32 blockheight,
 			const u32 txindex, const u8 *scriptpubkey,
 			const u64 satoshis);
@@ -1028,8 +1055,11 @@ void wallet_forwarded_payment_add(struct wallet *w, const struct htlc_in *in,
 u64 wallet_total_forward_fees(struct wallet *w);
 
 /**
- * Retrieve a list of all forwarded_payments
+ * Retrieve a list of up to @max forwarded_payments after @after_id
+ * (start at 0): @after_id is updated to the last one returned.
  */
 const struct forwarding *wallet_forwarded_payments_get(struct wallet *w,
-						       const tal_t *ctx);
+						       const tal_t *ctx,
+						       u64 *after_id,
+						       size_t max);
 #endif /* LIGHTNING_WALLET_WALLET_H */
@@ -538,3 +538,33 @@ static const struct json_command dev_rescan_output_command = {
 	"For each output stored in the internal wallet ask `bitcoind` whether we are in sync with its state (spent vs. unspent)"
 };
 AUTODATA(json_command, &dev_rescan_output_command);
+
+static void json_dev_dbstats(struct command *cmd,
+			     const char *buffer,
+			     const jsmntok_t *params)
+{
+	struct json_stream *response;
+	struct db *db = cmd->ld->wallet->db;
+
+	if (!param(cmd, buffer, params, NULL))
+		return;
+
+	response = json_stream_success(cmd);
+	json_object_start(response, NULL);
+	json_object_start(response, "statement_cache");
+	json_add_u64(response, "statements", db_stmt_cache_count(db));
+	json_add_u64(response, "hits", db->stmt_cache_hits);
+	json_add_u64(response, "misses", db->stmt_cache_misses);
+	json_object_end(response);
+	json_object_end(response);
+	command_success(cmd, response);
+}
+
+static const struct json_command dev_dbstats_command = {
+	"dev-dbstats",
+	json_dev_dbstats,
+	"Show database statistics",
+	false,
+	"Shows how many prepared statements are cached, and how often the cache was hit or missed."
+};
+AUTODATA(json_command, &dev_dbstats_command);